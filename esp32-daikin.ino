@@ -5,159 +5,572 @@
 #include "soc/rtc_cntl_reg.h"
 #include "soc/soc.h"
 #endif
+#include "src/daikin/analytics.h"
 #include "src/daikin/daikin_state.h"
+#include "src/daikin/s21_codec.h"
+#include "src/daikin/s21_commands.h"
 #include "src/daikin/s21_driver.h"
+#include "src/daikin/s21_line.h"
+#include "src/daikin/s21_supervisor.h"
+#include "src/net/fleet.h"
+#include "src/net/mqtt_bridge.h"
+#include "src/net/wifi_manager.h"
+#include "src/system/clock.h"
+#include "src/system/commands.h"
 #include "src/system/config.h"
+#include "src/system/console.h"
+#include "src/system/heap_tracker.h"
+#include "src/system/idle.h"
 #include "src/system/logger.h"
+#include "src/system/scheduler.h"
+#include "src/system/trace.h"
+#include "src/web/api.h"
+#include "src/web/diagnostics.h"
+#include "src/web/http_server.h"
+#include "src/web/ota.h"
+#include "src/web/payload_writer.h"
+#include "src/web/rate_limiter.h"
 #include "src/web/web_ui.h"
-#include <HTTPUpdate.h>
 #include <Preferences.h>
-#include <Update.h>
-#include <WebServer.h>
 #include <WiFi.h>
-#include <WiFiClientSecure.h>
 
 Preferences preferences;
-String splitName = "NomeSplit";
-
-WebServer server(API_PORT);
-
-void handleRoot() { server.send(200, "text/html", WEB_UI_HTML); }
-
-void handleStatus() {
-  // Poll fresh data from AC
-  S21.pollNow();
-
-  String json = "{";
-  json += "\"power\":" + String(State.power ? "true" : "false") + ",";
-  json += "\"mode\":" + String(State.mode) + ",";
-  json += "\"target_temp\":" + String(State.targetTemp) + ",";
-  json += "\"room_temp\":" + String(State.roomTemp) + ",";
-  json += "\"outside_temp\":" + String(State.outsideTemp) + ",";
-  json += "\"fan\":" + String(State.fan) + ",";
-  json += "\"swing_v\":" + String(State.swingV ? "true" : "false") + ",";
-  json += "\"swing_h\":" + String(State.swingH ? "true" : "false") + ",";
-  json += "\"connected\":" + String(S21.isConnected() ? "true" : "false") + ",";
-  json += "\"split_name\":\"" + splitName + "\",";
-  json += "\"fw_version\":\"" + String(FW_VERSION) + "\"";
-  json += "}";
-  server.send(200, "application/json", json);
+
+// /status refreshes from the unit unless the data is fresher than this
+#define STATUS_MAX_AGE_MS 1000
+// How long /status waits for the refresh before answering with cached data
+#define STATUS_POLL_WAIT_MS 3000
+// ?wait=1 on /set, /set-swing and /commands answers within this, done or
+// not (below HTTP_HANDLER_TIMEOUT_MS)
+#define COMMAND_WAIT_MS 4000
+// Longest split name (the fleet name field holds 31)
+#define SPLIT_NAME_MAX 31
+
+char splitName[SPLIT_NAME_MAX + 1] = "NomeSplit";
+
+HttpServer server(API_PORT);
+
+// The status map. Runs on every poll, so it must not touch the heap.
+void writeStatus(PayloadWriter &w, bool stale) {
+  HEAP_SCOPE_NO_ALLOC("status");
+  w.beginMap(18);
+  w.key("power");
+  w.addBool(State.power);
+  w.key("mode");
+  w.addUInt(State.mode);
+  w.key("target_temp");
+  w.addFloat(State.targetTemp);
+  w.key("room_temp");
+  w.addFloat(State.roomTemp);
+  w.key("outside_temp");
+  w.addFloat(State.outsideTemp);
+  w.key("fan");
+  w.addUInt(State.fan);
+  w.key("swing_v");
+  w.addBool(State.swingV);
+  w.key("swing_h");
+  w.addBool(State.swingH);
+  w.key("powerful");
+  w.addBool(State.powerful);
+  w.key("econo");
+  w.addBool(State.econo);
+  w.key("coil_temp");
+  w.addFloat(State.coilTemp);
+  w.key("fan_rpm");
+  w.addUInt(State.fanRpm);
+  w.key("compressor_freq");
+  w.addUInt(State.compressorFreq);
+  w.key("energy_kwh");
+  w.addFloat(State.energyKWh);
+  w.key("connected");
+  w.addBool(S21.isConnected());
+  w.key("stale");
+  w.addBool(stale);
+  w.key("split_name");
+  w.addString(splitName);
+  w.key("fw_version");
+  w.addString(FW_VERSION);
+  w.end();
 }
 
-void handleSetConfig() {
-  if (server.hasArg("name")) {
-    String newName = server.arg("name");
-    newName.trim();
-    if (newName.length() > 0) {
-      splitName = newName;
-      preferences.begin("daikin", false);
-      preferences.putString("split_name", splitName);
-      preferences.end();
-      server.send(200, "application/json",
-                  "{\"status\":\"ok\", \"name\":\"" + splitName + "\"}");
-      LOG("Config: Split Name set to %s", splitName.c_str());
-    } else {
-      server.send(400, "text/plain", "Invalid name");
-    }
+void handleStatus(HttpRequest &req) {
+  // Poll fresh data from AC. The handler is called again on every loop until
+  // it answers, so the bus and other clients keep running meanwhile.
+  // Polls for HTTP reads share one bus budget; past it the last poll is
+  // served, marked stale, so commands still get bus time.
+  if (req.isFirstCall() && S21.pollAge() > STATUS_MAX_AGE_MS &&
+      Limiter.takeBusPoll())
+    S21.requestPoll();
+  if (S21.isPolling() && req.age() < STATUS_POLL_WAIT_MS)
+    return;
+  bool stale = S21.pollAge() > STATUS_MAX_AGE_MS;
+
+  // JSON by default, CBOR/MessagePack for machine clients (Accept header or
+  // ?format=), encoded straight from State into a stack buffer
+  PayloadFormat format = responseFormat(req);
+
+  uint8_t buf[640];
+  PayloadWriter w(format, buf, sizeof(buf));
+  writeStatus(w, stale);
+
+  if (w.overflow()) {
+    req.send(500, "text/plain", "Status too large");
+    return;
+  }
+  if (stale)
+    req.addHeader("Warning", "110 - \"Response is Stale\"");
+  req.send(200, formatContentType(format), w.data(), w.length());
+}
+
+#if ANALYTICS_ENABLED
+static void writeStats(PayloadWriter &w, const RunningStats &s) {
+  w.beginMap(5);
+  w.key("count");
+  w.addUInt(s.count);
+  w.key("mean");
+  w.addFloat(s.mean);
+  w.key("stddev");
+  w.addFloat(s.stddev());
+  w.key("min");
+  w.addFloat(s.min);
+  w.key("max");
+  w.addFloat(s.max);
+  w.end();
+}
+
+// Runtime, compressor cycling, time per mode and energy since the totals
+// were last reset (kept across reboots)
+void handleAnalytics(HttpRequest &req) {
+  PayloadFormat format = responseFormat(req);
+  const AnalyticsTotals &t = Analytics.getTotals();
+  float observedH = t.observedMs / 3600000.0f;
+
+  uint8_t buf[1024];
+  PayloadWriter w(format, buf, sizeof(buf));
+  w.beginMap(17);
+  w.key("observed_h");
+  w.addFloat(observedH);
+  w.key("on_h");
+  w.addFloat(t.onMs / 3600000.0f);
+  w.key("compressor_h");
+  w.addFloat(t.compressorMs / 3600000.0f);
+  w.key("duty_cycle");
+  w.addFloat(t.observedMs ? 100.0f * t.compressorMs / t.observedMs : 0);
+  w.key("power_ons");
+  w.addUInt(t.powerOns);
+  w.key("compressor_starts");
+  w.addUInt(t.compressorStarts);
+  w.key("starts_last_hour");
+  w.addUInt(Analytics.startsLastHour());
+  w.key("starts_per_hour");
+  w.addFloat(observedH > 0 ? t.compressorStarts / observedH : 0);
+  w.key("mode_h");
+  w.beginMap(ANALYTICS_MODE_COUNT);
+  for (int m = 0; m < ANALYTICS_MODE_COUNT; m++) {
+    w.key(analyticsModeName((AnalyticsMode)m));
+    w.addFloat(t.modeMs[m] / 3600000.0f);
+  }
+  w.end();
+  w.key("estimated_kwh");
+  w.addFloat(t.estimatedJ / 3600000.0f);
+  w.key("metered_kwh");
+  w.addFloat(t.meteredKWh);
+  w.key("room_temp");
+  writeStats(w, t.roomTemp);
+  w.key("outside_temp");
+  writeStats(w, t.outsideTemp);
+  w.key("compressor_hz");
+  writeStats(w, t.compressorHz);
+  w.key("cycle_min");
+  writeStats(w, t.cycleMinutes);
+  w.key("checkpoints");
+  w.addUInt(Analytics.checkpointCount());
+  w.key("checkpoint_age_s");
+  w.addUInt(Analytics.lastCheckpointAge() / 1000);
+  w.end();
+
+  if (w.overflow()) {
+    req.send(500, "text/plain", "Analytics too large");
+    return;
+  }
+  req.send(200, formatContentType(format), w.data(), w.length());
+}
+#endif // ANALYTICS_ENABLED
+
+static void writeCommand(PayloadWriter &w, const S21Command &c) {
+  bool swing = c.kind == S21_CMD_SWING;
+  w.beginMap(swing ? 10 : 12);
+  w.key("id");
+  w.addUInt(c.id);
+  w.key("kind");
+  w.addString(s21CommandKindName(c.kind));
+  w.key("status");
+  w.addString(s21CommandStatusName(c.status));
+  w.key("attempts");
+  w.addUInt(c.attempts);
+  w.key("naks");
+  w.addUInt(c.naks);
+  w.key("readbacks");
+  w.addUInt(c.readbacks);
+  w.key("ack_ms");
+  w.addUInt(c.ackMs);
+  w.key("done_ms");
+  w.addUInt(c.doneMs);
+  if (swing) {
+    w.key("swing_v");
+    w.addBool(c.swingV);
+    w.key("swing_h");
+    w.addBool(c.swingH);
   } else {
-    server.send(400, "text/plain", "Missing 'name' parameter");
+    w.key("power");
+    w.addBool(c.power);
+    w.key("mode");
+    w.addUInt(c.mode);
+    w.key("temp");
+    w.addFloat(c.temp);
+    w.key("fan");
+    w.addUInt(c.fan);
   }
+  w.end();
 }
 
-void handleSet() {
-  if (server.hasArg("temp")) {
-    float temp = server.arg("temp").toFloat();
-    // Default values if not provided
-    uint8_t mode = State.mode > 0 ? State.mode : 3; // Default Cool
-    uint8_t fan = State.fan > 0 ? State.fan : 5;    // Default 5
-    bool power = true;
-
-    if (server.hasArg("mode"))
-      mode = server.arg("mode").toInt();
-    if (server.hasArg("fan"))
-      fan = server.arg("fan").toInt();
-    if (server.hasArg("power")) {
-      String p = server.arg("power");
-      power = (p == "1" || p == "true" || p == "on");
+// Run a console command for an HTTP request: same semantics as the CLI.
+// Control commands answer {"status":"ok","command":{...}} once queued, or
+// with ?wait=1 once the unit confirmed them (502 if it didn't, 504 if
+// still pending after COMMAND_WAIT_MS).
+void runHttpCommand(HttpRequest &req, const char *name) {
+  if (req.isFirstCall()) {
+    RequestArgs args(req);
+    NullPrint out;
+    const char *error = findCommand(name)->run(args, out);
+    if (error) {
+      sendArgError(req, error, args.problem());
+      return;
     }
+    req.context = Commands.lastId();
+  }
 
-    State.setDaikinState(power, mode, temp, fan);
-    server.send(200, "application/json", "{\"status\":\"ok\"}");
-    LOG("API: Set Temp %.1f, Mode %d, Fan %d, Power %d", temp, mode, fan,
-        power);
-  } else {
-    server.send(400, "text/plain", "Missing 'temp' parameter");
+  const S21Command *c = Commands.find(req.context);
+  bool wait = req.hasArg("wait");
+  if (c && wait && !c->isDone() && req.age() < COMMAND_WAIT_MS)
+    return; // Called again on the next loop
+
+  int code = 200;
+  if (c && wait && !c->isDone())
+    code = 504;
+  else if (c && wait && c->status != S21_CMD_CONFIRMED &&
+           c->status != S21_CMD_SUPERSEDED)
+    code = 502;
+  uint8_t buf[320];
+  PayloadWriter w(FORMAT_JSON, buf, sizeof(buf));
+  w.beginMap(c ? 2 : 1);
+  w.key("status");
+  w.addString(code == 200 ? "ok" : "error");
+  if (c) {
+    w.key("command");
+    writeCommand(w, *c);
   }
+  w.end();
+  req.send(code, "application/json", w.data(), w.length());
 }
 
-// OTA Handlers
-void handleSetSwing() {
-  if (server.hasArg("v") && server.hasArg("h")) {
-    bool v = false;
-    bool h = false;
-    String argV = server.arg("v");
-    String argH = server.arg("h");
-    v = (argV == "1" || argV == "true" || argV == "on");
-    h = (argH == "1" || argH == "true" || argH == "on");
-
-    State.setSwing(v, h);
-    server.send(200, "application/json", "{\"status\":\"ok\"}");
-    LOG("API: Set Swing V=%d, H=%d", v, h);
-  } else {
-    server.send(400, "text/plain", "Missing 'v' or 'h' parameter");
+// Control command records: /commands?id=N for one, /commands?since=V for
+// those changed after version V (all kept ones without it). With ?wait=1
+// the answer waits until something changes: a status feed by long polling.
+void handleCommands(HttpRequest &req) {
+  PayloadFormat format = responseFormat(req);
+  RequestArgs args(req);
+  int32_t id;
+  ArgError idError = args.getInt("id", 1, INT32_MAX, id);
+  if (argInvalid(idError)) {
+    sendArgError(req, "Invalid argument", args.problem());
+    return;
+  }
+  if (idError == ARG_OK) {
+    const S21Command *c = Commands.find(id);
+    if (!c) {
+      req.send(404, "text/plain", "Unknown command id");
+      return;
+    }
+    uint8_t buf[256];
+    PayloadWriter w(format, buf, sizeof(buf));
+    writeCommand(w, *c);
+    req.send(200, formatContentType(format), w.data(), w.length());
+    return;
+  }
+
+  int32_t since = 0;
+  if (argInvalid(args.getInt("since", 0, INT32_MAX, since))) {
+    sendArgError(req, "Invalid argument", args.problem());
+    return;
+  }
+  if (req.hasArg("wait") && Commands.version() <= (uint32_t)since &&
+      req.age() < COMMAND_WAIT_MS)
+    return;
+
+  size_t changed = 0;
+  for (size_t i = 0; i < Commands.count(); i++) {
+    if (Commands.at(i).seq > (uint32_t)since)
+      changed++;
   }
+  const S21CommandStats &stats = Commands.getStats();
+
+  uint8_t buf[3072]; // The whole history plus stats
+  PayloadWriter w(format, buf, sizeof(buf));
+  w.beginMap(4);
+  w.key("version");
+  w.addUInt(Commands.version());
+  w.key("pending");
+  w.addUInt(Commands.pendingCount());
+  w.key("commands");
+  w.beginArray(changed);
+  for (size_t i = 0; i < Commands.count(); i++) {
+    if (Commands.at(i).seq > (uint32_t)since)
+      writeCommand(w, Commands.at(i));
+  }
+  w.end();
+
+  w.key("stats");
+  w.beginMap(10);
+  w.key("submitted");
+  w.addUInt(stats.submitted);
+  w.key("confirmed");
+  w.addUInt(stats.confirmed);
+  w.key("naked");
+  w.addUInt(stats.naked);
+  w.key("mismatch");
+  w.addUInt(stats.mismatched);
+  w.key("failed");
+  w.addUInt(stats.failed);
+  w.key("superseded");
+  w.addUInt(stats.superseded);
+  w.key("retries");
+  w.addUInt(stats.retries);
+  w.key("latency_bounds_ms");
+  w.beginArray(S21_LATENCY_BUCKETS - 1);
+  for (size_t i = 0; i + 1 < S21_LATENCY_BUCKETS; i++) {
+    w.addUInt(S21_COMMAND_BOUNDS_MS[i]);
+  }
+  w.end();
+  // From queued to the ACK, and to the readback that confirmed it
+  w.key("ack_latency");
+  writeLatency(w, stats.ackLatency);
+  w.key("confirm_latency");
+  writeLatency(w, stats.confirmLatency);
+  w.end();
+  w.end();
+
+  if (w.overflow()) {
+    req.send(500, "text/plain", "Commands too large");
+    return;
+  }
+  req.send(200, formatContentType(format), w.data(), w.length());
 }
 
-void handleUpdateUrl() {
-  if (!server.hasArg("url")) {
-    server.send(400, "text/plain", "Missing url");
+void handleSetConfig(HttpRequest &req) {
+  RequestArgs args(req);
+  ArgView name;
+  ArgError error = args.getText("name", SPLIT_NAME_MAX, name);
+  if (error == ARG_MISSING) {
+    sendArgError(req, "Missing 'name' parameter");
     return;
   }
-  String url = server.arg("url");
-  LOG("OTA: Updating from URL: %s", url.c_str());
-
-  WiFiClientSecure client;
-  client.setInsecure(); // Allow any certificate
-
-  // Disable auto-reboot to send response first
-  httpUpdate.rebootOnUpdate(false);
-  t_httpUpdate_return ret = httpUpdate.update(client, url);
-
-  switch (ret) {
-  case HTTP_UPDATE_FAILED:
-    server.send(500, "text/plain", "Fail: " + httpUpdate.getLastErrorString());
-    break;
-  case HTTP_UPDATE_NO_UPDATES:
-    server.send(304, "text/plain", "No updates");
-    break;
-  case HTTP_UPDATE_OK:
-    server.send(200, "text/plain", "OK");
-    delay(1000);
-    ESP.restart();
-    break;
+  if (argInvalid(error)) {
+    sendArgError(req, "Invalid name", args.problem());
+    return;
   }
+  name = name.trimmed();
+  if (name.len == 0) {
+    sendArgError(req, "Invalid name");
+    return;
+  }
+
+  name.copyTo(splitName, sizeof(splitName));
+  preferences.begin("daikin", false);
+  preferences.putString("split_name", splitName);
+  preferences.end();
+  Fleet.setName(splitName);
+  LOG("Config: Split Name set to %s", splitName);
+
+  // NVS and mDNS allocate; the reply must not
+  HEAP_SCOPE_NO_ALLOC("set-config");
+  uint8_t buf[96];
+  PayloadWriter w(FORMAT_JSON, buf, sizeof(buf));
+  w.beginMap(2);
+  w.key("status");
+  w.addString("ok");
+  w.key("name");
+  w.addString(splitName);
+  w.end();
+  req.send(200, "application/json", w.data(), w.length());
 }
 
-void handleUpdateUpload() {
-  HTTPUpload &upload = server.upload();
-  if (upload.status == UPLOAD_FILE_START) {
-    LOG("OTA: Upload Start: %s", upload.filename.c_str());
-    if (!Update.begin(UPDATE_SIZE_UNKNOWN)) {
-      Update.printError(Serial);
-    }
-  } else if (upload.status == UPLOAD_FILE_WRITE) {
-    if (Update.write(upload.buf, upload.currentSize) != upload.currentSize) {
-      Update.printError(Serial);
+void handleSet(HttpRequest &req) { runHttpCommand(req, "set"); }
+
+// Schedule Handlers
+static size_t writeScheduleEntry(uint8_t *buf, size_t size, int index) {
+  const ScheduleEntry &e = Schedule.entry(index);
+  PayloadWriter w(FORMAT_JSON, buf, size);
+  w.beginMap(8);
+  w.key("index");
+  w.addUInt(index);
+  w.key("day");
+  w.addUInt(e.minuteOfWeek / 1440 + 1);
+  w.key("minute");
+  w.addUInt(e.minuteOfWeek % 1440);
+  w.key("action");
+  w.addUInt(e.action);
+  w.key("mode");
+  w.addUInt(e.mode);
+  w.key("temp");
+  w.addFloat(e.tempTenths / 10.0f);
+  w.key("fan");
+  w.addUInt(e.fan);
+  w.key("ramp");
+  w.addUInt(e.rampMinutes);
+  w.end();
+  return w.length();
+}
+
+// A full table is ~4KB of JSON, too much for the loop stack: entries are
+// encoded one at a time, once to size the response and again to send it
+void handleSchedule(HttpRequest &req) {
+  HEAP_SCOPE_NO_ALLOC("schedule");
+  char head[64];
+  const ScheduleEntry *next;
+  uint16_t minutesUntil;
+  int headLen;
+  if (Schedule.nextEvent(&next, &minutesUntil))
+    headLen = snprintf(head, sizeof(head),
+                       "{\"clock_valid\":%s,\"next_in_min\":%u,\"entries\":[",
+                       clockValid() ? "true" : "false", minutesUntil);
+  else
+    headLen = snprintf(head, sizeof(head), "{\"clock_valid\":%s,\"entries\":[",
+                       clockValid() ? "true" : "false");
+
+  uint8_t chunk[512];
+  size_t len = headLen + 2; // "]}"
+  for (int i = 0; i < Schedule.count(); i++)
+    len += writeScheduleEntry(chunk, sizeof(chunk), i) + (i > 0);
+
+  Print &out = req.beginSend(200, "application/json", len);
+  out.write((const uint8_t *)head, headLen);
+  size_t used = 0;
+  for (int i = 0; i < Schedule.count(); i++) {
+    if (sizeof(chunk) - used < 128) { // Room for the longest entry
+      out.write(chunk, used);
+      used = 0;
     }
-  } else if (upload.status == UPLOAD_FILE_END) {
-    if (Update.end(true)) {
-      LOG("OTA: Success: %u bytes", upload.totalSize);
-    } else {
-      Update.printError(Serial);
+    if (i > 0)
+      chunk[used++] = ',';
+    used += writeScheduleEntry(chunk + used, sizeof(chunk) - used, i);
+  }
+  chunk[used++] = ']';
+  chunk[used++] = '}';
+  out.write(chunk, used);
+}
+
+// /schedule-add?days=12345&time=07:30&action=on&mode=4&temp=21&fan=10&ramp=30
+// days: 1 = Monday ... 7 = Sunday. action: on, off, temp.
+void handleScheduleAdd(HttpRequest &req) {
+  RequestArgs args(req);
+  ArgView days;
+  ArgView time;
+  if (!args.get("days", days) || !args.get("time", time)) {
+    sendArgError(req, "Missing 'days' or 'time' parameter");
+    return;
+  }
+
+  uint8_t dayMask = 0;
+  for (size_t i = 0; i < days.len; i++) {
+    char d = days.data[i];
+    if (d < '1' || d > '7') {
+      dayMask = 0;
+      break;
     }
+    dayMask |= 1 << (d - '1');
   }
+  if (dayMask == 0) {
+    sendArgError(req, "Invalid 'days' (digits 1-7, 1 = Monday)",
+                 {ARG_MALFORMED, "days"});
+    return;
+  }
+
+  const char *colon = (const char *)memchr(time.data, ':', time.len);
+  ArgView hourText = {time.data, colon ? colon - time.data : time.len};
+  ArgView minuteText = {colon ? colon + 1 : "0",
+                        colon ? time.len - (colon + 1 - time.data) : 1};
+  int32_t hour;
+  int32_t minute;
+  if (!parseArgInt(hourText, hour) || !parseArgInt(minuteText, minute) ||
+      hour < 0 || hour > 23 || minute < 0 || minute > 59) {
+    sendArgError(req, "Invalid 'time' (HH:MM)", {ARG_MALFORMED, "time"});
+    return;
+  }
+
+  static constexpr ArgName ACTION_NAMES[] = {
+      {"on", SCHED_ON}, {"off", SCHED_OFF}, {"temp", SCHED_TEMP}};
+  ScheduleEntry e = {};
+  e.action = SCHED_ON;
+  int32_t tempTenths = 0;
+  int32_t ramp = 0;
+  if (argInvalid(args.getChoice("action", ACTION_NAMES, e.action)) ||
+      argInvalid(args.getChoice("mode", MODE_NAMES, e.mode)) ||
+      argInvalid(args.getTenths("temp", TEMP_MIN_TENTHS, TEMP_MAX_TENTHS,
+                                tempTenths)) ||
+      argInvalid(args.getChoice("fan", FAN_NAMES, e.fan)) ||
+      argInvalid(args.getInt("ramp", 0, 255, ramp))) {
+    sendArgError(req, "Invalid argument", args.problem());
+    return;
+  }
+  e.tempTenths = tempTenths;
+  e.rampMinutes = ramp;
+
+  int added = Schedule.add(dayMask, hour * 60 + minute, e);
+  if (added == 0) {
+    sendArgError(req, "Schedule full");
+    return;
+  }
+  char reply[48];
+  snprintf(reply, sizeof(reply), "{\"status\":\"ok\", \"added\":%d}", added);
+  req.send(200, "application/json", reply);
+  LOG("API: Schedule add days=%.*s time=%02d:%02d action=%d", (int)days.len,
+      days.data, (int)hour, (int)minute, e.action);
+}
+
+void handleScheduleDelete(HttpRequest &req) {
+  RequestArgs args(req);
+  int32_t index;
+  if (req.hasArg("all")) {
+    Schedule.clear();
+  } else if (args.getInt("index", 0, 255, index) != ARG_OK ||
+             !Schedule.remove(index)) {
+    sendArgError(req, "Missing or invalid 'index' parameter", args.problem());
+    return;
+  }
+  req.send(200, "application/json", "{\"status\":\"ok\"}");
+}
+
+void handleSetSwing(HttpRequest &req) { runHttpCommand(req, "swing"); }
+
+// Network services start on the first connect and survive later drops
+void networkUp() {
+  static bool started = false;
+  digitalWrite(LED_PIN, LED_OFF); // WiFi OK -> LED OFF
+  if (started)
+    return;
+  started = true;
+
+  server.begin();
+  LOG("HTTP Server Started on port %d", API_PORT);
+  Mqtt.begin(splitName);
+  Fleet.begin(splitName);
+  clockBegin();
+  Cli.beginNetwork();
 }
 
+void networkDown() { digitalWrite(LED_PIN, LED_ON); }
+
 void setup() {
   // Disable brownout detector (temporary fix for USB power issues)
 #if defined(CONFIG_IDF_TARGET_ESP32C3)
@@ -169,9 +582,9 @@ void setup() {
 
   // Initialize Preferences
   preferences.begin("daikin", false); // Namespace "daikin", read/write
-  splitName = preferences.getString("split_name", "NomeSplit");
+  preferences.getString("split_name", splitName, sizeof(splitName));
   preferences.end();
-  LOG("Config: Split Name loaded: %s", splitName.c_str());
+  LOG("Config: Split Name loaded: %s", splitName);
 
   // Initialize LED
   pinMode(LED_PIN, OUTPUT);
@@ -188,96 +601,70 @@ void setup() {
   // Initialize S21 driver
   S21.begin();
 
+  // Event-driven loop wait and CPU clock scaling (after Serial1 is up)
+  Idle.begin();
+
+  // Duty-cycle and energy totals, restored from NVS
+  Analytics.begin();
+
+  // Weekly schedule (runs once the clock is set)
+  Schedule.begin();
+
   // Short delay to stabilize power before WiFi
   delay(500);
 
-  // WiFi Setup
-  WiFi.mode(WIFI_STA); // Explicitly set mode to Station
-  WiFi.begin(WIFI_SSID, WIFI_PASS);
-  LOG("Connecting to WiFi [%s]...", WIFI_SSID);
-  // Non-blocking wait (sort of, we just log)
-  int retries = 0;
-  while (WiFi.status() != WL_CONNECTED &&
-         retries < 40) { // Increased timeout to 20s
-
-    // Blink LED
-    digitalWrite(LED_PIN, (retries % 2 == 0) ? LED_ON : LED_OFF);
-
-    delay(500);
-    Serial.print(".");
-    retries++;
-  }
-  if (WiFi.status() == WL_CONNECTED) {
-    digitalWrite(LED_PIN, LED_OFF); // WiFi OK -> LED OFF
-    LOG("\nWiFi Connected! IP: %s", WiFi.localIP().toString().c_str());
-
-    // API Routes
-    server.on("/", handleRoot);
-    server.on("/status", handleStatus);
-    server.on("/set", handleSet);
-    server.on("/set-swing", handleSetSwing);
-    server.on("/set-config", handleSetConfig);
-
-    // OTA Routes
-    server.on("/update-url", HTTP_POST, handleUpdateUrl);
-    server.on(
-        "/update", HTTP_POST,
-        []() {
-          server.send(200, "text/plain", (Update.hasError()) ? "FAIL" : "OK");
-          if (!Update.hasError()) {
-            delay(1000);
-            ESP.restart();
-          }
-        },
-        handleUpdateUpload);
-    server.begin();
-    LOG("HTTP Server Started on port %d", API_PORT);
-  } else {
-    digitalWrite(LED_PIN, LED_ON); // WiFi Fail -> LED ON (Solid)
-    LOG("\nWiFi Connection Failed! Running in Serial-Only mode.");
-  }
+  // API Routes (served once the network is up)
+  server.on("/status", handleStatus);
+#if ANALYTICS_ENABLED
+  server.on("/analytics", handleAnalytics);
+#endif
+  server.on("/set", handleSet);
+  server.on("/set-swing", handleSetSwing);
+  server.on("/commands", handleCommands);
+  server.on("/set-config", handleSetConfig);
+  server.on("/schedule", handleSchedule);
+  server.on("/schedule-add", handleScheduleAdd);
+  server.on("/schedule-delete", handleScheduleDelete);
+  server.limit("/status", RATE_CLASS_READ);
+  server.limit("/set", RATE_CLASS_WRITE);
+  server.limit("/set-swing", RATE_CLASS_WRITE);
+  server.limit("/set-config", RATE_CLASS_WRITE);
+  server.limit("/schedule-add", RATE_CLASS_WRITE);
+  server.limit("/schedule-delete", RATE_CLASS_WRITE);
+  server.limit("/commands", RATE_CLASS_READ, "wait"); // Holds a connection
+
+  // Optional modules, each a no-op when switched off in config.h
+  webUiBegin(server);
+  diagnosticsBegin(server);
+  otaBegin(server);
+
+  // WiFi connects in the background while the S21 handshake runs
+  digitalWrite(LED_PIN, LED_ON); // No network -> LED ON
+  Wifi.onConnect(networkUp);
+  Wifi.onDisconnect(networkDown);
+  Wifi.begin(WIFI_SSID, WIFI_PASS);
+
+  // Bus recovery and task watchdog
+  Supervisor.begin();
 }
 
 // Main driver loop
 void loop() {
-  S21.loop();
-  server.handleClient();
-
-  // Simple CLI (Keep it for debugging)
-  if (Serial.available()) {
-    String line = Serial.readStringUntil('\n');
-    line.trim();
-
-    if (line.length() > 0) {
-      char cmd = line.charAt(0);
-      float temp = 22.0;
-      if (line.length() > 1)
-        temp = line.substring(1).toFloat();
-
-      if (cmd == 'C') {                         // Cool
-        State.setDaikinState(true, 3, temp, 5); // Cool, Temp, Fan 5
-        LOG("CMD: Set Cool %.1f", temp);
-      } else if (cmd == 'H') {                  // Heat
-        State.setDaikinState(true, 4, temp, 5); // Heat, Temp, Fan 5
-        LOG("CMD: Set Heat %.1f", temp);
-      } else if (cmd == 'D') { // Dry
-        State.setDaikinState(true, 2, temp, 5);
-        LOG("CMD: Set Dry %.1f", temp);
-      } else if (cmd == 'A') { // Auto
-        State.setDaikinState(true, 1, temp, 5);
-        LOG("CMD: Set Auto %.1f", temp);
-      } else if (cmd == 'F') { // Fan Mode
-        State.setDaikinState(true, 6, 25.0, 5);
-        LOG("CMD: Set Fan Only");
-      } else if (cmd == 'O') { // OFF
-        State.setDaikinState(false, 3, 25.0, 5);
-        LOG("CMD: Set Power OFF");
-      } else {
-        LOG("Unknown Command. Use C24, H22, D24, A24, F, O");
-      }
-    }
+  {
+    TRACE_SCOPE("loop");
+    S21.loop();
+    Supervisor.loop();
+    Wifi.loop();
+    server.loop();
+    Mqtt.loop();
+    Fleet.loop();
+    Schedule.loop();
+    Analytics.loop();
+
+    // Serial and TCP console (never blocks on partial lines)
+    Cli.loop();
   }
 
-  // Minimal yield to watchdog
-  delay(1);
+  // Wait for UART data or the earliest module deadline
+  Idle.sleep();
 }
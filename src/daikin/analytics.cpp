@@ -0,0 +1,220 @@
+#include "analytics.h"
+#include "../system/clock.h"
+#include "../system/logger.h"
+#include "../system/trace.h"
+#include "daikin_state.h"
+#include "s21_driver.h"
+#include <Preferences.h>
+#include <math.h>
+
+#define ANALYTICS_VERSION 1
+#define MS_PER_HOUR 3600000UL
+
+UnitAnalytics Analytics;
+
+// Checkpoint blob; a different version or size is ignored
+struct AnalyticsCheckpoint {
+  uint16_t version;
+  uint16_t size;
+  AnalyticsTotals totals;
+};
+
+static const char *const MODE_NAMES[] = {"auto", "dry", "cool", "heat", "fan"};
+
+const char *analyticsModeName(AnalyticsMode mode) {
+  return mode < ANALYTICS_MODE_COUNT ? MODE_NAMES[mode] : "?";
+}
+
+void RunningStats::add(float x) {
+  if (count == 0 || x < min)
+    min = x;
+  if (count == 0 || x > max)
+    max = x;
+  count++;
+  float delta = x - mean;
+  mean += delta / count;
+  m2 += delta * (x - mean);
+}
+
+float RunningStats::stddev() const { return sqrtf(variance()); }
+
+#if ANALYTICS_ENABLED
+
+// S21 mode: 1 auto, 2 dry, 3 cool, 4 heat, 6 fan (0 reads as auto)
+static AnalyticsMode modeOf(uint8_t s21Mode) {
+  switch (s21Mode) {
+  case 2:
+    return ANALYTICS_DRY;
+  case 3:
+    return ANALYTICS_COOL;
+  case 4:
+    return ANALYTICS_HEAT;
+  case 6:
+    return ANALYTICS_FAN;
+  default:
+    return ANALYTICS_AUTO;
+  }
+}
+
+void UnitAnalytics::begin() {
+  AnalyticsCheckpoint cp;
+  Preferences prefs;
+  prefs.begin("daikin", true);
+  if (prefs.getBytesLength("analytics") == sizeof(cp) &&
+      prefs.getBytes("analytics", &cp, sizeof(cp)) == sizeof(cp) &&
+      cp.version == ANALYTICS_VERSION && cp.size == sizeof(cp.totals)) {
+    totals = cp.totals;
+    LOG("Analytics: restored %lu h observed",
+        (unsigned long)(totals.observedMs / MS_PER_HOUR));
+  }
+  prefs.end();
+
+  unsigned long now = millis();
+  lastIntegrate = now;
+  lastSample = now;
+  lastCheckpoint = now;
+  hour = uptimeMs() / MS_PER_HOUR;
+  State.onChange(stateChanged);
+}
+
+void UnitAnalytics::stateChanged() { Analytics.observe(millis()); }
+
+void UnitAnalytics::loop() {
+  unsigned long now = millis();
+  if (elapsedMs(now, lastSample) >= ANALYTICS_SAMPLE_MS) {
+    TRACE_SCOPE("analytics");
+    lastSample = now;
+    observe(now); // Also notices a bus that went quiet
+    if (live) {
+      totals.roomTemp.add(State.roomTemp);
+      totals.outsideTemp.add(State.outsideTemp);
+      if (compressorHz > 0)
+        totals.compressorHz.add(compressorHz);
+    }
+  }
+
+  // Batched: many changes, one NVS write per interval
+  if (dirty && elapsedMs(now, lastCheckpoint) >= ANALYTICS_CHECKPOINT_MS)
+    checkpoint();
+}
+
+// Charge the time since the last call to what the unit was doing
+void UnitAnalytics::integrate(unsigned long now) {
+  uint32_t dt = elapsedMs(now, lastIntegrate);
+  lastIntegrate = now;
+  if (!live || dt == 0)
+    return;
+
+  totals.observedMs += dt;
+  uint32_t watts = compressorHz * ANALYTICS_WATTS_PER_HZ;
+  if (on) {
+    totals.onMs += dt;
+    totals.modeMs[mode] += dt;
+    watts += ANALYTICS_FAN_WATTS;
+  }
+  if (compressorHz > 0)
+    totals.compressorMs += dt;
+  totals.estimatedJ += (uint64_t)watts * dt / 1000;
+  dirty = true;
+}
+
+// State change (or sample tick): close the previous interval, then take
+// note of transitions
+void UnitAnalytics::observe(unsigned long now) {
+  integrate(now);
+  rollHour();
+
+  bool wasLive = live;
+  live = S21.isConnected();
+  if (!live) {
+    cycleStartKnown = false; // A run in progress can't be timed any more
+    return;
+  }
+
+  bool nowOn = State.power;
+  if (wasLive && nowOn && !on)
+    totals.powerOns++;
+  on = nowOn;
+  mode = modeOf(State.mode);
+
+  uint16_t hz = State.compressorFreq;
+  if (wasLive && hz > 0 && compressorHz == 0) {
+    totals.compressorStarts++;
+    startsThisHour++;
+    cycleStart = now;
+    cycleStartKnown = true;
+  } else if (hz == 0 && compressorHz > 0 && cycleStartKnown) {
+    totals.cycleMinutes.add(elapsedMs(now, cycleStart) / 60000.0f);
+    cycleStartKnown = false;
+  }
+  compressorHz = hz;
+
+  // The unit's counter only grows; a drop means it was reset or the read
+  // was bad, so that step is skipped
+  if (State.energyKWh > 0) {
+    if (lastMeterKWh > 0 && State.energyKWh > lastMeterKWh)
+      totals.meteredKWh += State.energyKWh - lastMeterKWh;
+    lastMeterKWh = State.energyKWh;
+  }
+  dirty = true;
+}
+
+void UnitAnalytics::rollHour() {
+  uint32_t current = uptimeMs() / MS_PER_HOUR;
+  if (current == hour)
+    return;
+  startsPreviousHour = current == hour + 1 ? startsThisHour : 0;
+  startsThisHour = 0;
+  hour = current;
+}
+
+void UnitAnalytics::checkpoint() {
+  integrate(millis());
+  AnalyticsCheckpoint cp = {ANALYTICS_VERSION, sizeof(cp.totals), totals};
+  Preferences prefs;
+  prefs.begin("daikin", false);
+  prefs.putBytes("analytics", &cp, sizeof(cp));
+  prefs.end();
+  checkpoints++;
+  lastCheckpoint = millis();
+  dirty = false;
+}
+
+void UnitAnalytics::reset() {
+  totals = {};
+  startsThisHour = 0;
+  startsPreviousHour = 0;
+  cycleStartKnown = false;
+  Preferences prefs;
+  prefs.begin("daikin", false);
+  prefs.remove("analytics");
+  prefs.end();
+  dirty = false;
+  LOG("Analytics: reset");
+}
+
+const AnalyticsTotals &UnitAnalytics::getTotals() {
+  integrate(millis());
+  return totals;
+}
+
+uint16_t UnitAnalytics::startsLastHour() {
+  rollHour();
+  return startsPreviousHour;
+}
+
+unsigned long UnitAnalytics::lastCheckpointAge() {
+  return msSince(lastCheckpoint);
+}
+
+#else // ANALYTICS_ENABLED
+
+void UnitAnalytics::begin() {}
+void UnitAnalytics::loop() {}
+void UnitAnalytics::checkpoint() {}
+void UnitAnalytics::reset() {}
+const AnalyticsTotals &UnitAnalytics::getTotals() { return totals; }
+uint16_t UnitAnalytics::startsLastHour() { return 0; }
+unsigned long UnitAnalytics::lastCheckpointAge() { return 0; }
+
+#endif // ANALYTICS_ENABLED
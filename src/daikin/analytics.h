@@ -0,0 +1,126 @@
+#ifndef ANALYTICS_H
+#define ANALYTICS_H
+
+#include "../system/config.h"
+#include <Arduino.h>
+
+// Duty-cycle and energy totals, /analytics and the analytics command. 0
+// keeps the class as a no-op (nothing sampled, nothing written to NVS).
+#ifndef ANALYTICS_ENABLED
+#define ANALYTICS_ENABLED 1
+#endif
+// Temperatures and compressor speed are sampled at this rate, so their
+// statistics are time-weighted
+#ifndef ANALYTICS_SAMPLE_MS
+#define ANALYTICS_SAMPLE_MS 60000
+#endif
+// Totals are written to NVS at most this often (one blob per write)
+#ifndef ANALYTICS_CHECKPOINT_MS
+#define ANALYTICS_CHECKPOINT_MS 900000
+#endif
+// Energy model for units without the GM energy counter: indoor fan while
+// on, plus a linear compressor term
+#ifndef ANALYTICS_FAN_WATTS
+#define ANALYTICS_FAN_WATTS 30
+#endif
+#ifndef ANALYTICS_WATTS_PER_HZ
+#define ANALYTICS_WATTS_PER_HZ 14
+#endif
+
+enum AnalyticsMode : uint8_t {
+  ANALYTICS_AUTO,
+  ANALYTICS_DRY,
+  ANALYTICS_COOL,
+  ANALYTICS_HEAT,
+  ANALYTICS_FAN,
+  ANALYTICS_MODE_COUNT
+};
+
+// Welford's online mean and variance, plus extremes, in constant memory
+struct RunningStats {
+  uint32_t count;
+  float mean;
+  float m2; // Sum of squared differences from the mean
+  float min;
+  float max;
+
+  void add(float x);
+  float variance() const { return count > 1 ? m2 / (count - 1) : 0; }
+  float stddev() const;
+};
+
+// Everything that survives a reboot. Times count only while the bus is
+// up: with the unit unreachable we don't know what it's doing.
+struct AnalyticsTotals {
+  uint64_t observedMs;
+  uint64_t onMs;
+  uint64_t compressorMs;
+  uint64_t modeMs[ANALYTICS_MODE_COUNT];
+  uint32_t powerOns;
+  uint32_t compressorStarts;
+  uint64_t estimatedJ; // From the energy model
+  float meteredKWh;    // Increase of the unit's own counter (GM)
+  RunningStats roomTemp;
+  RunningStats outsideTemp;
+  RunningStats compressorHz; // While running
+  RunningStats cycleMinutes; // Length of each compressor run
+};
+
+// On-device duty-cycle and energy analytics, fed by DaikinState change
+// events, so aggregators can read /analytics now and then instead of
+// polling /status hard
+class UnitAnalytics {
+public:
+  // Load the last checkpoint and subscribe to state changes
+  void begin();
+
+  void loop();
+
+  // Write the totals to NVS now (before a reboot)
+  void checkpoint();
+
+  // Forget everything, including the checkpoint
+  void reset();
+
+  // Totals brought up to date
+  const AnalyticsTotals &getTotals();
+
+  // Compressor starts in the last full hour of uptime
+  uint16_t startsLastHour();
+
+  uint32_t checkpointCount() const { return checkpoints; }
+  unsigned long lastCheckpointAge();
+
+private:
+  static void stateChanged();
+  void observe(unsigned long now);
+  void integrate(unsigned long now);
+  void rollHour();
+
+private:
+  AnalyticsTotals totals = {};
+  bool dirty = false;
+  uint32_t checkpoints = 0;
+  unsigned long lastCheckpoint = 0;
+  unsigned long lastIntegrate = 0;
+  unsigned long lastSample = 0;
+
+  // What the unit was doing since lastIntegrate
+  bool live = false;
+  bool on = false;
+  AnalyticsMode mode = ANALYTICS_AUTO;
+  uint16_t compressorHz = 0;
+  unsigned long cycleStart = 0;
+  bool cycleStartKnown = false; // Run began while we were watching
+  float lastMeterKWh = 0;
+
+  uint32_t hour = 0;
+  uint16_t startsThisHour = 0;
+  uint16_t startsPreviousHour = 0;
+};
+
+extern UnitAnalytics Analytics;
+
+const char *analyticsModeName(AnalyticsMode mode);
+
+#endif // ANALYTICS_H
@@ -3,6 +3,20 @@
 
 #include <Arduino.h>
 
+// A (partial) control request, shared by the HTTP API and integrations.
+// Fields without their has* flag keep the current value. Sent through
+// Commands (s21_commands.h).
+struct DaikinCommand {
+  bool hasPower = false;
+  bool power = false;
+  bool hasMode = false;
+  uint8_t mode = 0;
+  bool hasTemp = false;
+  float temp = 0.0;
+  bool hasFan = false;
+  uint8_t fan = 0;
+};
+
 struct DaikinState {
   float targetTemp = 0.0;
   float roomTemp = 0.0;
@@ -16,17 +30,30 @@ struct DaikinState {
   bool swingV = false;
   bool swingH = false;
 
+  // Special modes
+  bool powerful = false;
+  bool econo = false;
+
+  // Telemetry (slow poll)
+  float coilTemp = 0.0;        // Indoor heat exchanger
+  uint16_t fanRpm = 0;         // Indoor fan
+  uint16_t compressorFreq = 0; // Hz, 0 = stopped
+  float energyKWh = 0.0;       // Unit energy counter
+
   // Decodes a raw S21 frame
   void decodeFrame(const uint8_t *frame, size_t len);
 
-  // Send a command to set the state
-  void setDaikinState(bool power, uint8_t mode, float temp, uint8_t fan);
-  
-  // Send a command to set the swing state
-  void setSwing(bool v, bool h);
+  // Decodes a D1/D5 command sent by another bus master (passive mode)
+  void decodeCommand(const uint8_t *frame, size_t len);
+
+  // Called after a decoded frame changed any field (one listener)
+  void onChange(void (*listener)()) { changeListener = listener; }
 
 private:
-  float parseInvertedDecimal(const uint8_t *ptr, size_t len);
+  bool sameValues(const DaikinState &other) const;
+  void notifyIfChanged(const DaikinState &before);
+
+  void (*changeListener)() = nullptr;
 };
 
 extern DaikinState State;
@@ -0,0 +1,182 @@
+#include "s21_codec.h"
+#include "../system/logger.h"
+#include "daikin_state.h"
+
+S21Protocol Protocol;
+
+// Target temperature encodings (one byte in D1/G1)
+
+// Whole degrees Fahrenheit: what this driver has always sent
+struct FahrenheitTemp {
+  static uint8_t encode(float c) { return (uint8_t)((c * 1.8) + 32); }
+  static float decode(uint8_t raw) { return (raw - 32) / 1.8; }
+};
+
+// 0.5C steps, '@' (0x40) = 18.0C (Hypothesis: v2+ units, as in Faikin)
+struct HalfCelsiusTemp {
+  static uint8_t encode(float c) {
+    return (uint8_t)(0x40 + (int)lroundf((c - 18.0) * 2));
+  }
+  static float decode(uint8_t raw) { return 18.0 + ((int)raw - 0x40) / 2.0; }
+};
+
+// Fan speed: 1-5 -> '3'-'7', 10 -> 'A' (Auto), 11 -> 'B' (Silent)
+struct DigitFan {
+  static uint8_t encode(uint8_t fan) {
+    if (fan >= 1 && fan <= 5)
+      return fan + 0x32;
+    if (fan == 11)
+      return 'B';
+    return 'A';
+  }
+  static uint8_t decode(uint8_t raw) {
+    if (raw >= 0x33 && raw <= 0x39)
+      return raw - 0x32;
+    if (raw == 'B')
+      return 11;
+    if (raw == 'A')
+      return 10;
+    return 0; // Unknown
+  }
+};
+
+// D5: bit 0 = vertical, bit 1 = horizontal, +4 when both ("3D")
+struct BitmaskSwing {
+  static void encode(uint8_t *p, bool v, bool h) {
+    uint8_t val = 0;
+    if (v)
+      val += 1;
+    if (h)
+      val += 2;
+    if (v && h)
+      val += 4;
+    p[0] = '0' + val;
+    p[1] = (v || h) ? '?' : '0';
+    p[2] = '0';
+    p[3] = '0';
+  }
+};
+
+// Codec functions, specialized per variant by the compiler: no version
+// checks on the per-frame path
+template <class Temp, class Fan>
+static void encodeState(uint8_t *p, bool power, uint8_t mode, float temp,
+                        uint8_t fan) {
+  // Byte 0: Power (Hypothesis: '1'=ON, '0'=OFF)
+  p[0] = power ? '1' : '0';
+  // 1=Auto, 2=Dry, 3=Cool, 4=Heat, 6=Fan (anything else: Cool)
+  p[1] = (mode <= 4 || mode == 6) ? '0' + mode : '3';
+  p[2] = Temp::encode(temp);
+  p[3] = Fan::encode(fan);
+}
+
+template <class Swing>
+static void encodeSwing(uint8_t *p, bool v, bool h) {
+  Swing::encode(p, v, h);
+}
+
+template <class Temp, class Fan>
+static void decodeState(DaikinState &s, const uint8_t *p, size_t len) {
+  if (len < 4)
+    return;
+
+  // Byte 0: Power ('1' = ON, '0' = OFF)
+  s.power = (p[0] == '1');
+
+  // Byte 1: Mode
+  uint8_t modeChar = p[1];
+  if ((modeChar >= '0' && modeChar <= '4') || modeChar == '6') {
+    s.mode = modeChar - '0';
+  } else {
+    LOG("Parsed Mode (G1): Unknown (%c)", modeChar);
+  }
+
+  // Byte 2: Target Temp
+  s.targetTemp = Temp::decode(p[2]);
+
+  // Byte 3: Fan Speed
+  uint8_t fan = Fan::decode(p[3]);
+  if (fan) {
+    s.fan = fan;
+  } else {
+    LOG("Parsed Fan (G1): Unknown (Raw: %02X)", p[3]);
+  }
+
+  LOG("Parsed G1: Power %s, Mode %d, Target %.1f C (Raw: %d), Fan %d",
+      s.power ? "ON" : "OFF", s.mode, s.targetTemp, p[2], s.fan);
+}
+
+const S21Codec S21_FAHRENHEIT_CODEC = {
+    "fahrenheit",
+    encodeState<FahrenheitTemp, DigitFan>,
+    encodeSwing<BitmaskSwing>,
+    decodeState<FahrenheitTemp, DigitFan>,
+};
+
+const S21Codec S21_HALF_CELSIUS_CODEC = {
+    "half-celsius",
+    encodeState<HalfCelsiusTemp, DigitFan>,
+    encodeSwing<BitmaskSwing>,
+    decodeState<HalfCelsiusTemp, DigitFan>,
+};
+
+void S21Protocol::reset() {
+  versionMajor = 0;
+  versionFull = 0;
+  rejectedOnce = 0;
+  unsupported = 0;
+}
+
+void S21Protocol::setMajor(uint8_t major) { versionMajor = major; }
+
+void S21Protocol::setVersion(uint16_t version) {
+  versionFull = version;
+  if (version >= 100)
+    versionMajor = version / 100;
+}
+
+const S21Codec &S21Protocol::codecFor(uint8_t major) {
+#if S21_FORCE_CODEC == S21_CODEC_HALF_CELSIUS
+  (void)major;
+  return S21_HALF_CELSIUS_CODEC;
+#elif S21_FORCE_CODEC == S21_CODEC_FAHRENHEIT
+  (void)major;
+  return S21_FAHRENHEIT_CODEC;
+#else
+  if (S21_HALF_CELSIUS_MIN_MAJOR > 0 && major >= S21_HALF_CELSIUS_MIN_MAJOR)
+    return S21_HALF_CELSIUS_CODEC;
+  return S21_FAHRENHEIT_CODEC;
+#endif
+}
+
+void S21Protocol::selectCodec() {
+  active = &codecFor(versionMajor);
+  LOG("[S21] Protocol v%d (%u), codec %s", versionMajor, versionFull,
+      active->name);
+}
+
+bool S21Protocol::isSupported(size_t index) const {
+  return index >= S21_MAX_QUERIES || !(unsupported & (1UL << index));
+}
+
+void S21Protocol::noteAnswered(size_t index) {
+  if (index < S21_MAX_QUERIES)
+    rejectedOnce &= ~(1UL << index);
+}
+
+// One NAK can be a glitch, two in a row means the unit doesn't have it
+void S21Protocol::noteRejected(size_t index) {
+  if (index >= S21_MAX_QUERIES)
+    return;
+  uint32_t bit = 1UL << index;
+  if (rejectedOnce & bit)
+    unsupported |= bit;
+  rejectedOnce |= bit;
+}
+
+uint8_t S21Protocol::unsupportedCount() const {
+  uint8_t n = 0;
+  for (uint32_t m = unsupported; m; m &= m - 1)
+    n++;
+  return n;
+}
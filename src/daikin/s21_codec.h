@@ -0,0 +1,82 @@
+#ifndef S21_CODEC_H
+#define S21_CODEC_H
+
+#include "../system/config.h"
+#include <Arduino.h>
+
+struct DaikinState;
+
+#define S21_CODEC_BY_VERSION 0
+#define S21_CODEC_FAHRENHEIT 1
+#define S21_CODEC_HALF_CELSIUS 2
+// Encoding of the control frames, from the protocol version the handshake
+// reads (S21Protocol::codecFor), unless pinned here
+#ifndef S21_FORCE_CODEC
+#define S21_FORCE_CODEC S21_CODEC_BY_VERSION
+#endif
+// Units from this major version on get 0.5C steps, older ones whole
+// degrees F. 0 = none: whole F works on every version seen so far, 0.5C
+// steps are unconfirmed on real units.
+#ifndef S21_HALF_CELSIUS_MIN_MAJOR
+#define S21_HALF_CELSIUS_MIN_MAJOR 0
+#endif
+
+// Poll queries tracked for support (bit per S21_QUERIES index)
+#define S21_MAX_QUERIES 32
+
+// Encoding of the control frames (D1, D5) and the G1 readback, which
+// differ between S21 generations. One instance per variant, built from
+// the policy classes in s21_codec.cpp.
+struct S21Codec {
+  const char *name;
+  // D1 payload: power, mode, target, fan (4 bytes after "D1")
+  void (*encodeState)(uint8_t *payload, bool power, uint8_t mode, float temp,
+                      uint8_t fan);
+  // D5 payload: 4 bytes after "D5"
+  void (*encodeSwing)(uint8_t *payload, bool v, bool h);
+  // G1 payload
+  void (*decodeState)(DaikinState &s, const uint8_t *p, size_t len);
+};
+
+extern const S21Codec S21_FAHRENHEIT_CODEC;   // Whole degrees F (default)
+extern const S21Codec S21_HALF_CELSIUS_CODEC; // 0.5C steps
+
+// What the handshake learned about the unit: protocol version (F8/FY),
+// the codec in use and which poll queries it answers. Queries NAKed
+// twice in a row are skipped until the next handshake.
+class S21Protocol {
+public:
+  // Forget everything (start of a handshake)
+  void reset();
+
+  // From G8 (major) and GY (full version x100, e.g. 320 = 3.20)
+  void setMajor(uint8_t major);
+  void setVersion(uint16_t version);
+
+  // Pick the codec for the version read so far and log both (end of the
+  // handshake)
+  void selectCodec();
+  // The codec a unit of this major version gets
+  static const S21Codec &codecFor(uint8_t major);
+
+  const S21Codec &codec() const { return *active; }
+  uint8_t major() const { return versionMajor; }
+  uint16_t version() const { return versionFull; }
+
+  // Query support, by index in S21_QUERIES
+  bool isSupported(size_t index) const;
+  void noteAnswered(size_t index);
+  void noteRejected(size_t index);
+  uint8_t unsupportedCount() const;
+
+private:
+  const S21Codec *active = &S21_FAHRENHEIT_CODEC;
+  uint8_t versionMajor = 0;
+  uint16_t versionFull = 0;
+  uint32_t rejectedOnce = 0;
+  uint32_t unsupported = 0;
+};
+
+extern S21Protocol Protocol;
+
+#endif // S21_CODEC_H
@@ -0,0 +1,237 @@
+#include "s21_commands.h"
+#include "../system/clock.h"
+#include "../system/idle.h"
+#include "../system/logger.h"
+#include "s21_driver.h"
+
+S21CommandQueue Commands;
+
+const uint16_t S21_COMMAND_BOUNDS_MS[S21_LATENCY_BUCKETS] = {
+    200, 300, 500, 1000, 2000, 5000, 0xFFFF};
+
+static const char *const STATUS_NAMES[] = {
+    "queued", "sent",     "acked",  "confirmed",
+    "naked",  "mismatch", "failed", "superseded"};
+
+const char *s21CommandStatusName(S21CommandStatus status) {
+  return status <= S21_CMD_SUPERSEDED ? STATUS_NAMES[status] : "?";
+}
+
+const char *s21CommandKindName(S21CommandKind kind) {
+  return kind == S21_CMD_SWING ? "swing" : "state";
+}
+
+uint32_t S21CommandQueue::submit(const DaikinCommand &cmd) {
+  if (S21.isPassive())
+    return 0;
+  // Merge with what the unit will have once the pending command is through
+  const S21Command *before = pending(S21_CMD_STATE);
+  bool power = before ? before->power : State.power;
+  uint8_t mode = before ? before->mode : (State.mode > 0 ? State.mode : 3);
+  float temp = before ? before->temp
+                      : (State.targetTemp > 0 ? State.targetTemp : 24.0);
+  uint8_t fan = before ? before->fan : (State.fan > 0 ? State.fan : 5);
+
+  S21Command &c = add(S21_CMD_STATE);
+  c.power = cmd.hasPower ? cmd.power : power;
+  c.mode = cmd.hasMode ? cmd.mode : mode;
+  c.temp = cmd.hasTemp ? cmd.temp : temp;
+  c.fan = cmd.hasFan ? cmd.fan : fan;
+  supersede(S21_CMD_STATE, c.id);
+  changed(c);
+  return c.id;
+}
+
+uint32_t S21CommandQueue::submitSwing(bool v, bool h) {
+  if (S21.isPassive())
+    return 0;
+  S21Command &c = add(S21_CMD_SWING);
+  c.swingV = v;
+  c.swingH = h;
+  supersede(S21_CMD_SWING, c.id);
+  changed(c);
+  return c.id;
+}
+
+// A full history drops its oldest finished command. Pending ones stay: at
+// most two per kind (one on the bus, one queued), so there always is one.
+// Entries move, so the driver holds on to its command by id.
+S21Command &S21CommandQueue::add(S21CommandKind kind) {
+  if (used == S21_COMMAND_HISTORY) {
+    size_t i = 0;
+    while (i < used - 1 && !at(i).isDone())
+      i++;
+    drop(i);
+  }
+  size_t slot = (head + used) % S21_COMMAND_HISTORY;
+  used++;
+  S21Command &c = history[slot];
+  c = {};
+  c.id = nextId++;
+  c.kind = kind;
+  c.status = S21_CMD_QUEUED;
+  c.queuedAt = millis();
+  stats.submitted++;
+  Idle.busy(); // The driver picks it up on the next pass
+  return c;
+}
+
+// Closes the gap from the oldest end
+void S21CommandQueue::drop(size_t i) {
+  for (; i > 0; i--)
+    history[(head + i) % S21_COMMAND_HISTORY] =
+        history[(head + i - 1) % S21_COMMAND_HISTORY];
+  head = (head + 1) % S21_COMMAND_HISTORY;
+  used--;
+}
+
+const S21Command &S21CommandQueue::at(size_t i) const {
+  return history[(head + i) % S21_COMMAND_HISTORY];
+}
+
+const S21Command *S21CommandQueue::find(uint32_t id) const {
+  return const_cast<S21CommandQueue *>(this)->find(id);
+}
+
+S21Command *S21CommandQueue::find(uint32_t id) {
+  for (size_t i = 0; id && i < used; i++) {
+    S21Command &c = history[(head + i) % S21_COMMAND_HISTORY];
+    if (c.id == id)
+      return &c;
+  }
+  return nullptr;
+}
+
+size_t S21CommandQueue::pendingCount() const {
+  size_t n = 0;
+  for (size_t i = 0; i < used; i++) {
+    if (!at(i).isDone())
+      n++;
+  }
+  return n;
+}
+
+S21Command *S21CommandQueue::pending(S21CommandKind kind) {
+  for (size_t i = used; i-- > 0;) {
+    S21Command &c = history[(head + i) % S21_COMMAND_HISTORY];
+    if (c.kind == kind && !c.isDone())
+      return &c;
+  }
+  return nullptr;
+}
+
+// Older commands of the kind that haven't reached the bus yet
+void S21CommandQueue::supersede(S21CommandKind kind, uint32_t newerThan) {
+  for (size_t i = 0; i < used; i++) {
+    S21Command &c = history[(head + i) % S21_COMMAND_HISTORY];
+    if (c.kind == kind && c.id < newerThan && c.status == S21_CMD_QUEUED) {
+      stats.superseded++;
+      finish(c, S21_CMD_SUPERSEDED, millis());
+    }
+  }
+}
+
+S21Command *S21CommandQueue::next() {
+  for (size_t i = 0; i < used; i++) {
+    S21Command &c = history[(head + i) % S21_COMMAND_HISTORY];
+    if (c.status == S21_CMD_QUEUED)
+      return &c;
+  }
+  return nullptr;
+}
+
+void S21CommandQueue::expire(unsigned long now) {
+  for (size_t i = 0; i < used; i++) {
+    S21Command &c = history[(head + i) % S21_COMMAND_HISTORY];
+    if (c.status == S21_CMD_QUEUED &&
+        elapsedMs(now, c.queuedAt) >= S21_COMMAND_EXPIRE_MS) {
+      LOG("[S21] Command %lu expired in the queue", (unsigned long)c.id);
+      stats.failed++;
+      finish(c, S21_CMD_FAILED, now);
+    }
+  }
+}
+
+void S21CommandQueue::sent(S21Command &c, const uint8_t *payload) {
+  if (c.attempts > 0)
+    stats.retries++;
+  c.attempts++;
+  memcpy(c.payload, payload, sizeof(c.payload));
+  c.status = S21_CMD_SENT;
+  changed(c);
+}
+
+void S21CommandQueue::acked(S21Command &c, unsigned long now) {
+  c.ackMs = elapsedMs(now, c.queuedAt);
+  stats.ackLatency.add(c.ackMs, S21_COMMAND_BOUNDS_MS);
+  c.status = S21_CMD_ACKED;
+  changed(c);
+}
+
+void S21CommandQueue::rejected(S21Command &c, bool nak, unsigned long now) {
+  if (nak)
+    c.naks++;
+  // A newer command of the kind already waits: no point sending this again
+  const S21Command *newest = pending(c.kind);
+  if (newest && newest->id != c.id) {
+    stats.superseded++;
+    finish(c, S21_CMD_SUPERSEDED, now);
+  } else if (c.attempts < S21_COMMAND_ATTEMPTS) {
+    c.status = S21_CMD_QUEUED;
+    changed(c);
+  } else if (nak) {
+    LOG("[S21] Command %lu NAKed %u times", (unsigned long)c.id, c.naks);
+    stats.naked++;
+    finish(c, S21_CMD_NAKED, now);
+  } else {
+    LOG("[S21] Command %lu not ACKed", (unsigned long)c.id);
+    stats.failed++;
+    finish(c, S21_CMD_FAILED, now);
+  }
+}
+
+// G1 carries power, mode, target and fan encoded like D1; G5 byte 0 both
+// swing axes like D5
+static bool readbackMatches(const S21Command &c, const uint8_t *p,
+                            size_t len) {
+  size_t n = c.kind == S21_CMD_SWING ? 1 : 4;
+  return len >= n && memcmp(p, c.payload, n) == 0;
+}
+
+void S21CommandQueue::readback(S21Command &c, const uint8_t *p, size_t len,
+                               unsigned long now) {
+  c.readbacks++;
+  if (p && readbackMatches(c, p, len)) {
+    stats.confirmed++;
+    finish(c, S21_CMD_CONFIRMED, now);
+    stats.confirmLatency.add(c.doneMs, S21_COMMAND_BOUNDS_MS);
+  } else if (c.readbacks >= S21_COMMAND_READBACKS) {
+    LOG("[S21] Command %lu ACKed but not applied", (unsigned long)c.id);
+    stats.mismatched++;
+    finish(c, S21_CMD_MISMATCH, now);
+  } else {
+    changed(c); // Readback count
+  }
+}
+
+void S21CommandQueue::interrupted(S21Command &c) {
+  if (c.isDone())
+    return;
+  c.status = S21_CMD_QUEUED;
+  changed(c);
+}
+
+void S21CommandQueue::finish(S21Command &c, S21CommandStatus status,
+                             unsigned long now) {
+  c.status = status;
+  c.doneMs = elapsedMs(now, c.queuedAt);
+  if (c.doneMs == 0)
+    c.doneMs = 1; // 0 means pending
+  changed(c);
+}
+
+void S21CommandQueue::changed(S21Command &c) {
+  c.seq = ++seq;
+  if (updateListener)
+    updateListener(c);
+}
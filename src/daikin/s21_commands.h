@@ -0,0 +1,150 @@
+#ifndef S21_COMMANDS_H
+#define S21_COMMANDS_H
+
+#include "../system/config.h"
+#include "daikin_state.h"
+#include "s21_line.h"
+#include <Arduino.h>
+
+// Sends of one command (first try + retries) on NAK or missing ACK
+#ifndef S21_COMMAND_ATTEMPTS
+#define S21_COMMAND_ATTEMPTS 3
+#endif
+// F1/F5 reads after the ACK until the unit reports the new values
+#ifndef S21_COMMAND_READBACKS
+#define S21_COMMAND_READBACKS 3
+#endif
+// Pause before reading back again: some units apply a command late
+#define S21_COMMAND_READBACK_GAP_MS 300
+// A command still queued after this fails (link down, bus halted)
+#ifndef S21_COMMAND_EXPIRE_MS
+#define S21_COMMAND_EXPIRE_MS 15000
+#endif
+// Commands kept for /commands, finished ones included
+#define S21_COMMAND_HISTORY 16
+
+enum S21CommandKind : uint8_t {
+  S21_CMD_STATE, // D1: power, mode, target, fan
+  S21_CMD_SWING, // D5
+};
+
+// Order matters: everything from CONFIRMED on is final
+enum S21CommandStatus : uint8_t {
+  S21_CMD_QUEUED,     // Waiting for the bus (again, after a NAK/timeout)
+  S21_CMD_SENT,       // Waiting for the ACK
+  S21_CMD_ACKED,      // Reading back
+  S21_CMD_CONFIRMED,  // The readback shows the new values
+  S21_CMD_NAKED,      // NAKed on the last attempt
+  S21_CMD_MISMATCH,   // ACKed, but every readback showed other values
+  S21_CMD_FAILED,     // No ACK on the last attempt, or expired in the queue
+  S21_CMD_SUPERSEDED, // A newer command of the same kind replaced it
+};
+
+struct S21Command {
+  uint32_t id;
+  uint32_t seq; // Commands.version() at the last change
+  S21CommandKind kind;
+  S21CommandStatus status;
+  uint8_t attempts; // Sends so far
+  uint8_t naks;
+  uint8_t readbacks;
+
+  // Full values, partial requests merged with what came before
+  bool power;
+  uint8_t mode;
+  float temp;
+  uint8_t fan;
+  bool swingV;
+  bool swingH;
+
+  uint8_t payload[4]; // As sent, for the readback
+  unsigned long queuedAt;
+  uint32_t ackMs;  // Queued to ACK (0 = not yet)
+  uint32_t doneMs; // Queued to the final status (0 = pending)
+
+  bool isDone() const { return status >= S21_CMD_CONFIRMED; }
+};
+
+struct S21CommandStats {
+  uint32_t submitted;
+  uint32_t confirmed;
+  uint32_t naked;
+  uint32_t mismatched;
+  uint32_t failed;
+  uint32_t superseded;
+  uint32_t retries; // Sends after a NAK or missing ACK
+  S21Latency ackLatency;     // Queued to ACK, last attempt
+  S21Latency confirmLatency; // Queued to the confirming readback
+};
+
+// Bucket bounds of the command latencies: a D1 plus readback takes about
+// 250ms of bus time, so these start higher than the line's
+extern const uint16_t S21_COMMAND_BOUNDS_MS[S21_LATENCY_BUCKETS];
+
+const char *s21CommandStatusName(S21CommandStatus status);
+const char *s21CommandKindName(S21CommandKind kind);
+
+// Control commands from every front end, sent by the driver between poll
+// queries: D1/D5, ACK, then F1/F5 until the unit reports the new values.
+// A command still waiting for the bus is replaced by a newer one of the
+// same kind, so a burst of requests costs one bus transaction.
+class S21CommandQueue {
+public:
+  // Queue a (partial) state or swing command. Fields left out keep the
+  // value of the newest pending command, else the unit's state. Returns
+  // the command id, 0 when the bus is passive.
+  uint32_t submit(const DaikinCommand &cmd);
+  uint32_t submitSwing(bool v, bool h);
+
+  // nullptr once the id has left the history
+  const S21Command *find(uint32_t id) const;
+  uint32_t lastId() const { return nextId - 1; }
+  // Commands in the history, oldest first
+  size_t count() const { return used; }
+  const S21Command &at(size_t i) const;
+  // Bumped on every status change: wait for it to move to see the next
+  uint32_t version() const { return seq; }
+  const S21CommandStats &getStats() const { return stats; }
+  size_t pendingCount() const;
+
+  // Called on every status change (one listener)
+  void onUpdate(void (*listener)(const S21Command &)) { updateListener = listener; }
+
+  // Driver side
+  // Oldest queued command, nullptr if none
+  S21Command *next();
+  S21Command *find(uint32_t id);
+  // Fail queued commands older than S21_COMMAND_EXPIRE_MS
+  void expire(unsigned long now);
+  void sent(S21Command &c, const uint8_t *payload);
+  void acked(S21Command &c, unsigned long now);
+  // NAK or no ACK: back in the queue, or final after the last attempt
+  void rejected(S21Command &c, bool nak, unsigned long now);
+  // The F1/F5 reply (payload only), nullptr if it didn't come
+  void readback(S21Command &c, const uint8_t *p, size_t len,
+                unsigned long now);
+  // Transaction cut short (bus halted): send again when the link is back
+  void interrupted(S21Command &c);
+
+private:
+  S21Command &add(S21CommandKind kind);
+  void drop(size_t i);
+  // Newest command of a kind not yet final
+  S21Command *pending(S21CommandKind kind);
+  void supersede(S21CommandKind kind, uint32_t newerThan);
+  void finish(S21Command &c, S21CommandStatus status, unsigned long now);
+  void changed(S21Command &c);
+
+private:
+  S21Command history[S21_COMMAND_HISTORY];
+  size_t head = 0; // Oldest
+  size_t used = 0;
+  uint32_t nextId = 1;
+  uint32_t seq = 0;
+  S21CommandStats stats = {};
+  void (*updateListener)(const S21Command &) = nullptr;
+};
+
+extern S21CommandQueue Commands;
+
+#endif // S21_COMMANDS_H
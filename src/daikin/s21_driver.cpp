@@ -1,7 +1,15 @@
 #include "s21_driver.h"
+#include "../system/clock.h"
 #include "../system/config.h"
+#include "../system/heap_tracker.h"
+#include "../system/idle.h"
 #include "../system/logger.h"
+#include "../system/trace.h"
 #include "daikin_state.h"
+#include "s21_codec.h"
+#include "s21_commands.h"
+#include "s21_line.h"
+#include "s21_queries.h"
 
 S21Driver S21;
 
@@ -26,47 +34,125 @@ S21Driver S21;
 #define STATE_WAIT_RH 17
 #define STATE_INIT_RA 18
 #define STATE_WAIT_RA 19
+#define STATE_INIT_FY 20
+#define STATE_WAIT_FY 21
 #define STATE_IDLE 100
+#define STATE_HALTED 102 // Even: not a WAIT state, nothing is sent
+#define STATE_PASSIVE 104 // Listen only, see setPassive()
+
+// Handshake: a request without ACK is sent again after this
+#define S21_ACK_TIMEOUT_MS 1000
+// Poller timing
+#define S21_QUERY_TIMEOUT_MS 500 // Max wait for a response
+#define S21_QUERY_GAP_MS 50      // Small gap between commands
+// Our own frame read back on a shared line arrives within a few byte times
+#define S21_ECHO_WINDOW_MS 100
+// Frames are sent back to back; a partial frame followed by this much
+// silence lost its ETX to noise and would swallow the next frame
+#define S21_FRAME_GAP_MS 50
 
 // Internal flags (file scope, since we didn't add them to header)
 static bool g_ackReceived = false;
 static bool g_nakReceived = false;
+static bool g_frameReceived = false; // A full STX..ETX frame was decoded
+static uint8_t g_frameType[2] = {0, 0};
 
 void S21Driver::begin() {
   LOG("[S21] Initializing S21 Driver (Faikout Logic)...");
 
   // Hardware Setup
   pinMode(S21_RX_PIN, INPUT_PULLUP);
-  Serial1.begin(S21_BAUD_RATE, S21_CONFIG, S21_RX_PIN, S21_TX_PIN);
+  // RX interrupt per byte (FIFO threshold 1), so arrival times and UART
+  // errors can be placed within a frame
+  Serial1.begin(S21_BAUD_RATE, S21_CONFIG, S21_RX_PIN, S21_TX_PIN, false,
+                20000UL, 1);
+  Line.begin();
 
   // Init State
-  protocolState = STATE_INIT_D20;
+  protocolState = passive ? STATE_PASSIVE : STATE_INIT_D20;
   lastActionTime = millis();
   lastSuccessTime =
       millis(); // Assume connected at start to avoid immediate red error
   g_ackReceived = false;
 
   delay(100);
-  LOG("[S21] Ready. RX:%d TX:%d", S21_RX_PIN, S21_TX_PIN);
+  LOG("[S21] Ready. RX:%d TX:%d%s", S21_RX_PIN, S21_TX_PIN,
+      passive ? " (passive, listen only)" : "");
 }
 
 void S21Driver::loop() {
+  HEAP_SCOPE("s21");
   // 1. Process Incoming Data
-  while (Serial1.available()) {
-    processByte(Serial1.read());
+  {
+    TRACE_SCOPE("s21.rx");
+    while (Serial1.available()) {
+      uint8_t byte = Serial1.read();
+      Line.noteByte(byte, rxIndex);
+      processByte(byte);
+      lastRxTime = millis();
+    }
+    if (rxIndex > 0 && msSince(lastRxTime) > S21_FRAME_GAP_MS) {
+      Line.noteFrame(false);
+      rxIndex = 0;
+    }
   }
+  Line.loop();
+  Commands.expire(millis());
 
   // 2. Manage Protocol State
+  TRACE_SCOPE("s21.poll");
   pollState();
+  scheduleIdle(millis());
+}
+
+// Time left until deadline, from a start and a duration
+static uint32_t remainingMs(unsigned long now, unsigned long start,
+                            uint32_t duration) {
+  uint32_t spent = elapsedMs(now, start);
+  return spent < duration ? duration - spent + 1 : 0;
+}
+
+// Received bytes wake the loop by themselves; tell it when the driver has
+// to act without one
+void S21Driver::scheduleIdle(unsigned long now) {
+  if (rxIndex > 0)
+    Idle.within(remainingMs(now, lastRxTime, S21_FRAME_GAP_MS));
+
+  if (protocolState < STATE_IDLE) {
+    if (protocolState % 2 == 0)
+      Idle.busy(); // Next request goes out now
+    else
+      Idle.within(remainingMs(now, lastActionTime, S21_ACK_TIMEOUT_MS));
+  } else if (protocolState == STATE_IDLE && !pendingQuery &&
+             (activeCommandId || Commands.next())) {
+    const S21Command *c = Commands.find(activeCommandId);
+    uint32_t wait = S21_QUERY_GAP_MS;
+    if (c && (c->status == S21_CMD_SENT || commandReadback))
+      wait = S21_QUERY_TIMEOUT_MS;
+    else if (c && c->readbacks)
+      wait = S21_COMMAND_READBACK_GAP_MS;
+    Idle.within(remainingMs(now, lastActionTime, wait));
+  } else if (protocolState == STATE_IDLE && pollActive) {
+    if (pendingQuery)
+      Idle.within(remainingMs(now, lastActionTime, S21_QUERY_TIMEOUT_MS));
+    else
+      Idle.within(remainingMs(now, lastActionTime, S21_QUERY_GAP_MS));
+  }
 }
 
 void S21Driver::pollState() {
   unsigned long now = millis();
 
   // Timeout handling for waits
-  if (protocolState % 2 != 0) {        // Odd states are WAIT states
-    if (now - lastActionTime > 1000) { // 1 second timeout
+  if (protocolState % 2 != 0) { // Odd states are WAIT states
+    if (elapsedMs(now, lastActionTime) > S21_ACK_TIMEOUT_MS) {
+      if (protocolState == STATE_WAIT_FY) {
+        // Some pre-v3 units don't answer FY at all: unsupported, go on
+        protocolState = STATE_INIT_F2;
+        return;
+      }
       Serial.println("Timeout waiting for ACK. Retrying...");
+      Line.noteTimeout();
       protocolState--; // Go back to SEND state
       return;
     }
@@ -75,7 +161,8 @@ void S21Driver::pollState() {
   // State Machine
   switch (protocolState) {
   case STATE_INIT_D20:
-    sendFrame((const uint8_t *)"D20", 3);
+    Protocol.reset(); // Could be a different unit after a power cycle
+    sendFrame<S21Frame<'D', '2', '0'>>();
     protocolState = STATE_WAIT_D20;
     lastActionTime = now;
     g_ackReceived = false;
@@ -90,7 +177,7 @@ void S21Driver::pollState() {
     break;
 
   case STATE_INIT_F8:
-    sendFrame((const uint8_t *)"F8", 2);
+    sendFrame<S21Frame<'F', '8'>>();
     protocolState = STATE_WAIT_F8;
     lastActionTime = now;
     g_ackReceived = false;
@@ -98,14 +185,30 @@ void S21Driver::pollState() {
 
   case STATE_WAIT_F8:
     if (g_ackReceived) {
-      Serial.println("Got ACK for F8. Moving to F2.");
+      Serial.println("Got ACK for F8. Moving to FY.");
+      delay(50);
+      protocolState = STATE_INIT_FY;
+    }
+    break;
+
+  case STATE_INIT_FY:
+    // Full protocol version, only v3+ units know it. Older ones NAK it
+    // or stay silent; either way the handshake goes on.
+    sendFrame<S21Frame<'F', 'Y'>>();
+    protocolState = STATE_WAIT_FY;
+    lastActionTime = now;
+    g_ackReceived = false;
+    g_nakReceived = false;
+    break;
+  case STATE_WAIT_FY:
+    if (g_ackReceived || g_nakReceived) {
       delay(50);
       protocolState = STATE_INIT_F2;
     }
     break;
 
   case STATE_INIT_F2:
-    sendFrame((const uint8_t *)"F2", 2);
+    sendFrame<S21Frame<'F', '2'>>();
     protocolState = STATE_WAIT_F2;
     lastActionTime = now;
     g_ackReceived = false;
@@ -118,7 +221,7 @@ void S21Driver::pollState() {
     break;
 
   case STATE_INIT_F4:
-    sendFrame((const uint8_t *)"F4", 2);
+    sendFrame<S21Frame<'F', '4'>>();
     protocolState = STATE_WAIT_F4;
     lastActionTime = now;
     g_ackReceived = false;
@@ -131,7 +234,7 @@ void S21Driver::pollState() {
     break;
 
   case STATE_INIT_F3:
-    sendFrame((const uint8_t *)"F3", 2);
+    sendFrame<S21Frame<'F', '3'>>();
     protocolState = STATE_WAIT_F3;
     lastActionTime = now;
     g_ackReceived = false;
@@ -144,7 +247,7 @@ void S21Driver::pollState() {
     break;
 
   case STATE_INIT_F1:
-    sendFrame((const uint8_t *)"F1", 2);
+    sendFrame<S21Frame<'F', '1'>>();
     protocolState = STATE_WAIT_F1;
     lastActionTime = now;
     g_ackReceived = false;
@@ -157,7 +260,7 @@ void S21Driver::pollState() {
     break;
 
   case STATE_INIT_F5:
-    sendFrame((const uint8_t *)"F5", 2);
+    sendFrame<S21Frame<'F', '5'>>();
     protocolState = STATE_WAIT_F5;
     lastActionTime = now;
     g_ackReceived = false;
@@ -170,7 +273,7 @@ void S21Driver::pollState() {
     break;
 
   case STATE_INIT_D8:
-    sendFrame((const uint8_t *)"D80000", 6);
+    sendFrame<S21Frame<'D', '8', '0', '0', '0', '0'>>();
     protocolState = STATE_WAIT_D8;
     lastActionTime = now;
     g_ackReceived = false;
@@ -185,7 +288,7 @@ void S21Driver::pollState() {
     break;
 
   case STATE_INIT_RH:
-    sendFrame((const uint8_t *)"RH", 2);
+    sendFrame<S21Frame<'R', 'H'>>();
     protocolState = STATE_WAIT_RH;
     lastActionTime = now;
     g_ackReceived = false;
@@ -198,7 +301,7 @@ void S21Driver::pollState() {
     break;
 
   case STATE_INIT_RA:
-    sendFrame((const uint8_t *)"Ra", 2);
+    sendFrame<S21Frame<'R', 'a'>>();
     protocolState = STATE_WAIT_RA;
     lastActionTime = now;
     g_ackReceived = false;
@@ -206,40 +309,279 @@ void S21Driver::pollState() {
   case STATE_WAIT_RA:
     if (g_ackReceived) {
       Serial.println("Init Sequence Complete! Entering Idle Loop.");
+      Protocol.selectCodec(); // G8/GY arrived during the handshake
       protocolState = STATE_IDLE;
+      handshakeReplyDue = true;
     }
     break;
 
   case STATE_IDLE:
-    // In IDLE, we no longer auto-poll. Just wait for explicit pollNow() calls.
+    // In IDLE, we no longer auto-poll. Just run cycles asked by requestPoll().
+    // Commands go first, between two poll queries.
+    if (!pendingQuery && stepCommand(now))
+      break;
+    if (pollActive)
+      stepPoll(now);
     break;
   }
 }
 
-// On-demand polling: sends key queries and waits for responses
+void S21Driver::requestPoll() {
+  if (protocolState != STATE_IDLE || pollActive)
+    return;
+  pollActive = true;
+  pollSlowPhase = false;
+  pollIndex = 0;
+  pollStart = millis();
+  slowDue = (pollCycle % S21_SLOW_POLL_DIVIDER) == 0;
+  pollCycle++;
+}
+
+bool S21Driver::isPolling() { return pollActive; }
+
+bool S21Driver::isReady() { return protocolState == STATE_IDLE; }
+
+unsigned long S21Driver::pollRunTime() {
+  return pollActive ? msSince(pollStart) : 0;
+}
+
+void S21Driver::restart() {
+  halt();
+  handshakeReplyDue = false;
+  if (passive) {
+    protocolState = STATE_PASSIVE;
+    return;
+  }
+  LOG("[S21] Restarting handshake");
+  protocolState = STATE_INIT_D20;
+}
+
+void S21Driver::setPassive(bool enable) {
+  if (enable == passive)
+    return;
+  passive = enable;
+  LOG("[S21] %s mode", passive ? "Passive (listen only)" : "Active");
+  Protocol.reset(); // Passive learns the version from the other master
+  restart();
+}
+
+bool S21Driver::contention() {
+  return traffic.foreignRequests > 0 &&
+         msSince(lastForeign) < S21_CONTENTION_WINDOW_MS;
+}
+
+void S21Driver::halt() {
+  if (S21Command *c = Commands.find(activeCommandId))
+    Commands.interrupted(*c);
+  activeCommandId = 0;
+  commandReadback = false;
+  protocolState = STATE_HALTED;
+  pollActive = false;
+  pendingQuery = nullptr;
+  missStreak = 0;
+  rejectStreak = 0;
+  rxIndex = 0;
+  lastActionTime = millis();
+}
+
+unsigned long S21Driver::pollAge() { return msSince(lastPollDone); }
+
+// On-demand polling: runs a full cycle before returning
 void S21Driver::pollNow() {
-  const char *cmds[] = {"Ra", "RH", "F1", "F5"};
-  const int numCmds = 4;
+  requestPoll();
+  while (pollActive) {
+    loop();
+    delay(1);
+  }
+}
 
-  for (int i = 0; i < numCmds; i++) {
-    g_ackReceived = false;
-    sendFrame((const uint8_t *)cmds[i], strlen(cmds[i]));
+// Fast queries every cycle, slow ones round-robin with whatever is left of
+// the bus budget
+const S21Query *S21Driver::nextQuery(unsigned long now) {
+  unsigned long spent = elapsedMs(now, pollStart);
+
+  while (!pollSlowPhase) {
+    if (pollIndex >= S21_QUERY_COUNT) {
+      if (!slowDue)
+        return nullptr;
+      pollSlowPhase = true;
+      pollIndex = 0;
+      break;
+    }
+    size_t i = pollIndex++;
+    const S21Query &q = S21_QUERIES[i];
+    if (q.pollClass != S21_POLL_FAST || !Protocol.isSupported(i))
+      continue;
+    if (spent + q.costMs > S21_POLL_BUDGET_MS)
+      return nullptr;
+    return &q;
+  }
+
+  while (pollIndex < S21_QUERY_COUNT) {
+    size_t i = (slowCursor + pollIndex) % S21_QUERY_COUNT;
+    const S21Query &q = S21_QUERIES[i];
+    if (q.pollClass != S21_POLL_SLOW || !Protocol.isSupported(i)) {
+      pollIndex++;
+      continue;
+    }
+    if (spent + q.costMs > S21_POLL_BUDGET_MS) {
+      slowCursor = i; // Resume here next cycle
+      return nullptr;
+    }
+    pollIndex++;
+    return &q;
+  }
+  slowCursor = 0;
+  return nullptr;
+}
+
+void S21Driver::stepPoll(unsigned long now) {
+  if (pendingQuery) {
+    // Wait for the matching response frame (up to 500ms per command).
+    // Units that don't support a query NAK it, no point waiting then.
+    bool answered = g_frameReceived && g_frameType[0] == pendingQuery->rsp[0] &&
+                    g_frameType[1] == pendingQuery->rsp[1];
+    if (!answered && !g_nakReceived &&
+        elapsedMs(now, lastActionTime) < S21_QUERY_TIMEOUT_MS)
+      return;
+    size_t index = pendingQuery - S21_QUERIES;
+    if (answered) {
+      missStreak = 0;
+      rejectStreak = 0;
+      Protocol.noteAnswered(index);
+    } else if (g_nakReceived) {
+      rejectStreak++;
+      Protocol.noteRejected(index);
+    } else {
+      missStreak++;
+      Line.noteTimeout();
+    }
+    pendingQuery = nullptr;
+    lastActionTime = now; // Start of the inter-command gap
+    return;
+  }
+
+  if (elapsedMs(now, lastActionTime) < S21_QUERY_GAP_MS)
+    return;
 
-    // Wait for response (up to 500ms per command)
-    unsigned long start = millis();
-    while (!g_ackReceived && (millis() - start) < 500) {
-      while (Serial1.available()) {
-        processByte(Serial1.read());
+  const S21Query *q = nextQuery(now);
+  if (!q) {
+    pollActive = false;
+    lastPollDone = now;
+    return;
+  }
+
+  g_ackReceived = false;
+  g_nakReceived = false;
+  g_frameReceived = false;
+  write(q->frame, S21_QUERY_FRAME_LEN);
+  pendingQuery = q;
+  lastActionTime = now;
+}
+
+bool S21Driver::stepCommand(unsigned long now) {
+  S21Command *c = Commands.find(activeCommandId);
+  if (!c) {
+    c = Commands.next();
+    if (!c)
+      return false;
+    if (elapsedMs(now, lastActionTime) >= S21_QUERY_GAP_MS) {
+      activeCommandId = c->id;
+      commandStart = now;
+      sendCommand(*c, now);
+    }
+    return true; // Hold the bus for it during the gap
+  }
+
+  if (c->status == S21_CMD_SENT) {
+    if (g_ackReceived) {
+      missStreak = 0;
+      Commands.acked(*c, now);
+      lastActionTime = now; // Gap before the readback
+    } else if (g_nakReceived ||
+               elapsedMs(now, lastActionTime) >= S21_QUERY_TIMEOUT_MS) {
+      if (!g_nakReceived) {
+        missStreak++;
+        Line.noteTimeout();
       }
-      delay(10);
+      Commands.rejected(*c, g_nakReceived, now);
+      endCommand(now);
     }
-    delay(50); // Small gap between commands
+    return true;
+  }
+
+  // ACKed: read the state back until it shows the command (handleFrame)
+  if (!commandReadback) {
+    uint32_t gap =
+        c->readbacks ? S21_COMMAND_READBACK_GAP_MS : S21_QUERY_GAP_MS;
+    if (elapsedMs(now, lastActionTime) >= gap) {
+      g_nakReceived = false;
+      if (c->kind == S21_CMD_SWING)
+        sendFrame<S21Frame<'F', '5'>>();
+      else
+        sendFrame<S21Frame<'F', '1'>>();
+      commandReadback = true;
+      lastActionTime = now;
+    }
+  } else if (g_nakReceived ||
+             elapsedMs(now, lastActionTime) >= S21_QUERY_TIMEOUT_MS) {
+    Commands.readback(*c, nullptr, 0, now);
+    commandReadback = false;
+    lastActionTime = now;
+    if (c->isDone())
+      endCommand(now);
   }
+  return true;
+}
+
+// D1 / D5, encoded now: the codec may have changed since it was queued
+void S21Driver::sendCommand(S21Command &c, unsigned long now) {
+  uint8_t frame[s21FrameLength(6)];
+  uint8_t *payload = frame + 1;
+  payload[0] = 'D';
+  if (c.kind == S21_CMD_SWING) {
+    payload[1] = '5';
+    Protocol.codec().encodeSwing(payload + 2, c.swingV, c.swingH);
+    LOG("Sending Swing Packet #%lu: V=%d H=%d (byte0=%c byte1=%c)",
+        (unsigned long)c.id, c.swingV, c.swingH, payload[2], payload[3]);
+  } else {
+    payload[1] = '1';
+    Protocol.codec().encodeState(payload + 2, c.power, c.mode, c.temp, c.fan);
+    LOG("Sending Set Packet #%lu: Power=%s, Mode=%c, Temp=%d, Fan=%c (%s)",
+        (unsigned long)c.id, c.power ? "ON" : "OFF", payload[3], payload[4],
+        payload[5], Protocol.codec().name);
+  }
+  g_ackReceived = false;
+  g_nakReceived = false;
+  write(frame, s21SealFrame(frame, 6));
+  Commands.sent(c, payload + 2);
+  lastActionTime = now;
+}
+
+// The poll budget and the stuck-cycle check count poll time only
+void S21Driver::endCommand(unsigned long now) {
+  if (pollActive) {
+    uint32_t spent = elapsedMs(now, commandStart);
+    pollStart += min(spent, elapsedMs(now, pollStart));
+  }
+  activeCommandId = 0;
+  commandReadback = false;
+  lastActionTime = now;
 }
 
 void S21Driver::write(const uint8_t *data, size_t len) {
   if (len == 0)
     return;
+  if (passive) {
+    traffic.txBlocked++;
+    return;
+  }
+  Line.noteRequest(len, true);
+  if (len <= sizeof(lastTx)) {
+    memcpy(lastTx, data, len);
+    lastTxLen = len;
+    lastTxTime = millis();
+  }
   Serial.print("TX: 0x");
   for (size_t i = 0; i < len; i++) {
     if (data[i] < 0x10)
@@ -251,27 +593,11 @@ void S21Driver::write(const uint8_t *data, size_t len) {
 }
 
 void S21Driver::sendFrame(const uint8_t *payload, size_t len) {
-  uint8_t frame[64];
-  size_t idx = 0;
-
-  frame[idx++] = 0x02; // STX
-
-  uint8_t checksum = 0;
-  for (size_t i = 0; i < len; i++) {
-    frame[idx++] = payload[i];
-    checksum += payload[i];
-  }
-
-  // Faikout Checksum Rule: If 0x03, replace with 0x05
-  if (checksum == 0x03) {
-    // Serial.println("Checksum corrected (0x03 -> 0x05)");
-    checksum = 0x05;
-  }
-
-  frame[idx++] = checksum;
-  frame[idx++] = 0x03; // ETX
-
-  write(frame, idx);
+  if (len > S21_MAX_PAYLOAD)
+    return;
+  uint8_t frame[s21FrameLength(S21_MAX_PAYLOAD)];
+  memcpy(frame + 1, payload, len);
+  write(frame, s21SealFrame(frame, len));
 }
 
 uint8_t S21Driver::calculateChecksum(const uint8_t *data, size_t len) {
@@ -306,6 +632,7 @@ void S21Driver::processByte(uint8_t byte) {
       if (rxBuffer[0] == 0x06) {
         Serial.print(" (ACK Start)");
         g_ackReceived = true;
+        Line.noteAck();
         lastSuccessTime = millis(); // Valid, connected
       } // Some ACKs are separate?
     }
@@ -319,9 +646,7 @@ void S21Driver::processByte(uint8_t byte) {
     } else if (rxBuffer[0] == 0x02) {
       frameStart = 0;
     }
-
-    State.decodeFrame(&rxBuffer[frameStart], rxIndex - frameStart);
-    lastSuccessTime = millis(); // Valid frame received
+    handleFrame(&rxBuffer[frameStart], rxIndex - frameStart);
 
     // 4. Reset Buffer
     rxIndex = 0;
@@ -336,16 +661,85 @@ void S21Driver::processByte(uint8_t byte) {
   if (byte == 0x06 && rxIndex == 1) { // Single byte ACK
     Serial.println("RX: ACK (Single Byte)");
     g_ackReceived = true;
+    Line.noteAck();
     lastSuccessTime = millis();
     rxIndex = 0; // Reset
   } else if (byte == 0x15 && rxIndex == 1) {
     Serial.println("RX: NAK");
     g_nakReceived = true;
+    Line.noteAck();
     rxIndex = 0;
   }
 }
 
+void S21Driver::handleFrame(const uint8_t *frame, size_t len) {
+  unsigned long now = millis();
+
+  // Our own request read back (TX and RX on one wire). Same length in the
+  // echo window but different bytes: our request, garbled on the line.
+  if (len == lastTxLen && elapsedMs(now, lastTxTime) < S21_ECHO_WINDOW_MS) {
+    Line.noteEcho(len, memcmp(frame, lastTx, len) == 0);
+    lastTxLen = 0;
+    return;
+  }
+
+  // Corrupted frames would feed garbage into the state
+  bool valid = Line.frameValid(frame, len);
+  Line.noteFrame(valid);
+  if (!valid)
+    return;
+  traffic.frames++;
+  lastSuccessTime = now; // Valid frame received
+
+  // Requests (F query, D command, R read) only come from a bus master. In
+  // passive mode that's expected; otherwise someone else is polling too.
+  uint8_t type = len >= 3 ? frame[1] : 0;
+  if (type == 'F' || type == 'D' || type == 'R') {
+    if (passive) {
+      Line.noteRequest(len, false);
+      if (type == 'D') {
+        traffic.commandsSeen++;
+        State.decodeCommand(frame, len);
+      }
+      return;
+    }
+    if (!contention()) {
+      LOG("[S21] Another master is using the bus, consider passive mode");
+    }
+    traffic.foreignRequests++;
+    lastForeign = now;
+    return;
+  }
+
+  // The handshake moves on at the ACK, so its replies arrive "late"
+  if (!passive && !pendingQuery && !commandReadback &&
+      protocolState == STATE_IDLE && !handshakeReplyDue)
+    traffic.unsolicited++;
+  handshakeReplyDue = false;
+  Line.noteReply(len);
+  State.decodeFrame(frame, len);
+  S21Command *c = commandReadback ? Commands.find(activeCommandId) : nullptr;
+  if (c && type == 'G' && frame[2] == (c->kind == S21_CMD_SWING ? '5' : '1')) {
+    Commands.readback(*c, frame + 3, len - 5, now);
+    commandReadback = false;
+    lastActionTime = now;
+    if (c->isDone())
+      endCommand(now);
+  }
+  if (len >= 3) {
+    g_frameType[0] = frame[1];
+    g_frameType[1] = frame[2];
+    g_frameReceived = true;
+  }
+
+  if (passive) {
+    lastPollDone = now; // State follows the other master's polls
+    if (type == 'G' && (frame[2] == '8' || frame[2] == 'Y'))
+      Protocol.selectCodec();
+  }
+}
+
 bool S21Driver::isConnected() {
   // If no valid packet/ACK in last 10 seconds, consider disconnected
-  return (millis() - lastSuccessTime) < 10000;
+  return msSince(lastSuccessTime) < 10000;
 }
@@ -1,8 +1,32 @@
 #ifndef S21_DRIVER_H
 #define S21_DRIVER_H
 
+#include "../system/config.h"
+#include "s21_frame.h"
 #include <Arduino.h>
 
+// Listen only: never transmit, follow the traffic of another bus master
+// (official WiFi adapter, wall controller). Can be changed at runtime.
+#ifndef S21_PASSIVE
+#define S21_PASSIVE 0
+#endif
+// Requests from another master within this window = contention
+#ifndef S21_CONTENTION_WINDOW_MS
+#define S21_CONTENTION_WINDOW_MS 60000
+#endif
+
+struct S21Query;
+struct S21Command;
+
+// What the driver saw on the bus besides its own transactions
+struct S21Traffic {
+  uint32_t frames;          // Complete frames, own echo excluded
+  uint32_t foreignRequests; // Requests we didn't send: another master
+  uint32_t unsolicited;     // Replies while we weren't waiting for one
+  uint32_t commandsSeen;    // D1/D5 of the other master (passive mode)
+  uint32_t txBlocked;       // Writes dropped in passive mode
+};
+
 class S21Driver {
 public:
   // Initialize the driver (pins, serial port)
@@ -18,22 +42,80 @@ public:
   // Send a basic status poll command (Command 'F')
   void pollState();
 
+  // Start a background poll cycle (non-blocking). The cycle runs the query
+  // registry within S21_POLL_BUDGET_MS of bus time, driven by loop().
+  // No-op while the init sequence runs or a cycle is already active.
+  void requestPoll();
+
+  // A background poll cycle is in progress
+  bool isPolling();
+
+  // Milliseconds since the last poll cycle completed
+  unsigned long pollAge();
+
   // Poll status on-demand (blocking, refresh State)
   void pollNow();
 
   // Helper to construct and send valid S21 Frames (Public for control)
   void sendFrame(const uint8_t *payload, size_t len);
 
+  // Send a constant frame built at compile time, e.g.
+  // sendFrame<S21Frame<'F', '1'>>()
+  template <typename Frame> void sendFrame() {
+    write(Frame::bytes, Frame::LENGTH);
+  }
+
   // Check if we have received valid data recently (timeout 10s)
   bool isConnected();
 
+  // Recovery hooks for S21Supervisor
+  // Drop any transaction in progress and run the init handshake again
+  void restart();
+  // Stop all bus traffic until restart()
+  void halt();
+  // Handshake done, polls and commands accepted
+  bool isReady();
+  // Milliseconds the current poll cycle has been running (0 if none)
+  unsigned long pollRunTime();
+  // Consecutive poll queries that timed out / were NAKed. Reset by any
+  // answered query.
+  uint8_t missedStreak() { return missStreak; }
+  uint8_t nakStreak() { return rejectStreak; }
+
+  // Passive mode: decode the other master's requests and the unit's
+  // replies, never write. Switching back runs the handshake.
+  void setPassive(bool enable);
+  bool isPassive() { return passive; }
+
+  // Another master polled the bus recently (both of us active)
+  bool contention();
+  const S21Traffic &getTraffic() { return traffic; }
+
 private:
   // Internal method to handle received byte
   void processByte(uint8_t byte);
 
+  // Advance the background poll cycle (IDLE state only)
+  void stepPoll(unsigned long now);
+
+  // Advance the transaction of the oldest queued control command (IDLE
+  // state only). False when the bus is free for the poller.
+  bool stepCommand(unsigned long now);
+  void sendCommand(S21Command &c, unsigned long now);
+  void endCommand(unsigned long now);
+
+  // Earliest time loop() needs to run again (see IdlePolicy)
+  void scheduleIdle(unsigned long now);
+
+  // Next query of the current cycle, nullptr when done or out of budget
+  const S21Query *nextQuery(unsigned long now);
+
   // Calculate Checksum (Mod 256 of sum of bytes)
   uint8_t calculateChecksum(const uint8_t *data, size_t len);
 
+  // A complete frame from the bus: echo, foreign request or reply
+  void handleFrame(const uint8_t *frame, size_t len);
+
 private:
   // Protocol State Machine
   int protocolState = 0;
@@ -43,6 +125,34 @@ private:
   // RX Buffer
   uint8_t rxBuffer[64];
   int rxIndex = 0;
+  unsigned long lastRxTime = 0;
+
+  // Poller
+  bool pollActive = false;
+  bool pollSlowPhase = false;
+  bool slowDue = false;
+  uint32_t pollCycle = 0;
+  size_t pollIndex = 0;
+  size_t slowCursor = 0; // Next slow query, carried over between cycles
+  unsigned long pollStart = 0;
+  unsigned long lastPollDone = 0;
+  const S21Query *pendingQuery = nullptr; // Sent, waiting for response
+  uint8_t missStreak = 0;
+  uint8_t rejectStreak = 0;
+
+  // Control command on the bus (0 = none), see S21CommandQueue
+  uint32_t activeCommandId = 0;
+  bool commandReadback = false; // F1/F5 sent, waiting for G1/G5
+  unsigned long commandStart = 0;
+
+  // Bus observation
+  bool passive = S21_PASSIVE;
+  bool handshakeReplyDue = false; // Ra ACKed, its reply comes in IDLE
+  S21Traffic traffic = {};
+  unsigned long lastForeign = 0;
+  uint8_t lastTx[s21FrameLength(S21_MAX_PAYLOAD)]; // To recognise our echo
+  size_t lastTxLen = 0;
+  unsigned long lastTxTime = 0;
 };
 
 // Global instance declaration if needed, or just use singleton pattern
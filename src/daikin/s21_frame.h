@@ -0,0 +1,58 @@
+#ifndef S21_FRAME_H
+#define S21_FRAME_H
+
+#include <Arduino.h>
+
+// S21 framing: STX <payload> <checksum> ETX. The checksum is the byte sum of
+// the payload, with 0x03 sent as 0x05 so it can't be mistaken for ETX.
+#define S21_STX 0x02
+#define S21_ETX 0x03
+#define S21_MAX_PAYLOAD 16
+
+constexpr size_t s21FrameLength(size_t payloadLen) { return payloadLen + 3; }
+
+constexpr uint8_t s21FixChecksum(uint8_t sum) {
+  return sum == S21_ETX ? 0x05 : sum;
+}
+
+constexpr uint8_t s21Sum() { return 0; }
+
+template <typename... Rest>
+constexpr uint8_t s21Sum(char first, Rest... rest) {
+  return (uint8_t)(first + s21Sum(rest...));
+}
+
+// Complete frame for a constant command, built by the compiler:
+//   S21Frame<'F', '1'>::bytes == {0x02, 'F', '1', 0x77, 0x03}
+template <char... Payload> struct S21Frame {
+  static constexpr size_t LENGTH = s21FrameLength(sizeof...(Payload));
+  static constexpr uint8_t CHECKSUM = s21FixChecksum(s21Sum(Payload...));
+  static constexpr uint8_t bytes[LENGTH] = {S21_STX, (uint8_t)Payload...,
+                                            CHECKSUM, S21_ETX};
+
+  static_assert(sizeof...(Payload) > 0 && sizeof...(Payload) <= S21_MAX_PAYLOAD,
+                "S21 payload length out of range");
+  static_assert(CHECKSUM != S21_ETX, "S21 checksum must not be ETX");
+  static_assert(sizeof(bytes) == LENGTH, "S21 frame length mismatch");
+};
+
+template <char... Payload>
+constexpr uint8_t S21Frame<Payload...>::bytes[];
+
+// Every poll query is a 2-character command
+#define S21_QUERY_FRAME_LEN s21FrameLength(2)
+
+// Variable frames (D1, D5) are written in place: fill frame[1..len] with
+// the payload, then this adds STX, checksum and ETX around it. frame must
+// hold s21FrameLength(len) bytes. Returns the frame length.
+inline size_t s21SealFrame(uint8_t *frame, size_t payloadLen) {
+  uint8_t sum = 0;
+  for (size_t i = 1; i <= payloadLen; i++)
+    sum += frame[i];
+  frame[0] = S21_STX;
+  frame[payloadLen + 1] = s21FixChecksum(sum);
+  frame[payloadLen + 2] = S21_ETX;
+  return s21FrameLength(payloadLen);
+}
+
+#endif // S21_FRAME_H
@@ -0,0 +1,275 @@
+#include "s21_line.h"
+#include "../system/clock.h"
+#include "s21_frame.h"
+
+S21LineMonitor Line;
+
+const uint16_t S21_LATENCY_BOUNDS_MS[S21_LATENCY_BUCKETS] = {
+    10, 25, 50, 100, 150, 300, 0xFFFF};
+
+static const char *const VERDICT_NAMES[] = {"idle", "good", "noisy", "slow",
+                                            "no-reply"};
+static const char *const UART_ERROR_NAMES[] = {"parity", "framing", "break",
+                                               "overflow"};
+
+const char *s21LineVerdictName(S21LineVerdict verdict) {
+  return verdict <= S21_LINE_NO_REPLY ? VERDICT_NAMES[verdict] : "?";
+}
+
+const char *s21UartErrorName(S21UartError type) {
+  return type < S21_UART_ERROR_COUNT ? UART_ERROR_NAMES[type] : "?";
+}
+
+void S21Latency::add(uint32_t ms, const uint16_t *bounds) {
+  count++;
+  sumMs += ms;
+  if (ms > maxMs)
+    maxMs = min(ms, (uint32_t)0xFFFF);
+  size_t i = 0;
+  while (i < S21_LATENCY_BUCKETS - 1 && ms > bounds[i])
+    i++;
+  buckets[i]++;
+}
+
+uint32_t S21LineCounters::uartErrorTotal() const {
+  uint32_t sum = 0;
+  for (int i = 0; i < S21_UART_ERROR_COUNT; i++)
+    sum += uartErrors[i];
+  return sum;
+}
+
+// Both the lifetime totals and the current window
+#define LINE_COUNT(field)                                                      \
+  do {                                                                         \
+    total.field++;                                                             \
+    window.field++;                                                            \
+  } while (0)
+
+void S21LineMonitor::begin() {
+  windowStart = millis();
+  // Runs on the UART event task (the host bus calls it for noisy bytes)
+  Serial1.onReceiveError([](hardwareSerial_error_t error) {
+    switch (error) {
+    case UART_PARITY_ERROR:
+      Line.noteUartError(S21_UART_PARITY);
+      break;
+    case UART_FRAME_ERROR:
+      Line.noteUartError(S21_UART_FRAMING);
+      break;
+    case UART_BREAK_ERROR:
+      Line.noteUartError(S21_UART_BREAK);
+      break;
+    case UART_BUFFER_FULL_ERROR:
+    case UART_FIFO_OVF_ERROR:
+      Line.noteUartError(S21_UART_OVERFLOW);
+      break;
+    default:
+      break;
+    }
+  });
+}
+
+void S21LineMonitor::loop() {
+  drainErrors();
+  if (elapsedMs(millis(), windowStart) >= S21_LINE_WINDOW_MS)
+    closeWindow();
+}
+
+void S21LineMonitor::noteUartError(S21UartError type) {
+  if (type < S21_UART_ERROR_COUNT)
+    uartErrorsRaised[type] = uartErrorsRaised[type] + 1;
+}
+
+// Errors raised since the last call, pinned to where the frame was
+void S21LineMonitor::drainErrors() {
+  for (int i = 0; i < S21_UART_ERROR_COUNT; i++) {
+    uint32_t raised = uartErrorsRaised[i];
+    uint32_t fresh = raised - uartErrorsSeen[i];
+    if (!fresh)
+      continue;
+    uartErrorsSeen[i] = raised;
+    total.uartErrors[i] += fresh;
+    window.uartErrors[i] += fresh;
+
+    S21UartEvent &e = events[eventsRecorded % S21_LINE_EVENTS];
+    e.at = millis();
+    e.type = (S21UartError)i;
+    e.framePos = framePos;
+    e.lastByte = lastByte;
+    eventsRecorded++;
+  }
+}
+
+void S21LineMonitor::noteByte(uint8_t byte, size_t pos) {
+  drainErrors(); // Before this byte is counted: the error came earlier
+  uint32_t nowUs = micros();
+  LINE_COUNT(bytes);
+  if (pos > 0) {
+    uint32_t gap = nowUs - lastByteUs;
+    gaps.count++;
+    gaps.sumUs += gap;
+    if (gap > gaps.maxUs)
+      gaps.maxUs = gap;
+    if (gap > S21_GAP_STRETCH_US)
+      LINE_COUNT(stretchedGaps);
+  }
+  lastByteUs = nowUs;
+  lastByte = byte;
+  framePos = min(pos + 1, (size_t)0xFF);
+}
+
+void S21LineMonitor::noteRequest(size_t frameLen, bool ours) {
+  uint32_t nowUs = micros();
+  // Ours leaves the UART FIFO over the next frameLen byte times
+  requestEndUs = ours ? nowUs + frameLen * S21_BYTE_US : nowUs;
+  awaitingAck = true;
+  awaitingReply = true;
+  LINE_COUNT(requests);
+  if (ours) {
+    LINE_COUNT(sent);
+    total.txBytes += frameLen;
+    window.txBytes += frameLen;
+  }
+}
+
+// Latency from the end of the request, 0 if the answer beat our estimate
+static uint32_t latencyMs(uint32_t endUs, uint32_t startUs) {
+  int32_t us = (int32_t)(endUs - startUs);
+  return us > 0 ? us / 1000 : 0;
+}
+
+// ACK or NAK: either way the unit answered
+void S21LineMonitor::noteAck() {
+  LINE_COUNT(acks);
+  framePos = 0;
+  if (!awaitingAck)
+    return;
+  awaitingAck = false;
+  ack.add(latencyMs(micros(), requestEndUs));
+}
+
+void S21LineMonitor::noteReply(size_t frameLen) {
+  LINE_COUNT(replies);
+  if (!awaitingReply)
+    return;
+  awaitingReply = false;
+  awaitingAck = false;
+  // Time to the first byte of the reply
+  uint32_t ms = latencyMs(micros() - frameLen * S21_BYTE_US, requestEndUs);
+  reply.add(ms);
+  if (ms > S21_SLOW_REPLY_MS)
+    LINE_COUNT(slowReplies);
+}
+
+void S21LineMonitor::noteFrame(bool valid) {
+  LINE_COUNT(frames);
+  if (!valid)
+    LINE_COUNT(badFrames);
+  framePos = 0;
+}
+
+void S21LineMonitor::noteEcho(size_t frameLen, bool intact) {
+  total.echoBytes += frameLen;
+  window.echoBytes += frameLen;
+  if (intact)
+    LINE_COUNT(echoes);
+  else
+    LINE_COUNT(echoMismatches);
+  framePos = 0;
+}
+
+void S21LineMonitor::noteTimeout() {
+  LINE_COUNT(timeouts);
+  awaitingAck = false;
+  awaitingReply = false;
+}
+
+bool S21LineMonitor::frameValid(const uint8_t *frame, size_t len) {
+  if (len < s21FrameLength(1) || frame[0] != S21_STX ||
+      frame[len - 1] != S21_ETX)
+    return false;
+  uint8_t sum = 0;
+  for (size_t i = 1; i < len - 2; i++)
+    sum += frame[i];
+  return frame[len - 2] == s21FixChecksum(sum);
+}
+
+// Received bytes, plus what we sent unless it was read back as echo
+uint64_t S21LineMonitor::busyUs(const S21LineCounters &c) {
+  uint32_t onWire = c.bytes + c.txBytes - min(c.echoBytes, c.txBytes);
+  return (uint64_t)onWire * S21_BYTE_US;
+}
+
+uint64_t S21LineMonitor::busyMs() const { return busyUs(total) / 1000; }
+
+uint8_t S21LineMonitor::utilization() const {
+  uint32_t elapsed = elapsedMs(millis(), windowStart);
+  if (elapsed == 0)
+    return 0;
+  return min(busyUs(window) / 10 / elapsed, (uint64_t)100);
+}
+
+const char *S21LineMonitor::echoMode() const {
+  if (total.sent < 5)
+    return "unknown";
+  uint32_t readBack = total.echoes + total.echoMismatches;
+  if (readBack == 0)
+    return "none";
+  return readBack * 100 >= total.sent * 95 ? "full" : "partial";
+}
+
+// Wiring faults cost up to 70 points (5 per % of corrupted frames),
+// missing replies up to 30 (1 per % of requests), slow replies up to 10.
+// Gaps are left out: loop() stalls stretch them as well.
+S21LineScore S21LineMonitor::scoreOf(const S21LineCounters &c) {
+  S21LineScore s = {255, S21_LINE_IDLE};
+  if (c.bytes == 0 && c.sent == 0)
+    return s;
+  if (c.requests > 0 && c.frames == 0 && c.acks == 0) {
+    s.score = 0;
+    s.verdict = S21_LINE_NO_REPLY;
+    return s;
+  }
+
+  uint32_t corrupt = c.uartErrorTotal() + c.badFrames + c.echoMismatches;
+  uint32_t seen = max(1UL, (unsigned long)(c.frames + c.acks + c.echoes +
+                                           c.echoMismatches));
+  uint32_t corruptPct = corrupt * 100 / seen;
+  uint32_t missedPct = c.requests ? c.timeouts * 100 / c.requests : 0;
+  uint32_t slowPct = c.replies ? c.slowReplies * 100 / c.replies : 0;
+
+  uint32_t penalty = min(70UL, (unsigned long)corruptPct * 5) +
+                     min(30UL, (unsigned long)missedPct) +
+                     min(10UL, (unsigned long)slowPct / 5);
+  s.score = penalty >= 100 ? 0 : 100 - penalty;
+  if (corrupt > 0 && corrupt * 100 >= seen) // 1% or more
+    s.verdict = S21_LINE_NOISY;
+  else if (missedPct >= 5 || slowPct >= 20)
+    s.verdict = S21_LINE_SLOW;
+  else
+    s.verdict = S21_LINE_GOOD;
+  return s;
+}
+
+void S21LineMonitor::closeWindow() {
+  scores[scoresRecorded % S21_LINE_HISTORY] = scoreOf(window);
+  scoresRecorded++;
+  window = {};
+  windowStart = millis();
+}
+
+size_t S21LineMonitor::historyCount() const {
+  return min(scoresRecorded, (size_t)S21_LINE_HISTORY);
+}
+
+S21LineScore S21LineMonitor::history(size_t age) const {
+  return scores[(scoresRecorded - 1 - age) % S21_LINE_HISTORY];
+}
+
+size_t S21LineMonitor::eventCount() const {
+  return min(eventsRecorded, (size_t)S21_LINE_EVENTS);
+}
+
+const S21UartEvent &S21LineMonitor::event(size_t age) const {
+  return events[(eventsRecorded - 1 - age) % S21_LINE_EVENTS];
+}
@@ -0,0 +1,185 @@
+#ifndef S21_LINE_H
+#define S21_LINE_H
+
+#include "../system/config.h"
+#include <Arduino.h>
+
+// Line-quality analyzer for the S21 UART. Sorts what goes wrong on the
+// bus into wiring trouble (parity/framing/break errors, bad checksums, a
+// garbled echo of our own requests) and a slow or absent unit (late
+// replies, timeouts), and scores each window 0-100.
+
+// One score per window; the history keeps the last S21_LINE_HISTORY
+#ifndef S21_LINE_WINDOW_MS
+#define S21_LINE_WINDOW_MS 60000
+#endif
+#ifndef S21_LINE_HISTORY
+#define S21_LINE_HISTORY 60
+#endif
+// Recent UART error events kept for the report
+#ifndef S21_LINE_EVENTS
+#define S21_LINE_EVENTS 16
+#endif
+// Replies later than this (after the end of the request) count as slow
+#ifndef S21_SLOW_REPLY_MS
+#define S21_SLOW_REPLY_MS 150
+#endif
+
+// 8E2: start + 8 data + parity + 2 stop bits
+#define S21_BITS_PER_BYTE 12
+#define S21_BYTE_US (S21_BITS_PER_BYTE * 1000000UL / S21_BAUD_RATE)
+// A gap inside a frame longer than this means the sender stalled or a
+// byte was lost
+#define S21_GAP_STRETCH_US (3 * S21_BYTE_US)
+
+enum S21UartError : uint8_t {
+  S21_UART_PARITY,
+  S21_UART_FRAMING,
+  S21_UART_BREAK,
+  S21_UART_OVERFLOW, // RX FIFO or ring buffer full: we read too slowly
+  S21_UART_ERROR_COUNT
+};
+
+enum S21LineVerdict : uint8_t {
+  S21_LINE_IDLE,     // No traffic in the window
+  S21_LINE_GOOD,
+  S21_LINE_NOISY,    // Corrupted bytes or frames: cable, levels, ground
+  S21_LINE_SLOW,     // Clean bytes, but late or missing replies: the unit
+  S21_LINE_NO_REPLY, // Requests sent, nothing came back
+};
+
+// Latency histogram, bucket upper bounds in S21_LATENCY_BOUNDS_MS unless
+// the owner passes its own
+#define S21_LATENCY_BUCKETS 7
+extern const uint16_t S21_LATENCY_BOUNDS_MS[S21_LATENCY_BUCKETS];
+struct S21Latency {
+  uint32_t count;
+  uint32_t sumMs;
+  uint16_t maxMs;
+  uint32_t buckets[S21_LATENCY_BUCKETS];
+
+  void add(uint32_t ms, const uint16_t *bounds = S21_LATENCY_BOUNDS_MS);
+  uint16_t averageMs() const { return count ? sumMs / count : 0; }
+};
+
+struct S21LineCounters {
+  uint32_t bytes;
+  uint32_t frames;    // Received, own echo excluded
+  uint32_t badFrames; // Checksum or framing (STX/ETX) wrong
+  uint32_t uartErrors[S21_UART_ERROR_COUNT];
+  uint32_t sent;      // Our requests
+  uint32_t requests;  // Timed: ours, or the other master's when passive
+  uint32_t acks;
+  uint32_t replies;
+  uint32_t timeouts;
+  uint32_t slowReplies;    // Later than S21_SLOW_REPLY_MS
+  uint32_t echoes;         // Our request read back intact
+  uint32_t echoMismatches; // Read back with different bytes
+  uint32_t stretchedGaps;  // Inter-byte gaps over S21_GAP_STRETCH_US
+  uint32_t txBytes;
+  uint32_t echoBytes; // Part of bytes: our own requests read back
+
+  uint32_t uartErrorTotal() const;
+};
+
+struct S21GapStats {
+  uint32_t count;
+  uint64_t sumUs;
+  uint32_t maxUs;
+};
+
+struct S21UartEvent {
+  uint32_t at; // millis()
+  S21UartError type;
+  uint8_t framePos; // Bytes of the frame received before the error
+  uint8_t lastByte; // Last byte read before the error
+};
+
+struct S21LineScore {
+  uint8_t score; // 0-100, 255 = window without traffic
+  S21LineVerdict verdict;
+};
+
+class S21LineMonitor {
+public:
+  // Hook the UART error callback. Call right after Serial1.begin().
+  void begin();
+
+  // Close the window when it's due. Call from loop().
+  void loop();
+
+  // Driver events. framePos: bytes of the current frame before this one.
+  void noteByte(uint8_t byte, size_t framePos);
+  // A request went out (ours: just queued, still being transmitted) or
+  // the other master's request was received (passive mode)
+  void noteRequest(size_t frameLen, bool ours);
+  void noteAck(); // ACK or NAK
+  void noteReply(size_t frameLen);
+  // Any frame received except our echo
+  void noteFrame(bool valid);
+  void noteEcho(size_t frameLen, bool intact);
+  void noteTimeout();
+  // From the UART event task (or a test). Only counts; the event is
+  // attributed to the current frame position by the next loop().
+  void noteUartError(S21UartError type);
+
+  // A complete frame: STX, payload, checksum, ETX
+  static bool frameValid(const uint8_t *frame, size_t len);
+
+  // Since boot
+  const S21LineCounters &totals() const { return total; }
+  const S21Latency &ackLatency() const { return ack; }
+  const S21Latency &replyLatency() const { return reply; }
+  const S21GapStats &byteGaps() const { return gaps; }
+  // Time the wire was busy in both directions, and as % of the window in
+  // progress
+  uint64_t busyMs() const;
+  uint8_t utilization() const;
+  // Echo wiring as seen so far: "unknown", "none", "full" or "partial"
+  const char *echoMode() const;
+
+  // The window in progress, and finished ones (0 = latest)
+  S21LineScore current() const { return scoreOf(window); }
+  size_t historyCount() const;
+  S21LineScore history(size_t age) const;
+
+  size_t eventCount() const;
+  const S21UartEvent &event(size_t age) const; // 0 = latest
+
+private:
+  static S21LineScore scoreOf(const S21LineCounters &c);
+  static uint64_t busyUs(const S21LineCounters &c);
+  void closeWindow();
+  void drainErrors();
+
+private:
+  S21LineCounters total = {};
+  S21LineCounters window = {};
+  S21Latency ack = {};
+  S21Latency reply = {};
+  S21GapStats gaps = {};
+  unsigned long windowStart = 0;
+
+  uint32_t lastByteUs = 0;
+  uint8_t lastByte = 0;
+  uint8_t framePos = 0;
+  uint32_t requestEndUs = 0;
+  bool awaitingAck = false;
+  bool awaitingReply = false;
+
+  // Only the UART event task writes raised, only loop() writes seen
+  volatile uint32_t uartErrorsRaised[S21_UART_ERROR_COUNT] = {};
+  uint32_t uartErrorsSeen[S21_UART_ERROR_COUNT] = {};
+
+  S21LineScore scores[S21_LINE_HISTORY];
+  size_t scoresRecorded = 0;
+  S21UartEvent events[S21_LINE_EVENTS];
+  size_t eventsRecorded = 0;
+};
+
+extern S21LineMonitor Line;
+
+const char *s21LineVerdictName(S21LineVerdict verdict);
+const char *s21UartErrorName(S21UartError type);
+
+#endif // S21_LINE_H
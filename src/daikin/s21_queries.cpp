@@ -0,0 +1,174 @@
+#include "s21_queries.h"
+#include "../system/config.h"
+#include "../system/logger.h"
+#include "daikin_state.h"
+#include "s21_codec.h"
+
+// Helper to parse Daikin's weird inverted text numbers
+// Format: "570+" -> "+075" -> 75
+// Format: "091+" -> "+190" -> 190
+static int parseInvertedInt(const uint8_t *ptr, size_t len) {
+  char buf[8];
+  if (len > sizeof(buf) - 1)
+    len = sizeof(buf) - 1;
+
+  // Reorder bytes: last first (sign ends up in front)
+  for (size_t i = 0; i < len; i++) {
+    buf[i] = ptr[len - 1 - i];
+  }
+  buf[len] = '\0';
+
+  return atoi(buf);
+}
+
+// Same as above, with 0.1C resolution
+static float parseInvertedDecimal(const uint8_t *ptr, size_t len) {
+  return parseInvertedInt(ptr, len) / 10.0;
+}
+
+// Hex digits, least significant first (e.g. "A300" -> 0x003A)
+static uint32_t parseInvertedHex(const uint8_t *ptr, size_t len) {
+  uint32_t val = 0;
+  for (size_t i = len; i > 0; i--) {
+    uint8_t c = ptr[i - 1];
+    uint8_t nibble = 0;
+    if (c >= '0' && c <= '9')
+      nibble = c - '0';
+    else if (c >= 'A' && c <= 'F')
+      nibble = c - 'A' + 10;
+    val = (val << 4) | nibble;
+  }
+  return val;
+}
+
+// G1: Power, Mode, Temp, Fan. Encoding depends on the unit generation.
+static void decodeG1(DaikinState &s, const uint8_t *p, size_t len) {
+  Protocol.codec().decodeState(s, p, len);
+}
+
+// G5: Swing
+static void decodeG5(DaikinState &s, const uint8_t *p, size_t len) {
+  if (len < 1)
+    return;
+  uint8_t swingVal = p[0] - '0';
+  s.swingV = (swingVal & 1) != 0;
+  s.swingH = (swingVal & 2) != 0;
+  LOG("Parsed Swing (G5): V=%d H=%d", s.swingV, s.swingH);
+}
+
+// G6: Special modes (byte 0 bit 1 = Powerful)
+static void decodeG6(DaikinState &s, const uint8_t *p, size_t len) {
+  if (len < 1)
+    return;
+  s.powerful = (p[0] & 0x02) != 0;
+  LOG("Parsed Powerful (G6): %d", s.powerful);
+}
+
+// G7: Demand/Econo (byte 1 = '2' when Econo is active)
+static void decodeG7(DaikinState &s, const uint8_t *p, size_t len) {
+  if (len < 2)
+    return;
+  s.econo = (p[1] == '2');
+  LOG("Parsed Econo (G7): %d", s.econo);
+}
+
+// GM: Energy meter (Hypothesis: inverted hex, 0.1 kWh units)
+static void decodeGM(DaikinState &s, const uint8_t *p, size_t len) {
+  if (len < 4)
+    return;
+  s.energyKWh = parseInvertedHex(p, 4) / 10.0;
+  LOG("Parsed Energy (GM): %.1f kWh", s.energyKWh);
+}
+
+// G8: Protocol version, major in byte 1 (Hypothesis: "0200" = v2)
+static void decodeG8(DaikinState &, const uint8_t *p, size_t len) {
+  if (len < 2 || p[1] < '0' || p[1] > '9')
+    return;
+  Protocol.setMajor(p[1] - '0');
+}
+
+// GY: Full protocol version on v3+ units, inverted digits ("0230" = 3.20)
+static void decodeGY(DaikinState &, const uint8_t *p, size_t len) {
+  if (len < 4)
+    return;
+  int version = parseInvertedInt(p, 4);
+  if (version > 0)
+    Protocol.setVersion(version);
+}
+
+// SH: Room Temperature
+// Frame: 02 S H [0 9 1 +] CS 03
+static void decodeSH(DaikinState &s, const uint8_t *p, size_t len) {
+  if (len < 4)
+    return;
+  float val = parseInvertedDecimal(p, 4);
+  s.roomTemp = val;
+  LOG("Parsed Room Temp (SH): %.1f C", val);
+}
+
+// Sa: Outside Temperature
+// Frame: 02 S a [5 7 0 +] CS 03
+static void decodeSa(DaikinState &s, const uint8_t *p, size_t len) {
+  if (len < 4)
+    return;
+  float val = parseInvertedDecimal(p, 4);
+  s.outsideTemp = val + OUTSIDE_TEMP_OFFSET;
+  LOG("Parsed Outside Temp (Sa): %.1f C (raw: %.1f)", s.outsideTemp, val);
+}
+
+// SI: Indoor coil (heat exchanger) temperature
+static void decodeSI(DaikinState &s, const uint8_t *p, size_t len) {
+  if (len < 4)
+    return;
+  s.coilTemp = parseInvertedDecimal(p, 4);
+  LOG("Parsed Coil Temp (SI): %.1f C", s.coilTemp);
+}
+
+// SL: Indoor fan speed, in units of 10 rpm
+static void decodeSL(DaikinState &s, const uint8_t *p, size_t len) {
+  if (len < 3)
+    return;
+  s.fanRpm = parseInvertedInt(p, len > 4 ? 4 : len) * 10;
+  LOG("Parsed Fan RPM (SL): %u", s.fanRpm);
+}
+
+// Sd: Compressor frequency (Hz), 0 when the compressor is stopped
+static void decodeSd(DaikinState &s, const uint8_t *p, size_t len) {
+  if (len < 3)
+    return;
+  s.compressorFreq = parseInvertedInt(p, len > 4 ? 4 : len);
+  LOG("Parsed Compressor (Sd): %u Hz", s.compressorFreq);
+}
+
+// Bus cost estimate at 2400 8E2 (5ms per byte): request 5 bytes, ACK,
+// response 6-9 bytes, plus unit turnaround and inter-command gap.
+const S21Query S21_QUERIES[] = {
+    // Request frames are built at compile time
+    // request                 rsp   decoder   class          costMs
+    {S21Frame<'F', '1'>::bytes, "G1", decodeG1, S21_POLL_FAST, 170},
+    {S21Frame<'F', '5'>::bytes, "G5", decodeG5, S21_POLL_FAST, 170},
+    {S21Frame<'R', 'H'>::bytes, "SH", decodeSH, S21_POLL_FAST, 170},
+    {S21Frame<'R', 'a'>::bytes, "Sa", decodeSa, S21_POLL_FAST, 170},
+    {S21Frame<'F', '6'>::bytes, "G6", decodeG6, S21_POLL_SLOW, 170},
+    {S21Frame<'F', '7'>::bytes, "G7", decodeG7, S21_POLL_SLOW, 170},
+    {S21Frame<'R', 'I'>::bytes, "SI", decodeSI, S21_POLL_SLOW, 170},
+    {S21Frame<'R', 'L'>::bytes, "SL", decodeSL, S21_POLL_SLOW, 170},
+    {S21Frame<'R', 'd'>::bytes, "Sd", decodeSd, S21_POLL_SLOW, 170},
+    {S21Frame<'F', 'M'>::bytes, "GM", decodeGM, S21_POLL_SLOW, 170},
+    // Sent by the handshake
+    {S21Frame<'F', '8'>::bytes, "G8", decodeG8, S21_POLL_NEVER, 170},
+    {S21Frame<'F', 'Y'>::bytes, "GY", decodeGY, S21_POLL_NEVER, 170},
+};
+
+static_assert(sizeof(S21_QUERIES) / sizeof(S21_QUERIES[0]) <= S21_MAX_QUERIES,
+              "Too many S21 queries for the support mask");
+
+const size_t S21_QUERY_COUNT = sizeof(S21_QUERIES) / sizeof(S21_QUERIES[0]);
+
+const S21Query *findS21Query(uint8_t type1, uint8_t type2) {
+  for (size_t i = 0; i < S21_QUERY_COUNT; i++) {
+    if (S21_QUERIES[i].rsp[0] == type1 && S21_QUERIES[i].rsp[1] == type2)
+      return &S21_QUERIES[i];
+  }
+  return nullptr;
+}
@@ -0,0 +1,47 @@
+#ifndef S21_QUERIES_H
+#define S21_QUERIES_H
+
+#include "../system/config.h"
+#include "s21_frame.h"
+#include <Arduino.h>
+
+struct DaikinState;
+
+// Bus time the poller may spend per cycle (ms). Queries that do not fit are
+// carried over to the next cycle.
+#ifndef S21_POLL_BUDGET_MS
+#define S21_POLL_BUDGET_MS 1500
+#endif
+
+// Slow queries are refreshed at most once every N poll cycles
+#ifndef S21_SLOW_POLL_DIVIDER
+#define S21_SLOW_POLL_DIVIDER 4
+#endif
+
+// How often a query is refreshed by the poller
+enum S21PollClass : uint8_t {
+  S21_POLL_FAST = 0, // Every cycle (state shown by the UI)
+  S21_POLL_SLOW = 1, // Telemetry, every S21_SLOW_POLL_DIVIDER cycles
+  S21_POLL_NEVER = 2 // Handshake only, listed for the decoder
+};
+
+// Decodes the payload of a response (bytes between the tag and the checksum)
+typedef void (*S21Decoder)(DaikinState &state, const uint8_t *payload,
+                           size_t len);
+
+// One S21 query: request command, expected response tag and how to decode it
+struct S21Query {
+  const uint8_t *frame; // Request frame (S21_QUERY_FRAME_LEN bytes)
+  char rsp[3];          // Response tag, e.g. "G1"
+  S21Decoder decode;    // Payload decoder
+  uint8_t pollClass;    // S21PollClass
+  uint16_t costMs;      // Estimated bus time: request + ACK + response
+};
+
+extern const S21Query S21_QUERIES[];
+extern const size_t S21_QUERY_COUNT;
+
+// Find the query whose response carries the given tag (nullptr if unknown)
+const S21Query *findS21Query(uint8_t type1, uint8_t type2);
+
+#endif // S21_QUERIES_H
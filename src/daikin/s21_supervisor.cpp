@@ -0,0 +1,214 @@
+#include "s21_supervisor.h"
+#include "../system/clock.h"
+#include "../system/logger.h"
+#include "s21_driver.h"
+#include "s21_queries.h"
+#include <esp_idf_version.h>
+#include <esp_task_wdt.h>
+
+// A poll cycle is bounded by the budget plus one query timeout; anything
+// well past that means the state machine is wedged
+#define S21_STUCK_MS (S21_POLL_BUDGET_MS + 5000)
+
+S21Supervisor Supervisor;
+
+void S21Supervisor::begin() {
+  unsigned long now = millis();
+  // S21.begin() already started the first handshake
+  linkState = S21_LINK_HANDSHAKE;
+  stateSince = now;
+  lastAccount = now;
+  metrics.handshakes = 1;
+
+#if WDT_TIMEOUT_S > 0
+#if ESP_IDF_VERSION_MAJOR >= 5
+  esp_task_wdt_config_t wdt = {};
+  wdt.timeout_ms = WDT_TIMEOUT_S * 1000;
+  wdt.trigger_panic = true;
+  // Arduino-ESP32 3.x starts the watchdog itself
+  if (esp_task_wdt_init(&wdt) == ESP_ERR_INVALID_STATE)
+    esp_task_wdt_reconfigure(&wdt);
+#else
+  esp_task_wdt_init(WDT_TIMEOUT_S, true);
+#endif
+  esp_task_wdt_add(NULL); // The loop task
+  LOG("[S21] Watchdog armed (%ds)", WDT_TIMEOUT_S);
+#endif
+}
+
+void S21Supervisor::feedWatchdog() {
+#if WDT_TIMEOUT_S > 0
+  esp_task_wdt_reset();
+#endif
+}
+
+void S21Supervisor::loop() {
+  unsigned long now = millis();
+  feedWatchdog();
+  account(now);
+
+  if (S21.isPassive()) {
+    if (linkState != S21_LINK_PASSIVE) {
+      linkState = S21_LINK_PASSIVE;
+      stateSince = now;
+      inOutage = false;
+    }
+    return;
+  }
+  if (linkState == S21_LINK_PASSIVE) {
+    // Back to active: the driver runs the handshake
+    linkState = S21_LINK_HANDSHAKE;
+    stateSince = now;
+    backoff = S21_BACKOFF_MIN_MS;
+  }
+
+  switch (linkState) {
+  case S21_LINK_HANDSHAKE:
+    if (S21.isReady()) {
+      linkState = S21_LINK_UP;
+      stateSince = now;
+      backoff = S21_BACKOFF_MIN_MS;
+      everUp = true;
+      if (inOutage) {
+        uint32_t duration = elapsedMs(now, outageStart);
+        inOutage = false;
+        metrics.recoveries++;
+        metrics.repairMs += duration;
+        metrics.lastOutageMs = duration;
+        if (duration > metrics.longestOutageMs)
+          metrics.longestOutageMs = duration;
+        LOG("[S21] Link recovered after %lu ms", (unsigned long)duration);
+      }
+      S21.requestPoll(); // Refresh whatever changed while down
+    } else if (elapsedMs(now, stateSince) > S21_HANDSHAKE_TIMEOUT_MS) {
+      metrics.handshakeFailures++;
+      metrics.faults[S21_FAULT_HANDSHAKE]++;
+      fault = S21_FAULT_HANDSHAKE;
+      S21.halt();
+      linkState = S21_LINK_BACKOFF;
+      stateSince = now;
+      LOG("[S21] Handshake failed, retry in %lu ms", backoff);
+    }
+    break;
+
+  case S21_LINK_UP:
+    if (!S21.isReady()) {
+      // Restarted from elsewhere: follow the handshake
+      linkState = S21_LINK_HANDSHAKE;
+      stateSince = now;
+    } else if (S21.missedStreak() >= S21_MAX_MISSED) {
+      fail(S21_FAULT_LINK_LOST);
+    } else if (S21.nakStreak() >= S21_MAX_NAKS) {
+      fail(S21_FAULT_NAK);
+    } else if (S21.pollRunTime() > S21_STUCK_MS) {
+      fail(S21_FAULT_STUCK);
+    } else if (!S21.isPolling() && S21.pollAge() > S21_PROBE_MS) {
+      S21.requestPoll();
+    }
+    break;
+
+  case S21_LINK_BACKOFF:
+    if (elapsedMs(now, stateSince) >= backoff) {
+      backoff = min(backoff * 2, (unsigned long)S21_BACKOFF_MAX_MS);
+      startHandshake(now);
+    }
+    break;
+
+  case S21_LINK_PASSIVE:
+    break; // Handled above
+  }
+}
+
+void S21Supervisor::restart() {
+  if (S21.isPassive()) {
+    S21.restart(); // Only resets the receiver, there's no handshake
+    return;
+  }
+  fail(S21_FAULT_MANUAL);
+}
+
+// First retry is immediate, later ones back off
+void S21Supervisor::fail(S21Fault reason) {
+  unsigned long now = millis();
+  fault = reason;
+  metrics.faults[reason]++;
+  if (!inOutage && everUp) {
+    inOutage = true;
+    outageStart = now;
+    metrics.outages++;
+  }
+  LOG("[S21] Fault: %s", s21FaultName(reason));
+  startHandshake(now);
+}
+
+void S21Supervisor::startHandshake(unsigned long now) {
+  metrics.handshakes++;
+  S21.restart();
+  linkState = S21_LINK_HANDSHAKE;
+  stateSince = now;
+}
+
+void S21Supervisor::account(unsigned long now) {
+  unsigned long elapsed = elapsedMs(now, lastAccount);
+  lastAccount = now;
+  // Passive: up while the other master's traffic is seen
+  bool up = linkState == S21_LINK_UP ||
+            (linkState == S21_LINK_PASSIVE && S21.isConnected());
+  if (up)
+    everUp = true;
+  if (!everUp)
+    return;
+  if (up)
+    metrics.upMs += elapsed;
+  else
+    metrics.downMs += elapsed;
+}
+
+const S21BusMetrics &S21Supervisor::getMetrics() {
+  account(millis());
+  return metrics;
+}
+
+float S21Supervisor::availability() {
+  account(millis());
+  uint64_t total = metrics.upMs + metrics.downMs;
+  if (total == 0)
+    return 100.0;
+  return 100.0 * metrics.upMs / total;
+}
+
+uint32_t S21Supervisor::mttr() {
+  if (metrics.recoveries == 0)
+    return 0;
+  return metrics.repairMs / metrics.recoveries;
+}
+
+const char *s21LinkStateName(S21LinkState state) {
+  switch (state) {
+  case S21_LINK_UP:
+    return "up";
+  case S21_LINK_BACKOFF:
+    return "backoff";
+  case S21_LINK_PASSIVE:
+    return "passive";
+  default:
+    return "handshake";
+  }
+}
+
+const char *s21FaultName(S21Fault fault) {
+  switch (fault) {
+  case S21_FAULT_LINK_LOST:
+    return "link_lost";
+  case S21_FAULT_STUCK:
+    return "stuck";
+  case S21_FAULT_NAK:
+    return "nak";
+  case S21_FAULT_HANDSHAKE:
+    return "handshake";
+  case S21_FAULT_MANUAL:
+    return "manual";
+  default:
+    return "none";
+  }
+}
@@ -0,0 +1,117 @@
+#ifndef S21_SUPERVISOR_H
+#define S21_SUPERVISOR_H
+
+#include "../system/config.h"
+#include <Arduino.h>
+
+// Consecutive poll queries without an answer before the link counts as lost
+#ifndef S21_MAX_MISSED
+#define S21_MAX_MISSED 3
+#endif
+// Consecutive NAKs (more than a full cycle of unsupported queries)
+#ifndef S21_MAX_NAKS
+#define S21_MAX_NAKS 12
+#endif
+// Handshake must reach IDLE within this time
+#ifndef S21_HANDSHAKE_TIMEOUT_MS
+#define S21_HANDSHAKE_TIMEOUT_MS 10000
+#endif
+// Retry delay after a failed handshake: doubles up to the max
+#ifndef S21_BACKOFF_MIN_MS
+#define S21_BACKOFF_MIN_MS 1000
+#endif
+#ifndef S21_BACKOFF_MAX_MS
+#define S21_BACKOFF_MAX_MS 60000
+#endif
+// Poll at least this often so a dead link is noticed without clients
+#ifndef S21_PROBE_MS
+#define S21_PROBE_MS 30000
+#endif
+// Task watchdog on the loop task (0 = disabled)
+#ifndef WDT_TIMEOUT_S
+#define WDT_TIMEOUT_S 30
+#endif
+
+enum S21LinkState : uint8_t {
+  S21_LINK_HANDSHAKE, // Init sequence running
+  S21_LINK_UP,        // Polls and commands go through
+  S21_LINK_BACKOFF,   // Bus halted, waiting to retry the handshake
+  S21_LINK_PASSIVE    // Listen only (S21.setPassive), nothing to recover
+};
+
+enum S21Fault : uint8_t {
+  S21_FAULT_NONE,
+  S21_FAULT_LINK_LOST, // Queries time out
+  S21_FAULT_STUCK,     // Poll cycle never finished
+  S21_FAULT_NAK,       // Unit rejects everything
+  S21_FAULT_HANDSHAKE, // Init sequence did not complete
+  S21_FAULT_MANUAL,    // restart() from the CLI
+  S21_FAULT_COUNT
+};
+
+// Availability counts from the first successful handshake
+struct S21BusMetrics {
+  uint32_t outages;
+  uint32_t recoveries;
+  uint32_t handshakes;        // Attempts, including the first one
+  uint32_t handshakeFailures;
+  uint32_t faults[S21_FAULT_COUNT];
+  uint64_t upMs;
+  uint64_t downMs;
+  uint64_t repairMs; // Downtime of outages that ended (for MTTR)
+  uint32_t lastOutageMs;
+  uint32_t longestOutageMs;
+};
+
+// Watches the S21 driver and brings the bus back after a unit power cycle,
+// a loose cable or a wedged transaction: halts it, re-runs the handshake
+// with exponential backoff and keeps availability figures. Also owns the
+// task watchdog, so a stalled loop() resets the board.
+class S21Supervisor {
+public:
+  // Call at the end of setup(), after S21.begin()
+  void begin();
+
+  // Call from loop()
+  void loop();
+
+  // Force a re-handshake now (counted as an outage)
+  void restart();
+
+  // Keep the watchdog quiet during long blocking work (OTA download)
+  void feedWatchdog();
+
+  S21LinkState state() const { return linkState; }
+  S21Fault lastFault() const { return fault; }
+  unsigned long backoffMs() const { return backoff; }
+
+  // Metrics with upMs/downMs brought up to date
+  const S21BusMetrics &getMetrics();
+  // Percent of time up since the first handshake (100 before that)
+  float availability();
+  // Mean time to repair in ms (0 if no outage has ended yet)
+  uint32_t mttr();
+
+private:
+  void fail(S21Fault reason);
+  void startHandshake(unsigned long now);
+  void account(unsigned long now);
+
+private:
+  S21LinkState linkState = S21_LINK_HANDSHAKE;
+  S21Fault fault = S21_FAULT_NONE;
+  bool everUp = false;
+  bool inOutage = false;
+  unsigned long stateSince = 0;
+  unsigned long outageStart = 0;
+  unsigned long lastAccount = 0;
+  unsigned long backoff = S21_BACKOFF_MIN_MS;
+  S21BusMetrics metrics = {};
+};
+
+extern S21Supervisor Supervisor;
+
+const char *s21LinkStateName(S21LinkState state);
+const char *s21FaultName(S21Fault fault);
+
+#endif // S21_SUPERVISOR_H
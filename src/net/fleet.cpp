@@ -0,0 +1,188 @@
+#include "fleet.h"
+#include "../daikin/daikin_state.h"
+#include "../daikin/s21_codec.h"
+#include "../daikin/s21_driver.h"
+#include "../daikin/s21_supervisor.h"
+#include "../system/clock.h"
+#include "../system/console.h"
+#include "../system/logger.h"
+#include "../web/diagnostics.h"
+#include <ESPmDNS.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+
+#define FLEET_CHECK_MS 500
+#define FLEET_SERVICE "daikin-s21"
+#define FLEET_STATE_OFFSET 6 // Compared for changes from here on
+
+// "caps" TXT record: what this build serves, from the module switches
+#if METRICS_ENABLED
+#define FLEET_CAP_METRICS ",metrics"
+#else
+#define FLEET_CAP_METRICS ""
+#endif
+#if CLI_ENABLED
+#define FLEET_CAP_CONSOLE ",console"
+#else
+#define FLEET_CAP_CONSOLE ""
+#endif
+#ifdef MQTT_HOST
+#define FLEET_CAP_MQTT ",mqtt"
+#else
+#define FLEET_CAP_MQTT ""
+#endif
+#define FLEET_CAPS                                                             \
+  "status-cbor" FLEET_CAP_METRICS ",schedule" FLEET_CAP_CONSOLE FLEET_CAP_MQTT
+
+FleetBroadcast Fleet;
+
+static WiFiUDP g_udp;
+
+static uint8_t *putU16(uint8_t *p, uint16_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  return p + 2;
+}
+
+static uint8_t *putU32(uint8_t *p, uint32_t v) {
+  p = putU16(p, v);
+  return putU16(p, v >> 16);
+}
+
+static int16_t tenths(float v) { return (int16_t)lroundf(v * 10); }
+
+void FleetBroadcast::begin(const char *unitName) {
+  if (started)
+    return;
+  uint8_t mac[6];
+  WiFi.macAddress(mac);
+  memcpy(id, mac + 3, 3);
+  snprintf(hostname, sizeof(hostname), "daikin-%02x%02x%02x", id[0], id[1],
+           id[2]);
+  snprintf(name, sizeof(name), "%s", unitName);
+
+  if (MDNS.begin(hostname)) {
+    MDNS.addService("http", "tcp", API_PORT);
+    MDNS.addService(FLEET_SERVICE, "tcp", API_PORT);
+    updateTxt();
+    LOG("mDNS: %s.local, _%s._tcp", hostname, FLEET_SERVICE);
+  } else {
+    LOG("mDNS: Failed to start");
+  }
+  started = true;
+}
+
+void FleetBroadcast::setName(const char *unitName) {
+  snprintf(name, sizeof(name), "%s", unitName);
+  if (!started)
+    return;
+  updateTxt();
+  send(0, millis());
+}
+
+void FleetBroadcast::updateTxt() {
+  char version[8];
+  snprintf(version, sizeof(version), "%u",
+           Protocol.version() ? Protocol.version() : Protocol.major() * 100);
+  MDNS.addServiceTxt(FLEET_SERVICE, "tcp", "name", name);
+  MDNS.addServiceTxt(FLEET_SERVICE, "tcp", "fw", FW_VERSION);
+  MDNS.addServiceTxt(FLEET_SERVICE, "tcp", "s21", version);
+  MDNS.addServiceTxt(FLEET_SERVICE, "tcp", "codec", Protocol.codec().name);
+  MDNS.addServiceTxt(FLEET_SERVICE, "tcp", "caps", FLEET_CAPS);
+#if FLEET_BROADCAST
+  char group[24];
+  snprintf(group, sizeof(group), "%s:%d",
+           IPAddress(FLEET_GROUP_IP).toString().c_str(), FLEET_PORT);
+  MDNS.addServiceTxt(FLEET_SERVICE, "tcp", "mcast", group);
+#endif
+  announcedCodec = &Protocol.codec();
+}
+
+void FleetBroadcast::loop() {
+  if (!started)
+    return;
+  unsigned long now = millis();
+  if (elapsedMs(now, lastCheck) < FLEET_CHECK_MS)
+    return;
+  lastCheck = now;
+
+  // Version and codec are known once the handshake is done
+  if (announcedCodec != &Protocol.codec())
+    updateTxt();
+
+#if FLEET_BROADCAST
+  if (elapsedMs(now, lastRefresh) >= FLEET_REFRESH_MS) {
+    lastRefresh = now;
+    S21.requestPoll();
+  }
+
+  uint8_t buf[FLEET_MAX_DATAGRAM];
+  size_t len = encode(buf, 0);
+  bool changed = len != lastStateLen ||
+                 memcmp(buf + FLEET_STATE_OFFSET, lastState + FLEET_STATE_OFFSET,
+                        len - FLEET_STATE_OFFSET) != 0;
+  if (changed)
+    send(0, now);
+  else if (elapsedMs(now, lastSend) >= FLEET_HEARTBEAT_MS)
+    send(1, now);
+#endif
+}
+
+size_t FleetBroadcast::encode(uint8_t *buf, uint8_t kind) {
+  uint8_t *p = buf;
+  *p++ = 'D';
+  *p++ = 'K';
+  *p++ = FLEET_DATAGRAM_VERSION;
+  *p++ = kind;
+  p = putU16(p, seq);
+  memcpy(p, id, 3);
+  p += 3;
+
+  uint8_t flags = 0;
+  if (State.power)
+    flags |= 0x01;
+  if (State.swingV)
+    flags |= 0x02;
+  if (State.swingH)
+    flags |= 0x04;
+  if (State.powerful)
+    flags |= 0x08;
+  if (State.econo)
+    flags |= 0x10;
+  if (Supervisor.state() == S21_LINK_UP)
+    flags |= 0x20;
+  *p++ = flags;
+  *p++ = State.mode;
+  *p++ = State.fan;
+  p = putU16(p, tenths(State.targetTemp));
+  p = putU16(p, tenths(State.roomTemp));
+  p = putU16(p, tenths(State.outsideTemp));
+  p = putU16(p, tenths(State.coilTemp));
+  p = putU16(p, State.fanRpm);
+  p = putU16(p, State.compressorFreq);
+  p = putU32(p, (uint32_t)lroundf(State.energyKWh * 10));
+
+  size_t nameLen = strlen(name);
+  *p++ = nameLen;
+  memcpy(p, name, nameLen);
+  p += nameLen;
+  return p - buf;
+}
+
+void FleetBroadcast::send(uint8_t kind, unsigned long now) {
+#if FLEET_BROADCAST
+  uint8_t buf[FLEET_MAX_DATAGRAM];
+  size_t len = encode(buf, kind);
+  if (!g_udp.beginPacket(IPAddress(FLEET_GROUP_IP), FLEET_PORT))
+    return;
+  g_udp.write(buf, len);
+  if (!g_udp.endPacket())
+    return;
+
+  memcpy(lastState, buf, len);
+  lastStateLen = len;
+  lastSend = now;
+  seq++;
+  sent++;
+#endif
+}
@@ -0,0 +1,80 @@
+#ifndef FLEET_H
+#define FLEET_H
+
+#include "../system/config.h"
+#include <Arduino.h>
+
+// State datagrams to a multicast group, 0 = disabled
+#ifndef FLEET_BROADCAST
+#define FLEET_BROADCAST 1
+#endif
+#ifndef FLEET_GROUP_IP
+#define FLEET_GROUP_IP 239, 255, 21, 21
+#endif
+#ifndef FLEET_PORT
+#define FLEET_PORT 21021
+#endif
+// Datagram even without changes, so listeners can age out dead units
+#ifndef FLEET_HEARTBEAT_MS
+#define FLEET_HEARTBEAT_MS 30000
+#endif
+// Background S21 refresh, so changes are seen without any client polling
+#ifndef FLEET_REFRESH_MS
+#define FLEET_REFRESH_MS 15000
+#endif
+
+// Datagram layout (little endian), version 1:
+//   0  'D' 'K'     magic
+//   2  version     1
+//   3  kind        0 = change, 1 = heartbeat
+//   4  seq         uint16, +1 per datagram
+//   6  id          3 bytes, last half of the MAC
+//   9  flags       bit 0 power, 1 swing V, 2 swing H, 3 powerful, 4 econo,
+//                  5 bus up
+//   10 mode, 11 fan
+//   12 target, room, outside, coil: int16 in 0.1C
+//   20 fan rpm, compressor Hz: uint16
+//   24 energy: uint32 in 0.1 kWh
+//   28 name length, then the name (max 31 bytes)
+#define FLEET_DATAGRAM_VERSION 1
+#define FLEET_MAX_DATAGRAM 60
+
+// Lets one listener track many controllers without polling them: each one
+// announces itself over mDNS/DNS-SD (_daikin-s21._tcp with name, firmware
+// and capabilities in TXT) and multicasts a small state datagram whenever
+// something changes, plus a heartbeat.
+class FleetBroadcast {
+public:
+  // Start mDNS and the sender. Call once the network is up.
+  void begin(const char *unitName);
+
+  void loop();
+
+  // Unit renamed (/set-config)
+  void setName(const char *unitName);
+
+  uint32_t sentCount() const { return sent; }
+
+private:
+  size_t encode(uint8_t *buf, uint8_t kind);
+  void send(uint8_t kind, unsigned long now);
+  void updateTxt();
+
+private:
+  bool started = false;
+  char hostname[24];
+  char name[32];
+  uint8_t id[3];
+  uint16_t seq = 0;
+  uint32_t sent = 0;
+  const void *announcedCodec = nullptr;
+  unsigned long lastSend = 0;
+  unsigned long lastCheck = 0;
+  unsigned long lastRefresh = 0;
+  uint8_t lastState[FLEET_MAX_DATAGRAM];
+  size_t lastStateLen = 0;
+};
+
+extern FleetBroadcast Fleet;
+
+#endif // FLEET_H
@@ -0,0 +1,432 @@
+#include "mqtt_bridge.h"
+#include "../daikin/daikin_state.h"
+#include "../daikin/s21_commands.h"
+#include "../daikin/s21_driver.h"
+#include "../system/clock.h"
+#include "../system/commands.h"
+#include "../system/heap_tracker.h"
+#include "../system/logger.h"
+#include "../system/trace.h"
+
+MqttBridge Mqtt;
+
+#ifdef MQTT_HOST
+
+#include <PubSubClient.h>
+#include <WiFi.h>
+
+#define MQTT_PUBLISH_CHECK_MS 500
+#define MQTT_COMMAND_REFRESH_MS 1500 // Give the unit time to apply a command
+#define MQTT_BUFFER_SIZE 1024
+
+static WiFiClient g_netClient;
+static PubSubClient g_client(g_netClient);
+static char g_buf[MQTT_BUFFER_SIZE]; // Discovery payloads and topics
+
+// Published state, one retained topic per field
+enum {
+  FIELD_MODE,
+  FIELD_TARGET_TEMP,
+  FIELD_ROOM_TEMP,
+  FIELD_OUTSIDE_TEMP,
+  FIELD_FAN,
+  FIELD_SWING,
+  FIELD_POWERFUL,
+  FIELD_ECONO,
+  FIELD_COIL_TEMP,
+  FIELD_FAN_RPM,
+  FIELD_COMPRESSOR_FREQ,
+  FIELD_ENERGY,
+  FIELD_COUNT
+};
+
+static const char *const FIELD_TOPICS[FIELD_COUNT] = {
+    "mode",     "target_temp", "room_temp", "outside_temp",
+    "fan",      "swing",       "powerful",  "econo",
+    "coil_temp", "fan_rpm",    "compressor_freq", "energy_kwh"};
+
+// Last value sent per field (empty = never published)
+static char g_published[FIELD_COUNT][12];
+
+// Home Assistant HVAC mode from power + S21 mode
+static const char *haMode() {
+  if (!State.power)
+    return "off";
+  switch (State.mode) {
+  case 2:
+    return "dry";
+  case 3:
+    return "cool";
+  case 4:
+    return "heat";
+  case 6:
+    return "fan_only";
+  default:
+    return "auto";
+  }
+}
+
+static const char *haSwing() {
+  if (State.swingV && State.swingH)
+    return "both";
+  if (State.swingV)
+    return "vertical";
+  if (State.swingH)
+    return "horizontal";
+  return "off";
+}
+
+static void formatField(int field, char *out, size_t size) {
+  switch (field) {
+  case FIELD_MODE:
+    snprintf(out, size, "%s", haMode());
+    break;
+  case FIELD_TARGET_TEMP:
+    snprintf(out, size, "%.1f", State.targetTemp);
+    break;
+  case FIELD_ROOM_TEMP:
+    snprintf(out, size, "%.1f", State.roomTemp);
+    break;
+  case FIELD_OUTSIDE_TEMP:
+    snprintf(out, size, "%.1f", State.outsideTemp);
+    break;
+  case FIELD_FAN:
+    if (State.fan == 10)
+      snprintf(out, size, "auto");
+    else if (State.fan == 11)
+      snprintf(out, size, "silent");
+    else
+      snprintf(out, size, "%d", State.fan);
+    break;
+  case FIELD_SWING:
+    snprintf(out, size, "%s", haSwing());
+    break;
+  case FIELD_POWERFUL:
+    snprintf(out, size, "%s", State.powerful ? "ON" : "OFF");
+    break;
+  case FIELD_ECONO:
+    snprintf(out, size, "%s", State.econo ? "ON" : "OFF");
+    break;
+  case FIELD_COIL_TEMP:
+    snprintf(out, size, "%.1f", State.coilTemp);
+    break;
+  case FIELD_FAN_RPM:
+    snprintf(out, size, "%u", State.fanRpm);
+    break;
+  case FIELD_COMPRESSOR_FREQ:
+    snprintf(out, size, "%u", State.compressorFreq);
+    break;
+  case FIELD_ENERGY:
+    snprintf(out, size, "%.1f", State.energyKWh);
+    break;
+  }
+}
+
+void MqttBridge::begin(const char *name) {
+  // Device id from the last 3 MAC bytes, e.g. daikin_a1b2c3
+  String mac = WiFi.macAddress();
+  snprintf(deviceId, sizeof(deviceId), "daikin_%c%c%c%c%c%c", mac.charAt(9),
+           mac.charAt(10), mac.charAt(12), mac.charAt(13), mac.charAt(15),
+           mac.charAt(16));
+  for (char *p = deviceId; *p; p++)
+    *p = tolower(*p);
+
+  snprintf(baseTopic, sizeof(baseTopic), "%s/%s", MQTT_BASE_TOPIC, deviceId);
+  snprintf(unitName, sizeof(unitName), "%s", name);
+
+#if defined(ESP_ARDUINO_VERSION_MAJOR) && ESP_ARDUINO_VERSION_MAJOR >= 3
+  g_netClient.setConnectionTimeout(MQTT_CONNECT_TIMEOUT_MS);
+#else
+  g_netClient.setTimeout((MQTT_CONNECT_TIMEOUT_MS + 999) / 1000); // Seconds
+#endif
+  g_client.setSocketTimeout(MQTT_SOCKET_TIMEOUT_S);
+  g_client.setServer(MQTT_HOST, MQTT_PORT);
+  g_client.setBufferSize(MQTT_BUFFER_SIZE);
+  g_client.setCallback([this](char *topic, uint8_t *payload,
+                              unsigned int len) {
+    handleMessage(topic, payload, len);
+  });
+
+  Commands.onUpdate([](const S21Command &c) { Mqtt.publishCommand(c); });
+
+  enabled = true;
+  lastConnectAttempt = millis();
+  reconnectDelay = 0; // Connect right away
+  backoffStep = MQTT_BACKOFF_MIN_MS;
+  LOG("MQTT: Broker %s:%d, topic %s", MQTT_HOST, MQTT_PORT, baseTopic);
+}
+
+bool MqttBridge::connect() {
+  char willTopic[64];
+  snprintf(willTopic, sizeof(willTopic), "%s/status", baseTopic);
+
+  LOG("MQTT: Connecting...");
+  if (!g_client.connect(deviceId, MQTT_USER, MQTT_PASS, willTopic, 0, true,
+                        "offline"))
+    return false;
+
+  LOG("MQTT: Connected");
+  g_client.publish(willTopic, "online", true);
+
+  snprintf(g_buf, sizeof(g_buf), "%s/+/set", baseTopic);
+  g_client.subscribe(g_buf);
+
+  publishDiscovery();
+
+  // Retain what we have, changes follow once the refresh completes
+  publishState(true);
+  S21.requestPoll();
+  lastRefresh = millis();
+  return true;
+}
+
+void MqttBridge::loop() {
+  TRACE_SCOPE("mqtt");
+  HEAP_SCOPE("mqtt");
+  if (!enabled)
+    return;
+
+  unsigned long now = millis();
+
+  if (!g_client.connected()) {
+    if (WiFi.status() != WL_CONNECTED ||
+        elapsedMs(now, lastConnectAttempt) < reconnectDelay)
+      return;
+    if (connect()) {
+      reconnectDelay = MQTT_BACKOFF_MIN_MS; // Should the broker drop us
+      backoffStep = MQTT_BACKOFF_MIN_MS;
+    } else {
+      // Exponential with +-25% jitter, like the WiFi retries
+      reconnectDelay = backoffStep * random(75, 126) / 100;
+      backoffStep = min(backoffStep * 2, (unsigned long)MQTT_BACKOFF_MAX_MS);
+      LOG("MQTT: Connect failed (state %d), retry in %lu ms", g_client.state(),
+          reconnectDelay);
+    }
+    lastConnectAttempt = millis(); // After the time connect() blocked
+    return;
+  }
+
+  g_client.loop();
+
+  // Periodic refresh replaces client-side polling of /status
+  bool commandDue =
+      refreshPending &&
+      elapsedMs(now, commandTime) >= MQTT_COMMAND_REFRESH_MS;
+  if (commandDue || elapsedMs(now, lastRefresh) >= MQTT_REFRESH_MS) {
+    refreshPending = false;
+    S21.requestPoll();
+    lastRefresh = now;
+  }
+
+  // Publish whatever poll cycles (ours or /status) changed
+  if (elapsedMs(now, lastPublishCheck) >= MQTT_PUBLISH_CHECK_MS) {
+    lastPublishCheck = now;
+    publishState(false);
+  }
+}
+
+void MqttBridge::notifyCommand() {
+  refreshPending = true;
+  commandTime = millis();
+}
+
+bool MqttBridge::isConnected() { return enabled && g_client.connected(); }
+
+void MqttBridge::publishCommand(const S21Command &c) {
+  if (!g_client.connected())
+    return;
+  char topic[64];
+  char payload[128];
+  snprintf(topic, sizeof(topic), "%s/command", baseTopic);
+  snprintf(payload, sizeof(payload),
+           "{\"id\":%lu,\"kind\":\"%s\",\"status\":\"%s\",\"attempts\":%u,"
+           "\"ack_ms\":%lu,\"done_ms\":%lu}",
+           (unsigned long)c.id, s21CommandKindName(c.kind),
+           s21CommandStatusName(c.status), c.attempts, (unsigned long)c.ackMs,
+           (unsigned long)c.doneMs);
+  g_client.publish(topic, payload, false);
+}
+
+void MqttBridge::publishState(bool force) {
+  char value[12];
+  char topic[80];
+
+  for (int i = 0; i < FIELD_COUNT; i++) {
+    formatField(i, value, sizeof(value));
+    if (!force && strcmp(value, g_published[i]) == 0)
+      continue;
+
+    snprintf(topic, sizeof(topic), "%s/%s", baseTopic, FIELD_TOPICS[i]);
+    if (g_client.publish(topic, value, true)) {
+      strcpy(g_published[i], value);
+    }
+  }
+}
+
+// Home Assistant MQTT discovery: one climate entity plus telemetry sensors
+void MqttBridge::publishDiscovery() {
+  char topic[96];
+  char device[160];
+  snprintf(device, sizeof(device),
+           "\"dev\":{\"ids\":[\"%s\"],\"name\":\"%s\",\"mf\":\"Daikin\","
+           "\"mdl\":\"S21\",\"sw\":\"%s\"}",
+           deviceId, unitName, FW_VERSION);
+
+  snprintf(topic, sizeof(topic), "%s/climate/%s/config", MQTT_DISCOVERY_PREFIX,
+           deviceId);
+  snprintf(g_buf, sizeof(g_buf),
+           "{\"~\":\"%s\",\"name\":null,\"uniq_id\":\"%s_climate\","
+           "\"avty_t\":\"~/status\","
+           "\"modes\":[\"off\",\"auto\",\"dry\",\"cool\",\"heat\","
+           "\"fan_only\"],"
+           "\"mode_stat_t\":\"~/mode\",\"mode_cmd_t\":\"~/mode/set\","
+           "\"temp_stat_t\":\"~/target_temp\","
+           "\"temp_cmd_t\":\"~/target_temp/set\","
+           "\"curr_temp_t\":\"~/room_temp\","
+           "\"fan_modes\":[\"1\",\"2\",\"3\",\"4\",\"5\",\"auto\","
+           "\"silent\"],"
+           "\"fan_mode_stat_t\":\"~/fan\",\"fan_mode_cmd_t\":\"~/fan/set\","
+           "\"swing_modes\":[\"off\",\"vertical\",\"horizontal\",\"both\"],"
+           "\"swing_mode_stat_t\":\"~/swing\","
+           "\"swing_mode_cmd_t\":\"~/swing/set\","
+           "\"min_temp\":18,\"max_temp\":30,\"temp_step\":1,%s}",
+           baseTopic, deviceId, device);
+  g_client.publish(topic, g_buf, true);
+
+  // Read-only sensors: field, unit, device class, state class
+  static const struct {
+    const char *field;
+    const char *unit;
+    const char *devClass;
+    const char *stateClass;
+  } sensors[] = {
+      {"outside_temp", "°C", "temperature", "measurement"},
+      {"coil_temp", "°C", "temperature", "measurement"},
+      {"fan_rpm", "rpm", nullptr, "measurement"},
+      {"compressor_freq", "Hz", "frequency", "measurement"},
+      {"energy_kwh", "kWh", "energy", "total_increasing"},
+  };
+
+  for (const auto &s : sensors) {
+    char devClass[40] = "";
+    if (s.devClass)
+      snprintf(devClass, sizeof(devClass), "\"dev_cla\":\"%s\",", s.devClass);
+
+    snprintf(topic, sizeof(topic), "%s/sensor/%s_%s/config",
+             MQTT_DISCOVERY_PREFIX, deviceId, s.field);
+    snprintf(g_buf, sizeof(g_buf),
+             "{\"~\":\"%s\",\"name\":\"%s\",\"uniq_id\":\"%s_%s\","
+             "\"avty_t\":\"~/status\",\"stat_t\":\"~/%s\","
+             "\"unit_of_meas\":\"%s\",%s\"stat_cla\":\"%s\",%s}",
+             baseTopic, s.field, deviceId, s.field, s.field, s.unit, devClass,
+             s.stateClass, device);
+    g_client.publish(topic, g_buf, true);
+  }
+}
+
+// A <field>/set message as arguments of "set" or "swing"
+class MqttArgs : public CommandArgs {
+public:
+  void add(const char *name, const char *value) {
+    if (count < 2) {
+      names[count] = name;
+      values[count] = value;
+      count++;
+    }
+  }
+
+  bool get(const char *name, ArgView &value) const override {
+    for (int i = 0; i < count; i++) {
+      if (strcmp(names[i], name) == 0) {
+        value = {values[i], strlen(values[i])};
+        return true;
+      }
+    }
+    return false;
+  }
+
+private:
+  const char *names[2];
+  const char *values[2];
+  int count = 0;
+};
+
+// Home Assistant swing modes as the v/h arguments of "swing"
+static const struct {
+  const char *name;
+  const char *v;
+  const char *h;
+} SWING_MODES[] = {{"off", "0", "0"},
+                   {"vertical", "1", "0"},
+                   {"horizontal", "0", "1"},
+                   {"both", "1", "1"}};
+
+// Commands go through the same handlers as the console and /set, with
+// the same validation: an invalid value is logged and nothing is sent
+void MqttBridge::handleMessage(char *topic, uint8_t *payload,
+                               unsigned int len) {
+  size_t baseLen = strlen(baseTopic);
+  if (strncmp(topic, baseTopic, baseLen) != 0 || topic[baseLen] != '/')
+    return;
+  const char *field = topic + baseLen + 1;
+
+  char value[16];
+  if (len >= sizeof(value)) {
+    LOG("MQTT: Command %s: value too long", field);
+    return;
+  }
+  memcpy(value, payload, len);
+  value[len] = '\0';
+
+  LOG("MQTT: Command %s = %s", field, value);
+
+  MqttArgs args;
+  const char *command = "set";
+  if (strcmp(field, "mode/set") == 0) {
+    if (strcmp(value, "off") == 0)
+      args.add("power", "off");
+    else
+      args.add("mode", strcmp(value, "fan_only") == 0 ? "fan" : value);
+  } else if (strcmp(field, "target_temp/set") == 0) {
+    args.add("temp", value);
+  } else if (strcmp(field, "fan/set") == 0) {
+    args.add("fan", value);
+  } else if (strcmp(field, "swing/set") == 0) {
+    command = "swing";
+    for (const auto &m : SWING_MODES) {
+      if (strcmp(value, m.name) == 0) {
+        args.add("v", m.v);
+        args.add("h", m.h);
+      }
+    }
+    if (!args.has("v")) {
+      LOG("MQTT: Command %s: unknown swing mode '%s'", field, value);
+      return;
+    }
+  } else {
+    LOG("MQTT: Unknown command topic %s", field);
+    return;
+  }
+
+  NullPrint out;
+  const char *error = findCommand(command)->run(args, out);
+  if (!error)
+    return;
+  if (args.problem().error == ARG_OK) {
+    LOG("MQTT: Command %s: %s", field, error);
+    return;
+  }
+  char detail[80];
+  describeArgProblem(args.problem(), detail, sizeof(detail));
+  LOG("MQTT: Command %s: %s (%s)", field, error, detail);
+}
+
+#else // MQTT disabled
+
+void MqttBridge::begin(const char *) {}
+void MqttBridge::loop() {}
+void MqttBridge::notifyCommand() {}
+void MqttBridge::publishCommand(const S21Command &) {}
+bool MqttBridge::isConnected() { return false; }
+
+#endif // MQTT_HOST
@@ -0,0 +1,89 @@
+#ifndef MQTT_BRIDGE_H
+#define MQTT_BRIDGE_H
+
+#include "../system/config.h"
+#include <Arduino.h>
+
+struct S21Command;
+
+// MQTT is enabled by defining MQTT_HOST in config.h
+#ifndef MQTT_PORT
+#define MQTT_PORT 1883
+#endif
+#ifndef MQTT_USER
+#define MQTT_USER ""
+#endif
+#ifndef MQTT_PASS
+#define MQTT_PASS ""
+#endif
+#ifndef MQTT_BASE_TOPIC
+#define MQTT_BASE_TOPIC "daikin"
+#endif
+#ifndef MQTT_DISCOVERY_PREFIX
+#define MQTT_DISCOVERY_PREFIX "homeassistant"
+#endif
+// connect() blocks the loop: TCP connect (rounded up to whole seconds on
+// Arduino-ESP32 2.x), then the wait for CONNACK. Use an IP for MQTT_HOST,
+// a DNS lookup blocks too.
+#ifndef MQTT_CONNECT_TIMEOUT_MS
+#define MQTT_CONNECT_TIMEOUT_MS 1000
+#endif
+#ifndef MQTT_SOCKET_TIMEOUT_S
+#define MQTT_SOCKET_TIMEOUT_S 2
+#endif
+// Delay between failed connects: doubles up to the max, +-25% jitter
+#ifndef MQTT_BACKOFF_MIN_MS
+#define MQTT_BACKOFF_MIN_MS 2000
+#endif
+#ifndef MQTT_BACKOFF_MAX_MS
+#define MQTT_BACKOFF_MAX_MS 60000
+#endif
+// Background S21 refresh while the broker is connected
+#ifndef MQTT_REFRESH_MS
+#define MQTT_REFRESH_MS 30000
+#endif
+
+// Publishes DaikinState to a broker (retained, only on change), accepts
+// commands on <base>/<id>/<field>/set and announces itself to Home Assistant.
+class MqttBridge {
+public:
+  // Set up topics and client. Call once WiFi is connected.
+  void begin(const char *unitName);
+
+  // Keep the connection alive, refresh state, publish changes
+  void loop();
+
+  // A command was sent through another path (HTTP, CLI): refresh soon
+  void notifyCommand();
+
+  // Status changes of control commands go to <base>/<id>/command (not
+  // retained), from every front end
+  void publishCommand(const S21Command &c);
+
+  bool isConnected();
+
+private:
+  // False if the broker can't be reached
+  bool connect();
+  void publishDiscovery();
+  void publishState(bool force);
+  void handleMessage(char *topic, uint8_t *payload, unsigned int len);
+
+private:
+  bool enabled = false;
+  char deviceId[16];
+  char baseTopic[48];
+  char unitName[32];
+
+  unsigned long lastConnectAttempt = 0;
+  unsigned long reconnectDelay = 0; // Until the next attempt
+  unsigned long backoffStep = MQTT_BACKOFF_MIN_MS;
+  unsigned long lastRefresh = 0;
+  unsigned long lastPublishCheck = 0;
+  unsigned long commandTime = 0;
+  bool refreshPending = false;
+};
+
+extern MqttBridge Mqtt;
+
+#endif // MQTT_BRIDGE_H
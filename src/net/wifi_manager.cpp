@@ -0,0 +1,134 @@
+#include "wifi_manager.h"
+#include "../system/clock.h"
+#include "../system/logger.h"
+#include <WiFi.h>
+
+WifiManager Wifi;
+
+// Set from the WiFi event task, consumed in loop()
+static volatile bool g_linkLost = false;
+static volatile uint8_t g_lostReason = 0;
+
+static void onStaDisconnected(arduino_event_id_t, arduino_event_info_t info) {
+  g_lostReason = info.wifi_sta_disconnected.reason;
+  g_linkLost = true;
+}
+
+void WifiManager::begin(const char *ssid, const char *pass) {
+  this->ssid = ssid;
+  this->pass = pass;
+
+  WiFi.mode(WIFI_STA);
+  WiFi.setSleep(WIFI_MODEM_SLEEP != 0);
+  WiFi.setAutoReconnect(false); // Retries are ours, with backoff
+  WiFi.onEvent(onStaDisconnected, ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+
+  unsigned long now = millis();
+  downSince = now;
+  startAttempt(now);
+}
+
+void WifiManager::onConnect(NetworkCallback cb) {
+  if (connectCbCount < WIFI_MAX_CALLBACKS)
+    connectCbs[connectCbCount++] = cb;
+}
+
+void WifiManager::onDisconnect(NetworkCallback cb) {
+  if (disconnectCbCount < WIFI_MAX_CALLBACKS)
+    disconnectCbs[disconnectCbCount++] = cb;
+}
+
+void WifiManager::loop() {
+  if (!ssid)
+    return;
+  unsigned long now = millis();
+  bool lost = g_linkLost;
+  if (lost)
+    g_linkLost = false;
+
+  switch (linkState) {
+  case WIFI_LINK_CONNECTING:
+    if (WiFi.status() == WL_CONNECTED) {
+      linkUp(now);
+    } else if (lost || elapsedMs(now, stateSince) > WIFI_CONNECT_TIMEOUT_MS) {
+      WiFi.disconnect();
+      backoff = nextBackoff();
+      linkState = WIFI_LINK_BACKOFF;
+      stateSince = now;
+      LOG("WiFi: Attempt failed (reason %d), retry in %lu ms",
+          lost ? g_lostReason : 0, backoff);
+    }
+    break;
+
+  case WIFI_LINK_UP:
+    if (lost || WiFi.status() != WL_CONNECTED) {
+      linkDown(now);
+      startAttempt(now); // First retry right away
+    }
+    break;
+
+  case WIFI_LINK_BACKOFF:
+    if (elapsedMs(now, stateSince) >= backoff)
+      startAttempt(now);
+    break;
+  }
+}
+
+void WifiManager::startAttempt(unsigned long now) {
+  g_linkLost = false;
+  metrics.attempts++;
+  linkState = WIFI_LINK_CONNECTING;
+  stateSince = now;
+  WiFi.begin(ssid, pass);
+  LOG("WiFi: Connecting to [%s]...", ssid);
+}
+
+void WifiManager::linkUp(unsigned long now) {
+  metrics.connects++;
+  metrics.lastConnectMs = elapsedMs(now, stateSince);
+  if (everUp) {
+    uint32_t outage = elapsedMs(now, downSince);
+    metrics.lastOutageMs = outage;
+    metrics.downMs += outage;
+    if (outage > metrics.longestOutageMs)
+      metrics.longestOutageMs = outage;
+  }
+  everUp = true;
+  linkState = WIFI_LINK_UP;
+  stateSince = now;
+  backoffStep = WIFI_BACKOFF_MIN_MS;
+  LOG("WiFi: Connected, IP %s (%lu ms)", WiFi.localIP().toString().c_str(),
+      (unsigned long)metrics.lastConnectMs);
+
+  for (int i = 0; i < connectCbCount; i++)
+    connectCbs[i]();
+}
+
+void WifiManager::linkDown(unsigned long now) {
+  metrics.disconnects++;
+  metrics.lastReason = g_lostReason;
+  downSince = now;
+  LOG("WiFi: Link lost (reason %d)", metrics.lastReason);
+
+  for (int i = 0; i < disconnectCbCount; i++)
+    disconnectCbs[i]();
+}
+
+// Exponential with +-25% jitter, so devices dropped by the same AP reboot
+// don't all come back in lockstep
+unsigned long WifiManager::nextBackoff() {
+  unsigned long base = backoffStep;
+  backoffStep = min(backoffStep * 2, (unsigned long)WIFI_BACKOFF_MAX_MS);
+  return base * random(75, 126) / 100;
+}
+
+const char *wifiLinkStateName(WifiLinkState state) {
+  switch (state) {
+  case WIFI_LINK_UP:
+    return "up";
+  case WIFI_LINK_CONNECTING:
+    return "connecting";
+  default:
+    return "backoff";
+  }
+}
@@ -0,0 +1,95 @@
+#ifndef WIFI_MANAGER_H
+#define WIFI_MANAGER_H
+
+#include "../system/config.h"
+#include <Arduino.h>
+
+// Give up on one connection attempt after this long
+#ifndef WIFI_CONNECT_TIMEOUT_MS
+#define WIFI_CONNECT_TIMEOUT_MS 15000
+#endif
+// Delay between failed attempts: doubles up to the max, +-25% jitter
+#ifndef WIFI_BACKOFF_MIN_MS
+#define WIFI_BACKOFF_MIN_MS 1000
+#endif
+#ifndef WIFI_BACKOFF_MAX_MS
+#define WIFI_BACKOFF_MAX_MS 60000
+#endif
+
+// Modem sleep between DTIM beacons: the radio is off most of the time, at
+// the cost of up to a beacon interval of latency on incoming packets
+#ifndef WIFI_MODEM_SLEEP
+#define WIFI_MODEM_SLEEP 1
+#endif
+
+#define WIFI_MAX_CALLBACKS 4
+
+enum WifiLinkState : uint8_t {
+  WIFI_LINK_CONNECTING,
+  WIFI_LINK_UP,
+  WIFI_LINK_BACKOFF
+};
+
+struct WifiMetrics {
+  uint32_t attempts;      // WiFi.begin() calls
+  uint32_t connects;      // Got an IP
+  uint32_t disconnects;   // Lost the link after being up
+  uint32_t lastConnectMs; // WiFi.begin() to IP, last successful attempt
+  uint32_t lastOutageMs;  // Link lost to IP again
+  uint32_t longestOutageMs;
+  uint64_t downMs; // Total of the outages that ended
+  uint8_t lastReason; // Last disconnect reason (wifi_err_reason_t)
+};
+
+typedef void (*NetworkCallback)();
+
+// Brings the station link up in the background and keeps it up: the rest
+// of the firmware runs while it connects, and lost links are retried with
+// jittered exponential backoff. WiFi events only set flags; all state
+// changes and callbacks happen in loop().
+class WifiManager {
+public:
+  // Start connecting. Returns immediately.
+  void begin(const char *ssid, const char *pass);
+
+  // Call from loop()
+  void loop();
+
+  // Called from loop() every time the link comes up / goes down
+  void onConnect(NetworkCallback cb);
+  void onDisconnect(NetworkCallback cb);
+
+  bool isConnected() const { return linkState == WIFI_LINK_UP; }
+  WifiLinkState state() const { return linkState; }
+
+  const WifiMetrics &getMetrics() const { return metrics; }
+
+private:
+  void startAttempt(unsigned long now);
+  void linkUp(unsigned long now);
+  void linkDown(unsigned long now);
+  unsigned long nextBackoff();
+
+private:
+  const char *ssid = nullptr;
+  const char *pass = nullptr;
+  WifiLinkState linkState = WIFI_LINK_BACKOFF;
+  unsigned long stateSince = 0;
+  unsigned long downSince = 0; // Start of the current outage / first attempt
+  unsigned long backoff = 0;
+  unsigned long backoffStep = WIFI_BACKOFF_MIN_MS;
+  bool everUp = false;
+
+  NetworkCallback connectCbs[WIFI_MAX_CALLBACKS];
+  NetworkCallback disconnectCbs[WIFI_MAX_CALLBACKS];
+  uint8_t connectCbCount = 0;
+  uint8_t disconnectCbCount = 0;
+
+  WifiMetrics metrics = {};
+};
+
+extern WifiManager Wifi;
+
+const char *wifiLinkStateName(WifiLinkState state);
+
+#endif // WIFI_MANAGER_H
@@ -0,0 +1,162 @@
+#include "args.h"
+
+// Longer numbers are malformed; keeps the parsers free of overflow checks
+#define ARG_MAX_DIGITS 9
+
+static const char *const ERROR_NAMES[] = {"ok",     "missing", "malformed",
+                                          "range",  "choice",  "too_long"};
+
+const char *argErrorName(ArgError error) {
+  return error <= ARG_TOO_LONG ? ERROR_NAMES[error] : "?";
+}
+
+bool ArgView::equals(const char *s) const {
+  return strlen(s) == len && memcmp(data, s, len) == 0;
+}
+
+ArgView ArgView::trimmed() const {
+  ArgView v = *this;
+  while (v.len > 0 && v.data[0] == ' ') {
+    v.data++;
+    v.len--;
+  }
+  while (v.len > 0 && v.data[v.len - 1] == ' ')
+    v.len--;
+  return v;
+}
+
+bool ArgView::copyTo(char *out, size_t size) const {
+  if (size == 0)
+    return false;
+  size_t n = len < size - 1 ? len : size - 1;
+  memcpy(out, data, n);
+  out[n] = '\0';
+  return n == len;
+}
+
+// Digits from p, at most ARG_MAX_DIGITS; returns how many were read
+static size_t readDigits(const char *p, const char *end, int32_t &value) {
+  size_t n = 0;
+  value = 0;
+  while (p + n < end && isdigit((unsigned char)p[n])) {
+    if (n == ARG_MAX_DIGITS)
+      return 0;
+    value = value * 10 + (p[n] - '0');
+    n++;
+  }
+  return n;
+}
+
+bool parseArgInt(ArgView v, int32_t &out) {
+  const char *p = v.data;
+  const char *end = v.data + v.len;
+  bool negative = p < end && *p == '-';
+  if (p < end && (*p == '-' || *p == '+'))
+    p++;
+  int32_t value;
+  size_t n = readDigits(p, end, value);
+  if (n == 0 || p + n != end)
+    return false;
+  out = negative ? -value : value;
+  return true;
+}
+
+bool parseArgTenths(ArgView v, int32_t &out) {
+  const char *p = v.data;
+  const char *end = v.data + v.len;
+  bool negative = p < end && *p == '-';
+  if (p < end && (*p == '-' || *p == '+'))
+    p++;
+  int32_t whole;
+  size_t n = readDigits(p, end, whole);
+  if (n == 0 || n == ARG_MAX_DIGITS) // One digit less: room for the tenths
+    return false;
+  p += n;
+  int32_t tenths = whole * 10;
+  if (p < end && *p == '.') {
+    p++;
+    const char *fraction = p;
+    while (p < end && isdigit((unsigned char)*p))
+      p++;
+    if (p == fraction)
+      return false;
+    tenths += fraction[0] - '0';
+    if (p - fraction > 1 && fraction[1] >= '5')
+      tenths++;
+  }
+  if (p != end)
+    return false;
+  out = negative ? -tenths : tenths;
+  return true;
+}
+
+const ArgName *findArgName(ArgView v, const ArgName *table, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    if (v.equals(table[i].name))
+      return &table[i];
+  }
+  int32_t number;
+  if (!parseArgInt(v, number))
+    return nullptr;
+  for (size_t i = 0; i < count; i++) {
+    if (table[i].value == number)
+      return &table[i];
+  }
+  return nullptr;
+}
+
+void describeArgProblem(const ArgProblem &problem, char *out, size_t size) {
+  switch (problem.error) {
+  case ARG_RANGE:
+    if (problem.decimals)
+      snprintf(out, size, "out of range %.1f-%.1f", problem.min / 10.0,
+               problem.max / 10.0);
+    else
+      snprintf(out, size, "out of range %ld-%ld", (long)problem.min,
+               (long)problem.max);
+    break;
+  case ARG_CHOICE: {
+    size_t n = snprintf(out, size, "one of");
+    for (uint8_t i = 0; i < problem.choiceCount && n < size; i++) {
+      n += snprintf(out + n, size - n, i ? ", %s" : " %s",
+                    problem.choices[i].name);
+    }
+    break;
+  }
+  case ARG_TOO_LONG:
+    snprintf(out, size, "longer than %ld", (long)problem.max);
+    break;
+  default:
+    snprintf(out, size, "%s", argErrorName(problem.error));
+    break;
+  }
+}
+
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+size_t urlDecodeInPlace(char *s, size_t len) {
+  size_t out = 0;
+  for (size_t i = 0; i < len; i++) {
+    char c = s[i];
+    if (c == '+') {
+      c = ' ';
+    } else if (c == '%' && i + 2 < len) {
+      int hi = hexValue(s[i + 1]);
+      int lo = hexValue(s[i + 2]);
+      if (hi >= 0 && lo >= 0) {
+        c = (char)((hi << 4) | lo);
+        i += 2;
+      }
+    }
+    s[out++] = c;
+  }
+  return out;
+}
@@ -0,0 +1,62 @@
+#ifndef ARGS_H
+#define ARGS_H
+
+#include <Arduino.h>
+
+// Argument values for the console and the HTTP API, parsed where they lie:
+// a view points into the console line or the request buffer, no copies.
+
+// Part of a line or request; not NUL terminated
+struct ArgView {
+  const char *data;
+  size_t len;
+
+  bool equals(const char *s) const;
+  // Without leading and trailing spaces
+  ArgView trimmed() const;
+  // NUL-terminated copy; false if it had to be cut to fit
+  bool copyTo(char *out, size_t size) const;
+};
+
+enum ArgError : uint8_t {
+  ARG_OK,
+  ARG_MISSING,
+  ARG_MALFORMED, // Not a number
+  ARG_RANGE,     // A number outside [min, max]
+  ARG_CHOICE,    // None of the names or their values
+  ARG_TOO_LONG,
+};
+
+// A name and the value it stands for ("cool" = 3). The value written as a
+// number is accepted too.
+struct ArgName {
+  const char *name;
+  uint8_t value;
+};
+
+// The first bad argument of a command, for the error reply
+struct ArgProblem {
+  ArgError error;
+  const char *name;
+  int32_t min; // ARG_RANGE; ARG_TOO_LONG: max = longest length
+  int32_t max;
+  uint8_t decimals;       // 1 when min/max are in tenths
+  const ArgName *choices; // ARG_CHOICE
+  uint8_t choiceCount;
+};
+
+const char *argErrorName(ArgError error);
+
+// "out of range 10.0-32.0", "one of auto, dry, ..." (console output)
+void describeArgProblem(const ArgProblem &problem, char *out, size_t size);
+
+// The whole view must be a number: optional sign, digits
+bool parseArgInt(ArgView v, int32_t &out);
+// Decimal number in tenths, rounded half away from zero ("21.25" = 213)
+bool parseArgTenths(ArgView v, int32_t &out);
+const ArgName *findArgName(ArgView v, const ArgName *table, size_t count);
+
+// Decode %XX and '+' in place; returns the new length
+size_t urlDecodeInPlace(char *s, size_t len);
+
+#endif // ARGS_H
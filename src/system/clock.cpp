@@ -0,0 +1,53 @@
+#include "clock.h"
+#include "logger.h"
+#ifdef ESP_PLATFORM
+#include <esp_timer.h>
+#endif
+
+// Anything before this is an unset clock (1970 + boot time)
+#define CLOCK_MIN_VALID 1577836800 // 2020-01-01
+
+static time_t systemClock() { return time(nullptr); }
+
+static ClockSource g_source = systemClock;
+
+void clockBegin() {
+  configTzTime(TZ_INFO, NTP_SERVER);
+  LOG("Clock: SNTP %s, TZ %s", NTP_SERVER, TZ_INFO);
+}
+
+void setClockSource(ClockSource source) {
+  g_source = source ? source : systemClock;
+}
+
+bool clockValid() { return g_source() >= CLOCK_MIN_VALID; }
+
+uint64_t uptimeMs() {
+#ifdef ESP_PLATFORM
+  return esp_timer_get_time() / 1000;
+#else
+  // Extend millis() with a rollover count; called often enough (every
+  // metrics read) not to miss one
+  static uint32_t last = 0;
+  static uint32_t rollovers = 0;
+  uint32_t now = millis();
+  if (now < last)
+    rollovers++;
+  last = now;
+  return (uint64_t)rollovers << 32 | now;
+#endif
+}
+
+bool clockMinuteOfWeek(uint16_t &minuteOfWeek) {
+  time_t now = g_source();
+  if (now < CLOCK_MIN_VALID)
+    return false;
+
+  struct tm local;
+  localtime_r(&now, &local);
+
+  // tm_wday: 0 = Sunday. We count from Monday.
+  int day = (local.tm_wday + 6) % 7;
+  minuteOfWeek = day * 24 * 60 + local.tm_hour * 60 + local.tm_min;
+  return true;
+}
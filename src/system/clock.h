@@ -0,0 +1,43 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include "config.h"
+#include <Arduino.h>
+#include <time.h>
+
+#ifndef NTP_SERVER
+#define NTP_SERVER "pool.ntp.org"
+#endif
+// POSIX TZ string, default Central European Time with DST
+#ifndef TZ_INFO
+#define TZ_INFO "CET-1CEST,M3.5.0,M10.5.0/3"
+#endif
+
+#define MINUTES_PER_WEEK (7 * 24 * 60)
+
+// Wall-clock time source (seconds since epoch, UTC). Defaults to the
+// system clock kept by SNTP; can be replaced, e.g. by a fake clock.
+typedef time_t (*ClockSource)();
+
+// Start SNTP. Call once the network is up.
+void clockBegin();
+
+void setClockSource(ClockSource source);
+
+// True once the clock has been set (SNTP sync, RTC, ...)
+bool clockValid();
+
+// Local time as minutes since Monday 00:00. False while not valid.
+bool clockMinuteOfWeek(uint16_t &minuteOfWeek);
+
+// Milliseconds from `since` to `now`, both millis() readings. Computed in
+// 32 bits so it stays right across the 49.7-day millis() rollover, also
+// where unsigned long is 64 bits (host builds). Never compare two
+// timestamps directly.
+inline uint32_t elapsedMs(uint32_t now, uint32_t since) { return now - since; }
+inline uint32_t msSince(uint32_t since) { return elapsedMs(millis(), since); }
+
+// Time since boot that does not roll over
+uint64_t uptimeMs();
+
+#endif // CLOCK_H
@@ -0,0 +1,390 @@
+#include "commands.h"
+#include "../daikin/analytics.h"
+#include "../daikin/daikin_state.h"
+#include "../daikin/s21_commands.h"
+#include "../daikin/s21_driver.h"
+#include "../daikin/s21_line.h"
+#include "../daikin/s21_supervisor.h"
+#include "../net/mqtt_bridge.h"
+#include "console.h"
+#include "logger.h"
+
+#define COMMAND_MAX_WORDS 8
+
+// "key=value" words after the command name. A bare word is a flag.
+class LineArgs : public CommandArgs {
+public:
+  LineArgs(char **words, int count) : words(words), count(count) {}
+
+  bool get(const char *name, ArgView &value) const override {
+    size_t nameLen = strlen(name);
+    for (int i = 0; i < count; i++) {
+      const char *w = words[i];
+      if (strncmp(w, name, nameLen) != 0)
+        continue;
+      if (w[nameLen] == '=') {
+        value = {w + nameLen + 1, strlen(w + nameLen + 1)};
+        return true;
+      }
+      if (w[nameLen] == '\0') {
+        value = {"1", 1};
+        return true;
+      }
+    }
+    return false;
+  }
+
+private:
+  char **words;
+  int count;
+};
+
+static constexpr ArgName BOOL_NAMES[] = {{"1", 1},    {"0", 0},
+                                         {"true", 1}, {"false", 0},
+                                         {"on", 1},   {"off", 0}};
+
+ArgError CommandArgs::fail(ArgProblem problem) const {
+  lastProblem = problem;
+  return problem.error;
+}
+
+ArgError CommandArgs::getNumber(const char *name, int32_t min, int32_t max,
+                                bool tenths, int32_t &out) const {
+  ArgView v;
+  if (!get(name, v))
+    return ARG_MISSING;
+  int32_t value;
+  if (!(tenths ? parseArgTenths(v, value) : parseArgInt(v, value)))
+    return fail({ARG_MALFORMED, name});
+  if (value < min || value > max)
+    return fail({ARG_RANGE, name, min, max, tenths});
+  out = value;
+  return ARG_OK;
+}
+
+ArgError CommandArgs::getInt(const char *name, int32_t min, int32_t max,
+                             int32_t &out) const {
+  return getNumber(name, min, max, false, out);
+}
+
+ArgError CommandArgs::getTenths(const char *name, int32_t min, int32_t max,
+                                int32_t &out) const {
+  return getNumber(name, min, max, true, out);
+}
+
+ArgError CommandArgs::getChoice(const char *name, const ArgName *table,
+                                size_t count, uint8_t &out) const {
+  ArgView v;
+  if (!get(name, v))
+    return ARG_MISSING;
+  const ArgName *found = findArgName(v, table, count);
+  if (!found)
+    return fail({ARG_CHOICE, name, 0, 0, 0, table, (uint8_t)count});
+  out = found->value;
+  return ARG_OK;
+}
+
+ArgError CommandArgs::getBool(const char *name, bool &out) const {
+  uint8_t value;
+  ArgError error = getChoice(name, BOOL_NAMES, value);
+  if (error == ARG_OK)
+    out = value;
+  return error;
+}
+
+ArgError CommandArgs::getText(const char *name, size_t maxLen,
+                              ArgView &out) const {
+  ArgView v;
+  if (!get(name, v))
+    return ARG_MISSING;
+  if (v.len > maxLen)
+    return fail({ARG_TOO_LONG, name, 0, (int32_t)maxLen});
+  out = v;
+  return ARG_OK;
+}
+
+static const char *cmdSet(const CommandArgs &args, Print &out) {
+  if (S21.isPassive())
+    return "Bus is in passive mode (listen only)";
+  DaikinCommand cmd;
+  int32_t tenths = 0;
+  ArgError mode = args.getChoice("mode", MODE_NAMES, cmd.mode);
+  ArgError temp =
+      args.getTenths("temp", TEMP_MIN_TENTHS, TEMP_MAX_TENTHS, tenths);
+  ArgError fan = args.getChoice("fan", FAN_NAMES, cmd.fan);
+  ArgError power = args.getBool("power", cmd.power);
+  if (argInvalid(mode) || argInvalid(temp) || argInvalid(fan) ||
+      argInvalid(power))
+    return "Invalid argument";
+  cmd.hasMode = mode == ARG_OK;
+  cmd.hasTemp = temp == ARG_OK;
+  cmd.temp = tenths / 10.0f;
+  cmd.hasFan = fan == ARG_OK;
+  cmd.hasPower = power == ARG_OK;
+  // Picking a mode or a target turns the unit on, like the remote does
+  if (!cmd.hasPower && (cmd.hasMode || cmd.hasTemp)) {
+    cmd.hasPower = true;
+    cmd.power = true;
+  }
+  if (!cmd.hasPower && !cmd.hasFan)
+    return "Missing 'power', 'mode', 'temp' or 'fan' parameter";
+
+  uint32_t id = Commands.submit(cmd);
+  Mqtt.notifyCommand();
+  LOG("CMD: Set #%lu power %d, mode %d, temp %.1f, fan %d", (unsigned long)id,
+      cmd.hasPower ? cmd.power : -1, cmd.hasMode ? cmd.mode : -1,
+      cmd.hasTemp ? cmd.temp : 0.0, cmd.hasFan ? cmd.fan : -1);
+  out.printf("OK id=%lu\n", (unsigned long)id);
+  return nullptr;
+}
+
+static const char *cmdSwing(const CommandArgs &args, Print &out) {
+  if (S21.isPassive())
+    return "Bus is in passive mode (listen only)";
+  bool v;
+  bool h;
+  ArgError errorV = args.getBool("v", v);
+  ArgError errorH = args.getBool("h", h);
+  if (argInvalid(errorV) || argInvalid(errorH))
+    return "Invalid argument";
+  if (errorV == ARG_MISSING || errorH == ARG_MISSING)
+    return "Missing 'v' or 'h' parameter";
+
+  uint32_t id = Commands.submitSwing(v, h);
+  Mqtt.notifyCommand();
+  LOG("CMD: Set Swing #%lu V=%d, H=%d", (unsigned long)id, v, h);
+  out.printf("OK id=%lu\n", (unsigned long)id);
+  return nullptr;
+}
+
+// The rest only make sense on the console
+#if CLI_ENABLED
+
+static const char *cmdHelp(const CommandArgs &, Print &out) {
+  for (size_t i = 0; i < COMMAND_COUNT; i++) {
+    out.printf("  %-12s %s\n", COMMANDS[i].name, COMMANDS[i].usage);
+  }
+  out.println("  Shorthands: C24 H22 D24 A24 (mode + temp), F (fan), O (off), "
+              "R (bus restart)");
+  return nullptr;
+}
+
+static const char *cmdStatus(const CommandArgs &, Print &out) {
+  out.printf("power=%d mode=%d target=%.1f room=%.1f outside=%.1f fan=%d "
+             "swing_v=%d swing_h=%d\n",
+             State.power, State.mode, State.targetTemp, State.roomTemp,
+             State.outsideTemp, State.fan, State.swingV, State.swingH);
+  out.printf("bus=%s poll_age=%lums\n", s21LinkStateName(Supervisor.state()),
+             S21.pollAge());
+  return nullptr;
+}
+
+// Recent control commands, oldest first, then totals and latencies
+static const char *cmdCommands(const CommandArgs &, Print &out) {
+  for (size_t i = 0; i < Commands.count(); i++) {
+    const S21Command &c = Commands.at(i);
+    out.printf("#%lu %s %s attempts=%u naks=%u readbacks=%u ack_ms=%lu "
+               "done_ms=%lu\n",
+               (unsigned long)c.id, s21CommandKindName(c.kind),
+               s21CommandStatusName(c.status), c.attempts, c.naks,
+               c.readbacks, (unsigned long)c.ackMs, (unsigned long)c.doneMs);
+  }
+  const S21CommandStats &s = Commands.getStats();
+  out.printf("submitted=%lu confirmed=%lu naked=%lu mismatch=%lu failed=%lu "
+             "superseded=%lu retries=%lu\n",
+             (unsigned long)s.submitted, (unsigned long)s.confirmed,
+             (unsigned long)s.naked, (unsigned long)s.mismatched,
+             (unsigned long)s.failed, (unsigned long)s.superseded,
+             (unsigned long)s.retries);
+  out.printf("ack_avg_ms=%u ack_max_ms=%u confirm_avg_ms=%u "
+             "confirm_max_ms=%u\n",
+             s.ackLatency.averageMs(), s.ackLatency.maxMs,
+             s.confirmLatency.averageMs(), s.confirmLatency.maxMs);
+  return nullptr;
+}
+
+static const char *cmdPoll(const CommandArgs &, Print &out) {
+  S21.requestPoll();
+  out.println("OK");
+  return nullptr;
+}
+
+static const char *cmdBusRestart(const CommandArgs &, Print &out) {
+  Supervisor.restart();
+  LOG("CMD: Bus restart");
+  out.println("OK");
+  return nullptr;
+}
+
+static const char *cmdBusMode(const CommandArgs &args, Print &out) {
+  if (args.has("passive"))
+    S21.setPassive(true);
+  else if (args.has("active"))
+    S21.setPassive(false);
+  const S21Traffic &t = S21.getTraffic();
+  out.printf("mode=%s contention=%d frames=%lu foreign=%lu unsolicited=%lu "
+             "commands_seen=%lu tx_blocked=%lu\n",
+             S21.isPassive() ? "passive" : "active", S21.contention(),
+             (unsigned long)t.frames, (unsigned long)t.foreignRequests,
+             (unsigned long)t.unsolicited, (unsigned long)t.commandsSeen,
+             (unsigned long)t.txBlocked);
+  return nullptr;
+}
+
+// Line quality: score history (newest first) and error breakdown
+static const char *cmdLine(const CommandArgs &args, Print &out) {
+  S21LineScore now = Line.current();
+  const S21LineCounters &c = Line.totals();
+  out.printf("now=%u %s echo=%s\n", now.score,
+             s21LineVerdictName(now.verdict), Line.echoMode());
+  out.print("history=");
+  for (size_t i = 0; i < Line.historyCount(); i++) {
+    out.printf(i ? ",%u" : "%u", Line.history(i).score);
+  }
+  out.println();
+  out.printf("bytes=%lu frames=%lu bad_frames=%lu parity=%lu framing=%lu "
+             "break=%lu overflow=%lu\n",
+             (unsigned long)c.bytes, (unsigned long)c.frames,
+             (unsigned long)c.badFrames,
+             (unsigned long)c.uartErrors[S21_UART_PARITY],
+             (unsigned long)c.uartErrors[S21_UART_FRAMING],
+             (unsigned long)c.uartErrors[S21_UART_BREAK],
+             (unsigned long)c.uartErrors[S21_UART_OVERFLOW]);
+  out.printf("requests=%lu timeouts=%lu slow=%lu ack_avg_ms=%u "
+             "reply_avg_ms=%u reply_max_ms=%u echo_mismatch=%lu\n",
+             (unsigned long)c.requests, (unsigned long)c.timeouts,
+             (unsigned long)c.slowReplies, Line.ackLatency().averageMs(),
+             Line.replyLatency().averageMs(), Line.replyLatency().maxMs,
+             (unsigned long)c.echoMismatches);
+  return nullptr;
+}
+
+#if ANALYTICS_ENABLED
+static const char *cmdAnalytics(const CommandArgs &args, Print &out) {
+  if (args.has("reset"))
+    Analytics.reset();
+  const AnalyticsTotals &t = Analytics.getTotals();
+  out.printf("observed_h=%.1f on_h=%.1f compressor_h=%.1f starts=%lu "
+             "starts_last_hour=%u estimated_kwh=%.1f metered_kwh=%.1f\n",
+             t.observedMs / 3600000.0f, t.onMs / 3600000.0f,
+             t.compressorMs / 3600000.0f, (unsigned long)t.compressorStarts,
+             Analytics.startsLastHour(), t.estimatedJ / 3600000.0f,
+             t.meteredKWh);
+  for (int m = 0; m < ANALYTICS_MODE_COUNT; m++) {
+    out.printf("%s_h=%.1f ", analyticsModeName((AnalyticsMode)m),
+               t.modeMs[m] / 3600000.0f);
+  }
+  out.println();
+  return nullptr;
+}
+#endif // ANALYTICS_ENABLED
+
+#endif // CLI_ENABLED
+
+const Command COMMANDS[] = {
+#if CLI_ENABLED
+    {"help", "List commands", cmdHelp},
+    {"status", "Show the unit state", cmdStatus},
+#endif
+    {"set",
+     "[power=on|off] [mode=auto|dry|cool|heat|fan] [temp=10-32] "
+     "[fan=1-5|auto|silent]",
+     cmdSet},
+    {"swing", "v=0|1 h=0|1", cmdSwing},
+#if CLI_ENABLED
+    {"commands", "Recent set/swing commands and how they went", cmdCommands},
+    {"poll", "Refresh the state from the unit", cmdPoll},
+    {"bus-restart", "Re-run the S21 handshake", cmdBusRestart},
+    {"bus-mode", "[active|passive] Show or switch (passive = listen only)",
+     cmdBusMode},
+    {"line", "Show the S21 line quality", cmdLine},
+#if ANALYTICS_ENABLED
+    {"analytics", "[reset] Runtime, cycles and energy totals", cmdAnalytics},
+#endif
+#endif // CLI_ENABLED
+};
+
+const size_t COMMAND_COUNT = sizeof(COMMANDS) / sizeof(COMMANDS[0]);
+
+const Command *findCommand(const char *name) {
+  for (size_t i = 0; i < COMMAND_COUNT; i++) {
+    if (strcmp(COMMANDS[i].name, name) == 0)
+      return &COMMANDS[i];
+  }
+  return nullptr;
+}
+
+// Old one-letter CLI: C24 = cool at 24, H/D/A likewise, F = fan only,
+// O = off, R = bus restart. Expanded into a regular command line.
+static bool expandShorthand(const char *line, char *out, size_t size) {
+  char letter = line[0];
+  const char *number = line + 1;
+  for (const char *p = number; *p; p++) {
+    if (!isdigit(*p) && *p != '.')
+      return false;
+  }
+  const char *temp = *number ? number : "22";
+
+  int mode;
+  switch (letter) {
+  case 'C':
+    mode = 3;
+    break;
+  case 'H':
+    mode = 4;
+    break;
+  case 'D':
+    mode = 2;
+    break;
+  case 'A':
+    mode = 1;
+    break;
+  case 'F':
+    snprintf(out, size, "set mode=6 temp=25 fan=5");
+    return true;
+  case 'O':
+    snprintf(out, size, "set power=off");
+    return true;
+  case 'R':
+    snprintf(out, size, "bus-restart");
+    return true;
+  default:
+    return false;
+  }
+  snprintf(out, size, "set mode=%d temp=%s fan=5", mode, temp);
+  return true;
+}
+
+void runCommandLine(char *line, Print &out) {
+  char expanded[48];
+  if (isupper(line[0]) && expandShorthand(line, expanded, sizeof(expanded)))
+    line = expanded;
+
+  char *words[COMMAND_MAX_WORDS];
+  int count = 0;
+  char *save = nullptr;
+  for (char *w = strtok_r(line, " \t", &save); w && count < COMMAND_MAX_WORDS;
+       w = strtok_r(nullptr, " \t", &save)) {
+    words[count++] = w;
+  }
+  if (count == 0)
+    return;
+
+  const Command *cmd = findCommand(words[0]);
+  if (!cmd) {
+    out.printf("Unknown command '%s', try 'help'\n", words[0]);
+    return;
+  }
+  LineArgs args(words + 1, count - 1);
+  const char *error = cmd->run(args, out);
+  if (!error)
+    return;
+  const ArgProblem &problem = args.problem();
+  if (problem.error == ARG_OK) {
+    out.println(error);
+    return;
+  }
+  char detail[80];
+  describeArgProblem(problem, detail, sizeof(detail));
+  out.printf("%s '%s': %s\n", error, problem.name, detail);
+}
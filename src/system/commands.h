@@ -0,0 +1,84 @@
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#include "args.h"
+#include <Arduino.h>
+
+// Named arguments of a command, from "key=value" words on a console line
+// or from the query string of an HTTP request
+class CommandArgs {
+public:
+  // The raw value, pointing into the line or request
+  virtual bool get(const char *name, ArgView &value) const = 0;
+  bool has(const char *name) const {
+    ArgView unused;
+    return get(name, unused);
+  }
+
+  // Typed values. ARG_MISSING leaves out alone; any other error is kept in
+  // problem() for the reply.
+  ArgError getInt(const char *name, int32_t min, int32_t max,
+                  int32_t &out) const;
+  ArgError getTenths(const char *name, int32_t min, int32_t max,
+                     int32_t &out) const;
+  ArgError getBool(const char *name, bool &out) const;
+  ArgError getChoice(const char *name, const ArgName *table, size_t count,
+                     uint8_t &out) const;
+  template <size_t N>
+  ArgError getChoice(const char *name, const ArgName (&table)[N],
+                     uint8_t &out) const {
+    return getChoice(name, table, N, out);
+  }
+  ArgError getText(const char *name, size_t maxLen, ArgView &out) const;
+
+  const ArgProblem &problem() const { return lastProblem; }
+
+private:
+  ArgError fail(ArgProblem problem) const;
+  ArgError getNumber(const char *name, int32_t min, int32_t max, bool tenths,
+                     int32_t &out) const;
+
+  mutable ArgProblem lastProblem = {};
+};
+
+// Result of a typed accessor that needs a reply: present but invalid
+inline bool argInvalid(ArgError error) { return error > ARG_MISSING; }
+
+// Values of the unit settings, shared by every front end and the schedule
+constexpr ArgName MODE_NAMES[] = {
+    {"auto", 1}, {"dry", 2}, {"cool", 3}, {"heat", 4}, {"fan", 6}};
+constexpr ArgName FAN_NAMES[] = {{"1", 1},     {"2", 2},       {"3", 3},
+                                 {"4", 4},     {"5", 5},       {"auto", 10},
+                                 {"silent", 11}};
+#define TEMP_MIN_TENTHS 100
+#define TEMP_MAX_TENTHS 320
+
+// Returns nullptr on success or an error message for the caller (400 for
+// HTTP, with args.problem() when an argument was invalid). Text output goes
+// to out: the console prints it, HTTP drops it.
+typedef const char *(*CommandHandler)(const CommandArgs &args, Print &out);
+
+struct Command {
+  const char *name;
+  const char *usage;
+  CommandHandler run;
+};
+
+// One table for every front end (serial, TCP console, HTTP)
+extern const Command COMMANDS[];
+extern const size_t COMMAND_COUNT;
+
+const Command *findCommand(const char *name);
+
+// Run a console line: "set mode=3 temp=24", or the old one-letter
+// shorthands ("C24", "O", "R"). The line is modified while parsing.
+void runCommandLine(char *line, Print &out);
+
+// Discards output (HTTP front end)
+class NullPrint : public Print {
+public:
+  size_t write(uint8_t) override { return 1; }
+  size_t write(const uint8_t *, size_t len) override { return len; }
+};
+
+#endif // COMMANDS_H
@@ -0,0 +1,85 @@
+#include "console.h"
+#include "commands.h"
+#include "heap_tracker.h"
+#include "trace.h"
+#include <WiFi.h>
+
+Console Cli;
+
+#if CLI_ENABLED && CONSOLE_PORT
+static WiFiServer g_listener(CONSOLE_PORT);
+static WiFiClient g_client;
+static bool g_listening = false;
+#endif
+#if CLI_ENABLED
+static LineEditor g_serialLine;
+static LineEditor g_tcpLine;
+#endif
+
+bool LineEditor::feed(uint8_t c) {
+  if (complete) {
+    len = 0;
+    complete = false;
+  }
+
+  if (c == '\r' || c == '\n') {
+    bool ready = len > 0 && !overflow; // Empty: second half of CRLF
+    buf[len] = '\0';
+    if (!ready)
+      len = 0;
+    overflow = false;
+    complete = ready;
+    return ready;
+  }
+  if (c == '\b' || c == 0x7F) {
+    if (len > 0)
+      len--;
+    return false;
+  }
+  if (c < 0x20 || c >= 0x80)
+    return false; // Other control characters, telnet negotiation
+  if (len < sizeof(buf) - 1)
+    buf[len++] = c;
+  else
+    overflow = true;
+  return false;
+}
+
+void Console::beginNetwork() {
+#if CLI_ENABLED && CONSOLE_PORT
+  if (g_listening)
+    return;
+  g_listener.begin();
+  g_listener.setNoDelay(true);
+  g_listening = true;
+#endif
+}
+
+void Console::loop() {
+#if CLI_ENABLED
+  TRACE_SCOPE("console");
+  HEAP_SCOPE("console");
+  poll(Serial, g_serialLine, Serial);
+
+#if CONSOLE_PORT
+  if (!g_listening)
+    return;
+  if (g_listener.hasClient()) {
+    // Newest client wins, there is only one slot
+    if (g_client)
+      g_client.stop();
+    g_client = g_listener.accept();
+    g_client.println("Daikin S21 console, 'help' for commands");
+  }
+  if (g_client && g_client.connected())
+    poll(g_client, g_tcpLine, g_client);
+#endif
+#endif // CLI_ENABLED
+}
+
+void Console::poll(Stream &in, LineEditor &editor, Print &out) {
+  for (int n = 0; n < CONSOLE_MAX_BYTES_PER_LOOP && in.available(); n++) {
+    if (editor.feed(in.read()))
+      runCommandLine(editor.line(), out);
+  }
+}
@@ -0,0 +1,51 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include "config.h"
+#include <Arduino.h>
+
+// Command console on the debug serial port and TCP. 0 leaves only /set
+// and /set-swing in the command table; LOG output is not affected.
+#ifndef CLI_ENABLED
+#define CLI_ENABLED 1
+#endif
+// TCP console port, 0 = serial only
+#ifndef CONSOLE_PORT
+#define CONSOLE_PORT 23
+#endif
+
+#define CONSOLE_LINE_MAX 96
+// Bytes taken from each input per loop(), so a flood can't hog the loop
+#define CONSOLE_MAX_BYTES_PER_LOOP 64
+
+// Builds a line one byte at a time: never waits for the rest of it.
+// Handles CR/LF/CRLF endings and backspace; overlong lines are dropped.
+class LineEditor {
+public:
+  // Returns true when c completed a non-empty line, available in line()
+  bool feed(uint8_t c);
+  char *line() { return buf; }
+
+private:
+  char buf[CONSOLE_LINE_MAX];
+  size_t len = 0;
+  bool overflow = false;
+  bool complete = false; // buf holds the last line until the next byte
+};
+
+// Command console on the debug serial port and a single TCP client, both
+// feeding runCommandLine()
+class Console {
+public:
+  // TCP listener, once the network is up
+  void beginNetwork();
+
+  void loop();
+
+private:
+  void poll(Stream &in, LineEditor &editor, Print &out);
+};
+
+extern Console Cli;
+
+#endif // CONSOLE_H
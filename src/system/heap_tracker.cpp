@@ -0,0 +1,268 @@
+#include "heap_tracker.h"
+
+#ifdef ESP_PLATFORM
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
+
+// Tasks whose stack head-room is reported
+static const char *const TASK_NAMES[] = {"loopTask", "tiT",  "wifi",
+                                         "sys_evt",  "IDLE", "esp_timer"};
+
+HeapSnapshot heapSnapshot() {
+  HeapSnapshot s = {};
+#ifdef ESP_PLATFORM
+  s.freeBytes = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  s.minFreeBytes = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+  s.largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  if (s.freeBytes > 0)
+    s.fragmentation = 100 - (uint64_t)s.largestBlock * 100 / s.freeBytes;
+#endif
+  return s;
+}
+
+int32_t heapStackFree(const char *taskName) {
+#ifdef ESP_PLATFORM
+  TaskHandle_t task = xTaskGetHandle(taskName);
+  if (task)
+    return uxTaskGetStackHighWaterMark(task); // Bytes on ESP-IDF
+#endif
+  return -1;
+}
+
+const char *heapTaskName(size_t index) { return TASK_NAMES[index]; }
+
+size_t heapTaskCount() { return sizeof(TASK_NAMES) / sizeof(TASK_NAMES[0]); }
+
+#if HEAP_TRACKING
+
+#ifndef ESP_PLATFORM
+#include <atomic>
+#endif
+
+extern "C" {
+void *__real_malloc(size_t size);
+void __real_free(void *ptr);
+void *__real_realloc(void *ptr, size_t size);
+void *__real_calloc(size_t count, size_t size);
+}
+
+static_assert((HEAP_MAX_TRACKED & (HEAP_MAX_TRACKED - 1)) == 0,
+              "HEAP_MAX_TRACKED must be a power of two");
+
+// The allocator runs on every task, so the tables are guarded. Nothing in
+// here may allocate.
+#ifdef ESP_PLATFORM
+static portMUX_TYPE g_lock = portMUX_INITIALIZER_UNLOCKED;
+static void lock() { portENTER_CRITICAL(&g_lock); }
+static void unlock() { portEXIT_CRITICAL(&g_lock); }
+static uintptr_t currentTask() { return (uintptr_t)xTaskGetCurrentTaskHandle(); }
+#else
+static std::atomic_flag g_lock = ATOMIC_FLAG_INIT;
+static void lock() {
+  while (g_lock.test_and_set(std::memory_order_acquire)) {
+  }
+}
+static void unlock() { g_lock.clear(std::memory_order_release); }
+static uintptr_t currentTask() { return 1; } // Host tests are single-threaded
+#endif
+
+static HeapSiteStats g_sites[HEAP_MAX_SITES] = {{"untagged"}};
+static uint32_t g_siteMinute[HEAP_MAX_SITES];
+static uint8_t g_siteCount = 1;
+
+// Scope state, owned by the task that opened the first scope
+static uintptr_t g_scopeTask = 0;
+static volatile uint8_t g_site = 0;
+static volatile bool g_noAlloc = false;
+
+static uint32_t g_violations = 0;
+static uint32_t g_untracked = 0;
+
+// Open-addressing table of tagged live blocks: pointer -> size and site
+struct TrackedBlock {
+  uintptr_t ptr; // 0 = empty
+  uint32_t sizeAndSite; // size << 8 | site
+};
+static TrackedBlock g_blocks[HEAP_MAX_TRACKED];
+static uint16_t g_blockCount = 0;
+
+static size_t slotOf(uintptr_t ptr) {
+  return ((ptr >> 3) * 2654435761u) & (HEAP_MAX_TRACKED - 1);
+}
+
+static bool insertBlock(uintptr_t ptr, size_t size, uint8_t site) {
+  if (g_blockCount >= HEAP_MAX_TRACKED * 3 / 4 || size >= (1UL << 24))
+    return false;
+  size_t i = slotOf(ptr);
+  while (g_blocks[i].ptr)
+    i = (i + 1) & (HEAP_MAX_TRACKED - 1);
+  g_blocks[i].ptr = ptr;
+  g_blocks[i].sizeAndSite = size << 8 | site;
+  g_blockCount++;
+  return true;
+}
+
+// Returns false if the block isn't tracked
+static bool removeBlock(uintptr_t ptr, uint32_t &sizeAndSite) {
+  size_t i = slotOf(ptr);
+  while (g_blocks[i].ptr != ptr) {
+    if (!g_blocks[i].ptr)
+      return false;
+    i = (i + 1) & (HEAP_MAX_TRACKED - 1);
+  }
+  sizeAndSite = g_blocks[i].sizeAndSite;
+  g_blockCount--;
+
+  // Backward-shift deletion keeps probe chains intact without tombstones
+  for (;;) {
+    g_blocks[i].ptr = 0;
+    size_t j = i;
+    for (;;) {
+      j = (j + 1) & (HEAP_MAX_TRACKED - 1);
+      if (!g_blocks[j].ptr)
+        return true;
+      size_t home = slotOf(g_blocks[j].ptr);
+      bool between = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+      if (!between)
+        break;
+    }
+    g_blocks[i] = g_blocks[j];
+    i = j;
+  }
+}
+
+static void rollMinute(uint8_t site) {
+  uint32_t minute = millis() / 60000;
+  if (g_siteMinute[site] == minute)
+    return;
+  HeapSiteStats &s = g_sites[site];
+  s.allocsLastMinute = g_siteMinute[site] + 1 == minute ? s.allocsThisMinute : 0;
+  s.allocsThisMinute = 0;
+  g_siteMinute[site] = minute;
+}
+
+static void noteAlloc(void *ptr, size_t size) {
+  if (!ptr)
+    return;
+  uint8_t site = g_site && currentTask() == g_scopeTask ? g_site : 0;
+  bool violation = site && g_noAlloc;
+
+  lock();
+  rollMinute(site);
+  HeapSiteStats &s = g_sites[site];
+  s.allocs++;
+  s.allocsThisMinute++;
+  if (site) {
+    if (insertBlock((uintptr_t)ptr, size, site)) {
+      s.liveBytes += size;
+      if (s.liveBytes > s.peakBytes)
+        s.peakBytes = s.liveBytes;
+    } else {
+      g_untracked++;
+    }
+  }
+  if (violation)
+    g_violations++;
+  unlock();
+
+  if (violation && HEAP_STRICT)
+    abort();
+}
+
+static void noteFree(void *ptr) {
+  uint32_t sizeAndSite;
+  lock();
+  if (removeBlock((uintptr_t)ptr, sizeAndSite)) {
+    HeapSiteStats &s = g_sites[sizeAndSite & 0xFF];
+    s.frees++;
+    s.liveBytes -= sizeAndSite >> 8;
+  } else {
+    g_sites[0].frees++;
+  }
+  unlock();
+}
+
+extern "C" void *__wrap_malloc(size_t size) {
+  void *ptr = __real_malloc(size);
+  noteAlloc(ptr, size);
+  return ptr;
+}
+
+extern "C" void __wrap_free(void *ptr) {
+  if (ptr)
+    noteFree(ptr);
+  __real_free(ptr);
+}
+
+extern "C" void *__wrap_calloc(size_t count, size_t size) {
+  void *ptr = __real_calloc(count, size);
+  noteAlloc(ptr, count * size);
+  return ptr;
+}
+
+extern "C" void *__wrap_realloc(void *old, size_t size) {
+  void *ptr = __real_realloc(old, size);
+  if (!ptr && size)
+    return ptr; // Failed, the old block is untouched
+  if (old)
+    noteFree(old);
+  noteAlloc(ptr, size);
+  return ptr;
+}
+
+static uint8_t siteIndex(const char *name) {
+  for (uint8_t i = 1; i < g_siteCount; i++) {
+    if (g_sites[i].name == name || strcmp(g_sites[i].name, name) == 0)
+      return i;
+  }
+  if (g_siteCount >= HEAP_MAX_SITES)
+    return 0;
+  g_sites[g_siteCount].name = name;
+  g_siteMinute[g_siteCount] = millis() / 60000;
+  return g_siteCount++;
+}
+
+HeapScope::HeapScope(const char *site, bool noAlloc)
+    : previousSite(g_site), previousNoAlloc(g_noAlloc) {
+  if (!g_scopeTask)
+    g_scopeTask = currentTask();
+  if (currentTask() != g_scopeTask)
+    return; // Only the loop task is tagged
+  g_site = siteIndex(site);
+  g_noAlloc = noAlloc || previousNoAlloc;
+}
+
+HeapScope::~HeapScope() {
+  g_site = previousSite;
+  g_noAlloc = previousNoAlloc;
+}
+
+size_t heapSiteCount() {
+  lock();
+  for (uint8_t i = 0; i < g_siteCount; i++) {
+    rollMinute(i);
+  }
+  unlock();
+  return g_siteCount;
+}
+
+const HeapSiteStats &heapSite(size_t index) { return g_sites[index]; }
+
+uint32_t heapViolations() { return g_violations; }
+uint32_t heapUntracked() { return g_untracked; }
+
+#else
+
+size_t heapSiteCount() { return 0; }
+
+const HeapSiteStats &heapSite(size_t) {
+  static const HeapSiteStats NONE = {"untagged"};
+  return NONE;
+}
+
+uint32_t heapViolations() { return 0; }
+uint32_t heapUntracked() { return 0; }
+
+#endif // HEAP_TRACKING
@@ -0,0 +1,100 @@
+#ifndef HEAP_TRACKER_H
+#define HEAP_TRACKER_H
+
+#include "config.h"
+#include <Arduino.h>
+
+// Opt-in allocation tracker. With HEAP_TRACKING 1 the build must also wrap
+// the allocator at link time:
+//   -Wl,--wrap=malloc,--wrap=free,--wrap=realloc,--wrap=calloc
+// (PlatformIO build_flags, or compiler.c.elf.extra_flags in
+// platform.local.txt). Host builds also need -static-libstdc++ so that
+// operator new is wrapped too. Allocations made inside a HEAP_SCOPE on the
+// loop task are charged to that scope's site; everything else is
+// "untagged".
+// Heap and stack figures in heapSnapshot() work without tracking.
+#ifndef HEAP_TRACKING
+#define HEAP_TRACKING 0
+#endif
+// Abort when a HEAP_SCOPE_NO_ALLOC allocates (host test builds), instead
+// of only counting a violation
+#ifndef HEAP_STRICT
+#define HEAP_STRICT 0
+#endif
+// Named sites, including "untagged"
+#ifndef HEAP_MAX_SITES
+#define HEAP_MAX_SITES 16
+#endif
+// Live tagged blocks remembered so free() can credit their site (8 bytes
+// each, power of two). Blocks beyond this are counted as untracked.
+#ifndef HEAP_MAX_TRACKED
+#define HEAP_MAX_TRACKED 256
+#endif
+
+struct HeapSiteStats {
+  const char *name;
+  uint32_t allocs;
+  uint32_t frees;
+  uint32_t liveBytes;
+  uint32_t peakBytes;
+  uint16_t allocsLastMinute; // Allocation rate, last full minute
+  uint16_t allocsThisMinute;
+};
+
+struct HeapSnapshot {
+  uint32_t freeBytes;
+  uint32_t minFreeBytes; // Low-water mark since boot
+  uint32_t largestBlock;
+  uint8_t fragmentation; // 100 * (1 - largest block / free), in %
+};
+
+// Current heap figures (always available)
+HeapSnapshot heapSnapshot();
+
+// Unused stack of a task in bytes, by FreeRTOS task name (-1 = no such
+// task). heapTaskName(i) lists the tasks worth watching.
+int32_t heapStackFree(const char *taskName);
+const char *heapTaskName(size_t index);
+size_t heapTaskCount();
+
+#if HEAP_TRACKING
+
+class HeapScope {
+public:
+  explicit HeapScope(const char *site, bool noAlloc = false);
+  ~HeapScope();
+
+private:
+  uint8_t previousSite;
+  bool previousNoAlloc;
+};
+
+#define HEAP_CONCAT2(a, b) a##b
+#define HEAP_CONCAT(a, b) HEAP_CONCAT2(a, b)
+#define HEAP_SCOPE(site) HeapScope HEAP_CONCAT(heapScope, __LINE__)(site)
+// Steady-state path that must not allocate
+#define HEAP_SCOPE_NO_ALLOC(site)                                              \
+  HeapScope HEAP_CONCAT(heapScope, __LINE__)(site, true)
+
+#else
+
+#define HEAP_SCOPE(site)                                                       \
+  do {                                                                         \
+  } while (0)
+#define HEAP_SCOPE_NO_ALLOC(site)                                              \
+  do {                                                                         \
+  } while (0)
+
+#endif // HEAP_TRACKING
+
+// Site table (empty without HEAP_TRACKING). Rates roll over lazily, so
+// call heapSiteCount() before reading the sites.
+size_t heapSiteCount();
+const HeapSiteStats &heapSite(size_t index);
+
+// Allocations made inside HEAP_SCOPE_NO_ALLOC scopes
+uint32_t heapViolations();
+// Tagged blocks that didn't fit the tracking table
+uint32_t heapUntracked();
+
+#endif // HEAP_TRACKER_H
@@ -0,0 +1,102 @@
+#include "idle.h"
+#include "clock.h"
+
+IdlePolicy Idle;
+
+#if IDLE_SLEEP
+static SemaphoreHandle_t wakeSemaphore = nullptr;
+#endif
+
+void IdlePolicy::begin() {
+  mhz = getCpuFrequencyMhz();
+  lastActive = millis();
+  lastLoopUs = micros();
+#if IDLE_SLEEP
+  wakeSemaphore = xSemaphoreCreateBinary();
+  // Runs on the UART event task, once per byte: S21Driver::begin() sets
+  // the RX FIFO threshold to 1 (default 120 bytes or the RX timeout)
+  Serial1.onReceive([]() { Idle.wake(); });
+#endif
+}
+
+void IdlePolicy::wake() {
+#if IDLE_SLEEP
+  wakeAtUs = micros();
+  if (wakeSemaphore)
+    xSemaphoreGive(wakeSemaphore);
+#endif
+}
+
+uint32_t IdlePolicy::plan(unsigned long now) {
+  uint32_t ms = budget;
+  budget = IDLE_MAX_SLEEP_MS;
+  if (ms < IDLE_MAX_SLEEP_MS)
+    lastActive = now;
+  lowClock = IDLE_CPU_MHZ > 0 &&
+             elapsedMs(now, lastActive) >= IDLE_SCALE_AFTER_MS;
+  return ms;
+}
+
+void IdlePolicy::sleep() {
+#if IDLE_SLEEP
+  uint32_t ms = plan(millis());
+  if (IDLE_CPU_MHZ > 0 && wantedMhz() != mhz &&
+      setCpuFrequencyMhz(wantedMhz())) {
+    mhz = wantedMhz();
+    metrics.clockChanges++;
+  }
+
+  // At least one tick, like the delay(1) this replaces: lower priority
+  // tasks get to run even when a module is busy
+  if (ms == 0)
+    ms = 1;
+  uint32_t startUs = micros();
+  bool woken = xSemaphoreTake(wakeSemaphore, pdMS_TO_TICKS(ms)) == pdTRUE;
+  account(startUs, ms, woken);
+#else
+  delay(1);
+#endif
+}
+
+void IdlePolicy::account(uint32_t startUs, uint32_t waitMs, bool woken) {
+  uint32_t nowUs = micros();
+  uint32_t slept = nowUs - startUs;
+  uint32_t loopUs = nowUs - lastLoopUs;
+  lastLoopUs = nowUs;
+  metrics.sleeps++;
+  metrics.sleptUs += slept;
+  metrics.loopUs += loopUs;
+  windowSleptUs += slept;
+  windowUs += loopUs;
+
+  if (woken) {
+    metrics.eventWakeups++;
+    // A byte that came in while the loop was running leaves the semaphore
+    // given: nothing to time then
+    uint32_t at = wakeAtUs;
+    if ((int32_t)(at - startUs) >= 0) {
+      uint32_t latency = nowUs - at;
+      metrics.wakeLatencyCount++;
+      metrics.wakeLatencySumUs += latency;
+      if (latency > metrics.wakeLatencyMaxUs)
+        metrics.wakeLatencyMaxUs = latency;
+    }
+  } else if (slept > waitMs * 1000 + IDLE_LATE_US) {
+    uint32_t late = slept - waitMs * 1000;
+    metrics.late++;
+    if (late > metrics.lateMaxUs)
+      metrics.lateMaxUs = late;
+  }
+
+  if (windowUs >= IDLE_WINDOW_MS * 1000ULL) {
+    lastWindowPct = windowSleptUs * 100 / windowUs;
+    windowSleptUs = 0;
+    windowUs = 0;
+  }
+}
+
+uint8_t IdlePolicy::idlePercent() const {
+  if (lastWindowPct <= 100)
+    return lastWindowPct;
+  return windowUs ? windowSleptUs * 100 / windowUs : 0;
+}
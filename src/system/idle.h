@@ -0,0 +1,103 @@
+#ifndef IDLE_H
+#define IDLE_H
+
+#include "config.h"
+#include <Arduino.h>
+
+// Block at the end of loop() until a UART byte arrives or the earliest
+// deadline a module asked for, instead of spinning on delay(1). 0 = the
+// old delay(1) loop.
+#ifndef IDLE_SLEEP
+#define IDLE_SLEEP 1
+#endif
+// Longest wait when nobody asked for less. Bounds the latency of what
+// can't wake the loop: new TCP connections, MQTT, console input.
+#ifndef IDLE_MAX_SLEEP_MS
+#define IDLE_MAX_SLEEP_MS 20
+#endif
+// Longest wait while connections are open (their sockets are polled)
+#ifndef IDLE_NET_POLL_MS
+#define IDLE_NET_POLL_MS 5
+#endif
+// CPU clock after IDLE_SCALE_AFTER_MS without a short deadline, back to
+// ACTIVE_CPU_MHZ as soon as there is one. 0 = never change the clock.
+#ifndef IDLE_CPU_MHZ
+#define IDLE_CPU_MHZ 80
+#endif
+#ifndef ACTIVE_CPU_MHZ
+#define ACTIVE_CPU_MHZ 160
+#endif
+#ifndef IDLE_SCALE_AFTER_MS
+#define IDLE_SCALE_AFTER_MS 2000
+#endif
+// idle % is reported over windows of this length
+#ifndef IDLE_WINDOW_MS
+#define IDLE_WINDOW_MS 60000
+#endif
+// A wait that ends this much after its deadline counts as late
+#define IDLE_LATE_US 2000
+
+struct IdleMetrics {
+  uint64_t sleptUs; // Blocked in sleep(), since boot
+  uint64_t loopUs;  // Total time, since boot
+  uint32_t sleeps;
+  uint32_t eventWakeups; // Ended early by wake()
+  // wake() during the wait to the loop running again
+  uint32_t wakeLatencyCount;
+  uint64_t wakeLatencySumUs;
+  uint32_t wakeLatencyMaxUs;
+  uint32_t late; // Deadlines overshot by more than IDLE_LATE_US
+  uint32_t lateMaxUs;
+  uint32_t clockChanges;
+};
+
+class IdlePolicy {
+public:
+  // Create the wake semaphore and hook UART receive
+  void begin();
+
+  // From a module's loop(): look again within ms at the latest. The
+  // shortest request of the round wins.
+  void within(uint32_t ms) {
+    if (ms < budget)
+      budget = ms;
+  }
+  void busy() { within(0); }
+
+  // Something arrived that loop() should handle now. Any task.
+  void wake();
+
+  // End of loop(): wait, then start a new round of within() calls
+  void sleep();
+
+  // How long the loop may wait from now; starts the next round. Separate
+  // from sleep() so the deadline logic runs against a virtual clock.
+  uint32_t plan(unsigned long now);
+  // The clock to run at, as decided by the last plan()
+  uint16_t wantedMhz() const { return lowClock ? IDLE_CPU_MHZ : ACTIVE_CPU_MHZ; }
+
+  const IdleMetrics &getMetrics() const { return metrics; }
+  // % of the last full window spent waiting (the current one at first)
+  uint8_t idlePercent() const;
+  uint16_t cpuMhz() const { return mhz; }
+
+private:
+  void account(uint32_t startUs, uint32_t waitMs, bool woken);
+
+private:
+  uint32_t budget = IDLE_MAX_SLEEP_MS;
+  unsigned long lastActive = 0;
+  bool lowClock = false;
+  uint16_t mhz = 0;
+  volatile uint32_t wakeAtUs = 0;
+  uint32_t lastLoopUs = 0;
+
+  IdleMetrics metrics = {};
+  uint64_t windowSleptUs = 0;
+  uint64_t windowUs = 0;
+  uint8_t lastWindowPct = 255; // None finished yet
+};
+
+extern IdlePolicy Idle;
+
+#endif // IDLE_H
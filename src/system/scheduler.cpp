@@ -0,0 +1,230 @@
+#include "scheduler.h"
+#include "../daikin/daikin_state.h"
+#include "../daikin/s21_commands.h"
+#include "../net/mqtt_bridge.h"
+#include "clock.h"
+#include "logger.h"
+#include <Preferences.h>
+
+#define SCHED_CHECK_MS 1000
+// Larger clock jumps (first SNTP sync, manual set) skip missed events
+#define SCHED_MAX_CATCHUP_MIN 10
+// Ramp granularity: the unit takes whole Fahrenheit degrees anyway
+#define SCHED_RAMP_STEP 0.5
+
+Scheduler Schedule;
+
+void Scheduler::begin() {
+  Preferences prefs;
+  prefs.begin("daikin", true);
+  size_t len = prefs.getBytesLength("sched");
+  if (len > 0 && len % sizeof(ScheduleEntry) == 0 &&
+      len <= sizeof(entries)) {
+    prefs.getBytes("sched", entries, len);
+    entryCount = len / sizeof(ScheduleEntry);
+  }
+  prefs.end();
+  synced = false;
+  LOG("Schedule: %d entries loaded", entryCount);
+}
+
+void Scheduler::save() {
+  Preferences prefs;
+  prefs.begin("daikin", false);
+  if (entryCount > 0)
+    prefs.putBytes("sched", entries, entryCount * sizeof(ScheduleEntry));
+  else
+    prefs.remove("sched");
+  prefs.end();
+}
+
+int Scheduler::add(uint8_t dayMask, uint16_t minuteOfDay,
+                   const ScheduleEntry &entry) {
+  int days = 0;
+  for (int d = 0; d < 7; d++) {
+    if (dayMask & (1 << d))
+      days++;
+  }
+  if (days == 0 || minuteOfDay >= 24 * 60 ||
+      entryCount + days > SCHED_MAX_ENTRIES)
+    return 0;
+
+  for (int d = 0; d < 7; d++) {
+    if (!(dayMask & (1 << d)))
+      continue;
+    ScheduleEntry e = entry;
+    e.minuteOfWeek = d * 24 * 60 + minuteOfDay;
+
+    // Sorted insert, after entries at the same minute
+    int pos = entryCount;
+    while (pos > 0 && entries[pos - 1].minuteOfWeek > e.minuteOfWeek) {
+      entries[pos] = entries[pos - 1];
+      pos--;
+    }
+    entries[pos] = e;
+    entryCount++;
+  }
+
+  synced = false; // Re-seek the cursor on the next check
+  save();
+  return days;
+}
+
+bool Scheduler::remove(int index) {
+  if (index < 0 || index >= entryCount)
+    return false;
+  for (int i = index; i < entryCount - 1; i++) {
+    entries[i] = entries[i + 1];
+  }
+  entryCount--;
+  synced = false;
+  save();
+  return true;
+}
+
+void Scheduler::clear() {
+  entryCount = 0;
+  rampActive = false;
+  synced = false;
+  save();
+}
+
+// Point the cursor at the first entry after minuteOfWeek (binary search)
+void Scheduler::seek(uint16_t minuteOfWeek) {
+  int lo = 0;
+  int hi = entryCount;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (entries[mid].minuteOfWeek <= minuteOfWeek)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  cursor = lo < entryCount ? lo : 0; // Past the last one: wrap to next week
+}
+
+bool Scheduler::nextEvent(const ScheduleEntry **next,
+                          uint16_t *minutesUntil) {
+  uint16_t now;
+  if (entryCount == 0 || !synced || !clockMinuteOfWeek(now))
+    return false;
+  const ScheduleEntry &e = entries[cursor];
+  *next = &e;
+  *minutesUntil =
+      (e.minuteOfWeek - now + MINUTES_PER_WEEK - 1) % MINUTES_PER_WEEK + 1;
+  return true;
+}
+
+void Scheduler::loop() {
+  unsigned long nowMs = millis();
+  if (elapsedMs(nowMs, lastCheck) < SCHED_CHECK_MS)
+    return;
+  lastCheck = nowMs;
+
+  stepRamp();
+
+  uint16_t now;
+  if (!clockMinuteOfWeek(now))
+    return;
+
+  if (!synced) {
+    seek(now);
+    lastMinute = now;
+    synced = true;
+    return;
+  }
+  if (now == lastMinute || entryCount == 0) {
+    lastMinute = now;
+    return;
+  }
+
+  uint16_t elapsed = (now - lastMinute + MINUTES_PER_WEEK) % MINUTES_PER_WEEK;
+  if (elapsed > SCHED_MAX_CATCHUP_MIN) {
+    LOG("Schedule: Clock jumped %u min, skipping missed events", elapsed);
+    seek(now);
+  } else {
+    // Fire everything in (lastMinute, now]
+    for (int n = 0; n < entryCount; n++) {
+      const ScheduleEntry &e = entries[cursor];
+      uint16_t offset =
+          (e.minuteOfWeek - lastMinute + MINUTES_PER_WEEK) % MINUTES_PER_WEEK;
+      if (offset == 0 || offset > elapsed)
+        break;
+      fire(e);
+      cursor = (cursor + 1) % entryCount;
+    }
+  }
+  lastMinute = now;
+}
+
+// Events use the same command path as /set
+void Scheduler::fire(const ScheduleEntry &e) {
+  LOG("Schedule: Event at %u (action %d, mode %d, temp %.1f, ramp %d min)",
+      e.minuteOfWeek, e.action, e.mode, e.tempTenths / 10.0, e.rampMinutes);
+
+  rampActive = false; // A new event overrides a running ramp
+
+  DaikinCommand cmd;
+  if (e.action == SCHED_OFF) {
+    cmd.hasPower = true;
+    cmd.power = false;
+  } else if (e.action == SCHED_ON) {
+    cmd.hasPower = true;
+    cmd.power = true;
+  }
+  if (e.action != SCHED_OFF) {
+    if (e.mode) {
+      cmd.hasMode = true;
+      cmd.mode = e.mode;
+    }
+    if (e.fan) {
+      cmd.hasFan = true;
+      cmd.fan = e.fan;
+    }
+    if (e.tempTenths && e.rampMinutes == 0) {
+      cmd.hasTemp = true;
+      cmd.temp = e.tempTenths / 10.0;
+    } else if (e.tempTenths) {
+      rampFrom = State.targetTemp > 0 ? State.targetTemp : e.tempTenths / 10.0;
+      rampTo = e.tempTenths / 10.0;
+      rampSent = rampFrom;
+      rampStart = millis();
+      rampDuration = e.rampMinutes * 60000UL;
+      rampActive = true;
+    }
+  }
+
+  if (!cmd.hasPower && !cmd.hasMode && !cmd.hasFan && !cmd.hasTemp)
+    return; // Pure ramp: stepRamp() sends the targets
+
+  Commands.submit(cmd);
+  Mqtt.notifyCommand();
+}
+
+// Move the target along the ramp in SCHED_RAMP_STEP increments
+void Scheduler::stepRamp() {
+  if (!rampActive)
+    return;
+
+  unsigned long elapsed = msSince(rampStart);
+  float target = rampTo;
+  if (elapsed < rampDuration) {
+    float progress = (float)elapsed / rampDuration;
+    target = rampFrom + (rampTo - rampFrom) * progress;
+    target = roundf(target / SCHED_RAMP_STEP) * SCHED_RAMP_STEP;
+  } else {
+    rampActive = false;
+  }
+
+  if (fabsf(target - rampSent) < SCHED_RAMP_STEP / 2 && rampActive)
+    return;
+  if (target == rampSent)
+    return;
+
+  DaikinCommand cmd;
+  cmd.hasTemp = true;
+  cmd.temp = target;
+  Commands.submit(cmd);
+  rampSent = target;
+  LOG("Schedule: Ramp target %.1f", target);
+}
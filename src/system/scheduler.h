@@ -0,0 +1,80 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "config.h"
+#include <Arduino.h>
+
+// Entries in the weekly table (one per day a rule applies to)
+#ifndef SCHED_MAX_ENTRIES
+#define SCHED_MAX_ENTRIES 48
+#endif
+
+enum ScheduleAction : uint8_t {
+  SCHED_OFF = 0, // Power off
+  SCHED_ON = 1,  // Power on with mode/temp/fan
+  SCHED_TEMP = 2 // Change target only (keeps power and mode)
+};
+
+// One weekly event. 8 bytes, stored as-is in NVS.
+struct ScheduleEntry {
+  uint16_t minuteOfWeek; // 0 = Monday 00:00
+  uint8_t action;        // ScheduleAction
+  uint8_t mode;          // 0 = keep current
+  int16_t tempTenths;    // Target in 0.1C, 0 = keep current
+  uint8_t fan;           // 0 = keep current
+  uint8_t rampMinutes;   // Reach tempTenths gradually over this time
+};
+
+// Runs weekly events on the device, so schedules survive network outages.
+// Entries are kept sorted by time with a cursor on the next one: lookup is
+// O(1) and advancing is amortized O(1) as time moves forward.
+class Scheduler {
+public:
+  // Load the table from NVS
+  void begin();
+
+  // Fire due events and advance ramps. Call from loop().
+  void loop();
+
+  // Add an event on every day in dayMask (bit 0 = Monday). Returns the
+  // number of entries added (0 if the table is full).
+  int add(uint8_t dayMask, uint16_t minuteOfDay, const ScheduleEntry &entry);
+
+  bool remove(int index);
+  void clear();
+
+  int count() const { return entryCount; }
+  const ScheduleEntry &entry(int index) const { return entries[index]; }
+
+  // Next event and minutes until it fires. False if none or no clock.
+  bool nextEvent(const ScheduleEntry **next, uint16_t *minutesUntil);
+
+  // A ramp is moving the target temperature
+  bool isRamping() const { return rampActive; }
+
+private:
+  void save();
+  void seek(uint16_t minuteOfWeek);
+  void fire(const ScheduleEntry &e);
+  void stepRamp();
+
+private:
+  ScheduleEntry entries[SCHED_MAX_ENTRIES];
+  uint8_t entryCount = 0;
+  uint8_t cursor = 0; // Next entry to fire
+  bool synced = false;
+  uint16_t lastMinute = 0;
+  unsigned long lastCheck = 0;
+
+  // Active ramp
+  bool rampActive = false;
+  float rampFrom = 0.0;
+  float rampTo = 0.0;
+  float rampSent = 0.0;
+  unsigned long rampStart = 0;
+  unsigned long rampDuration = 0;
+};
+
+extern Scheduler Schedule;
+
+#endif // SCHEDULER_H
@@ -0,0 +1,85 @@
+#include "trace.h"
+
+#if TRACE_ENABLED
+
+#ifndef ESP_PLATFORM
+#include <chrono>
+
+uint32_t traceCycles() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+#endif
+
+static TraceEvent ring[TRACE_RING_SIZE];
+static uint32_t recorded = 0; // Total since clear; ring index = recorded % size
+
+void traceRecord(const char *name, uint32_t startUs, uint32_t cycles) {
+  TraceEvent &e = ring[recorded % TRACE_RING_SIZE];
+  e.name = name;
+  e.startUs = startUs;
+  e.cycles = cycles;
+  recorded++;
+}
+
+void traceClear() { recorded = 0; }
+
+uint32_t traceEventCount() { return recorded; }
+
+uint32_t traceDropped() {
+  return recorded > TRACE_RING_SIZE ? recorded - TRACE_RING_SIZE : 0;
+}
+
+// Complete ("X") events, oldest first. Durations keep the cycle
+// resolution as fractional microseconds.
+size_t traceWriteJson(Print *out) {
+  uint32_t count = min(recorded, (uint32_t)TRACE_RING_SIZE);
+  uint32_t first = recorded - count;
+  uint32_t perUs = traceCyclesPerUs();
+  char line[128];
+  size_t total = 0;
+
+  int n = snprintf(line, sizeof(line),
+                   "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped\":%lu,"
+                   "\"cycles_per_us\":%lu},\"traceEvents\":[",
+                   (unsigned long)traceDropped(), (unsigned long)perUs);
+  if (out)
+    out->write((const uint8_t *)line, n);
+  total += n;
+
+  for (uint32_t i = 0; i < count; i++) {
+    const TraceEvent &e = ring[(first + i) % TRACE_RING_SIZE];
+    uint32_t wholeUs = e.cycles / perUs;
+    uint32_t fracNs = (e.cycles % perUs) * 1000 / perUs;
+    n = snprintf(line, sizeof(line),
+                 "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+                 "\"ts\":%lu,\"dur\":%lu.%03lu}",
+                 i ? "," : "", e.name, (unsigned long)e.startUs,
+                 (unsigned long)wholeUs, (unsigned long)fracNs);
+    if (n >= (int)sizeof(line))
+      n = sizeof(line) - 1; // Absurdly long name: truncated, still counted
+    if (out)
+      out->write((const uint8_t *)line, n);
+    total += n;
+  }
+
+  if (out)
+    out->write((const uint8_t *)"]}", 2);
+  return total + 2;
+}
+
+#else
+
+size_t traceWriteJson(Print *out) {
+  static const char EMPTY[] = "{\"traceEvents\":[]}";
+  if (out)
+    out->write((const uint8_t *)EMPTY, sizeof(EMPTY) - 1);
+  return sizeof(EMPTY) - 1;
+}
+
+void traceClear() {}
+uint32_t traceEventCount() { return 0; }
+uint32_t traceDropped() { return 0; }
+
+#endif // TRACE_ENABLED
@@ -0,0 +1,73 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "config.h"
+#include <Arduino.h>
+
+// Scoped timing of the main loop, recorded into a RAM ring and exported at
+// /trace as Chrome Trace Event JSON (open in ui.perfetto.dev). Off by
+// default: with TRACE_ENABLED 0 the macros expand to nothing.
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 0
+#endif
+// Events kept (12 bytes each); the oldest are overwritten
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE 256
+#endif
+
+#if TRACE_ENABLED
+
+// Cycle counter and its rate. On a host build (no ESP-IDF) nanoseconds
+// stand in for cycles.
+#ifdef ESP_PLATFORM
+inline uint32_t traceCycles() { return ESP.getCycleCount(); }
+inline uint32_t traceCyclesPerUs() { return getCpuFrequencyMhz(); }
+#else
+uint32_t traceCycles();
+inline uint32_t traceCyclesPerUs() { return 1000; }
+#endif
+
+struct TraceEvent {
+  const char *name; // Must outlive the ring: literals or static tables
+  uint32_t startUs; // micros() at entry
+  uint32_t cycles;  // Duration
+};
+
+void traceRecord(const char *name, uint32_t startUs, uint32_t cycles);
+
+class TraceScope {
+public:
+  explicit TraceScope(const char *name)
+      : name(name), startUs(micros()), start(traceCycles()) {}
+  ~TraceScope() { traceRecord(name, startUs, traceCycles() - start); }
+
+private:
+  const char *name;
+  uint32_t startUs;
+  uint32_t start;
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+
+#else
+
+#define TRACE_SCOPE(name)                                                      \
+  do {                                                                         \
+  } while (0)
+
+#endif // TRACE_ENABLED
+
+// Write the ring as {"traceEvents": [...]}; out == nullptr only measures.
+// Returns the byte count. Without TRACE_ENABLED the list is empty.
+size_t traceWriteJson(Print *out);
+
+// Forget the recorded events
+void traceClear();
+
+// Events recorded / overwritten since boot or the last clear
+uint32_t traceEventCount();
+uint32_t traceDropped();
+
+#endif // TRACE_H
@@ -0,0 +1,77 @@
+#include "api.h"
+
+PayloadFormat responseFormat(HttpRequest &req) {
+  ArgView v;
+  char name[8] = "";
+  if (req.arg("format", v))
+    v.copyTo(name, sizeof(name));
+  return negotiateFormat(name, req.header("Accept"));
+}
+
+void sendArgError(HttpRequest &req, const char *message,
+                  const ArgProblem &problem) {
+  uint8_t buf[256];
+  PayloadWriter w(FORMAT_JSON, buf, sizeof(buf));
+  uint8_t count = 2;
+  if (problem.error != ARG_OK)
+    count++;
+  if (problem.error == ARG_RANGE)
+    count += 2;
+  else if (problem.error == ARG_CHOICE || problem.error == ARG_TOO_LONG)
+    count++;
+  w.beginMap(count);
+  w.key("error");
+  w.addString(problem.error != ARG_OK ? argErrorName(problem.error)
+                                      : "bad_request");
+  w.key("message");
+  w.addString(message);
+  if (problem.error != ARG_OK) {
+    w.key("arg");
+    w.addString(problem.name);
+  }
+  if (problem.error == ARG_RANGE && problem.decimals) {
+    w.key("min");
+    w.addFloat(problem.min / 10.0f);
+    w.key("max");
+    w.addFloat(problem.max / 10.0f);
+  } else if (problem.error == ARG_RANGE) {
+    w.key("min");
+    w.addInt(problem.min);
+    w.key("max");
+    w.addInt(problem.max);
+  } else if (problem.error == ARG_CHOICE) {
+    w.key("allowed");
+    w.beginArray(problem.choiceCount);
+    for (uint8_t i = 0; i < problem.choiceCount; i++) {
+      w.addString(problem.choices[i].name);
+    }
+    w.end();
+  } else if (problem.error == ARG_TOO_LONG) {
+    w.key("max_length");
+    w.addInt(problem.max);
+  }
+  w.end();
+  req.send(400, "application/json", w.data(), w.length());
+}
+
+void sendArgError(HttpRequest &req, const char *message) {
+  sendArgError(req, message, ArgProblem());
+}
+
+void writeLatency(PayloadWriter &w, const S21Latency &l) {
+  w.beginMap(4);
+  w.key("count");
+  w.addUInt(l.count);
+  w.key("avg_ms");
+  w.addUInt(l.averageMs());
+  w.key("max_ms");
+  w.addUInt(l.maxMs);
+  // Counts per bucket of latency_bounds_ms, the last one open-ended
+  w.key("histogram");
+  w.beginArray(S21_LATENCY_BUCKETS);
+  for (size_t i = 0; i < S21_LATENCY_BUCKETS; i++) {
+    w.addUInt(l.buckets[i]);
+  }
+  w.end();
+  w.end();
+}
@@ -0,0 +1,37 @@
+#ifndef API_H
+#define API_H
+
+#include "../daikin/s21_line.h"
+#include "../system/commands.h"
+#include "http_server.h"
+#include "payload_writer.h"
+#include <Arduino.h>
+
+// Helpers shared by the HTTP API handlers of the sketch and the modules
+
+// ?format= or the Accept header
+PayloadFormat responseFormat(HttpRequest &req);
+
+// Query string as command arguments
+class RequestArgs : public CommandArgs {
+public:
+  RequestArgs(HttpRequest &req) : req(req) {}
+  bool get(const char *name, ArgView &value) const override {
+    return req.arg(name, value);
+  }
+
+private:
+  HttpRequest &req;
+};
+
+// 400 with what was wrong: {"error":"range","message":"...","arg":"temp",
+// "min":10.0,"max":32.0}, "allowed" names instead of min/max for a choice
+void sendArgError(HttpRequest &req, const char *message,
+                  const ArgProblem &problem);
+void sendArgError(HttpRequest &req, const char *message);
+
+// {"count","avg_ms","max_ms","histogram"}, buckets as in the bounds the
+// caller lists next to it
+void writeLatency(PayloadWriter &w, const S21Latency &l);
+
+#endif // API_H
@@ -0,0 +1,390 @@
+#include "diagnostics.h"
+
+#if METRICS_ENABLED
+
+#include "../daikin/s21_codec.h"
+#include "../daikin/s21_driver.h"
+#include "../daikin/s21_line.h"
+#include "../daikin/s21_supervisor.h"
+#include "../net/wifi_manager.h"
+#include "../system/heap_tracker.h"
+#include "../system/idle.h"
+#include "../system/trace.h"
+#include "api.h"
+#include "payload_writer.h"
+#include "rate_limiter.h"
+
+static HttpServer *g_server = nullptr;
+
+static void handleMetrics(HttpRequest &req) {
+  PayloadFormat format = responseFormat(req);
+  const S21BusMetrics &bus = Supervisor.getMetrics();
+  const HttpServerStats &http = g_server->getStats();
+  const WifiMetrics &wifi = Wifi.getMetrics();
+  const RateLimitStats &admission = Limiter.getStats();
+  const S21Traffic &traffic = S21.getTraffic();
+  const IdleMetrics &idle = Idle.getMetrics();
+
+  uint8_t buf[1536];
+  PayloadWriter w(format, buf, sizeof(buf));
+  w.beginMap(7);
+  w.key("uptime_s");
+  w.addUInt(uptimeMs() / 1000);
+  w.key("free_heap");
+  w.addUInt(ESP.getFreeHeap());
+
+  w.key("bus");
+  w.beginMap(25);
+  w.key("mode");
+  w.addString(S21.isPassive() ? "passive" : "active");
+  w.key("contention");
+  w.addBool(S21.contention());
+  w.key("foreign_requests");
+  w.addUInt(traffic.foreignRequests);
+  w.key("unsolicited_replies");
+  w.addUInt(traffic.unsolicited);
+  w.key("commands_seen");
+  w.addUInt(traffic.commandsSeen);
+  // Last full window, so the figure doesn't jump while a window fills
+  S21LineScore line = Line.historyCount() ? Line.history(0) : Line.current();
+  w.key("line_quality");
+  w.addUInt(line.score);
+  w.key("line_verdict");
+  w.addString(s21LineVerdictName(line.verdict));
+  // Wire time in both directions; utilization = delta / elapsed
+  w.key("busy_ms");
+  w.addUInt(Line.busyMs());
+  w.key("protocol_version");
+  w.addUInt(Protocol.version() ? Protocol.version() : Protocol.major() * 100);
+  w.key("codec");
+  w.addString(Protocol.codec().name);
+  w.key("unsupported_queries");
+  w.addUInt(Protocol.unsupportedCount());
+  w.key("state");
+  w.addString(s21LinkStateName(Supervisor.state()));
+  w.key("last_fault");
+  w.addString(s21FaultName(Supervisor.lastFault()));
+  w.key("availability");
+  w.addFloat(Supervisor.availability());
+  w.key("up_s");
+  w.addUInt(bus.upMs / 1000);
+  w.key("down_s");
+  w.addUInt(bus.downMs / 1000);
+  w.key("outages");
+  w.addUInt(bus.outages);
+  w.key("recoveries");
+  w.addUInt(bus.recoveries);
+  w.key("mttr_ms");
+  w.addUInt(Supervisor.mttr());
+  w.key("last_outage_ms");
+  w.addUInt(bus.lastOutageMs);
+  w.key("longest_outage_ms");
+  w.addUInt(bus.longestOutageMs);
+  w.key("handshakes");
+  w.addUInt(bus.handshakes);
+  w.key("handshake_failures");
+  w.addUInt(bus.handshakeFailures);
+  w.key("backoff_ms");
+  w.addUInt(Supervisor.backoffMs());
+  w.key("faults");
+  w.beginMap(S21_FAULT_COUNT - 1);
+  for (int f = S21_FAULT_NONE + 1; f < S21_FAULT_COUNT; f++) {
+    w.key(s21FaultName((S21Fault)f));
+    w.addUInt(bus.faults[f]);
+  }
+  w.end();
+  w.end();
+
+  w.key("wifi");
+  w.beginMap(9);
+  w.key("state");
+  w.addString(wifiLinkStateName(Wifi.state()));
+  w.key("rssi");
+  w.addInt(Wifi.isConnected() ? WiFi.RSSI() : 0);
+  w.key("attempts");
+  w.addUInt(wifi.attempts);
+  w.key("connects");
+  w.addUInt(wifi.connects);
+  w.key("disconnects");
+  w.addUInt(wifi.disconnects);
+  w.key("last_connect_ms");
+  w.addUInt(wifi.lastConnectMs);
+  w.key("last_outage_ms");
+  w.addUInt(wifi.lastOutageMs);
+  w.key("longest_outage_ms");
+  w.addUInt(wifi.longestOutageMs);
+  w.key("down_s");
+  w.addUInt(wifi.downMs / 1000);
+  w.end();
+
+  w.key("http");
+  w.beginMap(8);
+  w.key("requests");
+  w.addUInt(http.requests);
+  w.key("reused_connections");
+  w.addUInt(http.reusedConnections);
+  w.key("accepted");
+  w.addUInt(http.accepted);
+  w.key("evicted");
+  w.addUInt(http.evicted);
+  w.key("rejected");
+  w.addUInt(http.rejected);
+  w.key("limited");
+  w.addUInt(http.limited);
+  w.key("active");
+  w.addUInt(http.active);
+  w.key("peak_active");
+  w.addUInt(http.peakActive);
+  w.end();
+
+  w.key("admission");
+  w.beginMap(6);
+  w.key("limited_reads");
+  w.addUInt(admission.limited[RATE_CLASS_READ]);
+  w.key("limited_writes");
+  w.addUInt(admission.limited[RATE_CLASS_WRITE]);
+  w.key("degraded_reads");
+  w.addUInt(admission.degraded);
+  w.key("bus_polls");
+  w.addUInt(admission.busPolls);
+  w.key("clients");
+  w.addUInt(Limiter.clientCount());
+  w.key("forgotten_clients");
+  w.addUInt(admission.forgotten);
+  w.end();
+
+  w.key("idle");
+  w.beginMap(10);
+  w.key("idle_pct");
+  w.addUInt(Idle.idlePercent());
+  w.key("idle_pct_total");
+  w.addUInt(idle.loopUs ? idle.sleptUs * 100 / idle.loopUs : 0);
+  w.key("cpu_mhz");
+  w.addUInt(Idle.cpuMhz());
+  w.key("sleeps");
+  w.addUInt(idle.sleeps);
+  w.key("event_wakeups");
+  w.addUInt(idle.eventWakeups);
+  w.key("wake_latency_avg_us");
+  w.addUInt(idle.wakeLatencyCount
+                ? idle.wakeLatencySumUs / idle.wakeLatencyCount
+                : 0);
+  w.key("wake_latency_max_us");
+  w.addUInt(idle.wakeLatencyMaxUs);
+  w.key("late");
+  w.addUInt(idle.late);
+  w.key("late_max_us");
+  w.addUInt(idle.lateMaxUs);
+  w.key("clock_changes");
+  w.addUInt(idle.clockChanges);
+  w.end();
+  w.end();
+
+  if (w.overflow()) {
+    req.send(500, "text/plain", "Metrics too large");
+    return;
+  }
+  req.send(200, formatContentType(format), w.data(), w.length());
+}
+
+// Heap health: fragmentation, stack head-room per task and, with
+// HEAP_TRACKING, live bytes and allocation rate per call site
+static void handleHeap(HttpRequest &req) {
+  PayloadFormat format = responseFormat(req);
+  HeapSnapshot heap = heapSnapshot();
+
+  uint8_t buf[1024];
+  PayloadWriter w(format, buf, sizeof(buf));
+  w.beginMap(9);
+  w.key("free");
+  w.addUInt(heap.freeBytes);
+  w.key("min_free");
+  w.addUInt(heap.minFreeBytes);
+  w.key("largest_block");
+  w.addUInt(heap.largestBlock);
+  w.key("fragmentation");
+  w.addUInt(heap.fragmentation);
+  w.key("tracking");
+  w.addBool(HEAP_TRACKING);
+  w.key("violations");
+  w.addUInt(heapViolations());
+  w.key("untracked");
+  w.addUInt(heapUntracked());
+
+  w.key("stack_free");
+  w.beginMap(heapTaskCount());
+  for (size_t i = 0; i < heapTaskCount(); i++) {
+    w.key(heapTaskName(i));
+    w.addInt(heapStackFree(heapTaskName(i)));
+  }
+  w.end();
+
+  size_t sites = heapSiteCount();
+  w.key("sites");
+  w.beginArray(sites);
+  for (size_t i = 0; i < sites; i++) {
+    const HeapSiteStats &s = heapSite(i);
+    w.beginMap(6);
+    w.key("site");
+    w.addString(s.name);
+    w.key("allocs");
+    w.addUInt(s.allocs);
+    w.key("frees");
+    w.addUInt(s.frees);
+    w.key("live_bytes");
+    w.addUInt(s.liveBytes);
+    w.key("peak_bytes");
+    w.addUInt(s.peakBytes);
+    w.key("allocs_per_min");
+    w.addUInt(s.allocsLastMinute);
+    w.end();
+  }
+  w.end();
+  w.end();
+
+  if (w.overflow()) {
+    req.send(500, "text/plain", "Heap report too large");
+    return;
+  }
+  req.send(200, formatContentType(format), w.data(), w.length());
+}
+
+// S21 line quality: score per window with history, UART errors and where
+// they hit, byte gaps, ACK/reply latency and echo
+static void handleLine(HttpRequest &req) {
+  PayloadFormat format = responseFormat(req);
+  const S21LineCounters &c = Line.totals();
+  const S21GapStats &gaps = Line.byteGaps();
+  S21LineScore now = Line.current();
+
+  uint8_t buf[2560]; // 16 events and a full history at their longest
+  PayloadWriter w(format, buf, sizeof(buf));
+  w.beginMap(13);
+  w.key("score");
+  w.addUInt(now.score);
+  w.key("verdict");
+  w.addString(s21LineVerdictName(now.verdict));
+  w.key("window_s");
+  w.addUInt(S21_LINE_WINDOW_MS / 1000);
+  w.key("utilization");
+  w.addUInt(Line.utilization());
+
+  // Newest first, 255 = no traffic
+  w.key("history");
+  w.beginArray(Line.historyCount());
+  for (size_t i = 0; i < Line.historyCount(); i++) {
+    w.addUInt(Line.history(i).score);
+  }
+  w.end();
+
+  w.key("counters");
+  w.beginMap(12);
+  w.key("bytes");
+  w.addUInt(c.bytes);
+  w.key("frames");
+  w.addUInt(c.frames);
+  w.key("bad_frames");
+  w.addUInt(c.badFrames);
+  w.key("sent");
+  w.addUInt(c.sent);
+  w.key("requests");
+  w.addUInt(c.requests);
+  w.key("acks");
+  w.addUInt(c.acks);
+  w.key("replies");
+  w.addUInt(c.replies);
+  w.key("timeouts");
+  w.addUInt(c.timeouts);
+  w.key("slow_replies");
+  w.addUInt(c.slowReplies);
+  w.key("echoes");
+  w.addUInt(c.echoes);
+  w.key("echo_mismatches");
+  w.addUInt(c.echoMismatches);
+  w.key("stretched_gaps");
+  w.addUInt(c.stretchedGaps);
+  w.end();
+
+  w.key("uart_errors");
+  w.beginMap(S21_UART_ERROR_COUNT);
+  for (int i = 0; i < S21_UART_ERROR_COUNT; i++) {
+    w.key(s21UartErrorName((S21UartError)i));
+    w.addUInt(c.uartErrors[i]);
+  }
+  w.end();
+
+  w.key("events");
+  w.beginArray(Line.eventCount());
+  for (size_t i = 0; i < Line.eventCount(); i++) {
+    const S21UartEvent &e = Line.event(i);
+    w.beginMap(4);
+    w.key("age_ms");
+    w.addUInt(msSince(e.at));
+    w.key("type");
+    w.addString(s21UartErrorName(e.type));
+    w.key("frame_pos");
+    w.addUInt(e.framePos);
+    w.key("last_byte");
+    w.addUInt(e.lastByte);
+    w.end();
+  }
+  w.end();
+
+  w.key("byte_gap_us");
+  w.beginMap(2);
+  w.key("avg");
+  w.addUInt(gaps.count ? gaps.sumUs / gaps.count : 0);
+  w.key("max");
+  w.addUInt(gaps.maxUs);
+  w.end();
+
+  w.key("latency_bounds_ms");
+  w.beginArray(S21_LATENCY_BUCKETS - 1);
+  for (size_t i = 0; i + 1 < S21_LATENCY_BUCKETS; i++) {
+    w.addUInt(S21_LATENCY_BOUNDS_MS[i]);
+  }
+  w.end();
+  w.key("ack_latency");
+  writeLatency(w, Line.ackLatency());
+  w.key("reply_latency");
+  writeLatency(w, Line.replyLatency());
+  w.key("echo");
+  w.addString(Line.echoMode());
+  w.end();
+
+  if (w.overflow()) {
+    req.send(500, "text/plain", "Line report too large");
+    return;
+  }
+  req.send(200, formatContentType(format), w.data(), w.length());
+}
+
+// Recorded loop timings as Chrome Trace Event JSON (TRACE_ENABLED builds).
+// ?clear=1 starts a fresh recording.
+static void handleTrace(HttpRequest &req) {
+  if (!TRACE_ENABLED) {
+    req.send(404, "text/plain", "Tracing disabled (build with TRACE_ENABLED 1)");
+    return;
+  }
+  if (req.hasArg("clear")) {
+    traceClear();
+    req.send(204, "text/plain", "");
+    return;
+  }
+  Print &out = req.beginSend(200, "application/json", traceWriteJson(nullptr));
+  traceWriteJson(&out);
+}
+
+void diagnosticsBegin(HttpServer &server) {
+  g_server = &server;
+  server.on("/metrics", handleMetrics);
+  server.on("/trace", handleTrace);
+  server.on("/heap", handleHeap);
+  server.on("/line", handleLine);
+}
+
+#else // METRICS_ENABLED
+
+void diagnosticsBegin(HttpServer &) {}
+
+#endif // METRICS_ENABLED
@@ -0,0 +1,18 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include "../system/config.h"
+#include "http_server.h"
+#include <Arduino.h>
+
+// /metrics, /line, /heap and /trace. 0 drops the routes and their report
+// code; the counters behind them keep running (the driver and the idle
+// loop use them).
+#ifndef METRICS_ENABLED
+#define METRICS_ENABLED 1
+#endif
+
+// Register the routes. The server's own counters go into /metrics.
+void diagnosticsBegin(HttpServer &server);
+
+#endif // DIAGNOSTICS_H
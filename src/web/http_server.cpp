@@ -0,0 +1,723 @@
+#include "http_server.h"
+#include "../system/commands.h"
+#include "../system/heap_tracker.h"
+#include "../system/idle.h"
+#include "../system/logger.h"
+#include "../system/trace.h"
+
+// Requests served on one connection before it is closed anyway
+#define HTTP_MAX_REQUESTS_PER_CONN 100
+// A kept-alive connection must be quiet this long before it can be evicted
+#define HTTP_EVICT_IDLE_MS 250
+// After an answer, the loop polls the connection on every pass this long:
+// a keep-alive client's next request is usually on its way
+#define HTTP_HOT_MS 50
+
+// Multipart parser states
+enum {
+  PART_PREAMBLE,
+  PART_HEADERS,
+  PART_DATA,
+  PART_DONE,
+};
+
+static const char *statusText(int code) {
+  switch (code) {
+  case 200:
+    return "OK";
+  case 204:
+    return "No Content";
+  case 304:
+    return "Not Modified";
+  case 400:
+    return "Bad Request";
+  case 404:
+    return "Not Found";
+  case 405:
+    return "Method Not Allowed";
+  case 408:
+    return "Request Timeout";
+  case 413:
+    return "Payload Too Large";
+  case 429:
+    return "Too Many Requests";
+  case 431:
+    return "Request Header Fields Too Large";
+  case 500:
+    return "Internal Server Error";
+  case 503:
+    return "Service Unavailable";
+  default:
+    return "";
+  }
+}
+
+static int findBytes(const uint8_t *hay, size_t hayLen, const char *needle,
+                     size_t needleLen) {
+  if (needleLen == 0 || hayLen < needleLen)
+    return -1;
+  for (size_t i = 0; i + needleLen <= hayLen; i++) {
+    if (hay[i] == (uint8_t)needle[0] && memcmp(hay + i, needle, needleLen) == 0)
+      return (int)i;
+  }
+  return -1;
+}
+
+// Decimal digits only, at most 9 of them (under 1 GB, more than any
+// upload), trailing spaces allowed. Nothing that could wrap a size_t.
+static bool parseContentLength(const char *s, size_t &out) {
+  size_t value = 0;
+  int digits = 0;
+  for (; *s >= '0' && *s <= '9'; s++) {
+    if (++digits > 9)
+      return false;
+    value = value * 10 + (*s - '0');
+  }
+  while (*s == ' ' || *s == '\t')
+    s++;
+  if (digits == 0 || *s)
+    return false;
+  out = value;
+  return true;
+}
+
+// ---- HttpRequest ----
+
+const char *HttpRequest::header(const char *name) const {
+  size_t nameLen = strlen(name);
+  const char *p = headers;
+  const char *end = headers + headersLen;
+  while (p < end) {
+    size_t lineLen = strlen(p);
+    if (lineLen > nameLen && strncasecmp(p, name, nameLen) == 0 &&
+        p[nameLen] == ':') {
+      const char *v = p + nameLen + 1;
+      while (*v == ' ')
+        v++;
+      return v;
+    }
+    p += lineLen + 2; // Skip the NUL (was '\r') and '\n'
+  }
+  return nullptr;
+}
+
+IPAddress HttpRequest::remoteIP() const { return conn->client.remoteIP(); }
+
+// Split "a=1&b=2" in place: every name and value is decoded where it lies
+void HttpRequest::addArgs(char *s, size_t len) {
+  char *base = (char *)conn->buf;
+  char *end = s + len;
+  while (s < end && argCount < HTTP_MAX_ARGS) {
+    char *next = (char *)memchr(s, '&', end - s);
+    if (!next)
+      next = end;
+    if (next > s) {
+      char *eq = (char *)memchr(s, '=', next - s);
+      char *value = eq ? eq + 1 : next;
+      Arg &a = args[argCount++];
+      a.name = s - base;
+      a.nameLen = urlDecodeInPlace(s, (eq ? eq : next) - s);
+      a.value = value - base;
+      a.valueLen = urlDecodeInPlace(value, next - value);
+    }
+    s = next + 1;
+  }
+}
+
+bool HttpRequest::arg(const char *name, ArgView &value) const {
+  const char *base = (const char *)conn->buf;
+  size_t nameLen = strlen(name);
+  for (uint8_t i = 0; i < argCount; i++) {
+    const Arg &a = args[i];
+    if (a.nameLen == nameLen && memcmp(base + a.name, name, nameLen) == 0) {
+      value = {base + a.value, a.valueLen};
+      return true;
+    }
+  }
+  return false;
+}
+
+bool HttpRequest::hasArg(const char *name) const {
+  ArgView unused;
+  return arg(name, unused);
+}
+
+Print &HttpRequest::beginSend(int code, const char *type, size_t len) {
+  sent = true;
+
+  char head[192 + HTTP_EXTRA_HEADERS_SIZE];
+  int n = snprintf(head, sizeof(head),
+                   "HTTP/1.1 %d %s\r\n"
+                   "Content-Type: %s\r\n"
+                   "Content-Length: %u\r\n"
+                   "%.*s"
+                   "Connection: %s\r\n\r\n",
+                   code, statusText(code), type, (unsigned)len, extraLen,
+                   extraHeaders, keepAlive ? "keep-alive" : "close");
+  extraLen = 0;
+  conn->client.write((const uint8_t *)head, n);
+  if (headOnly) {
+    static NullPrint discard; // HEAD: the length, not the body
+    return discard;
+  }
+  return conn->client;
+}
+
+void HttpRequest::send(int code, const char *type, const uint8_t *data,
+                       size_t len) {
+  if (sent)
+    return;
+  Print &out = beginSend(code, type, len);
+  if (len > 0)
+    out.write(data, len);
+}
+
+void HttpRequest::addHeader(const char *name, const char *value) {
+  size_t room = sizeof(extraHeaders) - extraLen;
+  int n = snprintf(extraHeaders + extraLen, room, "%s: %s\r\n", name, value);
+  if (n > 0 && (size_t)n < room)
+    extraLen += n;
+}
+
+void HttpRequest::send(int code, const char *type, const char *data) {
+  send(code, type, (const uint8_t *)data, strlen(data));
+}
+
+void HttpRequest::send(int code, const char *type, const String &data) {
+  send(code, type, (const uint8_t *)data.c_str(), data.length());
+}
+
+// ---- HttpServer ----
+
+HttpServer::HttpServer(uint16_t port) : listener(port, HTTP_MAX_CLIENTS), port(port) {}
+
+void HttpServer::on(const char *path, HttpHandler handler) {
+  on(path, HTTP_METHOD_ANY, handler);
+}
+
+void HttpServer::on(const char *path, HttpMethod method, HttpHandler handler,
+                    HttpUploadHandler upload) {
+  if (routeCount >= HTTP_MAX_ROUTES) {
+    LOG("HTTP: Too many routes, %s ignored", path);
+    return;
+  }
+  routes[routeCount++] = {path, method, handler, upload, RATE_CLASS_NONE,
+                          nullptr};
+}
+
+void HttpServer::limit(const char *path, RateClass cls,
+                       const char *onlyWithArg) {
+  for (int i = 0; i < routeCount; i++) {
+    if (strcmp(routes[i].path, path) == 0) {
+      routes[i].rateClass = cls;
+      routes[i].limitArg = onlyWithArg;
+    }
+  }
+}
+
+void HttpServer::begin() {
+  for (int i = 0; i < HTTP_MAX_CLIENTS; i++) {
+    conns[i].req.conn = &conns[i];
+  }
+  listener.begin();
+  listener.setNoDelay(true);
+}
+
+void HttpServer::loop() {
+  TRACE_SCOPE("http");
+  accept();
+  for (int i = 0; i < HTTP_MAX_CLIENTS; i++) {
+    if (conns[i].state != HTTP_CONN_FREE)
+      service(conns[i]);
+  }
+  // Sockets can't wake the loop, so the idle wait is kept short for them.
+  // A waiting handler waits for the bus, whose bytes do wake it.
+  unsigned long now = millis();
+  for (int i = 0; i < HTTP_MAX_CLIENTS; i++) {
+    const HttpConnection &c = conns[i];
+    if (c.state == HTTP_CONN_FREE)
+      continue;
+    if (c.state == HTTP_CONN_HANDLER)
+      Idle.within(IDLE_NET_POLL_MS);
+    else if (c.state != HTTP_CONN_HEAD || c.len > 0 ||
+             elapsedMs(now, c.lastActivity) < HTTP_HOT_MS)
+      Idle.busy();
+    else
+      Idle.within(IDLE_NET_POLL_MS); // Idle keep-alive
+  }
+}
+
+void HttpServer::accept() {
+  if (!listener.hasClient())
+    return;
+
+  HttpConnection *slot = nullptr;
+  for (int i = 0; i < HTTP_MAX_CLIENTS && !slot; i++) {
+    if (conns[i].state == HTTP_CONN_FREE)
+      slot = &conns[i];
+  }
+
+  // Pool full: make room by closing the longest idle keep-alive connection.
+  // Busy connections are never evicted, the newcomer waits in the backlog.
+  if (!slot) {
+    unsigned long now = millis();
+    for (int i = 0; i < HTTP_MAX_CLIENTS; i++) {
+      HttpConnection &c = conns[i];
+      if (c.state == HTTP_CONN_HEAD && c.len == 0 && c.requests > 0 &&
+          elapsedMs(now, c.lastActivity) >= HTTP_EVICT_IDLE_MS &&
+          c.client.available() == 0 &&
+          (!slot || elapsedMs(now, c.lastActivity) >
+                        elapsedMs(now, slot->lastActivity)))
+        slot = &c;
+    }
+    if (!slot)
+      return;
+    close(*slot);
+    stats.evicted++;
+  }
+
+  slot->client = listener.accept();
+  if (!slot->client)
+    return;
+
+  slot->client.setNoDelay(true);
+  slot->state = HTTP_CONN_HEAD;
+  slot->len = 0;
+  slot->requests = 0;
+  slot->lastActivity = millis();
+  stats.accepted++;
+  stats.active++;
+  if (stats.active > stats.peakActive)
+    stats.peakActive = stats.active;
+}
+
+void HttpServer::service(HttpConnection &c) {
+  if (!c.client.connected()) {
+    if (c.state == HTTP_CONN_UPLOAD && c.partState != PART_DONE &&
+        routes[c.route].upload) {
+      c.upload.status = HTTP_UPLOAD_ABORTED;
+      routes[c.route].upload(c.req, c.upload);
+    }
+    close(c);
+    return;
+  }
+
+  unsigned long now = millis();
+
+  // Pull whatever arrived, never waits
+  if (c.state != HTTP_CONN_HANDLER && c.len < HTTP_BUFFER_SIZE) {
+    size_t space = HTTP_BUFFER_SIZE - c.len;
+    if (c.state == HTTP_CONN_UPLOAD && c.contentLength - c.bodyReceived < space)
+      space = c.contentLength - c.bodyReceived; // Don't read past the body
+    int avail = c.client.available();
+    if (avail > 0 && space > 0) {
+      int n = c.client.read(c.buf + c.len, (size_t)avail < space ? avail : space);
+      if (n > 0) {
+        c.len += n;
+        c.lastActivity = now;
+        if (c.state == HTTP_CONN_UPLOAD)
+          c.bodyReceived += n;
+      }
+    }
+  }
+
+  switch (c.state) {
+  case HTTP_CONN_HEAD: {
+    int end = findBytes(c.buf, c.len, "\r\n\r\n", 4);
+    if (end < 0) {
+      if (c.len >= HTTP_BUFFER_SIZE)
+        fail(c, 431, "Headers too large");
+      else if (elapsedMs(now, c.lastActivity) > HTTP_KEEPALIVE_MS)
+        close(c); // Idle keep-alive or stalled client
+      return;
+    }
+    c.headLen = end + 4;
+    if (!parseHead(c))
+      return;
+    if (c.state != HTTP_CONN_HANDLER)
+      return;
+    break;
+  }
+
+  case HTTP_CONN_BODY:
+    if (c.len < c.headLen + c.contentLength) {
+      if (elapsedMs(now, c.lastActivity) > HTTP_KEEPALIVE_MS)
+        fail(c, 408, "Body timeout");
+      return;
+    }
+    bodyReceived(c);
+    break;
+
+  case HTTP_CONN_UPLOAD:
+    processUpload(c);
+    if (c.state != HTTP_CONN_HANDLER) {
+      if (elapsedMs(now, c.lastActivity) > HTTP_KEEPALIVE_MS)
+        fail(c, 408, "Upload timeout");
+      return;
+    }
+    break;
+
+  default:
+    break;
+  }
+
+  if (c.state == HTTP_CONN_HANDLER)
+    dispatch(c);
+}
+
+bool HttpServer::parseHead(HttpConnection &c) {
+  char *text = (char *)c.buf;
+  size_t headEnd = c.headLen - 4;
+
+  // Split lines in place: every '\r' becomes a terminator
+  for (size_t i = 0; i < headEnd; i++) {
+    if (text[i] == '\r')
+      text[i] = '\0';
+  }
+  text[headEnd] = '\0';
+  size_t lineEnd = strlen(text);
+  c.req.headOnly = false; // Until the method is known
+
+  // Request line: METHOD SP TARGET SP VERSION
+  char *method = text;
+  char *target = strchr(method, ' ');
+  if (!target) {
+    fail(c, 400, "Bad request line");
+    return false;
+  }
+  *target++ = '\0';
+  char *version = strchr(target, ' ');
+  if (!version) {
+    fail(c, 400, "Bad request line");
+    return false;
+  }
+  *version++ = '\0';
+
+  HttpRequest &req = c.req;
+  req.sent = false;
+  req.extraLen = 0;
+  req.calls = 0;
+  req.context = 0;
+  req.receivedAt = millis();
+  req.body = "";
+  req.bodyLen = 0;
+  req.formBody = false;
+  req.argCount = 0;
+  req.headOnly = strcmp(method, "HEAD") == 0;
+
+  if (strcmp(method, "GET") == 0 || req.headOnly)
+    req.reqMethod = HTTP_METHOD_GET;
+  else if (strcmp(method, "POST") == 0)
+    req.reqMethod = HTTP_METHOD_POST;
+  else
+    req.reqMethod = HTTP_METHOD_ANY; // Only matches ANY routes
+
+  char *q = strchr(target, '?');
+  if (q) {
+    *q++ = '\0';
+    req.addArgs(q, strlen(q));
+  }
+  req.reqPath = target;
+
+  if (lineEnd + 2 < headEnd) {
+    req.headers = text + lineEnd + 2;
+    req.headersLen = headEnd - lineEnd - 2;
+  } else {
+    req.headers = "";
+    req.headersLen = 0;
+  }
+
+  // Connection persistence: HTTP/1.1 defaults to keep-alive
+  const char *connHdr = req.header("Connection");
+  bool http11 = strcmp(version, "HTTP/1.1") == 0;
+  if (connHdr)
+    req.keepAlive = strncasecmp(connHdr, "keep-alive", 10) == 0 ||
+                    (http11 && strncasecmp(connHdr, "close", 5) != 0);
+  else
+    req.keepAlive = http11;
+  c.requests++;
+  if (c.requests >= HTTP_MAX_REQUESTS_PER_CONN)
+    req.keepAlive = false;
+  // Busy keep-alive clients never idle long enough to be evicted; when
+  // someone is waiting for a slot, hand this one over after the response
+  if (stats.active >= HTTP_MAX_CLIENTS && listener.hasClient())
+    req.keepAlive = false;
+
+  const char *cl = req.header("Content-Length");
+  c.contentLength = 0;
+  c.bodyReceived = 0;
+  if (cl && !parseContentLength(cl, c.contentLength)) {
+    fail(c, 400, "Bad Content-Length");
+    return false;
+  }
+
+  // Route lookup
+  c.route = -1;
+  bool pathMatched = false;
+  for (int i = 0; i < routeCount; i++) {
+    if (strcmp(routes[i].path, req.reqPath) != 0)
+      continue;
+    pathMatched = true;
+    if (routes[i].method == HTTP_METHOD_ANY ||
+        routes[i].method == req.reqMethod) {
+      c.route = i;
+      break;
+    }
+  }
+  if (c.route < 0) {
+    if (pathMatched)
+      fail(c, 405, "Method not allowed");
+    else
+      fail(c, 404, "Not found");
+    return false;
+  }
+
+  const char *type = req.header("Content-Type");
+  const Route &route = routes[c.route];
+
+  // Multipart upload: stream the body to the upload handler
+  if (route.upload && type &&
+      strncasecmp(type, "multipart/form-data", 19) == 0) {
+    const char *b = strstr(type, "boundary=");
+    if (!b || c.contentLength == 0) {
+      fail(c, 400, "Missing boundary");
+      return false;
+    }
+    b += 9;
+    if (*b == '"')
+      b++;
+    size_t bl = 0;
+    while (b[bl] && b[bl] != '"' && b[bl] != ';' && bl < 69) {
+      bl++;
+    }
+    // Delimiter is CRLF "--" boundary
+    memcpy(c.boundary, "\r\n--", 4);
+    memcpy(c.boundary + 4, b, bl);
+    c.boundary[4 + bl] = '\0';
+
+    // The header block is about to be overwritten by body data
+    req.reqPath = route.path;
+    req.argCount = 0;
+    req.headers = "";
+    req.headersLen = 0;
+
+    c.len -= c.headLen;
+    memmove(c.buf, c.buf + c.headLen, c.len);
+    if (c.len > c.contentLength)
+      c.len = c.contentLength;
+    c.bodyReceived = c.len;
+    c.headLen = 0;
+    c.partState = PART_PREAMBLE;
+    c.upload.filename[0] = '\0';
+    c.upload.totalSize = 0;
+    c.state = HTTP_CONN_UPLOAD;
+    return true;
+  }
+
+  if (c.contentLength > 0) {
+    if (c.contentLength > HTTP_BUFFER_SIZE - c.headLen) {
+      fail(c, 413, "Body too large");
+      return false;
+    }
+    req.formBody =
+        type &&
+        strncasecmp(type, "application/x-www-form-urlencoded", 33) == 0;
+    c.state = HTTP_CONN_BODY;
+    if (c.len >= c.headLen + c.contentLength)
+      bodyReceived(c);
+    return true;
+  }
+
+  c.state = HTTP_CONN_HANDLER;
+  return true;
+}
+
+void HttpServer::bodyReceived(HttpConnection &c) {
+  char *body = (char *)c.buf + c.headLen;
+  c.req.body = body;
+  c.req.bodyLen = c.contentLength;
+  if (c.req.formBody)
+    c.req.addArgs(body, c.contentLength);
+  c.state = HTTP_CONN_HANDLER;
+}
+
+void HttpServer::processUpload(HttpConnection &c) {
+  HttpUploadHandler upload = routes[c.route].upload;
+  const char *delim = c.boundary;
+  size_t delimLen = strlen(delim);
+  bool progress = true;
+
+  while (progress) {
+    progress = false;
+    size_t consumed = 0;
+
+    switch (c.partState) {
+    case PART_PREAMBLE: {
+      // First boundary has no leading CRLF
+      int pos = findBytes(c.buf, c.len, delim + 2, delimLen - 2);
+      if (pos < 0) {
+        if (c.len > delimLen)
+          consumed = c.len - delimLen;
+      } else {
+        consumed = pos + delimLen - 2;
+        c.partState = PART_HEADERS;
+        progress = true;
+      }
+      break;
+    }
+
+    case PART_HEADERS: {
+      int pos = findBytes(c.buf, c.len, "\r\n\r\n", 4);
+      if (pos < 0) {
+        if (c.len >= HTTP_BUFFER_SIZE) {
+          c.partState = PART_DONE; // Unparseable part, drain the body
+          consumed = c.len;
+        }
+        break;
+      }
+      c.buf[pos] = '\0';
+      const char *fn = strstr((const char *)c.buf, "filename=\"");
+      size_t fl = 0;
+      if (fn) {
+        fn += 10;
+        while (fn[fl] && fn[fl] != '"' && fl < sizeof(c.upload.filename) - 1)
+          fl++;
+        memcpy(c.upload.filename, fn, fl);
+      }
+      c.upload.filename[fl] = '\0';
+      consumed = pos + 4;
+
+      c.upload.status = HTTP_UPLOAD_START;
+      c.upload.buf = nullptr;
+      c.upload.currentSize = 0;
+      upload(c.req, c.upload);
+      c.partState = PART_DATA;
+      progress = true;
+      break;
+    }
+
+    case PART_DATA: {
+      int pos = findBytes(c.buf, c.len, delim, delimLen);
+      // Without a delimiter, hold back a possible partial one
+      size_t data = pos >= 0 ? (size_t)pos
+                             : (c.len >= delimLen ? c.len - (delimLen - 1) : 0);
+      if (data > 0) {
+        c.upload.status = HTTP_UPLOAD_WRITE;
+        c.upload.buf = c.buf;
+        c.upload.currentSize = data;
+        c.upload.totalSize += data;
+        upload(c.req, c.upload);
+      }
+      consumed = data;
+      if (pos >= 0) {
+        consumed += delimLen;
+        c.upload.status = HTTP_UPLOAD_END;
+        c.upload.buf = nullptr;
+        c.upload.currentSize = 0;
+        upload(c.req, c.upload);
+        c.partState = PART_DONE;
+        progress = true;
+      }
+      break;
+    }
+
+    case PART_DONE:
+      consumed = c.len; // Epilogue / further parts are ignored
+      break;
+    }
+
+    if (consumed > 0) {
+      c.len -= consumed;
+      memmove(c.buf, c.buf + consumed, c.len);
+    }
+  }
+
+  if (c.bodyReceived >= c.contentLength) {
+    if (c.partState != PART_DONE) {
+      c.upload.status = HTTP_UPLOAD_ABORTED;
+      upload(c.req, c.upload);
+      c.partState = PART_DONE;
+    }
+    c.len = 0;
+    c.contentLength = 0;
+    c.state = HTTP_CONN_HANDLER;
+  }
+}
+
+// Rate limit check before the handler first runs. Over budget = 429 on
+// the same connection, so a well-behaved client can simply retry.
+bool HttpServer::admit(HttpConnection &c) {
+  const Route &route = routes[c.route];
+  RateClass cls = route.rateClass;
+  if (route.limitArg && !c.req.hasArg(route.limitArg))
+    cls = RATE_CLASS_NONE;
+  uint32_t retryAfterS;
+  if (Limiter.admit((uint32_t)c.req.remoteIP(), cls, retryAfterS))
+    return true;
+
+  stats.limited++;
+  char retry[12];
+  snprintf(retry, sizeof(retry), "%lu", (unsigned long)retryAfterS);
+  c.req.addHeader("Retry-After", retry);
+  c.req.send(429, "text/plain", "Too many requests");
+  finish(c);
+  return false;
+}
+
+void HttpServer::dispatch(HttpConnection &c) {
+  HttpRequest &req = c.req;
+  req.calls++;
+  if (req.calls == 1 && !admit(c))
+    return;
+  {
+    TRACE_SCOPE(routes[c.route].path);
+    HEAP_SCOPE(routes[c.route].path);
+    routes[c.route].handler(req);
+  }
+
+  if (req.sent) {
+    finish(c);
+  } else if (req.age() > HTTP_HANDLER_TIMEOUT_MS) {
+    fail(c, 503, "Handler timeout");
+  }
+}
+
+void HttpServer::finish(HttpConnection &c) {
+  stats.requests++;
+  if (c.requests > 1)
+    stats.reusedConnections++;
+
+  if (!c.req.keepAlive) {
+    close(c);
+    return;
+  }
+
+  // Keep pipelined bytes that follow this request
+  size_t used = c.headLen + c.contentLength;
+  if (used > c.len)
+    used = c.len;
+  c.len -= used;
+  memmove(c.buf, c.buf + used, c.len);
+
+  c.headLen = 0;
+  c.contentLength = 0;
+  c.route = -1;
+  c.state = HTTP_CONN_HEAD;
+  c.lastActivity = millis();
+}
+
+void HttpServer::close(HttpConnection &c) {
+  c.client.stop();
+  c.state = HTTP_CONN_FREE;
+  c.len = 0;
+  if (stats.active > 0)
+    stats.active--;
+}
+
+void HttpServer::fail(HttpConnection &c, int code, const char *msg) {
+  stats.rejected++;
+  c.req.keepAlive = false;
+  c.req.sent = false;
+  c.req.send(code, "text/plain", msg);
+  close(c);
+}
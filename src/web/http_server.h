@@ -0,0 +1,222 @@
+#ifndef HTTP_SERVER_H
+#define HTTP_SERVER_H
+
+#include "../system/args.h"
+#include "../system/clock.h"
+#include "../system/config.h"
+#include "rate_limiter.h"
+#include <Arduino.h>
+#include <WiFi.h>
+
+// Concurrent connections (each one owns a request buffer)
+#ifndef HTTP_MAX_CLIENTS
+#define HTTP_MAX_CLIENTS 4
+#endif
+// Request line + headers + form body must fit here
+#ifndef HTTP_BUFFER_SIZE
+#define HTTP_BUFFER_SIZE 1536
+#endif
+// Idle keep-alive connections are closed after this
+#ifndef HTTP_KEEPALIVE_MS
+#define HTTP_KEEPALIVE_MS 5000
+#endif
+#ifndef HTTP_MAX_ROUTES
+#define HTTP_MAX_ROUTES 16
+#endif
+// A handler that keeps deferring is answered with 503 after this
+#ifndef HTTP_HANDLER_TIMEOUT_MS
+#define HTTP_HANDLER_TIMEOUT_MS 5000
+#endif
+// Query and form arguments kept per request; more are ignored
+#ifndef HTTP_MAX_ARGS
+#define HTTP_MAX_ARGS 12
+#endif
+// Extra response headers set with addHeader()
+#ifndef HTTP_EXTRA_HEADERS_SIZE
+#define HTTP_EXTRA_HEADERS_SIZE 64
+#endif
+
+enum HttpMethod : uint8_t {
+  HTTP_METHOD_ANY = 0,
+  HTTP_METHOD_GET,
+  HTTP_METHOD_POST,
+};
+
+// Multipart upload progress, same flow as the Arduino WebServer upload
+enum HttpUploadStatus : uint8_t {
+  HTTP_UPLOAD_START,
+  HTTP_UPLOAD_WRITE,
+  HTTP_UPLOAD_END,
+  HTTP_UPLOAD_ABORTED,
+};
+
+struct HttpUpload {
+  uint8_t status;
+  char filename[64];
+  uint8_t *buf;
+  size_t currentSize;
+  size_t totalSize;
+};
+
+struct HttpConnection;
+
+// A parsed request. Strings point into the connection buffer and stay valid
+// until the response has been sent.
+class HttpRequest {
+public:
+  HttpMethod method() const { return reqMethod; }
+  const char *path() const { return reqPath; }
+  const char *header(const char *name) const;
+  IPAddress remoteIP() const;
+
+  // Query string and urlencoded form body arguments, split and decoded in
+  // place when the request arrives. The query wins over the body.
+  bool hasArg(const char *name) const;
+  bool arg(const char *name, ArgView &value) const;
+
+  // Responses. Nothing sent by the handler = called again on the next loop
+  // (see isFirstCall()), so a handler can wait without blocking.
+  void send(int code, const char *type, const char *body);
+  void send(int code, const char *type, const String &body);
+  void send(int code, const char *type, const uint8_t *body, size_t len);
+  bool isSent() const { return sent; }
+
+  // Streamed response: writes the header, the caller then prints exactly
+  // len body bytes to the returned stream before returning
+  Print &beginSend(int code, const char *type, size_t len);
+
+  // Header line for the next response. Dropped if it doesn't fit.
+  void addHeader(const char *name, const char *value);
+
+  bool isFirstCall() const { return calls == 1; }
+  unsigned long age() const { return msSince(receivedAt); }
+
+  // For a handler that answers later: kept between its calls, 0 at first
+  uint32_t context = 0;
+
+private:
+  friend class HttpServer;
+  void addArgs(char *s, size_t len);
+
+  // Offsets into the connection buffer
+  struct Arg {
+    uint16_t name;
+    uint16_t nameLen;
+    uint16_t value;
+    uint16_t valueLen;
+  };
+
+  HttpConnection *conn = nullptr;
+  HttpMethod reqMethod = HTTP_METHOD_GET;
+  const char *reqPath = "";
+  Arg args[HTTP_MAX_ARGS];
+  uint8_t argCount = 0;
+  const char *body = "";
+  size_t bodyLen = 0;
+  bool formBody = false;
+  bool keepAlive = false;
+  bool headOnly = false; // HEAD: headers written, body discarded
+  bool sent = false;
+  uint16_t calls = 0;
+  unsigned long receivedAt = 0;
+  char extraHeaders[HTTP_EXTRA_HEADERS_SIZE];
+  uint8_t extraLen = 0;
+
+  // Raw header block (NUL separated "Name: value" lines)
+  const char *headers = "";
+  size_t headersLen = 0;
+};
+
+typedef void (*HttpHandler)(HttpRequest &req);
+typedef void (*HttpUploadHandler)(HttpRequest &req, HttpUpload &upload);
+
+enum HttpConnState : uint8_t {
+  HTTP_CONN_FREE,
+  HTTP_CONN_HEAD,    // Reading request line + headers
+  HTTP_CONN_BODY,    // Reading a (small) body into the buffer
+  HTTP_CONN_UPLOAD,  // Streaming a multipart body to an upload handler
+  HTTP_CONN_HANDLER, // Waiting for the handler to respond
+};
+
+struct HttpConnection {
+  WiFiClient client;
+  HttpConnState state = HTTP_CONN_FREE;
+  uint8_t buf[HTTP_BUFFER_SIZE + 1]; // +1 keeps the text NUL terminated
+  size_t len = 0;
+  size_t headLen = 0; // Bytes of request line + headers (incl. blank line)
+  size_t contentLength = 0;
+  size_t bodyReceived = 0;
+  unsigned long lastActivity = 0;
+  uint16_t requests = 0;
+  int8_t route = -1;
+  HttpRequest req;
+
+  // Multipart state
+  uint8_t partState = 0;
+  char boundary[72];
+  HttpUpload upload;
+};
+
+struct HttpServerStats {
+  uint32_t requests;
+  uint32_t reusedConnections; // Requests served on a kept-alive connection
+  uint32_t accepted;
+  uint32_t evicted; // Idle keep-alive connections closed to make room
+  uint32_t rejected; // 4xx/5xx produced by the server itself
+  uint32_t limited;  // 429 from the rate limiter
+  uint8_t active;
+  uint8_t peakActive;
+};
+
+// Small HTTP/1.1 server: fixed connection pool, keep-alive, pipelining,
+// handlers run from loop() and never block the main task.
+class HttpServer {
+public:
+  explicit HttpServer(uint16_t port);
+
+  void on(const char *path, HttpHandler handler);
+  void on(const char *path, HttpMethod method, HttpHandler handler,
+          HttpUploadHandler upload = nullptr);
+
+  // Put a registered path under a rate limit class (see rate_limiter.h).
+  // With onlyWithArg, requests without that argument are not limited.
+  void limit(const char *path, RateClass cls, const char *onlyWithArg = nullptr);
+
+  void begin();
+
+  // Accept, read and dispatch. Call from loop().
+  void loop();
+
+  const HttpServerStats &getStats() const { return stats; }
+
+private:
+  struct Route {
+    const char *path;
+    HttpMethod method;
+    HttpHandler handler;
+    HttpUploadHandler upload;
+    RateClass rateClass;
+    const char *limitArg;
+  };
+
+  void accept();
+  void service(HttpConnection &c);
+  bool parseHead(HttpConnection &c);
+  void bodyReceived(HttpConnection &c);
+  bool admit(HttpConnection &c);
+  void dispatch(HttpConnection &c);
+  void processUpload(HttpConnection &c);
+  void finish(HttpConnection &c);
+  void close(HttpConnection &c);
+  void fail(HttpConnection &c, int code, const char *msg);
+
+private:
+  WiFiServer listener;
+  uint16_t port;
+  Route routes[HTTP_MAX_ROUTES];
+  uint8_t routeCount = 0;
+  HttpConnection conns[HTTP_MAX_CLIENTS];
+  HttpServerStats stats = {};
+};
+
+#endif // HTTP_SERVER_H
@@ -0,0 +1,99 @@
+#include "ota.h"
+#include "../daikin/analytics.h"
+#include "../daikin/s21_supervisor.h"
+#include "../system/logger.h"
+#include "api.h"
+// Inside the switches, so a build without them doesn't link the libraries
+#if OTA_UPLOAD_ENABLED
+#include <Update.h>
+#endif
+#if OTA_URL_ENABLED
+#include <HTTPUpdate.h>
+#include <WiFiClientSecure.h>
+#endif
+
+#if OTA_URL_ENABLED
+static void handleUpdateUrl(HttpRequest &req) {
+  RequestArgs args(req);
+  ArgView urlArg;
+  ArgError error = args.getText("url", OTA_URL_MAX, urlArg);
+  if (error == ARG_MISSING || (error == ARG_OK && urlArg.len == 0)) {
+    sendArgError(req, "Missing url");
+    return;
+  }
+  if (error != ARG_OK) {
+    sendArgError(req, "Invalid url", args.problem());
+    return;
+  }
+  char url[OTA_URL_MAX + 1];
+  urlArg.copyTo(url, sizeof(url));
+  LOG("OTA: Updating from URL: %s", url);
+
+  // The download runs synchronously: the loop (and every other client)
+  // stalls until it completes, then the device reboots anyway.
+  WiFiClientSecure client;
+  client.setInsecure(); // Allow any certificate
+
+  // Disable auto-reboot to send response first
+  httpUpdate.rebootOnUpdate(false);
+  httpUpdate.onProgress([](int, int) { Supervisor.feedWatchdog(); });
+  t_httpUpdate_return ret = httpUpdate.update(client, url);
+
+  switch (ret) {
+  case HTTP_UPDATE_FAILED:
+    req.send(500, "text/plain", "Fail: " + httpUpdate.getLastErrorString());
+    break;
+  case HTTP_UPDATE_NO_UPDATES:
+    req.send(304, "text/plain", "No updates");
+    break;
+  case HTTP_UPDATE_OK:
+    req.send(200, "text/plain", "OK");
+    Analytics.checkpoint();
+    delay(1000);
+    ESP.restart();
+    break;
+  }
+}
+#endif // OTA_URL_ENABLED
+
+#if OTA_UPLOAD_ENABLED
+static void handleUpdateUpload(HttpRequest &req, HttpUpload &upload) {
+  if (upload.status == HTTP_UPLOAD_START) {
+    LOG("OTA: Upload Start: %s", upload.filename);
+    if (!Update.begin(UPDATE_SIZE_UNKNOWN)) {
+      Update.printError(Serial);
+    }
+  } else if (upload.status == HTTP_UPLOAD_WRITE) {
+    if (Update.write(upload.buf, upload.currentSize) != upload.currentSize) {
+      Update.printError(Serial);
+    }
+  } else if (upload.status == HTTP_UPLOAD_END) {
+    if (Update.end(true)) {
+      LOG("OTA: Success: %lu bytes", (unsigned long)upload.totalSize);
+    } else {
+      Update.printError(Serial);
+    }
+  } else if (upload.status == HTTP_UPLOAD_ABORTED) {
+    Update.abort();
+    LOG("OTA: Upload aborted");
+  }
+}
+
+static void handleUpdateDone(HttpRequest &req) {
+  req.send(200, "text/plain", (Update.hasError()) ? "FAIL" : "OK");
+  if (!Update.hasError()) {
+    Analytics.checkpoint();
+    delay(1000);
+    ESP.restart();
+  }
+}
+#endif // OTA_UPLOAD_ENABLED
+
+void otaBegin(HttpServer &server) {
+#if OTA_URL_ENABLED
+  server.on("/update-url", HTTP_METHOD_POST, handleUpdateUrl);
+#endif
+#if OTA_UPLOAD_ENABLED
+  server.on("/update", HTTP_METHOD_POST, handleUpdateDone, handleUpdateUpload);
+#endif
+}
@@ -0,0 +1,23 @@
+#ifndef OTA_H
+#define OTA_H
+
+#include "../system/config.h"
+#include "http_server.h"
+#include <Arduino.h>
+
+// POST /update: firmware image as a multipart upload
+#ifndef OTA_UPLOAD_ENABLED
+#define OTA_UPLOAD_ENABLED 1
+#endif
+// POST /update-url: the device downloads the image itself. Links
+// HTTPUpdate and WiFiClientSecure (mbedTLS), the largest optional module.
+#ifndef OTA_URL_ENABLED
+#define OTA_URL_ENABLED 1
+#endif
+
+#define OTA_URL_MAX 256
+
+// Register the enabled routes
+void otaBegin(HttpServer &server);
+
+#endif // OTA_H
@@ -0,0 +1,323 @@
+#include "payload_writer.h"
+
+PayloadFormat negotiateFormat(const char *formatArg, const char *accept) {
+  if (formatArg && *formatArg) {
+    if (strcmp(formatArg, "cbor") == 0)
+      return FORMAT_CBOR;
+    if (strcmp(formatArg, "msgpack") == 0)
+      return FORMAT_MSGPACK;
+    return FORMAT_JSON;
+  }
+  if (accept) {
+    if (strstr(accept, "application/cbor"))
+      return FORMAT_CBOR;
+    if (strstr(accept, "msgpack")) // application/msgpack, x-msgpack
+      return FORMAT_MSGPACK;
+  }
+  return FORMAT_JSON;
+}
+
+const char *formatContentType(PayloadFormat format) {
+  switch (format) {
+  case FORMAT_CBOR:
+    return "application/cbor";
+  case FORMAT_MSGPACK:
+    return "application/msgpack";
+  default:
+    return "application/json";
+  }
+}
+
+PayloadWriter::PayloadWriter(PayloadFormat format, uint8_t *buf, size_t size)
+    : format(format), buf(buf), size(size) {}
+
+void PayloadWriter::put(uint8_t b) {
+  if (len < size)
+    buf[len++] = b;
+  else
+    overflowed = true;
+}
+
+void PayloadWriter::put(const void *data, size_t n) {
+  if (len + n > size) {
+    overflowed = true;
+    return;
+  }
+  memcpy(buf + len, data, n);
+  len += n;
+}
+
+void PayloadWriter::putText(const char *s) { put(s, strlen(s)); }
+
+void PayloadWriter::putBE(uint32_t value, uint8_t bytes) {
+  for (int i = bytes - 1; i >= 0; i--) {
+    put((uint8_t)(value >> (8 * i)));
+  }
+}
+
+// CBOR initial byte + argument (RFC 8949, 3.1)
+void PayloadWriter::cborHead(uint8_t major, uint32_t value) {
+  major <<= 5;
+  if (value < 24) {
+    put(major | value);
+  } else if (value <= 0xFF) {
+    put(major | 24);
+    putBE(value, 1);
+  } else if (value <= 0xFFFF) {
+    put(major | 25);
+    putBE(value, 2);
+  } else {
+    put(major | 26);
+    putBE(value, 4);
+  }
+}
+
+// JSON separators: comma between elements, none right after a key
+void PayloadWriter::beforeValue() {
+  if (format != FORMAT_JSON)
+    return;
+  if (afterKey) {
+    afterKey = false;
+    return;
+  }
+  if (depth > 0) {
+    if (!first[depth - 1])
+      put(',');
+    first[depth - 1] = false;
+  }
+}
+
+void PayloadWriter::beginMap(uint16_t count) {
+  beforeValue();
+  switch (format) {
+  case FORMAT_CBOR:
+    cborHead(5, count);
+    return;
+  case FORMAT_MSGPACK:
+    if (count < 16) {
+      put(0x80 | count);
+    } else {
+      put(0xDE);
+      putBE(count, 2);
+    }
+    return;
+  default:
+    put('{');
+    if (depth < MAX_DEPTH) {
+      closers[depth] = '}';
+      first[depth] = true;
+      depth++;
+    }
+  }
+}
+
+void PayloadWriter::beginArray(uint16_t count) {
+  beforeValue();
+  switch (format) {
+  case FORMAT_CBOR:
+    cborHead(4, count);
+    return;
+  case FORMAT_MSGPACK:
+    if (count < 16) {
+      put(0x90 | count);
+    } else {
+      put(0xDC);
+      putBE(count, 2);
+    }
+    return;
+  default:
+    put('[');
+    if (depth < MAX_DEPTH) {
+      closers[depth] = ']';
+      first[depth] = true;
+      depth++;
+    }
+  }
+}
+
+void PayloadWriter::end() {
+  if (format != FORMAT_JSON || depth == 0)
+    return;
+  depth--;
+  put(closers[depth]);
+}
+
+void PayloadWriter::key(const char *name) {
+  if (format == FORMAT_JSON) {
+    beforeValue();
+    jsonString(name);
+    put(':');
+    afterKey = true;
+  } else {
+    addString(name);
+  }
+}
+
+void PayloadWriter::addBool(bool value) {
+  beforeValue();
+  switch (format) {
+  case FORMAT_CBOR:
+    put(value ? 0xF5 : 0xF4);
+    break;
+  case FORMAT_MSGPACK:
+    put(value ? 0xC3 : 0xC2);
+    break;
+  default:
+    putText(value ? "true" : "false");
+  }
+}
+
+void PayloadWriter::addNull() {
+  beforeValue();
+  switch (format) {
+  case FORMAT_CBOR:
+    put(0xF6);
+    break;
+  case FORMAT_MSGPACK:
+    put(0xC0);
+    break;
+  default:
+    putText("null");
+  }
+}
+
+void PayloadWriter::addUInt(uint32_t value) {
+  beforeValue();
+  switch (format) {
+  case FORMAT_CBOR:
+    cborHead(0, value);
+    break;
+  case FORMAT_MSGPACK:
+    if (value < 0x80) {
+      put((uint8_t)value);
+    } else if (value <= 0xFF) {
+      put(0xCC);
+      putBE(value, 1);
+    } else if (value <= 0xFFFF) {
+      put(0xCD);
+      putBE(value, 2);
+    } else {
+      put(0xCE);
+      putBE(value, 4);
+    }
+    break;
+  default: {
+    char tmp[11];
+    char *p = tmp + sizeof(tmp);
+    do {
+      *--p = '0' + value % 10;
+      value /= 10;
+    } while (value);
+    put(p, tmp + sizeof(tmp) - p);
+  }
+  }
+}
+
+void PayloadWriter::addInt(int32_t value) {
+  if (value >= 0) {
+    addUInt(value);
+    return;
+  }
+  switch (format) {
+  case FORMAT_CBOR:
+    beforeValue();
+    cborHead(1, (uint32_t)(-1 - value));
+    break;
+  case FORMAT_MSGPACK:
+    beforeValue();
+    if (value >= -32) {
+      put((uint8_t)(int8_t)value);
+    } else if (value >= -128) {
+      put(0xD0);
+      putBE((uint8_t)(int8_t)value, 1);
+    } else if (value >= -32768) {
+      put(0xD1);
+      putBE((uint16_t)(int16_t)value, 2);
+    } else {
+      put(0xD2);
+      putBE((uint32_t)value, 4);
+    }
+    break;
+  default:
+    beforeValue();
+    put('-');
+    afterKey = true; // Digits follow without a separator
+    addUInt((uint32_t)(-(int64_t)value));
+  }
+}
+
+void PayloadWriter::addFloat(float value) {
+  switch (format) {
+  case FORMAT_CBOR:
+  case FORMAT_MSGPACK: {
+    beforeValue();
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put(format == FORMAT_CBOR ? 0xFA : 0xCA);
+    putBE(bits, 4);
+    break;
+  }
+  default: {
+    // Fixed point, 2 decimals (same output as String(float))
+    if (isnan(value) || isinf(value)) {
+      addNull();
+      return;
+    }
+    int32_t hundredths = (int32_t)lroundf(value * 100);
+    beforeValue();
+    if (hundredths < 0) {
+      put('-');
+      hundredths = -hundredths;
+    }
+    afterKey = true;
+    addUInt(hundredths / 100);
+    put('.');
+    put('0' + (hundredths % 100) / 10);
+    put('0' + hundredths % 10);
+  }
+  }
+}
+
+void PayloadWriter::addString(const char *value) {
+  beforeValue();
+  size_t n = strlen(value);
+  switch (format) {
+  case FORMAT_CBOR:
+    cborHead(3, n);
+    put(value, n);
+    break;
+  case FORMAT_MSGPACK:
+    if (n < 32) {
+      put(0xA0 | n);
+    } else if (n <= 0xFF) {
+      put(0xD9);
+      putBE(n, 1);
+    } else {
+      put(0xDA);
+      putBE(n, 2);
+    }
+    put(value, n);
+    break;
+  default:
+    jsonString(value);
+  }
+}
+
+void PayloadWriter::jsonString(const char *s) {
+  put('"');
+  for (; *s; s++) {
+    uint8_t c = *s;
+    if (c == '"' || c == '\\') {
+      put('\\');
+      put(c);
+    } else if (c < 0x20) {
+      static const char hex[] = "0123456789abcdef";
+      put("\\u00", 4);
+      put(hex[c >> 4]);
+      put(hex[c & 0xF]);
+    } else {
+      put(c);
+    }
+  }
+  put('"');
+}
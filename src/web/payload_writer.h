@@ -0,0 +1,72 @@
+#ifndef PAYLOAD_WRITER_H
+#define PAYLOAD_WRITER_H
+
+#include <Arduino.h>
+
+enum PayloadFormat : uint8_t {
+  FORMAT_JSON,
+  FORMAT_CBOR,
+  FORMAT_MSGPACK,
+};
+
+// Pick the response format from ?format= or the Accept header
+PayloadFormat negotiateFormat(const char *formatArg, const char *accept);
+
+const char *formatContentType(PayloadFormat format);
+
+// Writes maps/arrays of scalars as JSON, CBOR or MessagePack straight into a
+// caller-provided buffer: no heap, no intermediate String.
+// Binary formats need the element count up front, JSON ignores it.
+//
+//   uint8_t buf[256];
+//   PayloadWriter w(format, buf, sizeof(buf));
+//   w.beginMap(2);
+//   w.key("power"); w.addBool(true);
+//   w.key("temp");  w.addFloat(24.5);
+//   w.end();
+class PayloadWriter {
+public:
+  PayloadWriter(PayloadFormat format, uint8_t *buf, size_t size);
+
+  void beginMap(uint16_t count);
+  void beginArray(uint16_t count);
+  void end(); // Closes the innermost map/array
+
+  void key(const char *name);
+
+  void addBool(bool value);
+  void addInt(int32_t value);
+  void addUInt(uint32_t value);
+  void addFloat(float value); // JSON: 2 decimals
+  void addString(const char *value);
+  void addNull();
+
+  const uint8_t *data() const { return buf; }
+  size_t length() const { return len; }
+  bool overflow() const { return overflowed; }
+
+private:
+  void beforeValue();
+  void put(uint8_t b);
+  void put(const void *data, size_t n);
+  void putText(const char *s);
+  void putBE(uint32_t value, uint8_t bytes);
+  void cborHead(uint8_t major, uint32_t value);
+  void jsonString(const char *s);
+
+private:
+  PayloadFormat format;
+  uint8_t *buf;
+  size_t size;
+  size_t len = 0;
+  bool overflowed = false;
+
+  // JSON bookkeeping
+  static const uint8_t MAX_DEPTH = 8;
+  char closers[MAX_DEPTH];
+  bool first[MAX_DEPTH];
+  uint8_t depth = 0;
+  bool afterKey = false;
+};
+
+#endif // PAYLOAD_WRITER_H
@@ -0,0 +1,103 @@
+#include "rate_limiter.h"
+#include "../system/clock.h"
+
+RateLimiter Limiter;
+
+static const uint16_t CLASS_PER_MIN[RATE_CLASS_COUNT] = {
+    0, RATE_READ_PER_MIN, RATE_WRITE_PER_MIN};
+static const uint16_t CLASS_BURST[RATE_CLASS_COUNT] = {0, RATE_READ_BURST,
+                                                       RATE_WRITE_BURST};
+
+// ---- TokenBucket ----
+
+void TokenBucket::fill(uint16_t burst, unsigned long now) {
+  milliTokens = burst * 1000UL;
+  updated = now;
+}
+
+bool TokenBucket::take(uint16_t perMinute, uint16_t burst,
+                       unsigned long now) {
+  if (perMinute == 0)
+    return true;
+
+  uint32_t capacity = burst * 1000UL;
+  unsigned long elapsed = elapsedMs(now, updated);
+  // perMinute tokens per 60000 ms = perMinute / 60 milli-tokens per ms
+  if (elapsed >= (capacity * 60) / perMinute) {
+    fill(burst, now);
+  } else {
+    uint32_t gained = elapsed * perMinute / 60;
+    if (gained > 0) {
+      // Only advance by the time actually converted, so frequent calls
+      // don't round the refill away
+      updated += gained * 60 / perMinute;
+      milliTokens = min(capacity, milliTokens + gained);
+    }
+  }
+
+  if (milliTokens < 1000)
+    return false;
+  milliTokens -= 1000;
+  return true;
+}
+
+uint32_t TokenBucket::waitMs(uint16_t perMinute) const {
+  if (perMinute == 0 || milliTokens >= 1000)
+    return 0;
+  return ((1000 - milliTokens) * 60 + perMinute - 1) / perMinute;
+}
+
+// ---- RateLimiter ----
+
+RateLimiter::Client &RateLimiter::lookup(uint32_t ip, unsigned long now) {
+  Client *oldest = nullptr;
+  for (uint8_t i = 0; i < clientsUsed; i++) {
+    if (clients[i].ip == ip)
+      return clients[i];
+    if (!oldest || elapsedMs(now, clients[i].lastSeen) >
+                       elapsedMs(now, oldest->lastSeen))
+      oldest = &clients[i];
+  }
+
+  Client *c;
+  if (clientsUsed < RATE_MAX_CLIENTS) {
+    c = &clients[clientsUsed++];
+  } else {
+    c = oldest;
+    stats.forgotten++;
+  }
+  c->ip = ip;
+  for (int k = RATE_CLASS_NONE + 1; k < RATE_CLASS_COUNT; k++) {
+    c->buckets[k - 1].fill(CLASS_BURST[k], now);
+  }
+  return *c;
+}
+
+bool RateLimiter::admit(uint32_t ip, RateClass cls, uint32_t &retryAfterS) {
+  retryAfterS = 0;
+  if (cls == RATE_CLASS_NONE || cls >= RATE_CLASS_COUNT ||
+      CLASS_PER_MIN[cls] == 0)
+    return true;
+
+  unsigned long now = millis();
+  Client &c = lookup(ip, now);
+  c.lastSeen = now;
+  TokenBucket &b = c.buckets[cls - 1];
+  if (b.take(CLASS_PER_MIN[cls], CLASS_BURST[cls], now))
+    return true;
+
+  stats.limited[cls]++;
+  retryAfterS = (b.waitMs(CLASS_PER_MIN[cls]) + 999) / 1000;
+  if (retryAfterS == 0)
+    retryAfterS = 1;
+  return false;
+}
+
+bool RateLimiter::takeBusPoll() {
+  if (!bus.take(RATE_BUS_POLLS_PER_MIN, RATE_BUS_POLL_BURST, millis())) {
+    stats.degraded++;
+    return false;
+  }
+  stats.busPolls++;
+  return true;
+}
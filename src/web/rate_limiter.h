@@ -0,0 +1,88 @@
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include "../system/config.h"
+#include <Arduino.h>
+
+// Per-client budgets (requests per minute, burst). 0 = unlimited.
+#ifndef RATE_READ_PER_MIN
+#define RATE_READ_PER_MIN 60
+#endif
+#ifndef RATE_READ_BURST
+#define RATE_READ_BURST 10
+#endif
+#ifndef RATE_WRITE_PER_MIN
+#define RATE_WRITE_PER_MIN 20
+#endif
+#ifndef RATE_WRITE_BURST
+#define RATE_WRITE_BURST 5
+#endif
+// Bus polls HTTP reads may trigger, shared by all clients. Past this,
+// /status answers from the last poll.
+#ifndef RATE_BUS_POLLS_PER_MIN
+#define RATE_BUS_POLLS_PER_MIN 12
+#endif
+#ifndef RATE_BUS_POLL_BURST
+#define RATE_BUS_POLL_BURST 3
+#endif
+// Clients tracked at once; the least recently seen one is forgotten
+#ifndef RATE_MAX_CLIENTS
+#define RATE_MAX_CLIENTS 8
+#endif
+
+enum RateClass : uint8_t {
+  RATE_CLASS_NONE = 0, // UI, metrics, OTA: not limited
+  RATE_CLASS_READ,     // May trigger a bus poll, or holds a connection
+  RATE_CLASS_WRITE,    // Sends frames to the unit, or writes NVS
+  RATE_CLASS_COUNT,
+};
+
+// Token bucket in thousandths of a token, refilled lazily on use
+struct TokenBucket {
+  uint32_t milliTokens;
+  unsigned long updated;
+
+  void fill(uint16_t burst, unsigned long now);
+  bool take(uint16_t perMinute, uint16_t burst, unsigned long now);
+  // Time until one token is available
+  uint32_t waitMs(uint16_t perMinute) const;
+};
+
+struct RateLimitStats {
+  uint32_t limited[RATE_CLASS_COUNT]; // Answered 429, by class
+  uint32_t degraded; // Status served from cache, bus budget spent
+  uint32_t busPolls; // Polls admitted for HTTP reads
+  uint32_t forgotten; // Clients dropped to make room
+};
+
+// Admission control in front of the bus: per client IP and route class,
+// plus one shared budget for the polls that status reads trigger.
+class RateLimiter {
+public:
+  // False = over budget; retryAfterS is when to come back
+  bool admit(uint32_t ip, RateClass cls, uint32_t &retryAfterS);
+
+  // One bus poll for an HTTP read. False = serve cached data.
+  bool takeBusPoll();
+
+  uint8_t clientCount() const { return clientsUsed; }
+  const RateLimitStats &getStats() const { return stats; }
+
+private:
+  struct Client {
+    uint32_t ip;
+    unsigned long lastSeen;
+    TokenBucket buckets[RATE_CLASS_COUNT - 1];
+  };
+
+  Client &lookup(uint32_t ip, unsigned long now);
+
+  Client clients[RATE_MAX_CLIENTS];
+  uint8_t clientsUsed = 0;
+  TokenBucket bus = {RATE_BUS_POLL_BURST * 1000UL, 0};
+  RateLimitStats stats = {};
+};
+
+extern RateLimiter Limiter;
+
+#endif // RATE_LIMITER_H
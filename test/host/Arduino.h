@@ -0,0 +1,253 @@
+// Host build of the parts of the Arduino-ESP32 core the firmware uses.
+// Declarations follow the core; arduino.cpp implements them on the host
+// (see host.h for what tests can control).
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <ctype.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <functional>
+#include <string>
+
+#include "freertos_host.h"
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (s)
+#define IRAM_ATTR
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+#define DEC 10
+#define HEX 16
+
+#define SERIAL_8N1 0x800001c
+#define SERIAL_8E2 0x800003e
+
+#define constrain(amt, low, high)                                              \
+  ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+using std::max;
+using std::min;
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+extern "C" uint32_t esp_random();
+
+bool setCpuFrequencyMhz(uint32_t mhz);
+uint32_t getCpuFrequencyMhz();
+
+void configTzTime(const char *tz, const char *server1,
+                  const char *server2 = nullptr,
+                  const char *server3 = nullptr);
+
+// Arduino String on top of std::string
+class String {
+public:
+  String(const char *s = "");
+  String(const String &other) = default;
+  explicit String(char c);
+  explicit String(int value, unsigned char base = 10);
+  explicit String(unsigned int value, unsigned char base = 10);
+  explicit String(long value, unsigned char base = 10);
+  explicit String(unsigned long value, unsigned char base = 10);
+  explicit String(float value, unsigned char decimals = 2);
+  explicit String(double value, unsigned char decimals = 2);
+
+  String &operator=(const String &other) = default;
+  String &operator+=(const String &other);
+  String &operator+=(const char *s);
+  String &operator+=(char c);
+  String &operator+=(int value);
+  String &operator+=(unsigned int value);
+  String &operator+=(long value);
+  String &operator+=(unsigned long value);
+  String &operator+=(float value);
+  String &operator+=(double value);
+  bool concat(const char *s) { return *this += s, true; }
+  bool concat(const String &s) { return *this += s, true; }
+
+  friend String operator+(const String &a, const String &b);
+  friend String operator+(const String &a, const char *b);
+  friend String operator+(const char *a, const String &b);
+  friend String operator+(const String &a, char b);
+  friend String operator+(const String &a, int b);
+  friend String operator+(const String &a, unsigned int b);
+  friend String operator+(const String &a, long b);
+  friend String operator+(const String &a, unsigned long b);
+  friend String operator+(const String &a, float b);
+  friend String operator+(const String &a, double b);
+
+  bool operator==(const String &other) const { return s == other.s; }
+  bool operator==(const char *other) const { return s == other; }
+  bool operator!=(const String &other) const { return s != other.s; }
+  bool operator!=(const char *other) const { return s != other; }
+  bool equals(const String &other) const { return s == other.s; }
+  bool equalsIgnoreCase(const String &other) const;
+
+  const char *c_str() const { return s.c_str(); }
+  unsigned int length() const { return s.size(); }
+  bool isEmpty() const { return s.empty(); }
+  bool reserve(unsigned int size);
+  char charAt(unsigned int index) const;
+  char operator[](unsigned int index) const { return charAt(index); }
+  int indexOf(char c, unsigned int from = 0) const;
+  int indexOf(const char *str, unsigned int from = 0) const;
+  int indexOf(const String &str, unsigned int from = 0) const;
+  int lastIndexOf(char c) const;
+  bool startsWith(const char *prefix) const;
+  bool startsWith(const String &prefix) const;
+  bool endsWith(const char *suffix) const;
+  String substring(unsigned int from) const;
+  String substring(unsigned int from, unsigned int to) const;
+  void trim();
+  void toLowerCase();
+  void toUpperCase();
+  void replace(const char *find, const char *with);
+  void remove(unsigned int index);
+  void remove(unsigned int index, unsigned int count);
+  long toInt() const;
+  float toFloat() const;
+
+private:
+  std::string s;
+};
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  size_t write(const char *str);
+  size_t write(const char *buffer, size_t size);
+  virtual int availableForWrite() { return 0; }
+  virtual void flush() {}
+
+  size_t printf(const char *format, ...)
+      __attribute__((format(printf, 2, 3)));
+  size_t print(const char *str);
+  size_t print(const String &str);
+  size_t print(char c);
+  size_t print(unsigned char value, int base = DEC);
+  size_t print(int value, int base = DEC);
+  size_t print(unsigned int value, int base = DEC);
+  size_t print(long value, int base = DEC);
+  size_t print(unsigned long value, int base = DEC);
+  size_t print(double value, int decimals = 2);
+  size_t println(const char *str);
+  size_t println(const String &str);
+  size_t println(char c);
+  size_t println(int value, int base = DEC);
+  size_t println(unsigned int value, int base = DEC);
+  size_t println(long value, int base = DEC);
+  size_t println(unsigned long value, int base = DEC);
+  size_t println(double value, int decimals = 2);
+  size_t println();
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() { return -1; }
+  void setTimeout(unsigned long ms) { timeout = ms; }
+  size_t readBytes(uint8_t *buffer, size_t length);
+  size_t readBytes(char *buffer, size_t length) {
+    return readBytes((uint8_t *)buffer, length);
+  }
+  String readStringUntil(char terminator);
+
+protected:
+  unsigned long timeout = 1000;
+};
+
+typedef enum {
+  UART_NO_ERROR,
+  UART_BREAK_ERROR,
+  UART_BUFFER_FULL_ERROR,
+  UART_FIFO_OVF_ERROR,
+  UART_FRAME_ERROR,
+  UART_PARITY_ERROR
+} hardwareSerial_error_t;
+
+typedef std::function<void(void)> OnReceiveCb;
+typedef std::function<void(hardwareSerial_error_t)> OnReceiveErrorCb;
+
+// Serial is the debug port (output captured, see host.h); Serial1 is wired
+// to the HostBus a test attaches, normally the S21 unit emulator
+class HardwareSerial : public Stream {
+public:
+  explicit HardwareSerial(int uart) : uart(uart) {}
+  void begin(unsigned long baud, uint32_t config = SERIAL_8N1,
+             int8_t rxPin = -1, int8_t txPin = -1, bool invert = false,
+             unsigned long timeoutMs = 20000UL,
+             uint8_t rxfifoFullThreshold = 112);
+  void end() {}
+  int available() override;
+  int read() override;
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+  int availableForWrite() override { return 128; }
+  void onReceive(OnReceiveCb function, bool onlyOnTimeout = false);
+  void onReceiveError(OnReceiveErrorCb function);
+  bool setRxFIFOFull(uint8_t threshold);
+  bool setRxTimeout(uint8_t symbols);
+  size_t setRxBufferSize(size_t size) { return size; }
+  operator bool() const { return true; }
+
+  // Host only: what the UART event task would call
+  OnReceiveCb receiveCallback;
+  OnReceiveErrorCb errorCallback;
+  uint8_t rxFifoFull = 112;
+
+private:
+  int uart;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+
+class EspClass {
+public:
+  void restart();
+  uint32_t getHeapSize();
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap();
+  uint32_t getMaxAllocHeap();
+  uint32_t getCycleCount();
+  uint32_t getCpuFreqMHz() { return getCpuFrequencyMhz(); }
+  uint32_t getSketchSize() { return 1024 * 1024; }
+  uint32_t getFreeSketchSpace() { return 1280 * 1024; }
+  const char *getSdkVersion() { return "host"; }
+  uint64_t getEfuseMac() { return 0x0000aabbccddeeffULL; }
+};
+
+extern EspClass ESP;
+
+#endif // ARDUINO_H
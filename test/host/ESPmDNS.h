@@ -0,0 +1,18 @@
+// Host build: services and TXT records are kept for tests (see host.h)
+#ifndef ESPMDNS_H
+#define ESPMDNS_H
+
+#include <Arduino.h>
+
+class MDNSResponder {
+public:
+  bool begin(const char *hostName);
+  void end() {}
+  bool addService(const char *service, const char *proto, uint16_t port);
+  bool addServiceTxt(const char *service, const char *proto, const char *key,
+                     const char *value);
+};
+
+extern MDNSResponder MDNS;
+
+#endif // ESPMDNS_H
@@ -0,0 +1,25 @@
+// Host build: URL updates always fail
+#ifndef HTTPUPDATE_H
+#define HTTPUPDATE_H
+
+#include "WiFiClient.h"
+#include <Arduino.h>
+
+typedef enum {
+  HTTP_UPDATE_FAILED,
+  HTTP_UPDATE_NO_UPDATES,
+  HTTP_UPDATE_OK
+} HTTPUpdateResult;
+#define t_httpUpdate_return HTTPUpdateResult
+
+class HTTPUpdate {
+public:
+  void rebootOnUpdate(bool reboot) {}
+  void onProgress(std::function<void(int, int)> callback) {}
+  HTTPUpdateResult update(WiFiClient &client, const String &url);
+  String getLastErrorString() { return String("not on a host build"); }
+};
+
+extern HTTPUpdate httpUpdate;
+
+#endif // HTTPUPDATE_H
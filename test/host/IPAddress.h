@@ -0,0 +1,25 @@
+#ifndef IPADDRESS_H
+#define IPADDRESS_H
+
+#include <Arduino.h>
+
+class IPAddress {
+public:
+  IPAddress() : address(0) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+      : address(a | b << 8 | c << 16 | (uint32_t)d << 24) {}
+  IPAddress(uint32_t address) : address(address) {}
+
+  operator uint32_t() const { return address; }
+  uint8_t operator[](int index) const { return address >> (8 * index); }
+  bool operator==(const IPAddress &other) const {
+    return address == other.address;
+  }
+  bool fromString(const char *text);
+  String toString() const;
+
+private:
+  uint32_t address; // Network byte order, like the core
+};
+
+#endif // IPADDRESS_H
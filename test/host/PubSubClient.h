@@ -0,0 +1,60 @@
+// Host build: an in-process broker instead of the network (see host.h)
+#ifndef PUBSUBCLIENT_H
+#define PUBSUBCLIENT_H
+
+#include "IPAddress.h"
+#include "WiFiClient.h"
+#include <Arduino.h>
+
+#define MQTT_CONNECTION_TIMEOUT -4
+#define MQTT_CONNECTION_LOST -3
+#define MQTT_CONNECT_FAILED -2
+#define MQTT_DISCONNECTED -1
+#define MQTT_CONNECTED 0
+
+#define MQTT_CALLBACK_SIGNATURE                                                \
+  std::function<void(char *, uint8_t *, unsigned int)> callback
+
+class PubSubClient {
+public:
+  PubSubClient() {}
+  explicit PubSubClient(Client &client);
+
+  PubSubClient &setServer(const char *domain, uint16_t port);
+  PubSubClient &setServer(IPAddress ip, uint16_t port);
+  PubSubClient &setCallback(MQTT_CALLBACK_SIGNATURE);
+  PubSubClient &setClient(Client &client) {
+    this->client = &client;
+    return *this;
+  }
+  PubSubClient &setKeepAlive(uint16_t keepAlive) { return *this; }
+  PubSubClient &setSocketTimeout(uint16_t timeout);
+  bool setBufferSize(uint16_t size);
+  uint16_t getBufferSize() { return bufferSize; }
+
+  bool connect(const char *id);
+  bool connect(const char *id, const char *user, const char *pass);
+  bool connect(const char *id, const char *user, const char *pass,
+               const char *willTopic, uint8_t willQos, bool willRetain,
+               const char *willMessage);
+  void disconnect();
+  bool publish(const char *topic, const char *payload);
+  bool publish(const char *topic, const char *payload, bool retained);
+  bool publish(const char *topic, const uint8_t *payload, unsigned int length,
+               bool retained = false);
+  bool subscribe(const char *topic, uint8_t qos = 0);
+  bool loop();
+  bool connected();
+  int state() { return connectState; }
+
+  // Host only
+  std::function<void(char *, uint8_t *, unsigned int)> callback;
+  uint16_t socketTimeout = 15;
+
+private:
+  Client *client = nullptr;
+  uint16_t bufferSize = 256;
+  int connectState = MQTT_DISCONNECTED;
+};
+
+#endif // PUBSUBCLIENT_H
@@ -0,0 +1,25 @@
+// Host build: an update that goes nowhere
+#ifndef UPDATE_H
+#define UPDATE_H
+
+#include <Arduino.h>
+
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+
+class UpdateClass {
+public:
+  bool begin(size_t size = UPDATE_SIZE_UNKNOWN);
+  size_t write(uint8_t *data, size_t len);
+  bool end(bool evenIfRemaining = false);
+  void abort();
+  bool hasError() { return false; }
+  bool isRunning() { return running; }
+  void printError(Print &out) { out.println("host: no update partition"); }
+
+private:
+  bool running = false;
+};
+
+extern UpdateClass Update;
+
+#endif // UPDATE_H
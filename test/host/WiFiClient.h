@@ -0,0 +1,59 @@
+// Host build: WiFiClient on a non-blocking loopback TCP socket
+#ifndef WIFICLIENT_H
+#define WIFICLIENT_H
+
+#include "IPAddress.h"
+#include <Arduino.h>
+
+class Client : public Stream {
+public:
+  virtual int connect(IPAddress ip, uint16_t port) = 0;
+  virtual int connect(const char *host, uint16_t port) = 0;
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size) = 0;
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int read(uint8_t *buffer, size_t size) = 0;
+  virtual void stop() = 0;
+  virtual uint8_t connected() = 0;
+  virtual operator bool() = 0;
+  using Print::write;
+};
+
+class WiFiClient : public Client {
+public:
+  WiFiClient() {}
+  explicit WiFiClient(int fd);
+  WiFiClient(const WiFiClient &other);
+  WiFiClient &operator=(const WiFiClient &other);
+  ~WiFiClient();
+
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(const char *host, uint16_t port) override;
+  int connect(IPAddress ip, uint16_t port, int32_t timeoutMs);
+  int connect(const char *host, uint16_t port, int32_t timeoutMs);
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+  int available() override;
+  int read() override;
+  int read(uint8_t *buffer, size_t size) override;
+  int peek() override;
+  void flush() override {}
+  void stop() override;
+  uint8_t connected() override;
+  operator bool() override { return connected(); }
+  int fd() const;
+  int setNoDelay(bool nodelay);
+  int setTimeout(uint32_t seconds);
+  IPAddress remoteIP() const;
+  uint16_t remotePort() const;
+  int32_t connectTimeout() const { return timeoutMs; } // Host only
+
+private:
+  struct Socket;
+  Socket *socket = nullptr; // Shared between copies, like the core
+  int32_t timeoutMs = 3000; // WIFI_CLIENT_DEF_CONN_TIMEOUT_MS
+};
+
+#endif // WIFICLIENT_H
@@ -0,0 +1,13 @@
+// Host build: no TLS, plain TCP
+#ifndef WIFICLIENTSECURE_H
+#define WIFICLIENTSECURE_H
+
+#include "WiFiClient.h"
+
+class WiFiClientSecure : public WiFiClient {
+public:
+  void setInsecure() {}
+  void setCACert(const char *) {}
+};
+
+#endif // WIFICLIENTSECURE_H
@@ -0,0 +1,28 @@
+// Host build: listens on 127.0.0.1
+#ifndef WIFISERVER_H
+#define WIFISERVER_H
+
+#include "WiFiClient.h"
+
+class WiFiServer {
+public:
+  explicit WiFiServer(uint16_t port = 80, uint8_t maxClients = 4)
+      : port(port) {}
+  ~WiFiServer() { end(); }
+  void begin(uint16_t port = 0);
+  void end();
+  void stop() { end(); }
+  void setNoDelay(bool nodelay) { noDelay = nodelay; }
+  bool hasClient();
+  WiFiClient accept();
+  WiFiClient available() { return accept(); }
+  operator bool() { return listenFd >= 0; }
+
+private:
+  uint16_t port;
+  int listenFd = -1;
+  int pendingFd = -1;
+  bool noDelay = false;
+};
+
+#endif // WIFISERVER_H
@@ -0,0 +1,27 @@
+// Host build: datagrams are counted, nothing is sent
+#ifndef WIFIUDP_H
+#define WIFIUDP_H
+
+#include "IPAddress.h"
+#include <Arduino.h>
+
+class WiFiUDP : public Stream {
+public:
+  uint8_t begin(uint16_t port);
+  uint8_t beginMulticast(IPAddress group, uint16_t port);
+  void stop() {}
+  int beginPacket(IPAddress ip, uint16_t port);
+  int beginMulticastPacket() { return 1; }
+  int endPacket();
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+  int parsePacket() { return 0; }
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int read(uint8_t *, size_t) { return 0; }
+  IPAddress remoteIP() { return IPAddress(); }
+  uint16_t remotePort() { return 0; }
+};
+
+#endif // WIFIUDP_H
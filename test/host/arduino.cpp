@@ -0,0 +1,844 @@
+// Host build of the Arduino-ESP32 core: clock, String/Print, the serial
+// ports, FreeRTOS waits, WiFi, sockets and Preferences
+#include "host.h"
+#include <Preferences.h>
+#include <esp_task_wdt.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <deque>
+#include <thread>
+
+// Clock
+
+static bool g_virtual = false;
+static uint64_t g_nowUs = 0;
+static const std::chrono::steady_clock::time_point g_start =
+    std::chrono::steady_clock::now();
+
+uint64_t hostNowUs() {
+  if (g_virtual)
+    return g_nowUs;
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - g_start)
+      .count();
+}
+
+void hostUseVirtualClock(uint32_t startMs) {
+  g_virtual = true;
+  g_nowUs = startMs * 1000ULL;
+}
+
+bool hostVirtualClock() { return g_virtual; }
+
+void hostAdvanceUs(uint32_t us) {
+  if (g_virtual)
+    g_nowUs += us;
+  else
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void hostAdvance(uint32_t ms) { hostAdvanceUs(ms * 1000); }
+
+// 32 bits like the ESP32, so the rollovers happen on the host too
+unsigned long millis() { return (uint32_t)(hostNowUs() / 1000); }
+unsigned long micros() { return (uint32_t)hostNowUs(); }
+void delay(uint32_t ms) { hostAdvance(ms); }
+void delayMicroseconds(uint32_t us) { hostAdvanceUs(us); }
+void yield() {}
+
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+int digitalRead(uint8_t) { return LOW; }
+
+long random(long max) { return max > 0 ? rand() % max : 0; }
+long random(long min, long max) { return min >= max ? min : min + random(max - min); }
+void randomSeed(unsigned long seed) { srand(seed); }
+extern "C" uint32_t esp_random() { return ((uint32_t)rand() << 16) ^ rand(); }
+
+static uint32_t g_cpuMhz = 160;
+bool setCpuFrequencyMhz(uint32_t mhz) {
+  g_cpuMhz = mhz;
+  return true;
+}
+uint32_t getCpuFrequencyMhz() { return g_cpuMhz; }
+
+void configTzTime(const char *tz, const char *, const char *, const char *) {
+  setenv("TZ", tz, 1);
+  tzset();
+}
+
+// String
+
+static std::string formatNumber(const char *format, long long value) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), format, value);
+  return buf;
+}
+
+static std::string formatBase(unsigned long long value, unsigned char base) {
+  if (base < 2 || base > 36)
+    base = 10;
+  std::string out;
+  do {
+    int digit = value % base;
+    out.insert(out.begin(), digit < 10 ? '0' + digit : 'a' + digit - 10);
+    value /= base;
+  } while (value);
+  return out;
+}
+
+static std::string formatFloat(double value, unsigned char decimals) {
+  char buf[48];
+  snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+  return buf;
+}
+
+String::String(const char *str) : s(str ? str : "") {}
+String::String(char c) : s(1, c) {}
+String::String(int value, unsigned char base)
+    : s(base == 10 ? formatNumber("%lld", value)
+                   : formatBase((unsigned int)value, base)) {}
+String::String(unsigned int value, unsigned char base)
+    : s(formatBase(value, base)) {}
+String::String(long value, unsigned char base)
+    : s(base == 10 ? formatNumber("%lld", value)
+                   : formatBase((unsigned long)value, base)) {}
+String::String(unsigned long value, unsigned char base)
+    : s(formatBase(value, base)) {}
+String::String(float value, unsigned char decimals)
+    : s(formatFloat(value, decimals)) {}
+String::String(double value, unsigned char decimals)
+    : s(formatFloat(value, decimals)) {}
+
+String &String::operator+=(const String &other) {
+  s += other.s;
+  return *this;
+}
+String &String::operator+=(const char *str) {
+  if (str)
+    s += str;
+  return *this;
+}
+String &String::operator+=(char c) {
+  s += c;
+  return *this;
+}
+String &String::operator+=(int value) { return *this += String(value); }
+String &String::operator+=(unsigned int value) { return *this += String(value); }
+String &String::operator+=(long value) { return *this += String(value); }
+String &String::operator+=(unsigned long value) { return *this += String(value); }
+String &String::operator+=(float value) { return *this += String(value); }
+String &String::operator+=(double value) { return *this += String(value); }
+
+String operator+(const String &a, const String &b) { return String(a) += b; }
+String operator+(const String &a, const char *b) { return String(a) += b; }
+String operator+(const char *a, const String &b) { return String(a) += b; }
+String operator+(const String &a, char b) { return String(a) += b; }
+String operator+(const String &a, int b) { return String(a) += b; }
+String operator+(const String &a, unsigned int b) { return String(a) += b; }
+String operator+(const String &a, long b) { return String(a) += b; }
+String operator+(const String &a, unsigned long b) { return String(a) += b; }
+String operator+(const String &a, float b) { return String(a) += b; }
+String operator+(const String &a, double b) { return String(a) += b; }
+
+bool String::equalsIgnoreCase(const String &other) const {
+  return strcasecmp(s.c_str(), other.s.c_str()) == 0;
+}
+bool String::reserve(unsigned int size) {
+  s.reserve(size);
+  return true;
+}
+char String::charAt(unsigned int index) const {
+  return index < s.size() ? s[index] : 0;
+}
+int String::indexOf(char c, unsigned int from) const {
+  size_t at = s.find(c, from);
+  return at == std::string::npos ? -1 : (int)at;
+}
+int String::indexOf(const char *str, unsigned int from) const {
+  size_t at = s.find(str, from);
+  return at == std::string::npos ? -1 : (int)at;
+}
+int String::indexOf(const String &str, unsigned int from) const {
+  return indexOf(str.c_str(), from);
+}
+int String::lastIndexOf(char c) const {
+  size_t at = s.rfind(c);
+  return at == std::string::npos ? -1 : (int)at;
+}
+bool String::startsWith(const char *prefix) const {
+  return s.compare(0, strlen(prefix), prefix) == 0;
+}
+bool String::startsWith(const String &prefix) const {
+  return startsWith(prefix.c_str());
+}
+bool String::endsWith(const char *suffix) const {
+  size_t n = strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+String String::substring(unsigned int from) const {
+  return from < s.size() ? String(s.substr(from).c_str()) : String();
+}
+String String::substring(unsigned int from, unsigned int to) const {
+  if (from > to)
+    std::swap(from, to);
+  if (from >= s.size())
+    return String();
+  return String(s.substr(from, to - from).c_str());
+}
+void String::trim() {
+  size_t first = s.find_first_not_of(" \t\r\n\v\f");
+  size_t last = s.find_last_not_of(" \t\r\n\v\f");
+  s = first == std::string::npos ? "" : s.substr(first, last - first + 1);
+}
+void String::toLowerCase() {
+  for (char &c : s)
+    c = tolower((unsigned char)c);
+}
+void String::toUpperCase() {
+  for (char &c : s)
+    c = toupper((unsigned char)c);
+}
+void String::replace(const char *find, const char *with) {
+  size_t findLen = strlen(find);
+  if (!findLen)
+    return;
+  for (size_t at = s.find(find); at != std::string::npos;
+       at = s.find(find, at + strlen(with)))
+    s.replace(at, findLen, with);
+}
+void String::remove(unsigned int index) {
+  if (index < s.size())
+    s.erase(index);
+}
+void String::remove(unsigned int index, unsigned int count) {
+  if (index < s.size())
+    s.erase(index, count);
+}
+long String::toInt() const { return atol(s.c_str()); }
+float String::toFloat() const { return atof(s.c_str()); }
+
+// Print, Stream
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t n = 0;
+  while (size--)
+    n += write(*buffer++);
+  return n;
+}
+size_t Print::write(const char *str) {
+  return str ? write((const uint8_t *)str, strlen(str)) : 0;
+}
+size_t Print::write(const char *buffer, size_t size) {
+  return write((const uint8_t *)buffer, size);
+}
+
+size_t Print::printf(const char *format, ...) {
+  char small[128];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(small, sizeof(small), format, args);
+  va_end(args);
+  if (len < 0)
+    return 0;
+  if ((size_t)len < sizeof(small))
+    return write((const uint8_t *)small, len);
+  std::string big(len + 1, '\0');
+  va_start(args, format);
+  vsnprintf(&big[0], big.size(), format, args);
+  va_end(args);
+  return write((const uint8_t *)big.data(), len);
+}
+
+size_t Print::print(const char *str) { return write(str); }
+size_t Print::print(const String &str) { return write(str.c_str(), str.length()); }
+size_t Print::print(char c) { return write((uint8_t)c); }
+size_t Print::print(unsigned char value, int base) { return print((unsigned long)value, base); }
+size_t Print::print(int value, int base) { return print((long)value, base); }
+size_t Print::print(unsigned int value, int base) { return print((unsigned long)value, base); }
+size_t Print::print(long value, int base) { return print(String(value, base)); }
+size_t Print::print(unsigned long value, int base) { return print(String(value, base)); }
+size_t Print::print(double value, int decimals) { return print(String(value, decimals)); }
+size_t Print::println(const char *str) { return print(str) + println(); }
+size_t Print::println(const String &str) { return print(str) + println(); }
+size_t Print::println(char c) { return print(c) + println(); }
+size_t Print::println(int value, int base) { return print(value, base) + println(); }
+size_t Print::println(unsigned int value, int base) { return print(value, base) + println(); }
+size_t Print::println(long value, int base) { return print(value, base) + println(); }
+size_t Print::println(unsigned long value, int base) { return print(value, base) + println(); }
+size_t Print::println(double value, int decimals) { return print(value, decimals) + println(); }
+size_t Print::println() { return write("\r\n"); }
+
+size_t Stream::readBytes(uint8_t *buffer, size_t length) {
+  size_t n = 0;
+  while (n < length && available() > 0)
+    buffer[n++] = read();
+  return n;
+}
+
+String Stream::readStringUntil(char terminator) {
+  String out;
+  while (available() > 0) {
+    int c = read();
+    if (c < 0 || c == terminator)
+      break;
+    out += (char)c;
+  }
+  return out;
+}
+
+// Serial ports
+
+HardwareSerial Serial(0);
+HardwareSerial Serial1(1);
+
+static HostBus *g_bus = nullptr;
+static std::string g_serialOut;
+static std::deque<uint8_t> g_serialIn;
+static bool g_echo = getenv("HOST_LOG") != nullptr;
+// Long runs log a lot: keep the tail
+#define HOST_SERIAL_KEEP (256 * 1024)
+
+void hostAttachBus(HostBus *bus) { g_bus = bus; }
+std::string &hostSerialOutput() { return g_serialOut; }
+void hostEchoSerial(bool on) { g_echo = on; }
+void hostSerialInput(const char *data) {
+  g_serialIn.insert(g_serialIn.end(), data, data + strlen(data));
+}
+
+void HardwareSerial::begin(unsigned long, uint32_t, int8_t, int8_t, bool,
+                           unsigned long, uint8_t rxfifoFullThreshold) {
+  rxFifoFull = rxfifoFullThreshold;
+}
+
+int HardwareSerial::available() {
+  if (uart == 0)
+    return g_serialIn.size();
+  return g_bus ? g_bus->available() : 0;
+}
+
+int HardwareSerial::read() {
+  if (uart == 0) {
+    if (g_serialIn.empty())
+      return -1;
+    int c = g_serialIn.front();
+    g_serialIn.pop_front();
+    return c;
+  }
+  return g_bus && g_bus->available() > 0 ? g_bus->read() : -1;
+}
+
+size_t HardwareSerial::write(uint8_t c) { return write(&c, 1); }
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+  if (uart == 1) {
+    if (g_bus)
+      g_bus->write(buffer, size);
+    return size;
+  }
+  if (g_echo)
+    fwrite(buffer, 1, size, stdout);
+  if (g_serialOut.size() > HOST_SERIAL_KEEP)
+    g_serialOut.erase(0, HOST_SERIAL_KEEP / 2);
+  g_serialOut.append((const char *)buffer, size);
+  return size;
+}
+
+void HardwareSerial::onReceive(OnReceiveCb function, bool) {
+  receiveCallback = function;
+}
+void HardwareSerial::onReceiveError(OnReceiveErrorCb function) {
+  errorCallback = function;
+}
+bool HardwareSerial::setRxFIFOFull(uint8_t threshold) {
+  rxFifoFull = threshold;
+  return true;
+}
+bool HardwareSerial::setRxTimeout(uint8_t) { return true; }
+
+// ESP
+
+EspClass ESP;
+void (*hostRestartHandler)() = nullptr;
+
+void EspClass::restart() {
+  if (hostRestartHandler)
+    hostRestartHandler();
+  else
+    exit(0);
+}
+
+// The C3 has about 320KB of heap; host allocations count against it, so
+// the figures move when the firmware allocates
+#define HOST_HEAP_SIZE (320 * 1024)
+static uint32_t g_minFreeHeap = HOST_HEAP_SIZE;
+
+uint32_t EspClass::getHeapSize() { return HOST_HEAP_SIZE; }
+uint32_t EspClass::getFreeHeap() {
+  size_t used = mallinfo2().uordblks;
+  uint32_t free = used < HOST_HEAP_SIZE ? HOST_HEAP_SIZE - used : 0;
+  if (free < g_minFreeHeap)
+    g_minFreeHeap = free;
+  return free;
+}
+uint32_t EspClass::getMinFreeHeap() {
+  getFreeHeap();
+  return g_minFreeHeap;
+}
+uint32_t EspClass::getMaxAllocHeap() { return getFreeHeap() / 2; }
+uint32_t EspClass::getCycleCount() {
+  return (uint32_t)(hostNowUs() * g_cpuMhz);
+}
+
+// FreeRTOS: the one semaphore is the idle wake-up (UART receive callback)
+
+struct HostSemaphore {
+  bool given = false;
+};
+
+SemaphoreHandle_t xSemaphoreCreateBinary() { return new HostSemaphore(); }
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+  ((HostSemaphore *)semaphore)->given = true;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t *) {
+  return xSemaphoreGive(semaphore);
+}
+
+// What the UART event task does when bytes come in
+static void serial1Received() {
+  if (Serial1.receiveCallback)
+    Serial1.receiveCallback();
+}
+
+static bool taken(HostSemaphore *s) {
+  if (!s->given)
+    return false;
+  s->given = false;
+  return true;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+  HostSemaphore *s = (HostSemaphore *)semaphore;
+  if (g_bus && g_bus->available() > 0)
+    serial1Received();
+  if (taken(s))
+    return pdTRUE;
+  if (ticks == 0)
+    return pdFALSE;
+
+  uint64_t deadline = hostNowUs() + ticks * 1000ULL;
+  if (g_virtual) {
+    uint32_t at;
+    if (g_bus && g_bus->nextByteAt(at)) {
+      uint64_t atUs = g_nowUs + (uint32_t)(at - millis()) * 1000ULL;
+      if ((int32_t)(at - millis()) <= 0)
+        atUs = g_nowUs;
+      if (atUs < deadline) {
+        g_nowUs = atUs;
+        serial1Received();
+        if (taken(s))
+          return pdTRUE;
+      }
+    }
+    g_nowUs = deadline;
+    return taken(s) ? pdTRUE : pdFALSE;
+  }
+
+  while (hostNowUs() < deadline) {
+    if (g_bus && g_bus->available() > 0)
+      serial1Received();
+    if (taken(s))
+      return pdTRUE;
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  }
+  return taken(s) ? pdTRUE : pdFALSE;
+}
+
+void vTaskDelay(TickType_t ticks) { delay(ticks); }
+
+esp_err_t esp_task_wdt_init(uint32_t, bool) { return ESP_OK; }
+esp_err_t esp_task_wdt_add(void *) { return ESP_OK; }
+esp_err_t esp_task_wdt_reset() { return ESP_OK; }
+
+// WiFi
+
+WiFiClass WiFi;
+static wl_status_t g_wifiStatus = WL_CONNECTED;
+static uint32_t g_wifiBegins = 0;
+static std::vector<std::pair<WiFiEventFuncCb, arduino_event_id_t>>
+    g_wifiEvents;
+
+void hostSetWifiStatus(wl_status_t status) { g_wifiStatus = status; }
+uint32_t hostWifiBegins() { return g_wifiBegins; }
+
+void hostWifiDisconnected(uint8_t reason) {
+  g_wifiStatus = WL_DISCONNECTED;
+  arduino_event_info_t info = {};
+  info.wifi_sta_disconnected.reason = reason;
+  for (auto &handler : g_wifiEvents) {
+    if (handler.second == ARDUINO_EVENT_WIFI_STA_DISCONNECTED ||
+        handler.second == ARDUINO_EVENT_MAX)
+      handler.first(ARDUINO_EVENT_WIFI_STA_DISCONNECTED, info);
+  }
+}
+
+bool WiFiClass::mode(wifi_mode_t) { return true; }
+wl_status_t WiFiClass::begin(const char *, const char *) {
+  g_wifiBegins++;
+  return g_wifiStatus;
+}
+bool WiFiClass::disconnect(bool) {
+  g_wifiStatus = WL_DISCONNECTED;
+  return true;
+}
+bool WiFiClass::reconnect() { return true; }
+wl_status_t WiFiClass::status() { return g_wifiStatus; }
+bool WiFiClass::setAutoReconnect(bool) { return true; }
+bool WiFiClass::setSleep(bool) { return true; }
+bool WiFiClass::setSleep(wifi_ps_type_t) { return true; }
+bool WiFiClass::setHostname(const char *) { return true; }
+IPAddress WiFiClass::localIP() { return IPAddress(127, 0, 0, 1); }
+int8_t WiFiClass::RSSI() { return -55; }
+uint8_t *WiFiClass::macAddress(uint8_t *mac) {
+  static const uint8_t HOST_MAC[6] = {0x02, 0x00, 0x00, 0xda, 0x1c, 0x21};
+  memcpy(mac, HOST_MAC, 6);
+  return mac;
+}
+String WiFiClass::macAddress() {
+  uint8_t mac[6];
+  macAddress(mac);
+  char buf[18];
+  snprintf(buf, sizeof(buf), "%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1],
+           mac[2], mac[3], mac[4], mac[5]);
+  return String(buf);
+}
+int WiFiClass::onEvent(WiFiEventFuncCb callback, arduino_event_id_t event) {
+  g_wifiEvents.push_back(std::make_pair(callback, event));
+  return g_wifiEvents.size();
+}
+
+// Sockets
+
+struct WiFiClient::Socket {
+  int fd;
+  int refs;
+};
+
+WiFiClient::WiFiClient(int fd) : socket(new Socket{fd, 1}) {}
+
+WiFiClient::WiFiClient(const WiFiClient &other)
+    : socket(other.socket), timeoutMs(other.timeoutMs) {
+  if (socket)
+    socket->refs++;
+}
+
+WiFiClient &WiFiClient::operator=(const WiFiClient &other) {
+  if (this == &other)
+    return *this;
+  if (other.socket)
+    other.socket->refs++;
+  stop();
+  socket = other.socket;
+  timeoutMs = other.timeoutMs;
+  return *this;
+}
+
+WiFiClient::~WiFiClient() { stop(); }
+
+int WiFiClient::fd() const { return socket ? socket->fd : -1; }
+
+void WiFiClient::stop() {
+  if (!socket)
+    return;
+  if (--socket->refs == 0) {
+    if (socket->fd >= 0)
+      ::close(socket->fd);
+    delete socket;
+  }
+  socket = nullptr;
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port) {
+  return connect(ip, port, timeoutMs);
+}
+
+int WiFiClient::connect(const char *host, uint16_t port) {
+  return connect(host, port, timeoutMs);
+}
+
+int WiFiClient::connect(const char *host, uint16_t port, int32_t timeout) {
+  IPAddress ip;
+  if (!strcmp(host, "localhost"))
+    ip = IPAddress(127, 0, 0, 1);
+  else if (!ip.fromString(host))
+    return 0; // No DNS on the host build
+  return connect(ip, port, timeout);
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port, int32_t timeout) {
+  stop();
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0)
+    return 0;
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = (uint32_t)ip;
+  int r = ::connect(fd, (sockaddr *)&addr, sizeof(addr));
+  if (r < 0 && errno == EINPROGRESS) {
+    pollfd p = {fd, POLLOUT, 0};
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if (poll(&p, 1, timeout) == 1 &&
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && !error)
+      r = 0;
+  }
+  if (r < 0) {
+    ::close(fd);
+    return 0;
+  }
+  fcntl(fd, F_SETFL, 0);
+  socket = new Socket{fd, 1};
+  return 1;
+}
+
+int WiFiClient::setTimeout(uint32_t seconds) {
+  Stream::setTimeout(seconds * 1000);
+  timeoutMs = seconds * 1000;
+  return 0;
+}
+
+int WiFiClient::setNoDelay(bool nodelay) {
+  int on = nodelay;
+  return setsockopt(fd(), IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
+
+uint8_t WiFiClient::connected() {
+  if (fd() < 0)
+    return 0;
+  char c;
+  int r = recv(fd(), &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (r > 0)
+    return 1;
+  if (r == 0)
+    return 0; // Peer closed
+  return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+int WiFiClient::available() {
+  int n = 0;
+  if (fd() < 0 || ioctl(fd(), FIONREAD, &n) < 0)
+    return 0;
+  return n;
+}
+
+int WiFiClient::read(uint8_t *buffer, size_t size) {
+  if (fd() < 0)
+    return -1;
+  return recv(fd(), buffer, size, MSG_DONTWAIT);
+}
+
+int WiFiClient::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::peek() {
+  uint8_t c;
+  if (fd() < 0 || recv(fd(), &c, 1, MSG_PEEK | MSG_DONTWAIT) != 1)
+    return -1;
+  return c;
+}
+
+size_t WiFiClient::write(uint8_t c) { return write(&c, 1); }
+
+size_t WiFiClient::write(const uint8_t *buffer, size_t size) {
+  size_t sent = 0;
+  while (fd() >= 0 && sent < size) {
+    ssize_t r = send(fd(), buffer + sent, size - sent, MSG_NOSIGNAL);
+    if (r <= 0)
+      break;
+    sent += r;
+  }
+  return sent;
+}
+
+IPAddress WiFiClient::remoteIP() const {
+  sockaddr_in addr = {};
+  socklen_t len = sizeof(addr);
+  if (fd() < 0 || getpeername(fd(), (sockaddr *)&addr, &len) < 0)
+    return IPAddress();
+  return IPAddress((uint32_t)addr.sin_addr.s_addr);
+}
+
+uint16_t WiFiClient::remotePort() const {
+  sockaddr_in addr = {};
+  socklen_t len = sizeof(addr);
+  if (fd() < 0 || getpeername(fd(), (sockaddr *)&addr, &len) < 0)
+    return 0;
+  return ntohs(addr.sin_port);
+}
+
+void WiFiServer::begin(uint16_t newPort) {
+  if (newPort)
+    port = newPort;
+  end();
+  listenFd = ::socket(AF_INET, SOCK_STREAM, 0);
+  int on = 1;
+  setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(listenFd, (sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(listenFd, 16) < 0) {
+    fprintf(stderr, "host: can't listen on port %u: %s\n", port,
+            strerror(errno));
+    ::close(listenFd);
+    listenFd = -1;
+    return;
+  }
+  fcntl(listenFd, F_SETFL, O_NONBLOCK);
+}
+
+void WiFiServer::end() {
+  if (pendingFd >= 0)
+    ::close(pendingFd);
+  if (listenFd >= 0)
+    ::close(listenFd);
+  pendingFd = listenFd = -1;
+}
+
+bool WiFiServer::hasClient() {
+  if (pendingFd < 0 && listenFd >= 0)
+    pendingFd = ::accept(listenFd, nullptr, nullptr);
+  return pendingFd >= 0;
+}
+
+WiFiClient WiFiServer::accept() {
+  if (!hasClient())
+    return WiFiClient();
+  WiFiClient client(pendingFd);
+  pendingFd = -1;
+  if (noDelay)
+    client.setNoDelay(true);
+  return client;
+}
+
+// Preferences, in memory
+
+static std::map<std::string, std::map<std::string, std::string>> g_nvs;
+static uint32_t g_nvsWrites = 0;
+
+uint32_t hostNvsWrites() { return g_nvsWrites; }
+void hostNvsClear() { g_nvs.clear(); }
+
+bool Preferences::begin(const char *name, bool ro, const char *) {
+  ns = name;
+  readOnly = ro;
+  open = true;
+  return true;
+}
+
+void Preferences::end() { open = false; }
+
+bool Preferences::clear() {
+  if (!open || readOnly)
+    return false;
+  g_nvsWrites++;
+  g_nvs[ns].clear();
+  return true;
+}
+
+bool Preferences::remove(const char *key) {
+  if (!open || readOnly)
+    return false;
+  g_nvsWrites++;
+  return g_nvs[ns].erase(key) > 0;
+}
+
+bool Preferences::isKey(const char *key) {
+  return open && g_nvs[ns].count(key) > 0;
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t len) {
+  if (!open || readOnly)
+    return 0;
+  g_nvsWrites++;
+  g_nvs[ns][key] = std::string((const char *)value, len);
+  return len;
+}
+
+size_t Preferences::getBytesLength(const char *key) {
+  if (!open)
+    return 0;
+  auto &space = g_nvs[ns];
+  auto it = space.find(key);
+  return it == space.end() ? 0 : it->second.size();
+}
+
+size_t Preferences::getBytes(const char *key, void *buf, size_t maxLen) {
+  size_t len = getBytesLength(key);
+  if (!len || len > maxLen)
+    return 0;
+  memcpy(buf, g_nvs[ns][key].data(), len);
+  return len;
+}
+
+template <typename T>
+static T getValue(Preferences &prefs, const char *key, T defaultValue) {
+  T value = defaultValue;
+  if (prefs.getBytesLength(key) == sizeof(T))
+    prefs.getBytes(key, &value, sizeof(T));
+  return value;
+}
+
+size_t Preferences::putUChar(const char *key, uint8_t value) { return putBytes(key, &value, sizeof(value)); }
+size_t Preferences::putShort(const char *key, int16_t value) { return putBytes(key, &value, sizeof(value)); }
+size_t Preferences::putInt(const char *key, int32_t value) { return putBytes(key, &value, sizeof(value)); }
+size_t Preferences::putUInt(const char *key, uint32_t value) { return putBytes(key, &value, sizeof(value)); }
+size_t Preferences::putULong64(const char *key, uint64_t value) { return putBytes(key, &value, sizeof(value)); }
+size_t Preferences::putFloat(const char *key, float value) { return putBytes(key, &value, sizeof(value)); }
+size_t Preferences::putBool(const char *key, bool value) { return putUChar(key, value); }
+size_t Preferences::putString(const char *key, const char *value) { return putBytes(key, value, strlen(value) + 1); }
+size_t Preferences::putString(const char *key, const String &value) { return putString(key, value.c_str()); }
+
+uint8_t Preferences::getUChar(const char *key, uint8_t value) { return getValue(*this, key, value); }
+int16_t Preferences::getShort(const char *key, int16_t value) { return getValue(*this, key, value); }
+int32_t Preferences::getInt(const char *key, int32_t value) { return getValue(*this, key, value); }
+uint32_t Preferences::getUInt(const char *key, uint32_t value) { return getValue(*this, key, value); }
+uint64_t Preferences::getULong64(const char *key, uint64_t value) { return getValue(*this, key, value); }
+float Preferences::getFloat(const char *key, float value) { return getValue(*this, key, value); }
+bool Preferences::getBool(const char *key, bool value) { return getUChar(key, value) != 0; }
+
+size_t Preferences::getString(const char *key, char *value, size_t maxLen) {
+  size_t len = getBytesLength(key);
+  if (!len || len > maxLen)
+    return 0;
+  return getBytes(key, value, maxLen);
+}
+
+String Preferences::getString(const char *key, const String &defaultValue) {
+  size_t len = getBytesLength(key);
+  if (!len)
+    return defaultValue;
+  std::string value = g_nvs[ns][key];
+  return String(value.c_str());
+}
@@ -0,0 +1,35 @@
+// Settings of the host test build, force-included before every source
+// (test/CMakeLists.txt). Defining CONFIG_H makes src/system/config.h, if
+// there is one, a no-op: tests don't depend on a local setup. Module
+// switches and tuning keep their header defaults unless a target sets
+// them with -D.
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#define S21_RX_PIN 3
+#define S21_TX_PIN 4
+#define LED_PIN 8
+#define LED_ON LOW
+#define LED_OFF HIGH
+
+#define S21_BAUD_RATE 2400
+#define S21_CONFIG SERIAL_8E2
+
+#define DEBUG_BAUD_RATE 115200
+
+#define WIFI_SSID "host"
+#define WIFI_PASS "host"
+#ifndef API_PORT
+#define API_PORT 18080
+#endif
+#ifndef CONSOLE_PORT
+#define CONSOLE_PORT 0
+#endif
+#ifndef WDT_TIMEOUT_S
+#define WDT_TIMEOUT_S 0
+#endif
+
+#define FW_VERSION "host"
+#define OUTSIDE_TEMP_OFFSET 0.0
+
+#endif // CONFIG_H
@@ -0,0 +1,30 @@
+// The firmware as a local process on real time, against the emulated unit:
+// the API on http://127.0.0.1:<API_PORT> for tools/http_load.py, the web
+// page and manual testing. The console is on stdin/stdout.
+#include "host.h"
+#include "s21_unit.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+void setup();
+void loop();
+
+int main() {
+  static S21Unit unit;
+  unit.attach();
+  hostEchoSerial(true);
+  setup();
+  printf("host: API on http://127.0.0.1:%d\n", API_PORT);
+  fflush(stdout);
+
+  fcntl(0, F_SETFL, O_NONBLOCK);
+  for (;;) {
+    char line[128];
+    ssize_t n = read(0, line, sizeof(line) - 1);
+    if (n > 0) {
+      line[n] = '\0';
+      hostSerialInput(line);
+    }
+    loop();
+  }
+}
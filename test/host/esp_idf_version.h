@@ -0,0 +1,16 @@
+// Host build: reports the ESP-IDF of Arduino-ESP32 2.x, to match the
+// other shims (esp_task_wdt.h)
+#ifndef ESP_IDF_VERSION_H
+#define ESP_IDF_VERSION_H
+
+#define ESP_IDF_VERSION_MAJOR 4
+#define ESP_IDF_VERSION_MINOR 4
+#define ESP_IDF_VERSION_PATCH 0
+
+#define ESP_IDF_VERSION_VAL(major, minor, patch)                               \
+  (((major) << 16) | ((minor) << 8) | (patch))
+#define ESP_IDF_VERSION                                                        \
+  ESP_IDF_VERSION_VAL(ESP_IDF_VERSION_MAJOR, ESP_IDF_VERSION_MINOR,            \
+                      ESP_IDF_VERSION_PATCH)
+
+#endif // ESP_IDF_VERSION_H
@@ -0,0 +1,4 @@
+// Host build: nothing from the clock driver is used
+#ifndef ESP_CLK_H
+#define ESP_CLK_H
+#endif // ESP_CLK_H
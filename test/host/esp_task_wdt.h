@@ -0,0 +1,14 @@
+// Host build: the task watchdog (ESP-IDF 4.x API, as in Arduino-ESP32 2.x)
+#ifndef ESP_TASK_WDT_H
+#define ESP_TASK_WDT_H
+
+#include <stdint.h>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+
+esp_err_t esp_task_wdt_init(uint32_t timeoutSeconds, bool panic);
+esp_err_t esp_task_wdt_add(void *task);
+esp_err_t esp_task_wdt_reset();
+
+#endif // ESP_TASK_WDT_H
@@ -0,0 +1,27 @@
+// The FreeRTOS calls the firmware makes outside ESP_PLATFORM blocks. One
+// task: a semaphore wait advances the virtual clock (see host.h).
+#ifndef FREERTOS_HOST_H
+#define FREERTOS_HOST_H
+
+#include <stdint.h>
+
+typedef void *TaskHandle_t;
+typedef void *SemaphoreHandle_t;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define portMAX_DELAY 0xffffffffUL
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+SemaphoreHandle_t xSemaphoreCreateBinary();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore,
+                                 BaseType_t *higherPriorityTaskWoken);
+void vTaskDelay(TickType_t ticks);
+
+#endif // FREERTOS_HOST_H
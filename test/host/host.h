@@ -0,0 +1,75 @@
+// What tests control and observe in the host build of the core
+// (arduino.cpp, libraries.cpp)
+#ifndef HOST_H
+#define HOST_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// Serial1, the S21 wire. Bytes become readable at the virtual (or real)
+// time the bus says they arrive.
+class HostBus {
+public:
+  virtual ~HostBus() {}
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual void write(const uint8_t *data, size_t len) = 0;
+  // millis() when the next byte arrives, false if nothing is on the way
+  virtual bool nextByteAt(uint32_t &at) = 0;
+};
+void hostAttachBus(HostBus *bus);
+
+// Virtual clock: millis() and micros() only move with hostAdvance(). The
+// waits of the firmware (delay(), the idle semaphore) advance it instead
+// of sleeping, an idle wait up to the next byte on the bus. Without it
+// the build runs on real time.
+void hostUseVirtualClock(uint32_t startMs = 0);
+bool hostVirtualClock();
+void hostAdvance(uint32_t ms);
+void hostAdvanceUs(uint32_t us);
+uint64_t hostNowUs(); // Virtual time, does not wrap
+
+// Everything printed on Serial (log lines, console replies). Echoed to
+// stdout when HOST_LOG is set in the environment.
+std::string &hostSerialOutput();
+void hostEchoSerial(bool on);
+// Bytes for the firmware to read from Serial
+void hostSerialInput(const char *data);
+
+// Preferences
+uint32_t hostNvsWrites();
+void hostNvsClear();
+
+// Station status and the disconnect event the WiFi driver would send
+void hostSetWifiStatus(wl_status_t status);
+void hostWifiDisconnected(uint8_t reason);
+uint32_t hostWifiBegins();
+
+// ESP.restart() calls this (default: exit)
+extern void (*hostRestartHandler)();
+
+// In-process MQTT broker behind PubSubClient
+struct HostMqtt {
+  bool reachable = true; // connect() succeeds
+  // Unreachable and silent (no RST): connect() blocks for the client's
+  // connect timeout, as on a network where the broker host is down
+  bool blackhole = false;
+  uint32_t connects = 0; // Attempts
+  uint32_t blockedMs = 0; // Spent in connect() that failed
+  std::vector<std::string> subscriptions;
+  std::map<std::string, std::string> retained;
+  std::vector<std::pair<std::string, std::string>> published;
+};
+HostMqtt &hostMqtt();
+// Deliver a message to the client as if another client published it
+void hostMqttDeliver(const char *topic, const char *payload);
+// Broker drops the connection
+void hostMqttDisconnect();
+
+// mDNS TXT records by key, as last set
+std::map<std::string, std::string> &hostMdnsTxt();
+
+#endif // HOST_H
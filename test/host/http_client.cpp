@@ -0,0 +1,112 @@
+#include "http_client.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+bool HostHttp::start(const char *path, uint16_t port, bool keepAlive,
+                     const char *method) {
+  char request[512];
+  snprintf(request, sizeof(request),
+           "%s %s HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+           "Connection: %s\r\n\r\n",
+           method, path, keepAlive ? "keep-alive" : "close");
+  bool ok = startRaw(request, port);
+  headOnly = strcmp(method, "HEAD") == 0;
+  return ok;
+}
+
+bool HostHttp::startRaw(const std::string &request, uint16_t port) {
+  if (fd < 0) {
+    fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    // Completes in the listen backlog, before the server accepts
+    if (fd < 0 || ::connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+      close();
+      return false;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+  }
+  status = 0;
+  head.clear();
+  body.clear();
+  in.clear();
+  headOnly = false;
+  headDone = false;
+  done = false;
+  ssize_t len = request.size();
+  if (::send(fd, request.data(), len, MSG_NOSIGNAL) != len) {
+    close();
+    done = true;
+    return false;
+  }
+  return true;
+}
+
+bool HostHttp::poll() {
+  if (done)
+    return true;
+  char buf[4096];
+  for (;;) {
+    ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+    if (n > 0) {
+      in.append(buf, n);
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      break;
+    close(); // EOF or error: what came is the response
+    done = true;
+    break;
+  }
+
+  if (!headDone) {
+    size_t end = in.find("\r\n\r\n");
+    if (end == std::string::npos)
+      return done;
+    head = in.substr(0, end + 2);
+    in.erase(0, end + 4);
+    headDone = true;
+    status = atoi(head.c_str() + 9); // "HTTP/1.1 200"
+    const char *cl = strcasestr(head.c_str(), "\r\nContent-Length:");
+    contentLength = cl ? strtoul(cl + 17, nullptr, 10) : SIZE_MAX;
+  }
+  if (headOnly) {
+    body = in; // Anything after the head of a HEAD answer is wrong
+    done = true;
+  } else if (contentLength != SIZE_MAX && in.size() >= contentLength) {
+    body = in.substr(0, contentLength);
+    done = true;
+  } else if (done) {
+    body = in;
+  }
+  if (done && !headDone)
+    status = 0;
+  return done;
+}
+
+void HostHttp::close() {
+  if (fd >= 0)
+    ::close(fd);
+  fd = -1;
+}
+
+HostHttp hostHttpGet(const char *path, uint16_t port, void (*pump)(),
+                     int maxPumps) {
+  HostHttp http;
+  if (!http.start(path, port))
+    return http;
+  for (int i = 0; i < maxPumps && !http.poll(); i++)
+    pump();
+  http.close(); // The copy returned doesn't own a socket
+  return http;
+}
@@ -0,0 +1,44 @@
+// HTTP/1.1 client on a loopback socket, to drive the host build of the
+// sketch from its own thread: start() sends, poll() reads what is there
+// without blocking, and the caller runs loop() in between.
+#ifndef HTTP_CLIENT_H
+#define HTTP_CLIENT_H
+
+#include <stdint.h>
+#include <string>
+
+class HostHttp {
+public:
+  ~HostHttp() { close(); }
+
+  // Send a GET (or HEAD: no body expected); a keep-alive connection is
+  // reused. False if the server doesn't accept connections.
+  bool start(const char *path, uint16_t port, bool keepAlive = false,
+             const char *method = "GET");
+  // Send a request as given, malformed ones included
+  bool startRaw(const std::string &request, uint16_t port);
+  // True once the response is complete, or the connection failed (status
+  // stays 0)
+  bool poll();
+  void close();
+  bool isOpen() const { return fd >= 0; }
+
+  int status = 0;
+  std::string head; // Status line and headers
+  std::string body;
+
+private:
+  int fd = -1;
+  std::string in;
+  size_t contentLength = 0;
+  bool headOnly = false;
+  bool headDone = false;
+  bool done = true;
+};
+
+// start() and loop `pump` until the response is complete, up to
+// `maxPumps` times
+HostHttp hostHttpGet(const char *path, uint16_t port, void (*pump)(),
+                     int maxPumps = 100000);
+
+#endif // HTTP_CLIENT_H
@@ -0,0 +1,203 @@
+// Host build of the libraries the firmware links: PubSubClient (against
+// an in-process broker), mDNS, UDP, OTA
+#include "host.h"
+#include <ESPmDNS.h>
+#include <HTTPUpdate.h>
+#include <PubSubClient.h>
+#include <Update.h>
+#include <arpa/inet.h>
+
+bool IPAddress::fromString(const char *text) {
+  in_addr addr;
+  if (inet_pton(AF_INET, text, &addr) != 1)
+    return false;
+  address = addr.s_addr;
+  return true;
+}
+
+String IPAddress::toString() const {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (*this)[0], (*this)[1],
+           (*this)[2], (*this)[3]);
+  return String(buf);
+}
+
+// MQTT
+
+static HostMqtt g_broker;
+static PubSubClient *g_session = nullptr; // Connected client
+
+HostMqtt &hostMqtt() { return g_broker; }
+
+static bool topicMatches(const std::string &filter, const std::string &topic) {
+  size_t f = 0, t = 0;
+  while (f < filter.size()) {
+    if (filter[f] == '#')
+      return true;
+    if (filter[f] == '+') {
+      while (t < topic.size() && topic[t] != '/')
+        t++;
+      f++;
+      continue;
+    }
+    if (t >= topic.size() || filter[f] != topic[t])
+      return false;
+    f++;
+    t++;
+  }
+  return t == topic.size();
+}
+
+void hostMqttDeliver(const char *topic, const char *payload) {
+  if (!g_session || !g_session->callback)
+    return;
+  bool subscribed = false;
+  for (const std::string &filter : g_broker.subscriptions)
+    subscribed = subscribed || topicMatches(filter, topic);
+  if (!subscribed)
+    return;
+  std::string t = topic, p = payload;
+  g_session->callback(&t[0], (uint8_t *)&p[0], p.size());
+}
+
+void hostMqttDisconnect() {
+  if (g_session)
+    g_session->disconnect();
+}
+
+PubSubClient::PubSubClient(Client &client) : client(&client) {}
+
+PubSubClient &PubSubClient::setServer(const char *, uint16_t) { return *this; }
+PubSubClient &PubSubClient::setServer(IPAddress, uint16_t) { return *this; }
+
+PubSubClient &PubSubClient::setCallback(MQTT_CALLBACK_SIGNATURE) {
+  this->callback = callback;
+  return *this;
+}
+
+PubSubClient &PubSubClient::setSocketTimeout(uint16_t timeout) {
+  socketTimeout = timeout;
+  return *this;
+}
+
+bool PubSubClient::setBufferSize(uint16_t size) {
+  bufferSize = size;
+  return true;
+}
+
+bool PubSubClient::connect(const char *id) {
+  return connect(id, nullptr, nullptr, nullptr, 0, false, nullptr);
+}
+
+bool PubSubClient::connect(const char *id, const char *user,
+                           const char *pass) {
+  return connect(id, user, pass, nullptr, 0, false, nullptr);
+}
+
+bool PubSubClient::connect(const char *, const char *, const char *,
+                           const char *willTopic, uint8_t, bool willRetain,
+                           const char *willMessage) {
+  g_broker.connects++;
+  if (!g_broker.reachable) {
+    connectState = MQTT_CONNECT_FAILED;
+    if (g_broker.blackhole) {
+      // TCP connect runs into the client's timeout
+      WiFiClient *tcp = dynamic_cast<WiFiClient *>(client);
+      uint32_t blocked = tcp ? tcp->connectTimeout() : 3000;
+      g_broker.blockedMs += blocked;
+      hostAdvance(blocked);
+    }
+    return false;
+  }
+  if (willTopic && willRetain)
+    g_broker.retained[willTopic] = willMessage ? willMessage : "";
+  g_broker.subscriptions.clear();
+  connectState = MQTT_CONNECTED;
+  g_session = this;
+  return true;
+}
+
+void PubSubClient::disconnect() {
+  connectState = MQTT_DISCONNECTED;
+  if (g_session == this)
+    g_session = nullptr;
+}
+
+bool PubSubClient::publish(const char *topic, const char *payload) {
+  return publish(topic, (const uint8_t *)payload, strlen(payload), false);
+}
+
+bool PubSubClient::publish(const char *topic, const char *payload,
+                           bool retained) {
+  return publish(topic, (const uint8_t *)payload, strlen(payload), retained);
+}
+
+bool PubSubClient::publish(const char *topic, const uint8_t *payload,
+                           unsigned int length, bool retained) {
+  if (!connected() || strlen(topic) + length + 7 > bufferSize)
+    return false;
+  std::string message((const char *)payload, length);
+  g_broker.published.push_back(std::make_pair(std::string(topic), message));
+  if (retained)
+    g_broker.retained[topic] = message;
+  return true;
+}
+
+bool PubSubClient::subscribe(const char *topic, uint8_t) {
+  if (!connected())
+    return false;
+  g_broker.subscriptions.push_back(topic);
+  return true;
+}
+
+bool PubSubClient::loop() { return connected(); }
+
+bool PubSubClient::connected() {
+  return connectState == MQTT_CONNECTED && g_broker.reachable;
+}
+
+// mDNS
+
+MDNSResponder MDNS;
+static std::map<std::string, std::string> g_txt;
+
+std::map<std::string, std::string> &hostMdnsTxt() { return g_txt; }
+
+bool MDNSResponder::begin(const char *) { return true; }
+bool MDNSResponder::addService(const char *, const char *, uint16_t) {
+  return true;
+}
+bool MDNSResponder::addServiceTxt(const char *, const char *, const char *key,
+                                  const char *value) {
+  g_txt[key] = value;
+  return true;
+}
+
+// UDP: fleet datagrams go nowhere
+
+uint8_t WiFiUDP::begin(uint16_t) { return 1; }
+uint8_t WiFiUDP::beginMulticast(IPAddress, uint16_t) { return 1; }
+int WiFiUDP::beginPacket(IPAddress, uint16_t) { return 1; }
+int WiFiUDP::endPacket() { return 1; }
+size_t WiFiUDP::write(uint8_t) { return 1; }
+size_t WiFiUDP::write(const uint8_t *, size_t size) { return size; }
+
+// OTA
+
+UpdateClass Update;
+HTTPUpdate httpUpdate;
+
+bool UpdateClass::begin(size_t) {
+  running = true;
+  return true;
+}
+size_t UpdateClass::write(uint8_t *, size_t len) { return running ? len : 0; }
+bool UpdateClass::end(bool) {
+  running = false;
+  return true;
+}
+void UpdateClass::abort() { running = false; }
+
+HTTPUpdateResult HTTPUpdate::update(WiFiClient &, const String &) {
+  return HTTP_UPDATE_FAILED;
+}
@@ -0,0 +1,210 @@
+#include "s21_unit.h"
+
+#define STX 0x02
+#define ETX 0x03
+#define ACK 0x06
+#define NAK 0x15
+
+static bool before(uint32_t a, uint32_t b) { return (int32_t)(a - b) < 0; }
+
+S21Unit::S21Unit()
+    : g1("1\x33\x50\x33"), g5("0000"), g8("0300"), gy("0230") {}
+
+void S21Unit::attach() {
+  busFree = millis(); // Not 0: the clock may start past 2^31
+  hostAttachBus(this);
+}
+
+void S21Unit::put(uint32_t at, uint8_t byte) {
+  bool noisy = noisePerMille && rand() % 1000 < noisePerMille;
+  if (noisy)
+    byte ^= 0x10;
+  auto it = wire.end();
+  while (it != wire.begin() && before(at, (it - 1)->at))
+    --it;
+  wire.insert(it, Timed{at, byte, noisy});
+}
+
+// STX payload checksum ETX, one byte time apart. Returns the end.
+uint32_t S21Unit::putFrame(uint32_t at, const std::string &payload) {
+  uint8_t sum = 0;
+  put(at, STX);
+  for (char c : payload) {
+    at += S21_UNIT_BYTE_MS;
+    put(at, c);
+    sum += c;
+  }
+  at += S21_UNIT_BYTE_MS;
+  put(at, sum == ETX ? 0x05 : sum);
+  at += S21_UNIT_BYTE_MS;
+  put(at, ETX);
+  return at + S21_UNIT_BYTE_MS;
+}
+
+void S21Unit::applyPending() {
+  if (pending && !before(millis(), pendingAt)) {
+    g1 = pendingG1;
+    pending = false;
+  }
+}
+
+int S21Unit::available() {
+  uint32_t now = millis();
+  applyPending();
+  while (!wire.empty() && !before(now, wire.front().at)) {
+    if (wire.front().noisy && Serial1.errorCallback)
+      Serial1.errorCallback(UART_PARITY_ERROR);
+    rx.push_back(wire.front().byte);
+    wire.pop_front();
+  }
+  return rx.size();
+}
+
+int S21Unit::read() {
+  if (rx.empty())
+    return -1;
+  int c = rx.front();
+  rx.pop_front();
+  return c;
+}
+
+bool S21Unit::nextByteAt(uint32_t &at) {
+  if (!rx.empty()) {
+    at = millis();
+    return true;
+  }
+  if (wire.empty())
+    return false;
+  at = wire.front().at;
+  return true;
+}
+
+void S21Unit::write(const uint8_t *data, size_t len) {
+  uint32_t t = millis();
+  if (before(t, busFree))
+    t = busFree; // Wait for the wire like a UART would
+  for (size_t i = 0; i < len; i++) {
+    t += S21_UNIT_BYTE_MS;
+    if (echo)
+      put(t, data[i]);
+    receive(data[i], t);
+  }
+  if (before(busFree, t))
+    busFree = t;
+}
+
+void S21Unit::inject(const uint8_t *data, size_t len, uint32_t at) {
+  if (!at)
+    at = millis();
+  for (size_t i = 0; i < len; i++)
+    put(at + i * S21_UNIT_BYTE_MS, data[i]);
+}
+
+void S21Unit::foreignRequest(const char *payload, uint32_t at) {
+  if (!at)
+    at = millis();
+  std::string p = payload;
+  uint32_t end = putFrame(at, p);
+  if (!silent) {
+    // The unit can't tell who asked
+    answer(p, end);
+    put(busFree + S21_UNIT_BYTE_MS, ACK); // Other master acknowledges
+    busFree += 2 * S21_UNIT_BYTE_MS;
+  }
+}
+
+// Bytes from the driver; a complete frame gets its answer
+void S21Unit::receive(uint8_t byte, uint32_t at) {
+  if (request.empty() && byte != STX)
+    return; // ACK of a reply, or line noise
+  request += (char)byte;
+  if (byte != ETX && request.size() < 32)
+    return;
+
+  std::string frame;
+  frame.swap(request);
+  if (byte != ETX || frame.size() < 4) {
+    badFrames++;
+    return;
+  }
+  std::string payload = frame.substr(1, frame.size() - 3);
+  uint8_t sum = 0;
+  for (char c : payload)
+    sum += c;
+  if ((uint8_t)frame[frame.size() - 2] != (sum == ETX ? 0x05 : sum)) {
+    badFrames++;
+    if (!silent)
+      put(at + ackDelayMs, NAK);
+    return;
+  }
+  requests++;
+  lastRequest = payload;
+  asked[payload]++;
+  if (!silent)
+    answer(payload, at);
+}
+
+// ACK (or NAK) and reply to a request that ended at `end`
+void S21Unit::answer(const std::string &p, uint32_t end) {
+  if (ignored.count(p))
+    return;
+  uint32_t ackAt = end + ackDelayMs;
+  if (p.size() < 2 || nakAll || unsupported.count(p)) {
+    put(ackAt, NAK);
+    busFree = ackAt + S21_UNIT_BYTE_MS;
+    return;
+  }
+
+  if (p[0] == 'D') {
+    if (p[1] == '1' || p[1] == '5') {
+      if (dropCommands)
+        return;
+      if (nakCommands) {
+        put(ackAt, NAK);
+        busFree = ackAt + S21_UNIT_BYTE_MS;
+        return;
+      }
+      if (!ignoreCommands) {
+        commands++;
+        if (p[1] == '5') {
+          g5 = p.substr(2);
+        } else if (applyDelayMs) {
+          pendingG1 = p.substr(2);
+          pendingAt = ackAt + applyDelayMs;
+          pending = true;
+        } else {
+          g1 = p.substr(2);
+        }
+      }
+    }
+    put(ackAt, ACK);
+    busFree = ackAt + S21_UNIT_BYTE_MS;
+    return;
+  }
+
+  applyPending();
+  std::string reply;
+  auto set = replies.find(p);
+  if (set != replies.end()) {
+    reply = (p[0] == 'F' ? "G" : "S") + p.substr(1) + set->second;
+  } else if (p[0] == 'F') {
+    std::string data = p == "F1"   ? g1
+                       : p == "F5" ? g5
+                       : p == "F8" ? g8
+                       : p == "FY" ? gy
+                                   : std::string("0000");
+    if (!data.empty())
+      reply = "G" + p.substr(1) + data;
+  } else if (p[0] == 'R') {
+    // Sensors, inverted digits: "052+" = 25.0
+    std::string data = p == "RH" ? "052+" : p == "Ra" ? "081+" : "000+";
+    reply = "S" + p.substr(1) + data;
+  }
+  if (reply.empty()) {
+    put(ackAt, NAK);
+    busFree = ackAt + S21_UNIT_BYTE_MS;
+    return;
+  }
+  put(ackAt, ACK);
+  busFree = putFrame(ackAt + S21_UNIT_BYTE_MS + replyDelayMs, reply);
+}
@@ -0,0 +1,88 @@
+// A Daikin indoor unit on the other end of Serial1: answers the S21
+// queries, applies D1/D5 and puts every byte on the wire at 2400 baud
+// 8E2 (5 ms a byte), the driver's own requests included as echo. Faults
+// and a second bus master can be injected.
+#ifndef S21_UNIT_H
+#define S21_UNIT_H
+
+#include "host.h"
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+
+#define S21_UNIT_BYTE_MS 5
+
+class S21Unit : public HostBus {
+public:
+  S21Unit();
+
+  // Wire to Serial1 (hostAttachBus)
+  void attach();
+
+  int available() override;
+  int read() override;
+  void write(const uint8_t *data, size_t len) override;
+  bool nextByteAt(uint32_t &at) override;
+
+  // A request from another master at millis() `at` (0 = now), with the
+  // unit's ACK, reply and the other master's ACK
+  void foreignRequest(const char *payload, uint32_t at = 0);
+  // Raw bytes on the wire, e.g. a torn frame
+  void inject(const uint8_t *data, size_t len, uint32_t at = 0);
+
+  // Unit state, as G1/G5 report it (4 payload bytes each)
+  std::string g1;
+  std::string g5;
+  std::string g8; // Protocol version
+  std::string gy; // Full version ("" = not supported)
+  // Reply data of the other queries, e.g. replies["Rd"] = "050+" (50 Hz)
+  std::map<std::string, std::string> replies;
+  std::set<std::string> unsupported; // Queries answered with NAK
+  std::set<std::string> ignored;     // Queries not answered at all
+
+  // Line behaviour
+  bool echo = true;
+  uint32_t ackDelayMs = 15;  // After the request's last byte
+  uint32_t replyDelayMs = 5; // After the ACK
+  bool silent = false;       // Unit off or unplugged
+  bool nakAll = false;       // Error state: every request NAKed
+  int noisePerMille = 0;     // Bytes with a parity error
+
+  // D1/D5 handling
+  bool nakCommands = false;    // NAK instead of ACK
+  bool dropCommands = false;   // No ACK at all
+  bool ignoreCommands = false; // ACK but don't apply
+  uint32_t applyDelayMs = 0;   // Applied later, readbacks see the old state
+
+  // What came in
+  uint32_t requests = 0;
+  uint32_t commands = 0; // D1/D5 applied
+  uint32_t badFrames = 0;
+  std::string lastRequest;
+  std::map<std::string, uint32_t> asked; // Requests by payload
+
+private:
+  struct Timed {
+    uint32_t at;
+    uint8_t byte;
+    bool noisy;
+  };
+
+  void put(uint32_t at, uint8_t byte);
+  uint32_t putFrame(uint32_t at, const std::string &payload);
+  void receive(uint8_t byte, uint32_t at);
+  void answer(const std::string &payload, uint32_t end);
+  void applyPending();
+
+  std::deque<Timed> wire; // Sorted by arrival
+  std::deque<uint8_t> rx;
+  std::string request; // Frame being written by the driver
+  uint32_t busFree = 0;
+
+  std::string pendingG1;
+  uint32_t pendingAt = 0;
+  bool pending = false;
+};
+
+#endif // S21_UNIT_H
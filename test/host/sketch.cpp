@@ -0,0 +1,6 @@
+// The sketch built for the host: setup(), loop() and the HTTP handlers of
+// esp32-daikin.ino, as the Arduino builder would compile them (it adds the
+// Arduino.h include)
+#include <Arduino.h>
+
+#include "../../esp32-daikin.ino"
@@ -0,0 +1,362 @@
+// Discrete-event soak run of the sketch: setup() and loop() on the
+// virtual clock against the emulated unit, HTTP clients over loopback,
+// bus outages and WiFi drops on a timetable. The idle waits jump the
+// clock to the next event, so days of uptime run in seconds.
+//   daikin_soak [scenario] [days]
+// Prints heap drift, latency percentiles, link availability and NVS
+// writes per report window, and each invariant violation as it happens.
+// The exit status is the number of violations.
+#include "host.h"
+#include "http_client.h"
+#include "s21_unit.h"
+#include "src/daikin/analytics.h"
+#include "src/daikin/s21_commands.h"
+#include "src/daikin/s21_driver.h"
+#include "src/daikin/s21_supervisor.h"
+#include "src/system/clock.h"
+#include <algorithm>
+#include <malloc.h>
+#include <stdarg.h>
+
+void setup();
+void loop();
+
+#define SECOND 1000ULL
+#define MINUTE (60 * SECOND)
+#define HOUR (60 * MINUTE)
+#define DAY (24 * HOUR)
+
+// After an outage or a WiFi drop, time for things to settle before the
+// invariants apply again
+#define SOAK_SETTLE_MS (2 * MINUTE)
+// No request should take longer than this (virtual time)
+#define SOAK_HTTP_TIMEOUT_MS (10 * SECOND)
+// One loop() blocking longer than this would starve the bus
+#define SOAK_LOOP_STALL_MS 1000
+// Heap in use is measured from here on, once caches and buffers are warm
+#define SOAK_WARMUP_MS HOUR
+// Growth past the warm-up figure that counts as a leak
+#define SOAK_HEAP_DRIFT_MAX (32 * 1024)
+
+struct Scenario {
+  const char *name;
+  const char *about;
+  uint32_t days;
+  uint32_t startMs; // millis() at boot
+  uint64_t statusEveryMs;
+  uint64_t setEveryMs;
+  uint64_t renameEveryMs;
+  uint64_t outageEveryMs; // Unit silent (0 = never)
+  uint64_t outageMs;
+  uint64_t wifiDropEveryMs; // Station disconnected (0 = never)
+  uint64_t wifiDropMs;
+  int noisePerMille; // Line noise on the unit's bytes
+  uint64_t reportEveryMs;
+};
+
+static const Scenario SCENARIOS[] = {
+    {"steady", "a week of polling and commands, nothing goes wrong", 7, 1000,
+     10 * SECOND, 15 * MINUTE, DAY, 0, 0, 0, 0, 0, DAY},
+    {"rollover", "a day across the 49.7-day millis() rollover", 1,
+     0xFFFFFFFFu - 10 * 60 * 1000, 5 * SECOND, 10 * MINUTE, 8 * HOUR,
+     6 * HOUR, 60 * SECOND, 8 * HOUR, 2 * MINUTE, 0, 3 * HOUR},
+    {"faults", "outages every 2h, WiFi drops, 1 bad byte in 1000", 3, 1000,
+     5 * SECOND, 10 * MINUTE, 12 * HOUR, 2 * HOUR, 90 * SECOND, 6 * HOUR,
+     5 * MINUTE, 1, 12 * HOUR},
+};
+
+static const Scenario *findScenario(const char *name) {
+  for (const Scenario &s : SCENARIOS) {
+    if (strcmp(s.name, name) == 0)
+      return &s;
+  }
+  return nullptr;
+}
+
+static S21Unit unit;
+static const Scenario *sc;
+static uint64_t bootUs;
+
+// Virtual ms since boot; does not wrap
+static uint64_t now() { return (hostNowUs() - bootUs) / 1000; }
+
+// ---- Invariants ----
+
+static uint32_t violations = 0;
+
+static void violation(const char *format, ...) {
+  violations++;
+  if (violations > 50)
+    return; // Counted, not printed
+  char text[160];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  printf("  VIOLATION at %.2f d: %s\n", now() / (double)DAY, text);
+}
+
+// ---- Faults on the timetable ----
+
+// A recurring window [at, at + length) every `every`, the first one after
+// one period
+static bool inWindow(uint64_t t, uint64_t every, uint64_t length) {
+  return every && t >= every && t % every < length;
+}
+
+static bool unsettled(uint64_t t) {
+  return inWindow(t, sc->outageEveryMs, sc->outageMs + SOAK_SETTLE_MS) ||
+         inWindow(t, sc->wifiDropEveryMs, sc->wifiDropMs + SOAK_SETTLE_MS);
+}
+
+static void applyFaults(uint64_t t) {
+  unit.silent = inWindow(t, sc->outageEveryMs, sc->outageMs);
+  bool drop = inWindow(t, sc->wifiDropEveryMs, sc->wifiDropMs);
+  if (drop && WiFi.status() == WL_CONNECTED)
+    hostWifiDisconnected(200); // Beacon timeout
+  else if (!drop && WiFi.status() != WL_CONNECTED)
+    hostSetWifiStatus(WL_CONNECTED);
+}
+
+// ---- HTTP clients ----
+
+struct SoakClient {
+  explicit SoakClient(const char *name) : name(name) {}
+
+  const char *name;
+  HostHttp http;
+  bool busy = false;
+  bool changesConfig = false;
+  uint64_t startedAt = 0;
+  uint64_t nextAt = 0;
+  std::vector<uint32_t> latencies; // This window, virtual ms
+  uint32_t requests = 0;
+  uint32_t skipped = 0; // Due while the last one was still running
+};
+
+static SoakClient statusClient("status");
+static SoakClient setClient("set");
+static SoakClient renameClient("set-config");
+static uint32_t nvsBaseline = 0;
+static uint32_t renames = 0;
+
+static void startRequest(SoakClient &c, const char *path, uint64_t t) {
+  if (c.busy) {
+    c.skipped++;
+    return;
+  }
+  if (!c.http.start(path, API_PORT)) {
+    violation("%s: connection refused", c.name);
+    return;
+  }
+  c.busy = true;
+  c.startedAt = t;
+  c.requests++;
+}
+
+static void pollRequest(SoakClient &c, uint64_t t) {
+  if (!c.busy)
+    return;
+  if (!c.http.poll()) {
+    if (t - c.startedAt > SOAK_HTTP_TIMEOUT_MS) {
+      violation("%s: no answer after %llu ms", c.name,
+                (unsigned long long)(t - c.startedAt));
+      c.http.close();
+      c.busy = false;
+    }
+    return;
+  }
+  c.busy = false;
+  c.http.close();
+  c.latencies.push_back(t - c.startedAt);
+  // A command sent into an outage may fail; anything else must succeed
+  if (c.http.status != 200 && !unsettled(c.startedAt) && !unsettled(t))
+    violation("%s: HTTP %d %s", c.name, c.http.status, c.http.body.c_str());
+  if (c.changesConfig)
+    nvsBaseline = hostNvsWrites();
+}
+
+static void driveClients(uint64_t t) {
+  bool wifiUp = WiFi.status() == WL_CONNECTED;
+  if (t >= statusClient.nextAt) {
+    statusClient.nextAt += sc->statusEveryMs;
+    if (wifiUp)
+      startRequest(statusClient, "/status", t);
+  }
+  if (t >= setClient.nextAt) {
+    setClient.nextAt += sc->setEveryMs;
+    // Alternates between two targets so every command changes something
+    static bool warm = false;
+    warm = !warm;
+    if (wifiUp)
+      startRequest(setClient, warm ? "/set?temp=23&wait=1" : "/set?temp=21&wait=1",
+                   t);
+  }
+  if (t >= renameClient.nextAt) {
+    renameClient.nextAt += sc->renameEveryMs;
+    char path[48];
+    snprintf(path, sizeof(path), "/set-config?name=Soak%lu",
+             (unsigned long)++renames);
+    if (wifiUp)
+      startRequest(renameClient, path, t);
+  }
+  pollRequest(statusClient, t);
+  pollRequest(setClient, t);
+  pollRequest(renameClient, t);
+}
+
+// ---- Checks once a second ----
+
+static uint64_t lastUptime = 0;
+static uint32_t commandsFailed = 0;
+static uint32_t nvsBackground = 0; // This window
+
+static void checkInvariants(uint64_t t) {
+  uint64_t uptime = uptimeMs();
+  if (uptime < lastUptime)
+    violation("uptime went back from %llu to %llu",
+              (unsigned long long)lastUptime, (unsigned long long)uptime);
+  lastUptime = uptime;
+
+  uint32_t nvs = hostNvsWrites();
+  if (nvs != nvsBaseline && !renameClient.busy) {
+    nvsBackground += nvs - nvsBaseline;
+    nvsBaseline = nvs;
+  }
+
+  // Commands sent into an outage fail, as they should
+  uint32_t failed = Commands.getStats().failed;
+  uint32_t newlyFailed = failed - commandsFailed;
+  commandsFailed = failed;
+
+  if (unsettled(t) || t < SOAK_SETTLE_MS)
+    return;
+  if (Supervisor.state() != S21_LINK_UP)
+    violation("bus link is %d outside an outage", (int)Supervisor.state());
+  if (S21.pollAge() > S21_PROBE_MS + 10 * SECOND)
+    violation("last poll %lu ms ago", (unsigned long)S21.pollAge());
+  if (newlyFailed)
+    violation("%lu command(s) failed", (unsigned long)newlyFailed);
+}
+
+// ---- Report ----
+
+static uint32_t percentile(std::vector<uint32_t> &v, int p) {
+  if (v.empty())
+    return 0;
+  size_t i = (v.size() - 1) * p / 100;
+  std::nth_element(v.begin(), v.begin() + i, v.end());
+  return v[i];
+}
+
+static void printLatency(SoakClient &c) {
+  std::vector<uint32_t> &v = c.latencies;
+  uint32_t max = v.empty() ? 0 : *std::max_element(v.begin(), v.end());
+  printf(" %s %u/%u/%u/%u", c.name, percentile(v, 50), percentile(v, 95),
+         percentile(v, 99), max);
+  v.clear();
+}
+
+static size_t heapInUse() { return mallinfo2().uordblks; }
+
+static size_t heapBaseline = 0;
+static uint32_t loops = 0;
+static uint32_t worstLoopMs = 0;
+
+static void report(uint64_t t) {
+  size_t heap = heapInUse();
+  long drift = heapBaseline ? (long)heap - (long)heapBaseline : 0;
+  if (drift > SOAK_HEAP_DRIFT_MAX)
+    violation("heap grew %ld bytes since warm-up", drift);
+  // Nobody asked for these: analytics checkpoints, at most one per period
+  uint32_t nvsAllowed = sc->reportEveryMs / ANALYTICS_CHECKPOINT_MS + 1;
+  if (nvsBackground > nvsAllowed)
+    violation("%lu background NVS writes in a window (max %lu)",
+              (unsigned long)nvsBackground, (unsigned long)nvsAllowed);
+
+  printf("%6.2f d  heap %7zu (%+6ld)  p50/p95/p99/max ms:", t / (double)DAY,
+         heap, drift);
+  printLatency(statusClient);
+  printLatency(setClient);
+  printf("  avail %.2f%%  nvs %lu  loops %lu  worst loop %lu ms\n",
+         Supervisor.availability(), (unsigned long)nvsBackground,
+         (unsigned long)loops,
+         (unsigned long)worstLoopMs);
+  fflush(stdout);
+  nvsBackground = 0;
+  loops = 0;
+  worstLoopMs = 0;
+}
+
+static int usage() {
+  printf("usage: daikin_soak [scenario] [days]\n");
+  for (const Scenario &s : SCENARIOS)
+    printf("  %-9s %s\n", s.name, s.about);
+  return 255;
+}
+
+int main(int argc, char **argv) {
+  sc = findScenario(argc > 1 ? argv[1] : "steady");
+  if (!sc)
+    return usage();
+  uint64_t days = argc > 2 ? strtoul(argv[2], nullptr, 10) : sc->days;
+  if (!days)
+    return usage();
+  printf("soak: %s, %llu day(s) from millis() = %lu\n", sc->name,
+         (unsigned long long)days, (unsigned long)sc->startMs);
+
+  hostUseVirtualClock(sc->startMs);
+  bootUs = hostNowUs();
+  unit.noisePerMille = sc->noisePerMille;
+  unit.attach();
+  setup();
+  for (int i = 0; i < 500; i++) // Handshake, WiFi up, server listening
+    loop();
+  nvsBaseline = hostNvsWrites();
+  statusClient.nextAt = now();
+  setClient.nextAt = now() + sc->setEveryMs;
+  renameClient.nextAt = now() + sc->renameEveryMs;
+  renameClient.changesConfig = true;
+  // Sized for a whole window, or their growth would read as heap drift
+  statusClient.latencies.reserve(sc->reportEveryMs / sc->statusEveryMs + 16);
+  setClient.latencies.reserve(sc->reportEveryMs / sc->setEveryMs + 16);
+
+  uint64_t end = days * DAY;
+  uint64_t nextCheck = now();
+  uint64_t nextReport = sc->reportEveryMs;
+  for (;;) {
+    uint64_t t = now();
+    applyFaults(t);
+    driveClients(t);
+    if (t >= nextCheck) {
+      nextCheck += SECOND;
+      checkInvariants(t);
+    }
+    if (!heapBaseline && t >= SOAK_WARMUP_MS)
+      heapBaseline = heapInUse();
+    if (t >= nextReport || t >= end) {
+      nextReport += sc->reportEveryMs;
+      report(t);
+    }
+    if (t >= end)
+      break;
+
+    loop();
+    loops++;
+    uint32_t loopMs = now() - t;
+    if (loopMs > worstLoopMs)
+      worstLoopMs = loopMs;
+    if (loopMs > SOAK_LOOP_STALL_MS)
+      violation("loop() blocked for %lu ms", (unsigned long)loopMs);
+  }
+
+  const S21BusMetrics &bus = Supervisor.getMetrics();
+  printf("soak: %llu requests, %lu skipped while busy, %lu outages, "
+         "%lu recoveries, %lu renames, %lu violation(s)\n",
+         (unsigned long long)(statusClient.requests + setClient.requests +
+                              renameClient.requests),
+         (unsigned long)(statusClient.skipped + setClient.skipped),
+         (unsigned long)bus.outages, (unsigned long)bus.recoveries,
+         (unsigned long)renames, (unsigned long)violations);
+  return violations > 254 ? 254 : violations;
+}
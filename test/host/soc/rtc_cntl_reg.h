@@ -0,0 +1,9 @@
+// Host build: no brown-out detector to switch off
+#ifndef RTC_CNTL_REG_H
+#define RTC_CNTL_REG_H
+
+#include "soc.h"
+
+#define RTC_CNTL_BROWN_OUT_REG 0
+
+#endif // RTC_CNTL_REG_H
@@ -0,0 +1,64 @@
+// Minimal test harness: TEST() cases in one executable per module, CHECK
+// macros that report and keep going. main() comes from test_main.cpp; the
+// exit status is the number of failed cases (ctest runs each executable).
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <string.h>
+
+struct TestCase {
+  TestCase(const char *name, void (*run)());
+  const char *name;
+  void (*run)();
+  TestCase *next;
+};
+
+// Failed checks in the running case
+extern int testFailures;
+
+#define TEST(name)                                                             \
+  static void test_##name();                                                   \
+  static TestCase testCase_##name(#name, test_##name);                         \
+  static void test_##name()
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);          \
+      testFailures++;                                                          \
+    }                                                                          \
+  } while (0)
+
+// Compared as long long (integers) or double (TEST_NEAR)
+#define CHECK_EQ(actual, expected)                                             \
+  do {                                                                         \
+    long long a_ = (long long)(actual), e_ = (long long)(expected);            \
+    if (a_ != e_) {                                                            \
+      printf("%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__,         \
+             #actual, a_, e_);                                                 \
+      testFailures++;                                                          \
+    }                                                                          \
+  } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance)                                \
+  do {                                                                         \
+    double a_ = (actual), e_ = (expected);                                     \
+    if (a_ < e_ - (tolerance) || a_ > e_ + (tolerance)) {                      \
+      printf("%s:%d: %s is %g, expected %g\n", __FILE__, __LINE__, #actual,    \
+             a_, e_);                                                          \
+      testFailures++;                                                          \
+    }                                                                          \
+  } while (0)
+
+#define CHECK_STR(actual, expected)                                            \
+  do {                                                                         \
+    const char *a_ = (actual), *e_ = (expected);                               \
+    if (!a_ || strcmp(a_, e_) != 0) {                                          \
+      printf("%s:%d: %s is \"%s\", expected \"%s\"\n", __FILE__, __LINE__,     \
+             #actual, a_ ? a_ : "(null)", e_);                                 \
+      testFailures++;                                                          \
+    }                                                                          \
+  } while (0)
+
+#endif // TEST_H
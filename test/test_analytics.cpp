@@ -0,0 +1,239 @@
+// Duty-cycle analytics fed by the driver polling the emulated unit: the
+// running statistics, compressor runs, NVS checkpoints and their restore
+#include <math.h>
+#include <vector>
+
+#include <Preferences.h>
+
+#include "host.h"
+#include "s21_unit.h"
+#include "src/daikin/analytics.h"
+#include "src/daikin/s21_commands.h"
+#include "src/daikin/s21_driver.h"
+#include "src/system/clock.h"
+#include "test.h"
+
+#define MINUTE 60000UL
+#define HOUR (60 * MINUTE)
+
+static S21Unit unit;
+
+// The bus as the sketch runs it, with a client polling every 2 s
+static void run(uint32_t ms) {
+  for (uint32_t i = 0; i < ms; i++) {
+    if (millis() % 2000 == 0)
+      S21.requestPoll();
+    S21.loop();
+    Analytics.loop();
+    hostAdvance(1);
+  }
+}
+
+// The board restarts: RAM is gone, NVS stays
+static void reboot() {
+  Analytics = UnitAnalytics();
+  Analytics.begin();
+}
+
+// Empty NVS, unit connected, analytics started from nothing
+static void boot() {
+  hostUseVirtualClock(1000);
+  hostNvsClear();
+  unit = S21Unit();
+  unit.attach();
+  S21.restart();
+  Commands = S21CommandQueue();
+  S21.begin();
+  for (int i = 0; i < 5000 && !S21.isReady(); i++) {
+    S21.loop();
+    hostAdvance(1);
+  }
+  CHECK(S21.isReady());
+  reboot();
+}
+
+static void compressor(uint16_t hz) {
+  char data[5];
+  snprintf(data, sizeof(data), "%03u+", hz); // Digits reversed below
+  std::swap(data[0], data[2]);
+  unit.replies["Rd"] = data;
+}
+
+TEST(welford_matches_two_pass) {
+  // Room temperatures: a large mean, a small spread
+  std::vector<float> xs;
+  for (int i = 0; i < 5000; i++)
+    xs.push_back(21.5f + 0.5f * sinf(i * 0.37f) + 0.01f * (i % 7));
+  RunningStats s = {};
+  for (float x : xs)
+    s.add(x);
+
+  double sum = 0;
+  for (float x : xs)
+    sum += x;
+  double mean = sum / xs.size();
+  double sq = 0, lo = xs[0], hi = xs[0];
+  for (float x : xs) {
+    sq += (x - mean) * (x - mean);
+    lo = x < lo ? x : lo;
+    hi = x > hi ? x : hi;
+  }
+  double variance = sq / (xs.size() - 1);
+
+  CHECK_EQ(s.count, xs.size());
+  CHECK_NEAR(s.mean, mean, 1e-4);
+  CHECK_NEAR(s.variance(), variance, variance * 1e-3);
+  CHECK_NEAR(s.stddev(), sqrt(variance), 1e-4);
+  CHECK_NEAR(s.min, lo, 0);
+  CHECK_NEAR(s.max, hi, 0);
+
+  RunningStats one = {};
+  one.add(-3);
+  CHECK_NEAR(one.mean, -3, 0);
+  CHECK_NEAR(one.variance(), 0, 0);
+  CHECK_NEAR(one.min, -3, 0);
+  CHECK_NEAR(one.max, -3, 0);
+}
+
+TEST(temperatures_are_sampled_while_connected) {
+  boot();
+  run(10 * MINUTE + 1000);
+  const AnalyticsTotals &t = Analytics.getTotals();
+  CHECK_EQ(t.roomTemp.count, 10);
+  CHECK_NEAR(t.roomTemp.mean, 25.0, 0.01); // The unit's "052+"
+  CHECK_NEAR(t.roomTemp.variance(), 0, 1e-6);
+  CHECK_NEAR(t.observedMs, 10 * MINUTE, 2000);
+  CHECK_NEAR(t.onMs, t.observedMs, 0); // G1 says on, cool
+  CHECK_NEAR(t.modeMs[ANALYTICS_COOL], t.onMs, 0);
+
+  // Unit gone: nothing sampled, no time charged
+  unit.silent = true;
+  unit.echo = false;
+  run(30 * MINUTE);
+  CHECK(!S21.isConnected());
+  CHECK(Analytics.getTotals().roomTemp.count <= 11);
+  CHECK_NEAR(Analytics.getTotals().observedMs, 10 * MINUTE, 61000);
+}
+
+// Three 20-minute runs with 10-minute pauses
+TEST(compressor_starts_and_cycles) {
+  boot();
+  compressor(0);
+  run(MINUTE);
+  for (int i = 0; i < 3; i++) {
+    compressor(50);
+    run(20 * MINUTE);
+    compressor(0);
+    run(10 * MINUTE);
+  }
+  const AnalyticsTotals &t = Analytics.getTotals();
+  CHECK_EQ(t.compressorStarts, 3);
+  CHECK_EQ(t.cycleMinutes.count, 3);
+  CHECK_NEAR(t.cycleMinutes.mean, 20, 0.2); // Slow poll every 8 s
+  CHECK_NEAR(t.compressorMs, 60 * MINUTE, 30000);
+  CHECK_NEAR(t.compressorHz.mean, 50, 0.01);
+  CHECK(t.compressorHz.count >= 57 && t.compressorHz.count <= 60);
+  // Fan plus 14 W/Hz while running
+  double joules = 91 * MINUTE / 1000.0 * ANALYTICS_FAN_WATTS +
+                  60 * MINUTE / 1000.0 * 50 * ANALYTICS_WATTS_PER_HZ;
+  CHECK_NEAR(t.estimatedJ, joules, joules * 0.01);
+
+  // Counted per hour of uptime: two short runs in a fresh hour
+  run(HOUR - uptimeMs() % HOUR + 1000);
+  for (int i = 0; i < 2; i++) {
+    compressor(30);
+    run(5 * MINUTE);
+    compressor(0);
+    run(5 * MINUTE);
+  }
+  CHECK_EQ(Analytics.getTotals().compressorStarts, 5);
+  run(HOUR - uptimeMs() % HOUR + 1000);
+  CHECK_EQ(Analytics.startsLastHour(), 2);
+  run(HOUR);
+  CHECK_EQ(Analytics.startsLastHour(), 0);
+}
+
+// A run already going at boot has no known start: not counted, not timed
+TEST(run_in_progress_at_boot_is_not_a_start) {
+  boot();
+  compressor(40);
+  run(5 * MINUTE);
+  reboot();
+  run(5 * MINUTE);
+  compressor(0);
+  run(MINUTE);
+  const AnalyticsTotals &t = Analytics.getTotals();
+  CHECK_EQ(t.compressorStarts, 0);
+  CHECK_EQ(t.cycleMinutes.count, 0);
+  CHECK(t.compressorMs > 4 * MINUTE);
+}
+
+// Changes every poll, but NVS is written once per checkpoint interval
+TEST(checkpoints_are_batched) {
+  boot();
+  uint32_t writes = hostNvsWrites();
+  for (int i = 0; i < 12; i++) { // 2 h, compressor cycling
+    compressor(i % 2 ? 0 : 45);
+    run(10 * MINUTE);
+  }
+  CHECK_NEAR(hostNvsWrites() - writes, 2 * HOUR / ANALYTICS_CHECKPOINT_MS, 1);
+  CHECK_EQ(Analytics.checkpointCount(), hostNvsWrites() - writes);
+  CHECK(Analytics.lastCheckpointAge() <= ANALYTICS_CHECKPOINT_MS);
+
+  // Unit gone: nothing new to save
+  unit.silent = true;
+  unit.echo = false;
+  run(ANALYTICS_CHECKPOINT_MS + 20000);
+  writes = hostNvsWrites();
+  run(4 * ANALYTICS_CHECKPOINT_MS);
+  CHECK_EQ(hostNvsWrites(), writes);
+}
+
+TEST(totals_survive_a_reboot) {
+  boot();
+  run(MINUTE);
+  compressor(50);
+  run(20 * MINUTE);
+  compressor(0);
+  run(5 * MINUTE);
+  Analytics.checkpoint();
+  AnalyticsTotals saved = Analytics.getTotals();
+  CHECK(saved.compressorStarts == 1);
+
+  // Ten more minutes, not checkpointed: lost with the reboot
+  run(10 * MINUTE);
+  reboot();
+  const AnalyticsTotals &t = Analytics.getTotals();
+  CHECK_EQ(t.observedMs, saved.observedMs);
+  CHECK_EQ(t.onMs, saved.onMs);
+  CHECK_EQ(t.compressorMs, saved.compressorMs);
+  CHECK_EQ(t.compressorStarts, 1);
+  CHECK_EQ(t.estimatedJ, saved.estimatedJ);
+  CHECK_EQ(t.roomTemp.count, saved.roomTemp.count);
+  CHECK_NEAR(t.roomTemp.mean, saved.roomTemp.mean, 0);
+  CHECK_NEAR(t.cycleMinutes.mean, saved.cycleMinutes.mean, 0);
+
+  // And it carries on from there, once the first sample has seen the unit
+  run(10 * MINUTE);
+  uint64_t observed = Analytics.getTotals().observedMs - saved.observedMs;
+  CHECK(observed <= 10 * MINUTE);
+  CHECK(observed >= 10 * MINUTE - ANALYTICS_SAMPLE_MS);
+}
+
+TEST(foreign_checkpoint_is_ignored) {
+  boot();
+  run(MINUTE);
+  Analytics.checkpoint();
+  // Same key, the layout of some other firmware
+  Preferences prefs;
+  prefs.begin("daikin", false);
+  uint8_t junk[40] = {1};
+  prefs.putBytes("analytics", junk, sizeof(junk));
+  prefs.end();
+  reboot();
+  CHECK_EQ(Analytics.getTotals().observedMs, 0);
+
+  Analytics.reset();
+  reboot();
+  CHECK_EQ(Analytics.getTotals().observedMs, 0);
+}
@@ -0,0 +1,242 @@
+// Control commands through the driver against the emulated unit: D1/D5,
+// ACK, readback, and what happens when any of it goes wrong
+#include "host.h"
+#include "s21_unit.h"
+#include "src/daikin/s21_codec.h"
+#include "src/daikin/s21_commands.h"
+#include "src/daikin/s21_driver.h"
+#include "test.h"
+
+static S21Unit unit;
+
+// Fresh unit, queue and driver, handshake done
+static void boot() {
+  hostUseVirtualClock(1000);
+  unit = S21Unit();
+  unit.attach();
+  S21.restart();
+  Commands = S21CommandQueue();
+  S21.begin();
+  for (int i = 0; i < 5000 && !S21.isReady(); i++) {
+    S21.loop();
+    hostAdvance(1);
+  }
+  CHECK(S21.isReady());
+}
+
+static void run(uint32_t ms) {
+  for (uint32_t i = 0; i < ms; i++) {
+    S21.loop();
+    hostAdvance(1);
+  }
+}
+
+// Runs the driver until the command is final; false on timeout
+static bool runUntilDone(uint32_t id, uint32_t maxMs = 5000) {
+  for (uint32_t i = 0; i < maxMs; i++) {
+    const S21Command *c = Commands.find(id);
+    if (!c || c->isDone())
+      return c != nullptr;
+    S21.loop();
+    hostAdvance(1);
+  }
+  return false;
+}
+
+static S21CommandStatus statusOf(uint32_t id) {
+  const S21Command *c = Commands.find(id);
+  return c ? c->status : S21_CMD_QUEUED;
+}
+
+static uint32_t setState(bool power, uint8_t mode, float temp, uint8_t fan) {
+  DaikinCommand cmd = {};
+  cmd.hasPower = cmd.hasMode = cmd.hasTemp = cmd.hasFan = true;
+  cmd.power = power;
+  cmd.mode = mode;
+  cmd.temp = temp;
+  cmd.fan = fan;
+  return Commands.submit(cmd);
+}
+
+static std::string payloadOf(uint32_t id) {
+  const S21Command *c = Commands.find(id);
+  return c ? std::string((const char *)c->payload, 4) : std::string();
+}
+
+TEST(state_command_is_confirmed_by_readback) {
+  boot();
+  uint32_t id = setState(true, 4, 22.0, 3);
+  CHECK(id != 0);
+  CHECK(runUntilDone(id));
+  const S21Command *c = Commands.find(id);
+  CHECK_EQ(c->status, S21_CMD_CONFIRMED);
+  CHECK_EQ(c->attempts, 1);
+  CHECK_EQ(c->readbacks, 1);
+  CHECK(c->ackMs > 0 && c->ackMs <= c->doneMs);
+  CHECK_EQ(unit.commands, 1);
+  CHECK(unit.g1 == payloadOf(id));
+  CHECK_STR(unit.lastRequest.c_str(), "F1");
+}
+
+// The unit reports v3 (G8 "0300"): still whole degrees F unless 0.5C
+// steps are switched on for it (test_protocol)
+TEST(fahrenheit_whatever_the_version) {
+  for (uint8_t major = 0; major < 10; major++)
+    CHECK_STR(S21Protocol::codecFor(major).name, "fahrenheit");
+  boot();
+  CHECK_EQ(Protocol.major(), 3);
+  CHECK_STR(Protocol.codec().name, "fahrenheit");
+  uint32_t id = setState(true, 3, 22.0, 3);
+  CHECK(runUntilDone(id));
+  CHECK_EQ(payloadOf(id)[2], 71); // 22C = 71F
+}
+
+TEST(swing_command_reads_back_g5) {
+  boot();
+  uint32_t id = Commands.submitSwing(true, false);
+  CHECK(runUntilDone(id));
+  CHECK_EQ(statusOf(id), S21_CMD_CONFIRMED);
+  CHECK_EQ(unit.g5[0], payloadOf(id)[0]);
+  CHECK_STR(unit.lastRequest.c_str(), "F5");
+}
+
+TEST(burst_costs_one_transaction) {
+  boot();
+  uint32_t ids[5];
+  for (int i = 0; i < 5; i++)
+    ids[i] = setState(true, 3, 20.0 + i, 5);
+  CHECK(runUntilDone(ids[4]));
+  for (int i = 0; i < 4; i++)
+    CHECK_EQ(statusOf(ids[i]), S21_CMD_SUPERSEDED);
+  CHECK_EQ(statusOf(ids[4]), S21_CMD_CONFIRMED);
+  CHECK_EQ(unit.commands, 1);
+  CHECK_EQ(Commands.getStats().superseded, 4);
+}
+
+TEST(command_during_a_poll_cycle) {
+  boot();
+  S21.requestPoll();
+  run(40); // First query on the wire
+  CHECK(S21.isPolling());
+  uint32_t id = setState(false, 2, 25.0, 5);
+  CHECK(runUntilDone(id));
+  CHECK_EQ(statusOf(id), S21_CMD_CONFIRMED);
+  run(5000);
+  CHECK(!S21.isPolling()); // The cycle finished around it
+  CHECK_EQ(unit.badFrames, 0);
+}
+
+TEST(nak_on_every_attempt) {
+  boot();
+  unit.nakCommands = true;
+  uint32_t id = setState(true, 4, 22.0, 3);
+  CHECK(runUntilDone(id));
+  const S21Command *c = Commands.find(id);
+  CHECK_EQ(c->status, S21_CMD_NAKED);
+  CHECK_EQ(c->attempts, S21_COMMAND_ATTEMPTS);
+  CHECK_EQ(c->naks, S21_COMMAND_ATTEMPTS);
+  CHECK_EQ(Commands.getStats().retries, S21_COMMAND_ATTEMPTS - 1);
+}
+
+TEST(no_ack_fails_after_the_last_attempt) {
+  boot();
+  unit.dropCommands = true;
+  uint32_t id = setState(true, 4, 22.0, 3);
+  CHECK(runUntilDone(id));
+  const S21Command *c = Commands.find(id);
+  CHECK_EQ(c->status, S21_CMD_FAILED);
+  CHECK_EQ(c->attempts, S21_COMMAND_ATTEMPTS);
+  CHECK_EQ(c->naks, 0);
+}
+
+TEST(acked_but_not_applied_is_a_mismatch) {
+  boot();
+  unit.ignoreCommands = true;
+  uint32_t id = setState(true, 4, 22.0, 3);
+  CHECK(runUntilDone(id));
+  const S21Command *c = Commands.find(id);
+  CHECK_EQ(c->status, S21_CMD_MISMATCH);
+  CHECK_EQ(c->readbacks, S21_COMMAND_READBACKS);
+  CHECK(c->ackMs > 0);
+}
+
+TEST(late_apply_confirms_on_a_later_readback) {
+  boot();
+  unit.applyDelayMs = 400;
+  uint32_t id = setState(true, 1, 21.0, 3);
+  CHECK(runUntilDone(id));
+  const S21Command *c = Commands.find(id);
+  CHECK_EQ(c->status, S21_CMD_CONFIRMED);
+  CHECK(c->readbacks >= 2);
+  CHECK(c->readbacks <= S21_COMMAND_READBACKS);
+}
+
+TEST(restart_sends_the_command_again) {
+  boot();
+  uint32_t id = setState(true, 4, 22.0, 3);
+  for (int i = 0; i < 1000 && statusOf(id) != S21_CMD_SENT; i++)
+    run(1);
+  CHECK_EQ(statusOf(id), S21_CMD_SENT);
+  S21.restart(); // Supervisor recovery mid-transaction
+  CHECK_EQ(statusOf(id), S21_CMD_QUEUED);
+  CHECK(runUntilDone(id));
+  CHECK_EQ(statusOf(id), S21_CMD_CONFIRMED);
+  CHECK_EQ(Commands.find(id)->attempts, 2);
+}
+
+// readbackMatches: all four D1 bytes, only the first of D5
+TEST(readback_compares_the_command_bytes) {
+  boot();
+  const uint8_t sent[4] = {'1', '4', '@', '3'};
+  uint32_t id = setState(true, 4, 22.0, 3);
+  S21Command *c = Commands.find(id);
+  Commands.sent(*c, sent);
+  Commands.acked(*c, millis());
+  Commands.readback(*c, (const uint8_t *)"1403", 4, millis()); // Temp
+  CHECK_EQ(c->status, S21_CMD_ACKED);
+  Commands.readback(*c, (const uint8_t *)"14@", 3, millis()); // Short
+  CHECK_EQ(c->status, S21_CMD_ACKED);
+  Commands.readback(*c, (const uint8_t *)"14@3", 4, millis());
+  CHECK_EQ(c->status, S21_CMD_CONFIRMED);
+
+  const uint8_t swing[4] = {'7', '?', '0', '0'};
+  id = Commands.submitSwing(true, true);
+  c = Commands.find(id);
+  Commands.sent(*c, swing);
+  Commands.acked(*c, millis());
+  Commands.readback(*c, (const uint8_t *)"1?00", 4, millis());
+  CHECK_EQ(c->status, S21_CMD_ACKED);
+  Commands.readback(*c, (const uint8_t *)"7000", 4, millis()); // Byte 1
+  CHECK_EQ(c->status, S21_CMD_CONFIRMED);
+}
+
+TEST(full_history_keeps_the_command_on_the_bus) {
+  boot();
+  unit.applyDelayMs = 400; // Readbacks keep it busy a while
+  uint32_t id = setState(true, 4, 22.0, 3);
+  for (int i = 0; i < 1000 && statusOf(id) != S21_CMD_ACKED; i++)
+    run(1);
+  CHECK_EQ(statusOf(id), S21_CMD_ACKED);
+
+  // Every swing supersedes the one before: the history fills with
+  // finished commands behind the oldest, still pending one
+  uint32_t last = 0;
+  for (int i = 0; i < 2 * S21_COMMAND_HISTORY; i++)
+    last = Commands.submitSwing(i % 2, false);
+  CHECK_EQ(Commands.count(), S21_COMMAND_HISTORY);
+  const S21Command *c = Commands.find(id);
+  CHECK(c != nullptr);
+  if (!c)
+    return;
+  CHECK_EQ(c->kind, S21_CMD_STATE);
+  CHECK_EQ(Commands.at(0).id, id); // Still the oldest
+  for (size_t i = 1; i < Commands.count(); i++)
+    CHECK(Commands.at(i - 1).id < Commands.at(i).id);
+
+  CHECK(runUntilDone(id));
+  CHECK_EQ(statusOf(id), S21_CMD_CONFIRMED);
+  CHECK(runUntilDone(last));
+  CHECK_EQ(statusOf(last), S21_CMD_CONFIRMED);
+  CHECK_EQ(unit.commands, 2);
+  CHECK(unit.g1 == payloadOf(id));
+}
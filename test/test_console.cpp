@@ -0,0 +1,87 @@
+// Console input one byte at a time: lines are only run once complete,
+// and loop() takes a bounded slice of whatever is waiting
+#include "host.h"
+#include "src/system/console.h"
+#include "test.h"
+#include <chrono>
+#include <string>
+
+static bool feedAll(LineEditor &e, const char *s, int &lines) {
+  bool last = false;
+  for (; *s; s++) {
+    last = e.feed(*s);
+    lines += last;
+  }
+  return last;
+}
+
+TEST(line_endings) {
+  LineEditor e;
+  int lines = 0;
+  CHECK(feedAll(e, "status\r", lines));
+  CHECK_STR(e.line(), "status");
+  CHECK(!feedAll(e, "\n", lines)); // Rest of the CRLF
+  CHECK(feedAll(e, "help\n", lines));
+  CHECK_STR(e.line(), "help");
+  CHECK(!feedAll(e, "\r\n\n\r", lines));
+  CHECK_EQ(lines, 2);
+}
+
+TEST(backspace_and_control_characters) {
+  LineEditor e;
+  int lines = 0;
+  CHECK(feedAll(e, "stat\bts\x7f"
+                   "us\xff\xfb\x01\n",
+                lines));
+  CHECK_STR(e.line(), "status");
+  CHECK(!feedAll(e, "\b\b\n", lines)); // Nothing left to erase
+}
+
+TEST(overlong_line_is_dropped_whole) {
+  LineEditor e;
+  int lines = 0;
+  std::string longLine(CONSOLE_LINE_MAX + 10, 'x');
+  CHECK(!feedAll(e, (longLine + "\n").c_str(), lines));
+  CHECK(feedAll(e, "help\n", lines)); // The next line is fine
+  CHECK_STR(e.line(), "help");
+  CHECK_EQ(lines, 1);
+}
+
+TEST(loop_takes_a_bounded_slice) {
+  hostSerialInput(std::string(200, 'x').c_str());
+  Cli.loop();
+  CHECK_EQ(Serial.available(), 200 - CONSOLE_MAX_BYTES_PER_LOOP);
+  while (Serial.available())
+    Cli.loop();
+  hostSerialInput("\n"); // Overlong, dropped
+  Cli.loop();
+}
+
+// Before: readStringUntil() held the loop for its 1s timeout on a
+// partial line. A byte per loop must cost microseconds, and nothing runs
+// before the line ends.
+TEST(trickled_input_never_blocks_the_loop) {
+  hostUseVirtualClock(1000);
+  const char *script = "help\r\nstatus\nset mode=heat temp=99\n";
+  hostSerialOutput().clear();
+  double worstUs = 0;
+  unsigned long start = millis();
+  for (const char *p = script; *p; p++) {
+    char byte[2] = {*p, '\0'};
+    hostSerialInput(byte);
+    auto t0 = std::chrono::steady_clock::now();
+    Cli.loop();
+    auto t1 = std::chrono::steady_clock::now();
+    double us = std::chrono::duration<double, std::micro>(t1 - t0).count();
+    if (us > worstUs)
+      worstUs = us;
+    if (p < script + 4) // "help" without its CR
+      CHECK(hostSerialOutput().empty());
+    CHECK_EQ(Serial.available(), 0);
+  }
+  printf("  worst loop %.1f us for one byte\n", worstUs);
+  CHECK_EQ(millis(), start); // Never waited for the rest of a line
+  CHECK(worstUs < 5000);
+  CHECK(hostSerialOutput().find("bus-restart") != std::string::npos);
+  CHECK(hostSerialOutput().find("out of range") != std::string::npos);
+}
@@ -0,0 +1,33 @@
+// mDNS announcement: the TXT records, caps following the build switches
+// (built once per firmware variant)
+#include "host.h"
+#include "src/net/fleet.h"
+#include "src/system/console.h"
+#include "src/web/diagnostics.h"
+#include "test.h"
+
+TEST(txt_records) {
+  Fleet.begin("Living room");
+  std::map<std::string, std::string> &txt = hostMdnsTxt();
+  CHECK(txt["name"] == "Living room");
+  CHECK(txt["fw"] == FW_VERSION);
+  CHECK(txt["codec"] == "fahrenheit");
+#if FLEET_BROADCAST
+  CHECK(txt["mcast"] == "239.255.21.21:21021");
+#endif
+  Fleet.setName("Bedroom");
+  CHECK(txt["name"] == "Bedroom");
+}
+
+TEST(caps_follow_the_module_switches) {
+  Fleet.begin("Living room");
+  const char *expected;
+#if METRICS_ENABLED && CLI_ENABLED
+  expected = "status-cbor,metrics,schedule,console";
+#elif !METRICS_ENABLED && !CLI_ENABLED
+  expected = "status-cbor,schedule";
+#else
+#error "No expected caps for this variant"
+#endif
+  CHECK_STR(hostMdnsTxt()["caps"].c_str(), expected);
+}
@@ -0,0 +1,110 @@
+// Constant S21 frames built by the compiler, checked against the runtime
+// builder they replaced, and what that saves per poll
+#include "host.h"
+#include "src/daikin/s21_frame.h"
+#include "src/daikin/s21_queries.h"
+#include "test.h"
+#include <chrono>
+
+// The frames are usable in constant expressions
+static_assert(S21Frame<'F', '1'>::LENGTH == 5, "F1 length");
+static_assert(S21Frame<'F', '1'>::CHECKSUM == 0x77, "F1 checksum");
+static_assert(S21Frame<'D', '8', '0', '0', '0', '0'>::LENGTH == 9, "D8 length");
+static_assert(s21FixChecksum(S21_ETX) == 0x05, "ETX checksum fixup");
+static_assert(s21Sum('\x81', '\x82') == S21_ETX, "sum wraps at 256");
+
+// Before: sendFrame(payload, len) copied every frame into a stack buffer
+// and summed it on each send
+static size_t oldBuildFrame(uint8_t *frame, const uint8_t *payload,
+                            size_t len) {
+  size_t idx = 0;
+  frame[idx++] = 0x02;
+  uint8_t checksum = 0;
+  for (size_t i = 0; i < len; i++) {
+    frame[idx++] = payload[i];
+    checksum += payload[i];
+  }
+  if (checksum == 0x03)
+    checksum = 0x05;
+  frame[idx++] = checksum;
+  frame[idx++] = 0x03;
+  return idx;
+}
+
+template <typename F>
+static bool sameAsOld(const char *payload) {
+  uint8_t old[64];
+  size_t len = oldBuildFrame(old, (const uint8_t *)payload, strlen(payload));
+  return len == F::LENGTH && memcmp(old, F::bytes, len) == 0;
+}
+
+TEST(constant_frames_match_the_runtime_builder) {
+  CHECK((sameAsOld<S21Frame<'D', '2', '0'>>("D20")));
+  CHECK((sameAsOld<S21Frame<'F', '8'>>("F8")));
+  CHECK((sameAsOld<S21Frame<'F', 'Y'>>("FY")));
+  CHECK((sameAsOld<S21Frame<'D', '8', '0', '0', '0', '0'>>("D80000")));
+  CHECK((sameAsOld<S21Frame<'R', 'a'>>("Ra")));
+}
+
+// Every query's request is the reply tag with G -> F and S -> R
+TEST(query_table_frames) {
+  for (size_t i = 0; i < S21_QUERY_COUNT; i++) {
+    const S21Query &q = S21_QUERIES[i];
+    uint8_t request[2] = {(uint8_t)(q.rsp[0] == 'G' ? 'F' : 'R'),
+                          (uint8_t)q.rsp[1]};
+    uint8_t old[64];
+    CHECK_EQ(oldBuildFrame(old, request, 2), S21_QUERY_FRAME_LEN);
+    if (memcmp(old, q.frame, S21_QUERY_FRAME_LEN) != 0)
+      printf("  %s: request frame differs\n", q.rsp);
+    CHECK(memcmp(old, q.frame, S21_QUERY_FRAME_LEN) == 0);
+  }
+}
+
+TEST(sealed_frames_fix_an_etx_checksum) {
+  uint8_t frame[s21FrameLength(2)] = {0, 0x81, 0x82};
+  CHECK_EQ(s21SealFrame(frame, 2), 5);
+  CHECK_EQ(frame[0], S21_STX);
+  CHECK_EQ(frame[3], 0x05);
+  CHECK_EQ(frame[4], S21_ETX);
+
+  const uint8_t d1[4] = {'1', '4', '@', '3'};
+  uint8_t sealed[s21FrameLength(6)] = {0, 'D', '1'};
+  memcpy(sealed + 3, d1, 4);
+  uint8_t payload[6] = {'D', '1'};
+  memcpy(payload + 2, d1, 4);
+  uint8_t old[64];
+  CHECK_EQ(s21SealFrame(sealed, 6), oldBuildFrame(old, payload, 6));
+  CHECK(memcmp(sealed, old, sizeof(sealed)) == 0);
+}
+
+// A fast poll cycle's four queries, sent into a sink
+TEST(benchmark_against_the_runtime_builder) {
+  static const char *const PAYLOADS[] = {"F1", "F5", "RH", "Ra"};
+  static const uint8_t *const FRAMES[] = {
+      S21Frame<'F', '1'>::bytes, S21Frame<'F', '5'>::bytes,
+      S21Frame<'R', 'H'>::bytes, S21Frame<'R', 'a'>::bytes};
+  const int rounds = 1000000;
+  volatile uint8_t sink = 0;
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; i++) {
+    uint8_t frame[64];
+    const char *p = PAYLOADS[i % 4];
+    size_t len = oldBuildFrame(frame, (const uint8_t *)p, strlen(p));
+    sink = sink + frame[len - 2];
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; i++) {
+    const uint8_t *frame = FRAMES[i % 4];
+    sink = sink + frame[S21_QUERY_FRAME_LEN - 2];
+  }
+  auto t2 = std::chrono::steady_clock::now();
+
+  double built =
+      std::chrono::duration<double, std::nano>(t1 - t0).count() / rounds;
+  double constant =
+      std::chrono::duration<double, std::nano>(t2 - t1).count() / rounds;
+  printf("  runtime builder %.1f ns/frame, constant frame %.1f ns/frame\n",
+         built, constant);
+  (void)sink;
+}
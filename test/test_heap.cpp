@@ -0,0 +1,87 @@
+// The sketch with the allocator wrapped and HEAP_STRICT on: a steady-state
+// path that allocates inside HEAP_SCOPE_NO_ALLOC aborts the test
+#include "host.h"
+#include "http_client.h"
+#include "s21_unit.h"
+#include "src/system/heap_tracker.h"
+#include "src/system/scheduler.h"
+#include "test.h"
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+void setup();
+void loop();
+
+static S21Unit unit;
+
+static void boot() {
+  static bool booted = false;
+  if (booted)
+    return;
+  booted = true;
+  hostUseVirtualClock(1000);
+  unit.attach();
+  setup();
+  for (int i = 0; i < 500; i++)
+    loop();
+}
+
+static HostHttp get(const char *path) {
+  boot();
+  return hostHttpGet(path, API_PORT, loop);
+}
+
+// Allocations charged to a site so far (0 if it never ran)
+static uint32_t allocsAt(const char *site) {
+  for (size_t i = 0; i < heapSiteCount(); i++) {
+    if (strcmp(heapSite(i).name, site) == 0)
+      return heapSite(i).allocs;
+  }
+  return 0;
+}
+
+TEST(status_does_not_allocate) {
+  for (int i = 0; i < 3; i++)
+    CHECK_EQ(get("/status").status, 200);
+  CHECK_EQ(allocsAt("/status"), 0);
+  CHECK_EQ(heapViolations(), 0);
+}
+
+TEST(full_schedule_does_not_allocate) {
+  boot();
+  Schedule.clear();
+  while (Schedule.add(0x7f, 23 * 60 + 59, ScheduleEntry()) == 7)
+    ;
+  CHECK(Schedule.count() > SCHED_MAX_ENTRIES - 7);
+  HostHttp r = get("/schedule");
+  CHECK_EQ(r.status, 200);
+  CHECK(r.body.size() > 2048); // More than one chunk
+  CHECK_EQ(r.body.back(), '}');
+  CHECK(r.body.find("\"index\":" + std::to_string(Schedule.count() - 1)) !=
+        std::string::npos);
+  CHECK_EQ(allocsAt("/schedule"), 0);
+  CHECK_EQ(heapViolations(), 0);
+}
+
+TEST(set_config_reply_does_not_allocate) {
+  HostHttp r = get("/set-config?name=Hall");
+  CHECK_EQ(r.status, 200);
+  CHECK(r.body.find("\"name\":\"Hall\"") != std::string::npos);
+  CHECK_EQ(allocsAt("set-config"), 0);
+  CHECK_EQ(heapViolations(), 0);
+}
+
+// The check itself, in a child process since it aborts
+TEST(allocating_in_a_no_alloc_scope_aborts) {
+  fflush(stdout);
+  pid_t child = fork();
+  if (child == 0) {
+    HEAP_SCOPE_NO_ALLOC("test");
+    String s("long enough to need the heap, whatever the SSO size");
+    _exit(0);
+  }
+  int status = 0;
+  waitpid(child, &status, 0);
+  CHECK(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+}
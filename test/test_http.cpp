@@ -0,0 +1,191 @@
+// The sketch's HTTP API over loopback, against the emulated unit on the
+// virtual clock: what a client sees, status codes and errors included
+#include "host.h"
+#include "http_client.h"
+#include "s21_unit.h"
+#include "src/system/scheduler.h"
+#include "src/web/rate_limiter.h"
+#include "test.h"
+
+void setup();
+void loop();
+
+static S21Unit unit;
+
+static void boot() {
+  static bool booted = false;
+  if (booted)
+    return;
+  booted = true;
+  hostUseVirtualClock(1000);
+  unit.attach();
+  setup();
+  for (int i = 0; i < 500; i++) // Handshake, WiFi up, server listening
+    loop();
+}
+
+static HostHttp get(const char *path) {
+  boot();
+  return hostHttpGet(path, API_PORT, loop);
+}
+
+// Write routes are limited per client: wait for a token first
+static HostHttp writeGet(const char *path) {
+  hostAdvance(60000 / RATE_WRITE_PER_MIN);
+  return get(path);
+}
+
+static bool has(const HostHttp &r, const char *text) {
+  return r.body.find(text) != std::string::npos;
+}
+
+TEST(status_reads_the_unit) {
+  HostHttp r = get("/status");
+  CHECK_EQ(r.status, 200);
+  CHECK(r.head.find("application/json") != std::string::npos);
+  CHECK(has(r, "\"connected\":true"));
+  CHECK(has(r, "\"power\":true"));
+  CHECK(has(r, "\"room_temp\":25"));
+  CHECK(unit.requests > 10);
+}
+
+TEST(set_with_wait_answers_once_confirmed) {
+  HostHttp r = writeGet("/set?mode=heat&temp=22&wait=1");
+  CHECK_EQ(r.status, 200);
+  CHECK(has(r, "\"status\":\"confirmed\""));
+  CHECK_EQ(unit.g1[1], '4'); // Heat
+
+  r = writeGet("/set?temp=99");
+  CHECK_EQ(r.status, 400);
+  CHECK(has(r, "\"error\":\"range\""));
+  r = writeGet("/set-swing?v=1");
+  CHECK_EQ(r.status, 400);
+}
+
+TEST(commands_lists_the_history) {
+  writeGet("/set-swing?v=1&h=0&wait=1");
+  HostHttp r = get("/commands");
+  CHECK_EQ(r.status, 200);
+  CHECK(has(r, "\"kind\":\"swing\""));
+  CHECK_EQ(get("/commands?id=999999").status, 404);
+}
+
+TEST(schedule_add_list_delete) {
+  writeGet("/schedule-delete?all=1");
+  HostHttp r = writeGet("/schedule-add?days=1x9&time=07:30");
+  CHECK_EQ(r.status, 400);
+  CHECK(has(r, "digits 1-7"));
+  CHECK_EQ(writeGet("/schedule-add?days=8&time=07:30").status, 400);
+  CHECK_EQ(writeGet("/schedule-add?days=1&time=24:00").status, 400);
+  CHECK_EQ(writeGet("/schedule-add?days=1&time=7:30&mode=turbo").status,
+           400);
+
+  r = writeGet(
+      "/schedule-add?days=135&time=07:30&action=on&mode=heat&temp=21.5");
+  CHECK_EQ(r.status, 200);
+  CHECK(has(r, "\"added\":3"));
+  CHECK_EQ(Schedule.count(), 3);
+
+  r = get("/schedule");
+  CHECK_EQ(r.status, 200);
+  CHECK(has(r, "\"day\":5,\"minute\":450"));
+  CHECK(has(r, "\"temp\":21.5"));
+  CHECK_EQ(writeGet("/schedule-delete?index=0").status, 200);
+  CHECK_EQ(Schedule.count(), 2);
+  CHECK_EQ(writeGet("/schedule-delete?index=9").status, 400);
+}
+
+TEST(set_config_renames_and_persists) {
+  uint32_t writes = hostNvsWrites();
+  HostHttp r = writeGet("/set-config?name=Office%20North");
+  CHECK_EQ(r.status, 200);
+  CHECK(has(r, "\"name\":\"Office North\""));
+  CHECK(hostNvsWrites() > writes);
+  CHECK(has(get("/status"), "\"split_name\":\"Office North\""));
+  CHECK_EQ(writeGet("/set-config?name=%20%20").status, 400);
+  CHECK_EQ(writeGet("/set-config").status, 400);
+  CHECK_EQ(
+      writeGet("/set-config?name=0123456789012345678901234567890123").status,
+      400);
+}
+
+TEST(unknown_route) { CHECK_EQ(get("/nope").status, 404); }
+
+static void pump(HostHttp &http) {
+  for (int i = 0; i < 100000 && !http.poll(); i++)
+    loop();
+}
+
+TEST(head_sends_no_body) {
+  boot();
+  HostHttp http;
+  CHECK(http.start("/status", API_PORT, true, "HEAD"));
+  pump(http);
+  CHECK_EQ(http.status, 200);
+  CHECK(http.head.find("Content-Length: 0") == std::string::npos);
+  CHECK(http.body.empty());
+  // Same connection: the next answer starts where the HEAD one ended
+  CHECK(http.start("/status", API_PORT, true));
+  pump(http);
+  CHECK_EQ(http.status, 200);
+  CHECK(http.body.compare(0, 1, "{") == 0);
+}
+
+static HostHttp post(const char *length, const char *body) {
+  boot();
+  std::string request = "POST /set-config HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+                        "Content-Type: application/x-www-form-urlencoded\r\n"
+                        "Connection: close\r\nContent-Length: ";
+  request += length;
+  request += "\r\n\r\n";
+  request += body;
+  HostHttp http;
+  if (http.startRaw(request, API_PORT))
+    pump(http);
+  return http;
+}
+
+TEST(content_length_is_checked_before_use) {
+  hostAdvance(60000 / RATE_WRITE_PER_MIN);
+  HostHttp r = post("11 ", "name=Posted");
+  CHECK_EQ(r.status, 200);
+  CHECK(has(r, "\"name\":\"Posted\""));
+  // Used to wrap headLen + length past the 413 check
+  CHECK_EQ(post("18446744073709551615", "").status, 400);
+  CHECK_EQ(post("1000000000", "").status, 400);
+  CHECK_EQ(post("-1", "").status, 400);
+  CHECK_EQ(post("12abc", "").status, 400);
+  CHECK_EQ(post("", "").status, 400);
+  CHECK_EQ(post("99999", "").status, 413);
+}
+
+TEST(flash_writes_and_waits_are_limited) {
+  boot();
+  hostAdvance(60000); // Full buckets
+  for (int i = 0; i < RATE_WRITE_BURST; i++)
+    CHECK_EQ(get("/schedule-delete?index=99").status, 400);
+  CHECK_EQ(get("/schedule-delete?index=99").status, 429);
+  CHECK_EQ(get("/set-config?name=x").status, 429);
+  CHECK_EQ(get("/schedule-add?days=1&time=07:30").status, 429);
+
+  // /commands is only limited when it waits
+  for (int i = 0; i < 2 * RATE_READ_BURST; i++)
+    CHECK_EQ(get("/commands").status, 200);
+  int limited = 0;
+  for (int i = 0; i < 2 * RATE_READ_BURST && !limited; i++)
+    limited += get("/commands?wait=1&since=0").status == 429;
+  CHECK_EQ(limited, 1);
+}
+
+// Last: it spends the read budget of the loopback client
+TEST(over_budget_reads_get_429) {
+  int limited = 0;
+  HostHttp r;
+  for (int i = 0; i < 2 * RATE_READ_BURST && !limited; i++) {
+    r = get("/status");
+    limited += r.status == 429;
+  }
+  CHECK_EQ(limited, 1);
+  CHECK(r.head.find("Retry-After: ") != std::string::npos);
+  CHECK_EQ(get("/").status, 200); // The UI is not limited
+}
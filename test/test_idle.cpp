@@ -0,0 +1,99 @@
+// Idle policy on the virtual clock: how long the loop may wait, when the
+// CPU clock drops, and what a sleep costs
+#include "host.h"
+#include "src/system/idle.h"
+#include "test.h"
+
+// Plans a round every `step` ms for `ms` without any within() calls
+static void quiet(IdlePolicy &p, uint32_t ms, uint32_t step = 20) {
+  for (uint32_t t = 0; t < ms; t += step) {
+    hostAdvance(step);
+    p.plan(millis());
+  }
+}
+
+TEST(nothing_asked_waits_the_maximum) {
+  hostUseVirtualClock(1000);
+  IdlePolicy p;
+  CHECK_EQ(p.plan(millis()), IDLE_MAX_SLEEP_MS);
+  p.within(IDLE_MAX_SLEEP_MS + 50); // Never longer
+  CHECK_EQ(p.plan(millis()), IDLE_MAX_SLEEP_MS);
+}
+
+TEST(shortest_request_wins_for_one_round) {
+  hostUseVirtualClock(1000);
+  IdlePolicy p;
+  p.within(15);
+  p.within(3);
+  p.within(8);
+  CHECK_EQ(p.plan(millis()), 3);
+  CHECK_EQ(p.plan(millis()), IDLE_MAX_SLEEP_MS); // Next round
+  p.busy();
+  p.within(10);
+  CHECK_EQ(p.plan(millis()), 0);
+}
+
+TEST(clock_drops_when_quiet_and_returns_on_demand) {
+  hostUseVirtualClock(1000);
+  IdlePolicy p;
+  p.busy();
+  p.plan(millis());
+  CHECK_EQ(p.wantedMhz(), ACTIVE_CPU_MHZ);
+  quiet(p, IDLE_SCALE_AFTER_MS - 20);
+  CHECK_EQ(p.wantedMhz(), ACTIVE_CPU_MHZ);
+  quiet(p, 40);
+  CHECK_EQ(p.wantedMhz(), IDLE_CPU_MHZ);
+
+  p.within(5); // A deadline: full speed in the same round
+  p.plan(millis());
+  CHECK_EQ(p.wantedMhz(), ACTIVE_CPU_MHZ);
+  quiet(p, IDLE_SCALE_AFTER_MS - 20);
+  CHECK_EQ(p.wantedMhz(), ACTIVE_CPU_MHZ);
+}
+
+TEST(a_maximum_wait_is_not_activity) {
+  hostUseVirtualClock(1000);
+  IdlePolicy p;
+  p.busy();
+  p.plan(millis());
+  for (uint32_t t = 0; t <= IDLE_SCALE_AFTER_MS; t += 20) {
+    hostAdvance(20);
+    p.within(IDLE_MAX_SLEEP_MS);
+    p.plan(millis());
+  }
+  CHECK_EQ(p.wantedMhz(), IDLE_CPU_MHZ);
+}
+
+TEST(millis_rollover_keeps_the_timing) {
+  hostUseVirtualClock(0xFFFFFFFFu - 500);
+  IdlePolicy p;
+  p.busy();
+  p.plan(millis());
+  quiet(p, IDLE_SCALE_AFTER_MS - 20);
+  CHECK(millis() < IDLE_SCALE_AFTER_MS); // Wrapped
+  CHECK_EQ(p.wantedMhz(), ACTIVE_CPU_MHZ);
+  quiet(p, 40);
+  CHECK_EQ(p.wantedMhz(), IDLE_CPU_MHZ);
+}
+
+TEST(sleep_waits_the_plan_or_until_woken) {
+  hostUseVirtualClock(1000);
+  Idle.begin();
+  Idle.within(7);
+  unsigned long t0 = millis();
+  Idle.sleep();
+  CHECK_EQ(millis() - t0, 7);
+  CHECK_EQ(Idle.getMetrics().sleeps, 1);
+  CHECK_EQ(Idle.getMetrics().late, 0);
+
+  Idle.wake(); // Before the wait: no wait at all
+  t0 = millis();
+  Idle.sleep();
+  CHECK_EQ(millis() - t0, 0);
+  CHECK_EQ(Idle.getMetrics().eventWakeups, 1);
+
+  Idle.busy(); // Still one tick, like delay(1)
+  t0 = millis();
+  Idle.sleep();
+  CHECK_EQ(millis() - t0, 1);
+}
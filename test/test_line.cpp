@@ -0,0 +1,215 @@
+// Line-quality analyzer against the emulated unit: noise, late replies,
+// a dead line and our own echo, and how each one is scored
+#include "host.h"
+#include "s21_unit.h"
+#include "src/daikin/daikin_state.h"
+#include "src/daikin/s21_commands.h"
+#include "src/daikin/s21_driver.h"
+#include "src/daikin/s21_frame.h"
+#include "src/daikin/s21_line.h"
+#include "test.h"
+
+static S21Unit unit;
+
+static void run(uint32_t ms) {
+  for (uint32_t i = 0; i < ms; i++) {
+    S21.loop();
+    hostAdvance(1);
+  }
+}
+
+// Fresh unit, driver and monitor, handshake done, then a window that
+// starts clean
+static void boot() {
+  hostUseVirtualClock(1000);
+  srand(1);
+  unit = S21Unit();
+  unit.attach();
+  S21.restart();
+  Commands = S21CommandQueue();
+  S21.begin();
+  for (int i = 0; i < 5000 && !S21.isReady(); i++)
+    run(1);
+  CHECK(S21.isReady());
+  run(500); // Handshake replies
+  Line = S21LineMonitor();
+  Line.begin();
+}
+
+// A client polling every 2 s for `ms`
+static void poll(uint32_t ms) {
+  for (uint32_t t = 0; t < ms; t += 2000) {
+    S21.requestPoll();
+    run(2000);
+  }
+}
+
+// A frame around `payload`, its checksum off by `damage`
+static std::string frame(const char *payload, uint8_t damage = 0) {
+  std::string f = "\x02";
+  uint8_t sum = 0;
+  for (const char *p = payload; *p; p++) {
+    f += *p;
+    sum += *p;
+  }
+  f += (char)(s21FixChecksum(sum) + damage);
+  f += '\x03';
+  return f;
+}
+
+static void inject(const std::string &f) {
+  unit.inject((const uint8_t *)f.data(), f.size());
+}
+
+TEST(clean_line_is_good) {
+  boot();
+  CHECK_EQ(Line.current().verdict, S21_LINE_IDLE);
+  CHECK_EQ(Line.current().score, 255);
+  poll(20000);
+  S21LineScore s = Line.current();
+  CHECK_EQ(s.verdict, S21_LINE_GOOD);
+  CHECK_EQ(s.score, 100);
+
+  const S21LineCounters &c = Line.totals();
+  CHECK(c.sent >= 40);
+  CHECK_EQ(c.acks, c.sent);
+  CHECK_EQ(c.replies, c.sent);
+  CHECK_EQ(c.timeouts, 0);
+  CHECK_EQ(c.slowReplies, 0);
+  CHECK_EQ(c.badFrames, 0);
+  CHECK_EQ(c.uartErrorTotal(), 0);
+  CHECK_EQ(Line.eventCount(), 0);
+
+  // Every request read back intact, and none taken for a reply
+  CHECK_EQ(c.echoes, c.sent);
+  CHECK_EQ(c.echoMismatches, 0);
+  CHECK_EQ(c.echoBytes, c.txBytes);
+  CHECK_EQ(c.frames, c.replies);
+  CHECK_STR(Line.echoMode(), "full");
+
+  // Measured from the end of the request, as the unit was set up
+  CHECK_NEAR(Line.ackLatency().averageMs(), unit.ackDelayMs, 2);
+  CHECK_NEAR(Line.replyLatency().averageMs(),
+             unit.ackDelayMs + unit.replyDelayMs, 2);
+  CHECK_EQ(Line.replyLatency().buckets[1], c.replies); // 10-25 ms
+}
+
+TEST(late_replies_are_slow) {
+  boot();
+  unit.replyDelayMs = 200;
+  poll(20000);
+  const S21LineCounters &c = Line.totals();
+  CHECK(c.replies >= 40);
+  CHECK_EQ(c.timeouts, 0);
+  CHECK_EQ(c.slowReplies, c.replies);
+  CHECK(Line.replyLatency().maxMs > S21_SLOW_REPLY_MS);
+  CHECK_EQ(Line.replyLatency().buckets[5], c.replies); // 150-300 ms
+  S21LineScore s = Line.current();
+  CHECK_EQ(s.verdict, S21_LINE_SLOW);
+  CHECK_EQ(s.score, 90); // All slow: the full 10 points
+}
+
+// Nothing but our own echo comes back: the echo is no sign of a unit
+TEST(dead_line_is_no_reply) {
+  boot();
+  unit.silent = true;
+  poll(10000);
+  const S21LineCounters &c = Line.totals();
+  CHECK(c.sent > 0);
+  CHECK_EQ(c.echoes, c.sent);
+  CHECK_EQ(c.frames, 0);
+  CHECK_EQ(c.acks, 0);
+  CHECK_EQ(c.replies, 0);
+  CHECK(c.timeouts > 0);
+  S21LineScore s = Line.current();
+  CHECK_EQ(s.verdict, S21_LINE_NO_REPLY);
+  CHECK_EQ(s.score, 0);
+}
+
+TEST(noise_is_noisy) {
+  boot();
+  unit.noisePerMille = 20;
+  poll(20000);
+  const S21LineCounters &c = Line.totals();
+  CHECK(c.uartErrors[S21_UART_PARITY] > 0);
+  CHECK_EQ(c.uartErrorTotal(), c.uartErrors[S21_UART_PARITY]);
+  CHECK(c.badFrames + c.echoMismatches > 0);
+  CHECK(Line.eventCount() > 0);
+  if (Line.eventCount() > 0) {
+    CHECK_EQ(Line.event(0).type, S21_UART_PARITY);
+    CHECK(Line.event(0).framePos < 16);
+  }
+  S21LineScore s = Line.current();
+  CHECK_EQ(s.verdict, S21_LINE_NOISY); // Even with the timeouts it causes
+  CHECK(s.score < 90);
+}
+
+// A corrupted reply must not reach the state
+TEST(bad_checksum_is_dropped) {
+  boot();
+  CHECK(State.power);
+  inject(frame("G10\x33\x50\x33", 1)); // Power off, checksum wrong
+  run(100);
+  CHECK_EQ(Line.totals().frames, 1);
+  CHECK_EQ(Line.totals().badFrames, 1);
+  CHECK(State.power);
+
+  inject(frame("G10\x33\x50\x33"));
+  run(100);
+  CHECK_EQ(Line.totals().frames, 2);
+  CHECK_EQ(Line.totals().badFrames, 1);
+  CHECK(!State.power);
+}
+
+TEST(frame_validation) {
+  std::string good = frame("G1\x31\x33\x50\x33");
+  const uint8_t *g = (const uint8_t *)good.data();
+  CHECK(S21LineMonitor::frameValid(g, good.size()));
+  CHECK(!S21LineMonitor::frameValid(g, good.size() - 1)); // No ETX
+  CHECK(!S21LineMonitor::frameValid(g + 1, good.size() - 1)); // No STX
+  std::string bad = frame("G1\x31\x33\x50\x33", 1);
+  CHECK(!S21LineMonitor::frameValid((const uint8_t *)bad.data(), bad.size()));
+  CHECK(!S21LineMonitor::frameValid((const uint8_t *)"\x02\x03", 2));
+
+  // A sum of ETX is sent as 0x05
+  std::string etx = frame("\x01\x02");
+  CHECK_EQ((uint8_t)etx[3], 0x05);
+  CHECK(S21LineMonitor::frameValid((const uint8_t *)etx.data(), etx.size()));
+}
+
+// A frame of our request's length right after it is the echo, garbled:
+// a wiring fault, not a reply or a bad frame
+TEST(garbled_echo_is_rejected) {
+  boot();
+  unit.echo = false;
+  uint32_t before = unit.requests;
+  S21.requestPoll();
+  while (unit.requests == before)
+    run(1);
+  inject(frame("F\x71")); // F1 with a flipped bit
+  while (S21.isPolling())
+    run(1);
+  const S21LineCounters &c = Line.totals();
+  CHECK_EQ(c.echoMismatches, 1);
+  CHECK_EQ(c.echoes, 0);
+  CHECK_EQ(c.badFrames, 0);
+  CHECK_EQ(c.replies, c.sent); // The unit's answers still got through
+  CHECK_EQ(Line.current().verdict, S21_LINE_NOISY);
+}
+
+TEST(windows_keep_their_score) {
+  boot();
+  poll(S21_LINE_WINDOW_MS);
+  unit.noisePerMille = 20;
+  poll(S21_LINE_WINDOW_MS);
+  unit.noisePerMille = 0;
+  unit.silent = true;
+  poll(S21_LINE_WINDOW_MS);
+  run(1); // The last window closes
+  CHECK_EQ(Line.historyCount(), 3);
+  CHECK_EQ(Line.history(2).verdict, S21_LINE_GOOD);
+  CHECK_EQ(Line.history(1).verdict, S21_LINE_NOISY);
+  CHECK_EQ(Line.history(0).verdict, S21_LINE_NO_REPLY);
+  // Totals span all of them
+  CHECK(Line.totals().uartErrorTotal() > 0);
+}
@@ -0,0 +1,34 @@
+#include "test.h"
+
+static TestCase *g_first = nullptr;
+static TestCase *g_last = nullptr;
+int testFailures = 0;
+
+TestCase::TestCase(const char *name, void (*run)())
+    : name(name), run(run), next(nullptr) {
+  if (g_last)
+    g_last->next = this;
+  else
+    g_first = this;
+  g_last = this;
+}
+
+// Runs every case, or the ones named on the command line
+int main(int argc, char **argv) {
+  int failed = 0, ran = 0;
+  for (TestCase *t = g_first; t; t = t->next) {
+    bool wanted = argc < 2;
+    for (int i = 1; i < argc; i++)
+      wanted = wanted || strcmp(argv[i], t->name) == 0;
+    if (!wanted)
+      continue;
+    testFailures = 0;
+    t->run();
+    ran++;
+    printf("%s %s\n", testFailures ? "FAIL" : "ok  ", t->name);
+    if (testFailures)
+      failed++;
+  }
+  printf("%d/%d passed\n", ran - failed, ran);
+  return failed;
+}
@@ -0,0 +1,160 @@
+// MQTT bridge against the in-process broker: /set topics through the
+// command table, nothing sent for an invalid value
+#include "host.h"
+#include "src/daikin/s21_commands.h"
+#include "src/net/mqtt_bridge.h"
+#include "test.h"
+
+#define BASE "daikin/daikin_da1c21" // From the host MAC
+
+static void connect() {
+  hostUseVirtualClock(1000);
+  hostSetWifiStatus(WL_CONNECTED);
+  hostMqttDisconnect();
+  hostMqtt() = HostMqtt();
+  Commands = S21CommandQueue();
+  Mqtt.begin("Test");
+  Mqtt.loop();
+  CHECK(Mqtt.isConnected());
+}
+
+// The command a message submitted, nullptr if none
+static const S21Command *deliver(const char *topic, const char *payload) {
+  uint32_t last = Commands.lastId();
+  hostSerialOutput().clear();
+  hostMqttDeliver(topic, payload);
+  return Commands.lastId() != last ? Commands.find(Commands.lastId())
+                                   : nullptr;
+}
+
+static bool logged(const char *text) {
+  return hostSerialOutput().find(text) != std::string::npos;
+}
+
+TEST(subscribes_to_the_set_topics) {
+  connect();
+  CHECK_EQ(hostMqtt().subscriptions.size(), 1);
+  CHECK_STR(hostMqtt().subscriptions[0].c_str(), BASE "/+/set");
+  CHECK(hostMqtt().retained[BASE "/status"] == "online");
+}
+
+TEST(mode_turns_the_unit_on) {
+  connect();
+  const S21Command *c = deliver(BASE "/mode/set", "cool");
+  CHECK(c != nullptr);
+  if (c) {
+    CHECK(c->power);
+    CHECK_EQ(c->mode, 3);
+  }
+  c = deliver(BASE "/mode/set", "fan_only");
+  CHECK(c && c->power && c->mode == 6);
+  c = deliver(BASE "/mode/set", "off");
+  CHECK(c && !c->power && c->mode == 6); // Mode kept
+}
+
+TEST(target_and_fan) {
+  connect();
+  const S21Command *c = deliver(BASE "/target_temp/set", "22.5");
+  CHECK(c != nullptr);
+  if (c)
+    CHECK_NEAR(c->temp, 22.5, 0.01);
+  c = deliver(BASE "/fan/set", "silent");
+  CHECK(c && c->fan == 11);
+  c = deliver(BASE "/fan/set", "3");
+  CHECK(c && c->fan == 3);
+}
+
+TEST(swing_modes) {
+  connect();
+  const S21Command *c = deliver(BASE "/swing/set", "both");
+  CHECK(c && c->kind == S21_CMD_SWING && c->swingV && c->swingH);
+  c = deliver(BASE "/swing/set", "horizontal");
+  CHECK(c && !c->swingV && c->swingH);
+  c = deliver(BASE "/swing/set", "off");
+  CHECK(c && !c->swingV && !c->swingH);
+}
+
+TEST(invalid_values_are_logged_not_sent) {
+  connect();
+  CHECK(deliver(BASE "/target_temp/set", "abc") == nullptr);
+  CHECK(logged("Invalid argument (malformed)"));
+  CHECK(deliver(BASE "/target_temp/set", "99") == nullptr);
+  CHECK(logged("out of range 10.0-32.0"));
+  CHECK(deliver(BASE "/fan/set", "99") == nullptr);
+  CHECK(logged("one of 1, 2, 3, 4, 5, auto, silent"));
+  // Before, an unknown mode still turned the unit on
+  CHECK(deliver(BASE "/mode/set", "turbo") == nullptr);
+  CHECK(logged("Invalid argument"));
+  CHECK(deliver(BASE "/swing/set", "diagonal") == nullptr);
+  CHECK(logged("unknown swing mode"));
+  CHECK(deliver(BASE "/target_temp/set", "22.000000000000001") == nullptr);
+  CHECK(logged("too long"));
+  CHECK(deliver(BASE "/power/set", "on") == nullptr);
+  CHECK(logged("Unknown command topic"));
+  CHECK_EQ(Commands.getStats().submitted, 0);
+}
+
+TEST(command_status_is_published) {
+  connect();
+  hostMqtt().published.clear();
+  const S21Command *c = deliver(BASE "/mode/set", "heat");
+  CHECK(c != nullptr);
+  bool found = false;
+  for (const auto &m : hostMqtt().published) {
+    if (m.first == BASE "/command")
+      found = found || m.second.find("\"status\":\"queued\"") !=
+                           std::string::npos;
+  }
+  CHECK(found);
+}
+
+// Loop at 10 ms steps for `ms` of virtual time (connect() moves it too)
+static void runLoop(uint32_t ms) {
+  uint32_t end = millis() + ms;
+  while ((int32_t)(millis() - end) < 0) {
+    Mqtt.loop();
+    hostAdvance(10);
+  }
+}
+
+TEST(unreachable_broker_backs_off) {
+  connect();
+  hostMqttDisconnect();
+  hostMqtt().reachable = false;
+  hostMqtt().blackhole = true; // Every attempt runs into the timeout
+  hostMqtt().connects = 0;
+  runLoop(10 * 60 * 1000);
+
+  // 2s doubling to 60s: about 6 attempts to reach the cap, then one a
+  // minute. A fixed 5s retry would have made 120.
+  CHECK(hostMqtt().connects >= 10);
+  CHECK(hostMqtt().connects <= 20);
+  CHECK_EQ(hostMqtt().blockedMs, hostMqtt().connects * 1000);
+  CHECK(hostMqtt().blockedMs < 10 * 60 * 1000 / 20); // Under 5% of the time
+  CHECK(!Mqtt.isConnected());
+
+  // Back within one capped delay once the broker returns
+  hostMqtt().reachable = true;
+  hostMqtt().blackhole = false;
+  runLoop(MQTT_BACKOFF_MAX_MS * 5 / 4 + 100);
+  CHECK(Mqtt.isConnected());
+}
+
+TEST(dropped_connection_reconnects_quickly) {
+  connect();
+  uint32_t connects = hostMqtt().connects;
+  hostMqttDisconnect();
+  runLoop(MQTT_BACKOFF_MIN_MS * 5 / 4 + 100);
+  CHECK(Mqtt.isConnected());
+  CHECK_EQ(hostMqtt().connects, connects + 1);
+}
+
+TEST(no_attempts_without_wifi) {
+  connect();
+  hostMqttDisconnect();
+  hostSetWifiStatus(WL_DISCONNECTED);
+  uint32_t connects = hostMqtt().connects;
+  runLoop(60000);
+  CHECK_EQ(hostMqtt().connects, connects);
+  hostSetWifiStatus(WL_CONNECTED);
+}
@@ -0,0 +1,520 @@
+// PayloadWriter: JSON, CBOR and MessagePack decoded back and compared, and
+// the /status map's size and encode time in each format
+#include <chrono>
+#include <math.h>
+#include <string>
+#include <vector>
+
+#include "host.h"
+#include "src/daikin/daikin_state.h"
+#include "src/web/payload_writer.h"
+#include "test.h"
+
+// From the sketch
+void writeStatus(PayloadWriter &w, bool stale);
+extern char splitName[];
+
+static const PayloadFormat FORMATS[] = {FORMAT_JSON, FORMAT_CBOR,
+                                        FORMAT_MSGPACK};
+static const char *const FORMAT_NAMES[] = {"json", "cbor", "msgpack"};
+
+// A decoded value; numbers of every format end up in num
+struct Value {
+  enum Type { INVALID, NUL, BOOL, NUM, STR, ARR, MAP } type = INVALID;
+  double num = 0;
+  std::string str;
+  std::vector<std::string> keys; // MAP
+  std::vector<Value> items;      // ARR, MAP (values)
+
+  const Value &operator[](const char *key) const {
+    static const Value missing;
+    for (size_t i = 0; i < keys.size(); i++)
+      if (keys[i] == key)
+        return items[i];
+    return missing;
+  }
+};
+
+// Each decoder reads one value from p and advances it; INVALID on a
+// malformed or truncated input
+struct Reader {
+  const uint8_t *p;
+  const uint8_t *end;
+  bool ok;
+
+  uint8_t byte() {
+    if (p >= end) {
+      ok = false;
+      return 0;
+    }
+    return *p++;
+  }
+  uint32_t be(uint8_t bytes) {
+    uint32_t v = 0;
+    while (bytes--)
+      v = v << 8 | byte();
+    return v;
+  }
+  std::string text(uint32_t n) {
+    if ((size_t)(end - p) < n) {
+      ok = false;
+      return "";
+    }
+    std::string s((const char *)p, n);
+    p += n;
+    return s;
+  }
+};
+
+static float floatBits(uint32_t bits) {
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+static Value cborValue(Reader &r) {
+  Value v;
+  uint8_t ib = r.byte();
+  uint8_t major = ib >> 5, info = ib & 0x1F;
+  if (major == 7) {
+    if (ib == 0xF4 || ib == 0xF5) {
+      v.type = Value::BOOL;
+      v.num = ib == 0xF5;
+    } else if (ib == 0xF6) {
+      v.type = Value::NUL;
+    } else if (ib == 0xFA) {
+      v.type = Value::NUM;
+      v.num = floatBits(r.be(4));
+    }
+    return v;
+  }
+  uint32_t arg = info < 24    ? info
+                 : info == 24 ? r.be(1)
+                 : info == 25 ? r.be(2)
+                 : info == 26 ? r.be(4)
+                              : (r.ok = false, 0);
+  switch (major) {
+  case 0:
+    v.type = Value::NUM;
+    v.num = arg;
+    break;
+  case 1:
+    v.type = Value::NUM;
+    v.num = -1.0 - arg;
+    break;
+  case 3:
+    v.type = Value::STR;
+    v.str = r.text(arg);
+    break;
+  case 4:
+    v.type = Value::ARR;
+    for (uint32_t i = 0; i < arg && r.ok; i++)
+      v.items.push_back(cborValue(r));
+    break;
+  case 5:
+    v.type = Value::MAP;
+    for (uint32_t i = 0; i < arg && r.ok; i++) {
+      Value k = cborValue(r);
+      if (k.type != Value::STR)
+        r.ok = false;
+      v.keys.push_back(k.str);
+      v.items.push_back(cborValue(r));
+    }
+    break;
+  default:
+    r.ok = false;
+  }
+  return v;
+}
+
+static Value msgpackValue(Reader &r) {
+  Value v;
+  uint8_t b = r.byte();
+  uint32_t n = 0;
+  if (b < 0x80 || b >= 0xE0) {
+    v.type = Value::NUM;
+    v.num = (int8_t)b;
+    if (b < 0x80)
+      v.num = b;
+    return v;
+  }
+  switch (b) {
+  case 0xC0:
+    v.type = Value::NUL;
+    return v;
+  case 0xC2:
+  case 0xC3:
+    v.type = Value::BOOL;
+    v.num = b == 0xC3;
+    return v;
+  case 0xCA:
+    v.type = Value::NUM;
+    v.num = floatBits(r.be(4));
+    return v;
+  case 0xCC:
+  case 0xCD:
+  case 0xCE:
+    v.type = Value::NUM;
+    v.num = r.be(1 << (b - 0xCC));
+    return v;
+  case 0xD0:
+    v.type = Value::NUM;
+    v.num = (int8_t)r.be(1);
+    return v;
+  case 0xD1:
+    v.type = Value::NUM;
+    v.num = (int16_t)r.be(2);
+    return v;
+  case 0xD2:
+    v.type = Value::NUM;
+    v.num = (int32_t)r.be(4);
+    return v;
+  case 0xD9:
+  case 0xDA:
+    v.type = Value::STR;
+    v.str = r.text(r.be(b == 0xD9 ? 1 : 2));
+    return v;
+  case 0xDC:
+    v.type = Value::ARR;
+    n = r.be(2);
+    break;
+  case 0xDE:
+    v.type = Value::MAP;
+    n = r.be(2);
+    break;
+  default:
+    if ((b & 0xE0) == 0xA0) {
+      v.type = Value::STR;
+      v.str = r.text(b & 0x1F);
+      return v;
+    }
+    v.type = (b & 0xF0) == 0x80 ? Value::MAP : Value::ARR;
+    n = b & 0x0F;
+    if ((b & 0xE0) != 0x80)
+      r.ok = false;
+  }
+  for (uint32_t i = 0; i < n && r.ok; i++) {
+    if (v.type == Value::MAP) {
+      Value k = msgpackValue(r);
+      if (k.type != Value::STR)
+        r.ok = false;
+      v.keys.push_back(k.str);
+    }
+    v.items.push_back(msgpackValue(r));
+  }
+  return v;
+}
+
+static void jsonSpace(Reader &r) {
+  while (r.p < r.end && *r.p && strchr(" \t\r\n", *r.p))
+    r.p++;
+}
+
+static bool jsonLiteral(Reader &r, const char *word) {
+  size_t n = strlen(word);
+  if ((size_t)(r.end - r.p) < n || memcmp(r.p, word, n) != 0)
+    return false;
+  r.p += n;
+  return true;
+}
+
+static std::string jsonString(Reader &r) {
+  std::string s;
+  if (r.byte() != '"')
+    r.ok = false;
+  while (r.ok) {
+    char c = r.byte();
+    if (c == '"')
+      break;
+    if (c == '\\') {
+      char e = r.byte();
+      if (e == 'u') {
+        std::string hex = r.text(4);
+        s += (char)strtoul(hex.c_str(), nullptr, 16);
+      } else if (e == '"' || e == '\\' || e == '/') {
+        s += e;
+      } else {
+        r.ok = false;
+      }
+    } else if ((uint8_t)c < 0x20) {
+      r.ok = false; // Must be escaped
+    } else {
+      s += c;
+    }
+  }
+  return s;
+}
+
+static Value jsonValue(Reader &r) {
+  Value v;
+  jsonSpace(r);
+  if (r.p >= r.end) {
+    r.ok = false;
+    return v;
+  }
+  char c = *r.p;
+  if (c == '{' || c == '[') {
+    r.p++;
+    v.type = c == '{' ? Value::MAP : Value::ARR;
+    char close = c == '{' ? '}' : ']';
+    jsonSpace(r);
+    if (r.p < r.end && *r.p == close) {
+      r.p++;
+      return v;
+    }
+    while (r.ok) {
+      if (v.type == Value::MAP) {
+        jsonSpace(r);
+        v.keys.push_back(jsonString(r));
+        jsonSpace(r);
+        if (r.byte() != ':')
+          r.ok = false;
+      }
+      v.items.push_back(jsonValue(r));
+      jsonSpace(r);
+      char sep = r.byte();
+      if (sep == close)
+        break;
+      if (sep != ',')
+        r.ok = false;
+    }
+  } else if (c == '"') {
+    v.type = Value::STR;
+    v.str = jsonString(r);
+  } else if (jsonLiteral(r, "true") || jsonLiteral(r, "false")) {
+    v.type = Value::BOOL;
+    v.num = c == 't';
+  } else if (jsonLiteral(r, "null")) {
+    v.type = Value::NUL;
+  } else {
+    std::string digits;
+    while (r.p < r.end && *r.p && strchr("-0123456789.eE+", *r.p))
+      digits += *r.p++;
+    char *stop;
+    v.num = strtod(digits.c_str(), &stop);
+    v.type = Value::NUM;
+    if (digits.empty() || *stop)
+      r.ok = false;
+  }
+  return v;
+}
+
+// The whole buffer as one value
+static Value decode(PayloadFormat format, const PayloadWriter &w) {
+  Reader r = {w.data(), w.data() + w.length(), true};
+  Value v = format == FORMAT_CBOR      ? cborValue(r)
+            : format == FORMAT_MSGPACK ? msgpackValue(r)
+                                       : jsonValue(r);
+  if (format == FORMAT_JSON)
+    jsonSpace(r);
+  if (!r.ok || r.p != r.end)
+    return Value();
+  return v;
+}
+
+static void setState() {
+  State.power = true;
+  State.mode = 3;
+  State.targetTemp = 24.5;
+  State.roomTemp = 22.25;
+  State.outsideTemp = -3.5;
+  State.fan = 10;
+  State.swingV = true;
+  State.swingH = false;
+  State.powerful = false;
+  State.econo = true;
+  State.coilTemp = 8;
+  State.fanRpm = 1240;
+  State.compressorFreq = 58;
+  State.energyKWh = 1234.56;
+}
+
+TEST(status_decodes_the_same_in_every_format) {
+  setState();
+  strcpy(splitName, "Sala \"nord\"\\1");
+  for (int f = 0; f < 3; f++) {
+    uint8_t buf[640];
+    PayloadWriter w(FORMATS[f], buf, sizeof(buf));
+    writeStatus(w, true);
+    CHECK(!w.overflow());
+    Value v = decode(FORMATS[f], w);
+    printf("  %s\n", FORMAT_NAMES[f]);
+    CHECK_EQ(v.type, Value::MAP);
+    CHECK_EQ(v.keys.size(), 18);
+    CHECK_EQ(v["power"].type, Value::BOOL);
+    CHECK_EQ(v["power"].num, 1);
+    CHECK_EQ(v["mode"].num, 3);
+    CHECK_NEAR(v["target_temp"].num, 24.5, 0.001);
+    CHECK_NEAR(v["room_temp"].num, 22.25, 0.001);
+    CHECK_NEAR(v["outside_temp"].num, -3.5, 0.001);
+    CHECK_EQ(v["fan"].num, 10);
+    CHECK_EQ(v["swing_v"].num, 1);
+    CHECK_EQ(v["swing_h"].num, 0);
+    CHECK_EQ(v["econo"].num, 1);
+    CHECK_NEAR(v["coil_temp"].num, 8, 0.001);
+    CHECK_EQ(v["fan_rpm"].num, 1240);
+    CHECK_EQ(v["compressor_freq"].num, 58);
+    CHECK_NEAR(v["energy_kwh"].num, 1234.56, 0.005); // JSON: 2 decimals
+    CHECK_EQ(v["stale"].type, Value::BOOL);
+    CHECK_EQ(v["stale"].num, 1);
+    CHECK_STR(v["split_name"].str.c_str(), "Sala \"nord\"\\1");
+    CHECK_STR(v["fw_version"].str.c_str(), FW_VERSION);
+  }
+  strcpy(splitName, "NomeSplit");
+}
+
+// Every width of every integer, string and container header
+static const int32_t INTS[] = {0,    1,      23,     24,     127,    128,
+                               255,  256,    65535,  65536,  -1,     -24,
+                               -25,  -32,    -33,    -128,   -129,   -256,
+                               -257, -32768, -32769, -65536, -65537, INT32_MIN,
+                               INT32_MAX};
+static const uint32_t UINTS[] = {0xFFFF, 0x10000, 0xFFFFFFFF};
+static const size_t STRING_LENGTHS[] = {0, 23, 24, 31, 32, 255, 256, 300};
+
+TEST(every_encoding_width_round_trips) {
+  static uint8_t buf[4096];
+  for (int f = 0; f < 3; f++) {
+    printf("  %s\n", FORMAT_NAMES[f]);
+    PayloadWriter w(FORMATS[f], buf, sizeof(buf));
+    size_t nInts = sizeof(INTS) / sizeof(INTS[0]);
+    size_t nUInts = sizeof(UINTS) / sizeof(UINTS[0]);
+    size_t nStrings = sizeof(STRING_LENGTHS) / sizeof(STRING_LENGTHS[0]);
+    std::vector<std::string> strings;
+    for (size_t i = 0; i < nStrings; i++)
+      strings.push_back(std::string(STRING_LENGTHS[i], 'a' + i));
+
+    w.beginMap(20);
+    w.key("ints");
+    w.beginArray(nInts);
+    for (size_t i = 0; i < nInts; i++)
+      w.addInt(INTS[i]);
+    w.end();
+    w.key("uints");
+    w.beginArray(nUInts);
+    for (size_t i = 0; i < nUInts; i++)
+      w.addUInt(UINTS[i]);
+    w.end();
+    w.key("strings");
+    w.beginArray(nStrings);
+    for (size_t i = 0; i < nStrings; i++)
+      w.addString(strings[i].c_str());
+    w.end();
+    w.key("floats");
+    w.beginArray(3);
+    w.addFloat(-0.25);
+    w.addFloat(1e6);
+    w.addFloat(NAN);
+    w.end();
+    w.key("escaped");
+    w.addString("tab\tnl\n\x01");
+    w.key("none");
+    w.addNull();
+    w.key("empty");
+    w.beginArray(0);
+    w.end();
+    for (int i = 7; i < 20; i++) { // Past the 15 of a fixmap
+      char k[8];
+      snprintf(k, sizeof(k), "k%d", i);
+      w.key(k);
+      w.addBool(i % 2);
+    }
+    w.end();
+    CHECK(!w.overflow());
+
+    Value v = decode(FORMATS[f], w);
+    CHECK_EQ(v.type, Value::MAP);
+    CHECK_EQ(v.keys.size(), 20);
+    CHECK_EQ(v["ints"].items.size(), nInts);
+    for (size_t i = 0; i < nInts && i < v["ints"].items.size(); i++)
+      CHECK_EQ(v["ints"].items[i].num, INTS[i]);
+    CHECK_EQ(v["uints"].items.size(), nUInts);
+    for (size_t i = 0; i < nUInts && i < v["uints"].items.size(); i++)
+      CHECK_EQ(v["uints"].items[i].num, UINTS[i]);
+    CHECK_EQ(v["strings"].items.size(), nStrings);
+    for (size_t i = 0; i < nStrings && i < v["strings"].items.size(); i++)
+      CHECK(v["strings"].items[i].str == strings[i]);
+    const Value &floats = v["floats"];
+    CHECK_EQ(floats.items.size(), 3);
+    if (floats.items.size() == 3) {
+      CHECK_NEAR(floats.items[0].num, -0.25, 0.001);
+      CHECK_NEAR(floats.items[1].num, 1e6, 0.001);
+      if (FORMATS[f] == FORMAT_JSON) // No NaN in JSON
+        CHECK_EQ(floats.items[2].type, Value::NUL);
+      else
+        CHECK(isnan(floats.items[2].num));
+    }
+    CHECK_STR(v["escaped"].str.c_str(), "tab\tnl\n\x01");
+    CHECK_EQ(v["none"].type, Value::NUL);
+    CHECK_EQ(v["empty"].type, Value::ARR);
+    CHECK_EQ(v["empty"].items.size(), 0);
+    CHECK_EQ(v["k19"].num, 1);
+  }
+}
+
+TEST(full_buffer_stops_and_flags) {
+  for (int f = 0; f < 3; f++) {
+    uint8_t buf[40];
+    memset(buf, 0xEE, sizeof(buf));
+    PayloadWriter w(FORMATS[f], buf, 32);
+    writeStatus(w, false);
+    CHECK(w.overflow());
+    CHECK(w.length() <= 32);
+    CHECK_EQ(buf[32], 0xEE);
+  }
+}
+
+TEST(format_from_the_query_or_accept) {
+  CHECK_EQ(negotiateFormat("cbor", nullptr), FORMAT_CBOR);
+  CHECK_EQ(negotiateFormat("msgpack", "application/cbor"), FORMAT_MSGPACK);
+  CHECK_EQ(negotiateFormat("json", "application/cbor"), FORMAT_JSON);
+  CHECK_EQ(negotiateFormat("xml", nullptr), FORMAT_JSON);
+  CHECK_EQ(negotiateFormat("", "application/cbor"), FORMAT_CBOR);
+  CHECK_EQ(negotiateFormat(nullptr, "application/x-msgpack"), FORMAT_MSGPACK);
+  CHECK_EQ(negotiateFormat(nullptr, "*/*"), FORMAT_JSON);
+  CHECK_EQ(negotiateFormat(nullptr, nullptr), FORMAT_JSON);
+  CHECK_STR(formatContentType(FORMAT_CBOR), "application/cbor");
+  CHECK_STR(formatContentType(FORMAT_MSGPACK), "application/msgpack");
+  CHECK_STR(formatContentType(FORMAT_JSON), "application/json");
+}
+
+// Best of a few rounds, in nanoseconds per encode
+static double encodeNs(PayloadFormat format, size_t &length) {
+  const int ROUNDS = 5, ENCODES = 20000;
+  double best = 1e30;
+  for (int round = 0; round < ROUNDS; round++) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ENCODES; i++) {
+      uint8_t buf[640];
+      PayloadWriter w(format, buf, sizeof(buf));
+      writeStatus(w, false);
+      length = w.length();
+      asm volatile("" : : "r"(buf) : "memory"); // Keep the encode
+    }
+    double ns = std::chrono::duration<double, std::nano>(
+                    std::chrono::steady_clock::now() - start)
+                    .count() /
+                ENCODES;
+    if (ns < best)
+      best = ns;
+  }
+  return best;
+}
+
+// The benchmark: the binary maps drop the quoting, separators and decimal
+// text, so they are smaller and cheaper to encode than the JSON
+TEST(binary_status_is_smaller_and_faster) {
+  setState();
+  size_t length[3];
+  double ns[3];
+  for (int f = 0; f < 3; f++) {
+    ns[f] = encodeNs(FORMATS[f], length[f]);
+    printf("  %-8s %4zu bytes %7.0f ns/encode\n", FORMAT_NAMES[f], length[f],
+           ns[f]);
+  }
+  for (int f = 1; f < 3; f++) {
+    CHECK(length[f] * 100 < length[FORMAT_JSON] * 85);
+    // Loose: the host may be busy with other tests
+    CHECK(ns[f] < ns[FORMAT_JSON] * 1.5);
+  }
+}
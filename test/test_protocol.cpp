@@ -0,0 +1,140 @@
+// What the handshake learns about the unit: G8/GY, the codec picked for
+// that version (built with S21_HALF_CELSIUS_MIN_MAJOR=3), and the poll
+// queries the unit doesn't have
+#include "host.h"
+#include "s21_unit.h"
+#include "src/daikin/s21_codec.h"
+#include "src/daikin/s21_commands.h"
+#include "src/daikin/s21_driver.h"
+#include "src/daikin/s21_queries.h"
+#include "test.h"
+
+static S21Unit unit;
+
+static void run(uint32_t ms) {
+  for (uint32_t i = 0; i < ms; i++) {
+    S21.loop();
+    hostAdvance(1);
+  }
+}
+
+static bool waitReady() {
+  for (int i = 0; i < 10000 && !S21.isReady(); i++)
+    run(1);
+  return S21.isReady();
+}
+
+// Fresh unit reporting these versions, handshake done
+static void boot(const char *g8, const char *gy) {
+  hostUseVirtualClock(1000);
+  unit = S21Unit();
+  unit.g8 = g8;
+  unit.gy = gy;
+  unit.attach();
+  S21.restart();
+  Commands = S21CommandQueue();
+  S21.begin();
+  CHECK(waitReady());
+}
+
+static void pollCycle() {
+  S21.requestPoll();
+  for (int i = 0; i < 5000 && S21.isPolling(); i++)
+    run(1);
+  CHECK(!S21.isPolling());
+}
+
+// D1 temperature byte sent for 22.0C
+static uint8_t sentTemp() {
+  DaikinCommand cmd = {};
+  cmd.hasPower = cmd.hasMode = cmd.hasTemp = true;
+  cmd.power = true;
+  cmd.mode = 3;
+  cmd.temp = 22.0;
+  uint32_t id = Commands.submit(cmd);
+  for (int i = 0; i < 5000 && !Commands.find(id)->isDone(); i++)
+    run(1);
+  return Commands.find(id)->payload[2];
+}
+
+TEST(g8_and_gy_give_the_version) {
+  boot("0300", "0230");
+  CHECK_EQ(Protocol.major(), 3);
+  CHECK_EQ(Protocol.version(), 320);
+  CHECK_EQ(unit.asked["FY"], 1);
+}
+
+TEST(gy_nak_leaves_the_major_version) {
+  boot("0200", ""); // Answers FY with NAK
+  CHECK_EQ(Protocol.major(), 2);
+  CHECK_EQ(Protocol.version(), 0);
+}
+
+TEST(garbage_g8_reads_as_unknown) {
+  boot("0X00", "");
+  CHECK_EQ(Protocol.major(), 0);
+  CHECK_STR(Protocol.codec().name, "fahrenheit");
+}
+
+// Used to resend FY forever, the handshake never finished
+TEST(unit_silent_on_fy_still_comes_up) {
+  hostUseVirtualClock(1000);
+  unit = S21Unit();
+  unit.g8 = "0200";
+  unit.ignored.insert("FY");
+  unit.attach();
+  S21.restart();
+  S21.begin();
+  CHECK(waitReady());
+  CHECK_EQ(unit.asked["FY"], 1);
+  CHECK_EQ(unit.asked["F2"], 1);
+  CHECK_EQ(Protocol.major(), 2);
+}
+
+TEST(codec_follows_the_version) {
+  CHECK_STR(S21Protocol::codecFor(0).name, "fahrenheit");
+  CHECK_STR(S21Protocol::codecFor(2).name, "fahrenheit");
+  CHECK_STR(S21Protocol::codecFor(3).name, "half-celsius");
+  CHECK_STR(S21Protocol::codecFor(4).name, "half-celsius");
+
+  boot("0200", "");
+  CHECK_STR(Protocol.codec().name, "fahrenheit");
+  CHECK_EQ(sentTemp(), 71); // 71.6F, truncated
+  CHECK_EQ(unit.g1[2], 71);
+
+  boot("0300", "0230");
+  CHECK_STR(Protocol.codec().name, "half-celsius");
+  CHECK_EQ(sentTemp(), 'H'); // '@' = 18C, 0.5C steps
+  CHECK_EQ(unit.g1[2], 'H');
+}
+
+TEST(gy_wins_over_g8) {
+  boot("0200", "0230");
+  CHECK_EQ(Protocol.major(), 3);
+  CHECK_STR(Protocol.codec().name, "half-celsius");
+}
+
+TEST(naked_queries_are_skipped_until_the_next_handshake) {
+  boot("0300", "0230");
+  unit.unsupported = {"RL", "Rd"};
+  for (int i = 0; i < 8 * S21_SLOW_POLL_DIVIDER; i++)
+    pollCycle();
+  CHECK_EQ(Protocol.unsupportedCount(), 2);
+  CHECK_EQ(unit.asked["RL"], 2); // One NAK can be a glitch, two can't
+  CHECK_EQ(unit.asked["Rd"], 2);
+
+  uint32_t meter = unit.asked["FM"];
+  for (int i = 0; i < 8 * S21_SLOW_POLL_DIVIDER; i++)
+    pollCycle();
+  CHECK_EQ(unit.asked["RL"], 2);
+  CHECK_EQ(unit.asked["Rd"], 2);
+  CHECK(unit.asked["FM"] > meter); // The rest still polled
+
+  // Could be another unit after a restart: ask again
+  S21.restart();
+  CHECK(waitReady());
+  CHECK_EQ(Protocol.unsupportedCount(), 0);
+  for (int i = 0; i < 2 * S21_SLOW_POLL_DIVIDER; i++)
+    pollCycle();
+  CHECK(unit.asked["RL"] > 2);
+}
@@ -0,0 +1,94 @@
+// Token buckets per client and route class, and the shared bus poll
+// budget, on the virtual clock
+#include "host.h"
+#include "src/web/rate_limiter.h"
+#include "test.h"
+
+#define CLIENT_A 0x0A00000A
+#define CLIENT_B 0x0A00000B
+
+// Requests admitted out of one every `stepMs` for `ms`
+static uint32_t hammer(RateLimiter &l, uint32_t ip, RateClass cls,
+                       uint32_t ms, uint32_t stepMs) {
+  uint32_t admitted = 0;
+  uint32_t retry;
+  for (uint32_t t = 0; t < ms; t += stepMs) {
+    admitted += l.admit(ip, cls, retry);
+    hostAdvance(stepMs);
+  }
+  return admitted;
+}
+
+TEST(burst_then_the_sustained_rate) {
+  hostUseVirtualClock(1000);
+  RateLimiter l;
+  uint32_t retry = 0;
+  for (int i = 0; i < RATE_READ_BURST; i++)
+    CHECK(l.admit(CLIENT_A, RATE_CLASS_READ, retry));
+  CHECK(!l.admit(CLIENT_A, RATE_CLASS_READ, retry));
+  CHECK_EQ(retry, 60 / RATE_READ_PER_MIN);
+  CHECK_EQ(l.getStats().limited[RATE_CLASS_READ], 1);
+
+  // Ten minutes at 10 requests/s: the refill rate and nothing more
+  uint32_t admitted = hammer(l, CLIENT_A, RATE_CLASS_READ, 600000, 100);
+  CHECK_NEAR(admitted, 10 * RATE_READ_PER_MIN, 1);
+}
+
+// Calls every millisecond must not round the refill away
+TEST(frequent_calls_keep_the_refill) {
+  hostUseVirtualClock(1000);
+  RateLimiter l;
+  uint32_t admitted = hammer(l, CLIENT_A, RATE_CLASS_WRITE, 60000, 1);
+  CHECK_NEAR(admitted, RATE_WRITE_BURST + RATE_WRITE_PER_MIN, 1);
+}
+
+TEST(classes_and_clients_are_separate) {
+  hostUseVirtualClock(1000);
+  RateLimiter l;
+  uint32_t retry;
+  hammer(l, CLIENT_A, RATE_CLASS_WRITE, RATE_WRITE_BURST + 1, 1);
+  CHECK(!l.admit(CLIENT_A, RATE_CLASS_WRITE, retry));
+  CHECK(l.admit(CLIENT_A, RATE_CLASS_READ, retry));
+  CHECK(l.admit(CLIENT_B, RATE_CLASS_WRITE, retry));
+  CHECK(l.admit(CLIENT_A, RATE_CLASS_NONE, retry)); // Never limited
+  CHECK_EQ(l.clientCount(), 2);
+}
+
+TEST(least_recently_seen_client_is_forgotten) {
+  hostUseVirtualClock(1000);
+  RateLimiter l;
+  uint32_t retry;
+  hammer(l, CLIENT_A, RATE_CLASS_WRITE, RATE_WRITE_BURST, 1);
+  CHECK(!l.admit(CLIENT_A, RATE_CLASS_WRITE, retry));
+  for (uint32_t i = 1; i <= RATE_MAX_CLIENTS; i++) {
+    hostAdvance(1);
+    l.admit(CLIENT_B + i, RATE_CLASS_READ, retry);
+  }
+  CHECK_EQ(l.clientCount(), RATE_MAX_CLIENTS);
+  CHECK_EQ(l.getStats().forgotten, 1);
+  // A forgotten client starts over with a full bucket
+  CHECK(l.admit(CLIENT_A, RATE_CLASS_WRITE, retry));
+}
+
+TEST(bus_polls_share_one_budget) {
+  hostUseVirtualClock(1000);
+  RateLimiter l;
+  int polls = 0;
+  for (int i = 0; i < 10; i++)
+    polls += l.takeBusPoll();
+  CHECK_EQ(polls, RATE_BUS_POLL_BURST);
+  CHECK_EQ(l.getStats().degraded, 10 - RATE_BUS_POLL_BURST);
+
+  hostAdvance(60000 / RATE_BUS_POLLS_PER_MIN);
+  CHECK(l.takeBusPoll());
+  CHECK(!l.takeBusPoll());
+  CHECK_EQ(l.getStats().busPolls, RATE_BUS_POLL_BURST + 1);
+}
+
+TEST(millis_rollover) {
+  hostUseVirtualClock(0xFFFFFFFFu - 30000);
+  RateLimiter l;
+  uint32_t admitted = hammer(l, CLIENT_A, RATE_CLASS_READ, 120000, 100);
+  CHECK(millis() < 120000); // Wrapped
+  CHECK_NEAR(admitted, RATE_READ_BURST + 2 * RATE_READ_PER_MIN, 1);
+}
@@ -0,0 +1,204 @@
+// Weekly schedule on an accelerated clock: the wall clock and millis()
+// move together, days pass in a fraction of a second
+#include "host.h"
+#include "src/daikin/daikin_state.h"
+#include "src/daikin/s21_commands.h"
+#include "src/system/clock.h"
+#include "src/system/scheduler.h"
+#include "test.h"
+#include <vector>
+
+#define MONDAY 1704067200 // 2024-01-01 00:00 UTC
+#define MIN 60
+#define HOUR (60 * MIN)
+#define DAY (24 * HOUR)
+
+static time_t g_wall = MONDAY;
+static time_t wallClock() { return g_wall; }
+
+struct Fired {
+  uint16_t minuteOfWeek; // When it was submitted
+  const S21Command *cmd;
+};
+
+static void start(time_t wall, uint32_t millisAt = 1000) {
+  setenv("TZ", "UTC0", 1);
+  tzset();
+  hostUseVirtualClock(millisAt);
+  setClockSource(wallClock);
+  g_wall = wall;
+  Schedule.clear();
+  State = DaikinState();
+}
+
+// Runs Schedule.loop() every `step` seconds; returns the commands it sent
+static std::vector<Fired> run(uint32_t seconds, uint32_t step = 1) {
+  std::vector<Fired> fired;
+  for (uint32_t t = 0; t < seconds; t += step) {
+    g_wall += step;
+    hostAdvance(step * 1000);
+    uint32_t last = Commands.lastId();
+    Schedule.loop();
+    if (Commands.lastId() != last) {
+      uint16_t now = 0;
+      clockMinuteOfWeek(now);
+      fired.push_back(Fired{now, Commands.find(Commands.lastId())});
+    }
+  }
+  return fired;
+}
+
+static ScheduleEntry onAt(int16_t tempTenths) {
+  ScheduleEntry e = {};
+  e.action = SCHED_ON;
+  e.mode = 4;
+  e.tempTenths = tempTenths;
+  return e;
+}
+
+static ScheduleEntry off() {
+  ScheduleEntry e = {};
+  e.action = SCHED_OFF;
+  return e;
+}
+
+TEST(add_keeps_the_table_sorted) {
+  start(MONDAY);
+  CHECK_EQ(Schedule.add(0x7f, 6 * 60 + 30, onAt(200)), 7);
+  CHECK_EQ(Schedule.add(0x1f, 23 * 60, off()), 5);
+  CHECK_EQ(Schedule.add(1 << 2, 7 * 60, onAt(220)), 1);
+  CHECK_EQ(Schedule.count(), 13);
+  for (int i = 1; i < Schedule.count(); i++)
+    CHECK(Schedule.entry(i - 1).minuteOfWeek <= Schedule.entry(i).minuteOfWeek);
+
+  CHECK_EQ(Schedule.add(0, 60, off()), 0);        // No day
+  CHECK_EQ(Schedule.add(1, 24 * 60, off()), 0);   // Past midnight
+  while (Schedule.add(0x7f, 12 * 60, off()) == 7) // Until it's full
+    ;
+  CHECK(Schedule.count() <= SCHED_MAX_ENTRIES);
+  CHECK(Schedule.count() > SCHED_MAX_ENTRIES - 7);
+}
+
+TEST(every_event_fires_once_a_week) {
+  start(MONDAY);
+  Schedule.add(0x7f, 6 * 60 + 30, onAt(200));
+  Schedule.add(0x1f, 23 * 60, off());
+  std::vector<Fired> fired = run(7 * DAY, 20);
+
+  CHECK_EQ(fired.size(), 12);
+  int ons = 0;
+  for (const Fired &f : fired) {
+    int minuteOfDay = f.minuteOfWeek % (24 * 60);
+    if (f.cmd->power) {
+      ons++;
+      CHECK_EQ(minuteOfDay, 6 * 60 + 30);
+      CHECK_EQ(f.cmd->mode, 4);
+      CHECK_NEAR(f.cmd->temp, 20.0, 0.01);
+    } else {
+      CHECK_EQ(minuteOfDay, 23 * 60);
+      CHECK(f.minuteOfWeek / (24 * 60) < 5); // Weekdays
+    }
+  }
+  CHECK_EQ(ons, 7);
+}
+
+TEST(short_clock_jump_catches_up) {
+  start(MONDAY + 7 * HOUR + 58 * MIN);
+  Schedule.add(1, 8 * 60, onAt(210));
+  Schedule.add(1, 8 * 60 + 2, onAt(215));
+  run(2);
+  g_wall += 7 * MIN; // 07:58 -> 08:05, both events missed
+  uint32_t submitted = Commands.getStats().submitted;
+  std::vector<Fired> fired = run(2);
+  CHECK_EQ(Commands.getStats().submitted - submitted, 2); // In one loop
+  CHECK_EQ(fired.size(), 1);
+  CHECK_NEAR(fired[0].cmd->temp, 21.5, 0.01);
+}
+
+TEST(long_clock_jump_skips_missed_events) {
+  start(MONDAY + 9 * HOUR + 58 * MIN);
+  Schedule.add(1, 10 * 60, onAt(210));
+  Schedule.add(1, 11 * 60, onAt(230));
+  run(2);
+  g_wall += 30 * MIN; // Past 10:00 by more than SCHED_MAX_CATCHUP_MIN
+  CHECK_EQ(run(2).size(), 0);
+  std::vector<Fired> fired = run(HOUR, 10);
+  CHECK_EQ(fired.size(), 1);
+  CHECK_EQ(fired[0].minuteOfWeek, 11 * 60);
+  CHECK_NEAR(fired[0].cmd->temp, 23.0, 0.01);
+}
+
+TEST(week_wraps_from_sunday_to_monday) {
+  start(MONDAY + 6 * DAY + 23 * HOUR + 58 * MIN); // Sunday 23:58
+  Schedule.add(1 << 6, 23 * 60 + 59, off());
+  Schedule.add(1, 0, onAt(190));
+  Schedule.add(1, 1, onAt(200));
+  std::vector<Fired> fired = run(4 * MIN);
+  CHECK_EQ(fired.size(), 3);
+  if (fired.size() == 3) {
+    CHECK_EQ(fired[0].minuteOfWeek, 7 * 24 * 60 - 1);
+    CHECK(!fired[0].cmd->power);
+    CHECK_EQ(fired[1].minuteOfWeek, 0);
+    CHECK_EQ(fired[2].minuteOfWeek, 1);
+  }
+}
+
+TEST(millis_rollover_keeps_the_schedule_running) {
+  start(MONDAY + 12 * HOUR, 0xFFFFFFFFu - 2500);
+  Schedule.add(0x7f, 12 * 60 + 1, onAt(200));
+  Schedule.add(0x7f, 12 * 60 + 2, off());
+  std::vector<Fired> fired = run(3 * MIN);
+  CHECK(millis() < 3 * MIN * 1000); // Wrapped
+  CHECK_EQ(fired.size(), 2);
+}
+
+TEST(next_event_seeks_and_wraps) {
+  start(MONDAY + 2 * DAY + 12 * HOUR); // Wednesday 12:00
+  Schedule.add(0x7f, 6 * 60 + 30, onAt(200));
+  Schedule.add(0x7f, 23 * 60, off());
+  const ScheduleEntry *next = nullptr;
+  uint16_t minutes = 0;
+  CHECK(!Schedule.nextEvent(&next, &minutes)); // Not synced yet
+  run(1);
+  CHECK(Schedule.nextEvent(&next, &minutes));
+  CHECK_EQ(next->minuteOfWeek, 2 * 24 * 60 + 23 * 60);
+  CHECK_EQ(minutes, 11 * 60);
+
+  // After Sunday's last event the next one is Monday's first
+  g_wall = MONDAY + 6 * DAY + 23 * HOUR + 30 * MIN;
+  Schedule.add(1 << 3, 9 * 60, off()); // Re-seek
+  run(1);
+  CHECK(Schedule.nextEvent(&next, &minutes));
+  CHECK_EQ(next->minuteOfWeek, 6 * 60 + 30);
+  CHECK_EQ(minutes, 7 * 60);
+}
+
+TEST(ramp_moves_the_target_in_half_degrees) {
+  start(MONDAY + 6 * HOUR + 59 * MIN);
+  State.targetTemp = 20.0;
+  ScheduleEntry ramp = {};
+  ramp.action = SCHED_TEMP;
+  ramp.tempTenths = 240;
+  ramp.rampMinutes = 60;
+  Schedule.add(1, 7 * 60, ramp);
+  std::vector<Fired> fired = run(62 * MIN, 10);
+
+  CHECK_EQ(fired.size(), 8); // 20.5 .. 24.0
+  float last = 20.0;
+  for (const Fired &f : fired) {
+    CHECK_NEAR(f.cmd->temp - last, 0.5, 0.01);
+    last = f.cmd->temp;
+  }
+  CHECK_NEAR(last, 24.0, 0.01);
+  CHECK(!Schedule.isRamping());
+}
+
+TEST(table_survives_a_reboot) {
+  start(MONDAY);
+  Schedule.add(0x15, 7 * 60, onAt(215));
+  Scheduler rebooted;
+  rebooted.begin();
+  CHECK_EQ(rebooted.count(), 3);
+  CHECK_EQ(rebooted.entry(2).minuteOfWeek, 4 * 24 * 60 + 7 * 60);
+  CHECK_EQ(rebooted.entry(2).tempTenths, 215);
+}
@@ -0,0 +1,108 @@
+// Two masters on one S21 bus: the driver alone, next to an adapter that
+// polls every second, and listening only (passive) behind it
+#include "host.h"
+#include "s21_unit.h"
+#include "src/daikin/daikin_state.h"
+#include "src/daikin/s21_codec.h"
+#include "src/daikin/s21_commands.h"
+#include "src/daikin/s21_driver.h"
+#include "src/system/commands.h"
+#include "test.h"
+
+static S21Unit unit;
+static S21Traffic before; // Counters are kept across restarts
+
+static void boot(bool passive) {
+  hostUseVirtualClock(1000);
+  unit = S21Unit();
+  unit.attach();
+  State = DaikinState();
+  Commands = S21CommandQueue();
+  S21.setPassive(passive);
+  S21.restart();
+  S21.begin();
+  for (int i = 0; i < 5000 && !passive && !S21.isReady(); i++) {
+    S21.loop();
+    hostAdvance(1);
+  }
+  before = S21.getTraffic();
+}
+
+// Runs the driver for `ms`, a poll cycle every 5s. With `adapterEveryMs`
+// another master sends F1 then F5, offset from our own polls.
+static void run(uint32_t ms, uint32_t adapterEveryMs = 0) {
+  for (uint32_t t = 1; t <= ms; t++) {
+    if (t % 5000 == 0)
+      S21.requestPoll();
+    if (adapterEveryMs && t % adapterEveryMs == adapterEveryMs / 2) {
+      unit.foreignRequest("F1");
+      unit.foreignRequest("F5", millis() + 200);
+    }
+    S21.loop();
+    hostAdvance(1);
+  }
+}
+
+TEST(alone_on_the_bus) {
+  boot(false);
+  run(30000);
+  const S21Traffic &t = S21.getTraffic();
+  CHECK(t.frames - before.frames > 20);
+  // Our own echo is not another master
+  CHECK_EQ(t.foreignRequests - before.foreignRequests, 0);
+  CHECK_EQ(t.unsolicited - before.unsolicited, 0);
+  CHECK(!S21.contention());
+}
+
+TEST(contention_is_flagged_and_clears) {
+  boot(false);
+  S21.requestPoll();
+  run(20000, 1000);
+  CHECK(S21.contention());
+  CHECK(S21.getTraffic().foreignRequests - before.foreignRequests >= 30);
+  run(S21_CONTENTION_WINDOW_MS - 5000); // Adapter unplugged
+  CHECK(S21.contention());
+  run(10000);
+  CHECK(!S21.contention());
+}
+
+TEST(passive_follows_the_other_master) {
+  boot(true);
+  CHECK_EQ(Protocol.major(), 0);
+  unit.foreignRequest("F8"); // The adapter's handshake
+  run(1000);
+  CHECK_EQ(Protocol.major(), 3);
+  run(10000, 1000);
+  CHECK(S21.isConnected());
+  CHECK(State.power);
+  CHECK_EQ(State.swingV, false);
+
+  // The adapter turns on heat at 22C
+  uint8_t d1[6] = {'D', '1'};
+  S21_FAHRENHEIT_CODEC.encodeState(d1 + 2, true, 4, 22.0, 3);
+  unit.foreignRequest(std::string((const char *)d1, 6).c_str());
+  unit.foreignRequest("D51000", millis() + 200); // Swing V
+  run(5000, 1000);
+  CHECK_EQ(S21.getTraffic().commandsSeen - before.commandsSeen, 2);
+  CHECK_EQ(State.mode, 4);
+  CHECK_NEAR(State.targetTemp, 22.0, 0.5);
+  CHECK(State.swingV);
+
+  CHECK_EQ(unit.requests, 0); // Not a byte from us
+  CHECK_EQ(S21.getTraffic().foreignRequests - before.foreignRequests, 0);
+}
+
+TEST(passive_refuses_commands) {
+  boot(true);
+  char line[] = "set mode=heat";
+  hostSerialOutput().clear();
+  runCommandLine(line, Serial);
+  CHECK(hostSerialOutput().find("passive mode") != std::string::npos);
+  CHECK_EQ(Commands.getStats().submitted, 0);
+  run(5000);
+  CHECK_EQ(unit.requests, 0);
+  S21.setPassive(false); // Back to active: handshake again
+  run(5000);
+  CHECK(S21.isReady());
+  CHECK(unit.requests > 0);
+}
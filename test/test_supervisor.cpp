@@ -0,0 +1,209 @@
+// Link supervision against the emulated unit: faults are detected, the
+// handshake is retried with backoff and the outage figures add up
+#include "host.h"
+#include "s21_unit.h"
+#include "src/daikin/s21_commands.h"
+#include "src/daikin/s21_driver.h"
+#include "src/daikin/s21_queries.h"
+#include "src/daikin/s21_supervisor.h"
+#include "test.h"
+
+static S21Unit unit;
+
+static void step() {
+  S21.loop();
+  Supervisor.loop();
+  hostAdvance(1);
+}
+
+static void run(uint32_t ms) {
+  for (uint32_t i = 0; i < ms; i++)
+    step();
+}
+
+// ms until the link is in `state`, or maxMs if it never gets there
+static uint32_t runUntil(S21LinkState state, uint32_t maxMs) {
+  uint32_t start = millis();
+  while (Supervisor.state() != state && millis() - start < maxMs)
+    step();
+  return millis() - start;
+}
+
+// Fresh unit, driver and supervisor, link up
+static void boot() {
+  hostUseVirtualClock(1000);
+  unit = S21Unit();
+  unit.attach();
+  S21.restart();
+  Commands = S21CommandQueue();
+  S21.begin();
+  Supervisor = S21Supervisor();
+  Supervisor.begin();
+  CHECK(runUntil(S21_LINK_UP, 5000) < 5000);
+  run(3000); // The first poll
+}
+
+// Runs until millis() reaches `at`
+static void runTo(uint32_t at) {
+  while ((int32_t)(millis() - at) < 0)
+    step();
+}
+
+// The unit is switched off for a minute: the probe poll notices, handshakes
+// fail and back off, and the link is back soon after power returns
+TEST(unit_power_cycle) {
+  boot();
+  unit.silent = true;
+  unit.echo = false;
+  uint32_t off = millis();
+
+  uint32_t detect = runUntil(S21_LINK_HANDSHAKE, 60000);
+  CHECK(detect <= S21_PROBE_MS + S21_MAX_MISSED * 600);
+  CHECK_EQ(Supervisor.lastFault(), S21_FAULT_LINK_LOST);
+  uint32_t faultAt = millis();
+
+  runTo(off + 60000);
+  CHECK(Supervisor.state() != S21_LINK_UP);
+  unit.silent = false;
+  unit.echo = true;
+  // At worst the rest of the backoff, then a clean handshake
+  uint32_t wait = Supervisor.backoffMs();
+  uint32_t back = runUntil(S21_LINK_UP, 120000);
+  CHECK(back <= wait + 3000);
+
+  const S21BusMetrics &m = Supervisor.getMetrics();
+  CHECK_EQ(m.outages, 1);
+  CHECK_EQ(m.recoveries, 1);
+  CHECK_EQ(m.faults[S21_FAULT_LINK_LOST], 1);
+  CHECK(m.faults[S21_FAULT_HANDSHAKE] >= 1);
+  CHECK_EQ(m.handshakeFailures, m.faults[S21_FAULT_HANDSHAKE]);
+  CHECK_NEAR(m.lastOutageMs, millis() - faultAt, 2);
+  CHECK_EQ(Supervisor.mttr(), m.lastOutageMs);
+  CHECK_NEAR(m.downMs, m.lastOutageMs, 2);
+  CHECK_EQ(Supervisor.backoffMs(), S21_BACKOFF_MIN_MS);
+  CHECK_EQ(S21.missedStreak(), 0);
+}
+
+// Two short cable pulls during polls: the first retry is immediate, so
+// each is repaired within a handshake of the cable going back
+TEST(cable_pull) {
+  boot();
+  uint32_t outage[2];
+  for (int i = 0; i < 2; i++) {
+    uint32_t pullMs = 2000 + 2000 * i;
+    unit.silent = true;
+    unit.echo = false;
+    uint32_t pulled = millis();
+    S21.requestPoll();
+    CHECK(runUntil(S21_LINK_HANDSHAKE, pullMs) < pullMs);
+    uint32_t faultAt = millis();
+    runTo(pulled + pullMs);
+    unit.silent = false;
+    unit.echo = true;
+    uint32_t back = runUntil(S21_LINK_UP, 10000);
+    CHECK(back < 3000);
+    outage[i] = millis() - faultAt;
+    CHECK_NEAR(Supervisor.getMetrics().lastOutageMs, outage[i], 2);
+
+    // A poll right after recovery picks up what changed meanwhile
+    CHECK(S21.isPolling());
+    run(3000);
+    CHECK(S21.pollAge() < 3000);
+  }
+
+  const S21BusMetrics &m = Supervisor.getMetrics();
+  CHECK_EQ(m.outages, 2);
+  CHECK_EQ(m.recoveries, 2);
+  CHECK_EQ(m.handshakeFailures, 0);
+  CHECK_NEAR(m.longestOutageMs, outage[1], 2);
+  CHECK_NEAR(Supervisor.mttr(), (outage[0] + outage[1]) / 2, 2);
+  CHECK(Supervisor.availability() < 100);
+  CHECK(Supervisor.availability() > 50);
+}
+
+// A unit in an error state NAKs everything: not a dead link, but the
+// supervisor restarts it all the same and waits it out
+TEST(nak_storm) {
+  boot();
+  unit.nakAll = true;
+  for (int i = 0; i < 30 && Supervisor.state() == S21_LINK_UP; i++) {
+    S21.requestPoll(); // A client polling every second
+    runUntil(S21_LINK_HANDSHAKE, 1000);
+  }
+  CHECK_EQ(Supervisor.lastFault(), S21_FAULT_NAK);
+  CHECK_EQ(Supervisor.getMetrics().faults[S21_FAULT_LINK_LOST], 0);
+
+  // The handshake can't get through either
+  CHECK(runUntil(S21_LINK_BACKOFF, S21_HANDSHAKE_TIMEOUT_MS + 100) <=
+        S21_HANDSHAKE_TIMEOUT_MS + 1);
+  CHECK_EQ(Supervisor.lastFault(), S21_FAULT_HANDSHAKE);
+
+  unit.nakAll = false;
+  CHECK(runUntil(S21_LINK_UP, 20000) < 20000);
+  const S21BusMetrics &m = Supervisor.getMetrics();
+  CHECK_EQ(m.faults[S21_FAULT_NAK], 1);
+  CHECK_EQ(m.recoveries, 1);
+  CHECK(Supervisor.mttr() >= S21_HANDSHAKE_TIMEOUT_MS);
+  CHECK(Supervisor.mttr() <= S21_HANDSHAKE_TIMEOUT_MS + S21_BACKOFF_MIN_MS +
+                                 S21_HANDSHAKE_TIMEOUT_MS);
+}
+
+// The driver stops making progress halfway through a poll cycle (a wedged
+// transaction) while the supervisor keeps running
+TEST(stuck_cycle) {
+  boot();
+  S21.requestPoll();
+  uint32_t start = millis();
+  run(300);
+  CHECK(S21.isPolling());
+  while (Supervisor.state() == S21_LINK_UP && millis() - start < 30000) {
+    Supervisor.loop();
+    hostAdvance(1);
+  }
+  CHECK_EQ(Supervisor.lastFault(), S21_FAULT_STUCK);
+  CHECK_NEAR(millis() - start, S21_POLL_BUDGET_MS + 5000, 2);
+  CHECK(!S21.isPolling()); // Dropped by the restart
+
+  CHECK(runUntil(S21_LINK_UP, 5000) < 5000);
+  const S21BusMetrics &m = Supervisor.getMetrics();
+  CHECK_EQ(m.faults[S21_FAULT_STUCK], 1);
+  CHECK_EQ(m.recoveries, 1);
+  CHECK(Supervisor.mttr() < 3000);
+}
+
+// A unit that stays away: every failed handshake doubles the wait, up to
+// the cap, and all of it is counted as down time
+TEST(backoff_doubles_up_to_the_cap) {
+  boot();
+  unit.silent = true;
+  unit.echo = false;
+  S21.requestPoll();
+  CHECK(runUntil(S21_LINK_HANDSHAKE, 5000) < 5000);
+  uint32_t faultAt = millis();
+
+  uint32_t expected = S21_BACKOFF_MIN_MS;
+  for (int i = 0; i < 9; i++) {
+    CHECK(runUntil(S21_LINK_BACKOFF, S21_HANDSHAKE_TIMEOUT_MS + 100) <=
+          S21_HANDSHAKE_TIMEOUT_MS + 1);
+    CHECK_EQ(Supervisor.backoffMs(), expected);
+    uint32_t waited = runUntil(S21_LINK_HANDSHAKE, 120000);
+    CHECK_NEAR(waited, expected, 1);
+    expected = expected * 2 > S21_BACKOFF_MAX_MS ? S21_BACKOFF_MAX_MS
+                                                  : expected * 2;
+  }
+  CHECK_EQ(Supervisor.backoffMs(), S21_BACKOFF_MAX_MS);
+
+  const S21BusMetrics &m = Supervisor.getMetrics();
+  CHECK_EQ(m.handshakeFailures, 9);
+  CHECK_EQ(m.handshakes, 1 + 1 + 9); // Boot, the fault's retry, backoffs
+  CHECK_EQ(m.recoveries, 0);
+  CHECK_NEAR(m.downMs, millis() - faultAt, 2);
+  CHECK_EQ(Supervisor.mttr(), 0); // Nothing repaired yet
+
+  unit.silent = false;
+  unit.echo = true;
+  CHECK(runUntil(S21_LINK_UP, S21_HANDSHAKE_TIMEOUT_MS + 1000) <
+        S21_HANDSHAKE_TIMEOUT_MS + 1000);
+  CHECK_EQ(Supervisor.backoffMs(), S21_BACKOFF_MIN_MS);
+  CHECK_NEAR(Supervisor.mttr(), millis() - faultAt, 2);
+}
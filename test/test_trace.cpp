@@ -0,0 +1,92 @@
+// Trace points on the host (TRACE_ENABLED 1, nanoseconds for cycles): the
+// ring, the JSON export, and the sketch's loop traced end to end
+#include "host.h"
+#include "http_client.h"
+#include "s21_unit.h"
+#include "src/system/trace.h"
+#include "test.h"
+#include <chrono>
+
+void setup();
+void loop();
+
+static S21Unit unit;
+
+// Collects what traceWriteJson() prints
+class StringPrint : public Print {
+public:
+  size_t write(uint8_t c) override {
+    text += (char)c;
+    return 1;
+  }
+  size_t write(const uint8_t *data, size_t len) override {
+    text.append((const char *)data, len);
+    return len;
+  }
+  std::string text;
+};
+
+static size_t occurrences(const std::string &s, const char *what) {
+  size_t count = 0;
+  for (size_t at = s.find(what); at != std::string::npos;
+       at = s.find(what, at + 1))
+    count++;
+  return count;
+}
+
+TEST(scope_measures_its_duration) {
+  traceClear();
+  {
+    TRACE_SCOPE("busy");
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(2);
+    while (std::chrono::steady_clock::now() < end) {
+    }
+  }
+  CHECK_EQ(traceEventCount(), 1);
+  StringPrint out;
+  traceWriteJson(&out);
+  size_t at = out.text.find("\"name\":\"busy\"");
+  CHECK(at != std::string::npos);
+  double durUs = atof(out.text.c_str() + out.text.find("\"dur\":", at) + 6);
+  CHECK(durUs >= 2000 && durUs < 50000);
+}
+
+TEST(ring_keeps_the_newest_events) {
+  traceClear();
+  static const char *const NAMES[] = {"a", "b"};
+  for (int i = 0; i < TRACE_RING_SIZE + 10; i++)
+    traceRecord(NAMES[i >= 10], i, 1500); // 10 "a", then only "b"
+  CHECK_EQ(traceEventCount(), TRACE_RING_SIZE + 10);
+  CHECK_EQ(traceDropped(), 10);
+
+  StringPrint out;
+  size_t measured = traceWriteJson(nullptr);
+  CHECK_EQ(traceWriteJson(&out), measured);
+  CHECK_EQ(out.text.size(), measured);
+  CHECK(out.text.find("\"dropped\":10") != std::string::npos);
+  CHECK_EQ(occurrences(out.text, "\"name\":\"a\""), 0);
+  CHECK_EQ(occurrences(out.text, "\"name\":\"b\""), TRACE_RING_SIZE);
+  CHECK(out.text.find("\"ts\":10,\"dur\":1.500}") != std::string::npos);
+  CHECK(out.text.compare(out.text.size() - 2, 2, "]}") == 0);
+}
+
+TEST(sketch_loop_is_traced) {
+  hostUseVirtualClock(1000);
+  unit.attach();
+  setup();
+  for (int i = 0; i < 500; i++)
+    loop();
+  hostHttpGet("/status", API_PORT, loop);
+  traceClear();
+  for (int i = 0; i < 50; i++)
+    loop();
+  CHECK(traceEventCount() >= 50);
+
+  HostHttp r = hostHttpGet("/trace", API_PORT, loop);
+  CHECK_EQ(r.status, 200);
+  CHECK(r.head.find("Content-Length: " + std::to_string(r.body.size())) !=
+        std::string::npos);
+  CHECK(occurrences(r.body, "\"name\":\"loop\"") >= 50);
+  CHECK(occurrences(r.body, "\"name\":\"s21.poll\"") > 0);
+  CHECK(occurrences(r.body, "\"name\":\"http\"") > 0);
+}
@@ -0,0 +1,150 @@
+// Station link on the host WiFi shim and the virtual clock: background
+// connect, jittered backoff and its cap, outage and connect-time figures
+#include "host.h"
+#include "src/net/wifi_manager.h"
+#include "test.h"
+
+static int connects = 0;
+static int disconnects = 0;
+
+static void run(uint32_t ms) {
+  for (uint32_t i = 0; i < ms; i++) {
+    Wifi.loop();
+    hostAdvance(1);
+  }
+}
+
+// ms until the link is in `state`, or maxMs if it never gets there
+static uint32_t runUntil(WifiLinkState state, uint32_t maxMs) {
+  uint32_t start = millis();
+  while (Wifi.state() != state && millis() - start < maxMs)
+    run(1);
+  return millis() - start;
+}
+
+// Fresh manager, AP out of reach
+static void start(unsigned seed = 1) {
+  hostUseVirtualClock(1000);
+  srand(seed);
+  hostSetWifiStatus(WL_DISCONNECTED);
+  connects = disconnects = 0;
+  Wifi = WifiManager();
+  Wifi.onConnect([] { connects++; });
+  Wifi.onDisconnect([] { disconnects++; });
+  Wifi.begin("ssid", "pass");
+}
+
+// The AP answers after `ms`
+static void connectAfter(uint32_t ms) {
+  run(ms);
+  hostSetWifiStatus(WL_CONNECTED);
+  CHECK(runUntil(WIFI_LINK_UP, 100) < 100);
+}
+
+TEST(connects_in_the_background) {
+  start();
+  uint32_t begins = hostWifiBegins();
+  CHECK_EQ(Wifi.state(), WIFI_LINK_CONNECTING);
+  CHECK_EQ(Wifi.getMetrics().attempts, 1);
+  connectAfter(1200);
+  CHECK(Wifi.isConnected());
+  CHECK_EQ(hostWifiBegins(), begins); // Still the first attempt
+  const WifiMetrics &m = Wifi.getMetrics();
+  CHECK_EQ(m.connects, 1);
+  CHECK_NEAR(m.lastConnectMs, 1200, 1);
+  CHECK_EQ(m.downMs, 0); // Boot is not an outage
+  CHECK_EQ(connects, 1);
+  CHECK_EQ(disconnects, 0);
+}
+
+// Each failed attempt doubles the wait, +-25%, up to the cap
+TEST(backoff_grows_to_the_cap) {
+  start();
+  uint32_t base = WIFI_BACKOFF_MIN_MS;
+  for (int i = 0; i < 10; i++) {
+    CHECK_NEAR(runUntil(WIFI_LINK_BACKOFF, 60000), WIFI_CONNECT_TIMEOUT_MS + 1,
+               1);
+    uint32_t waited = runUntil(WIFI_LINK_CONNECTING, 120000);
+    CHECK(waited >= base * 75 / 100);
+    CHECK(waited <= base * 125 / 100 + 1);
+    base = base * 2 > WIFI_BACKOFF_MAX_MS ? WIFI_BACKOFF_MAX_MS : base * 2;
+  }
+  CHECK_EQ(base, WIFI_BACKOFF_MAX_MS);
+  CHECK_EQ(Wifi.getMetrics().attempts, 11);
+  CHECK_EQ(Wifi.getMetrics().connects, 0);
+}
+
+// Devices dropped by the same AP must not retry in lockstep
+TEST(backoff_is_jittered) {
+  uint32_t lo = UINT32_MAX, hi = 0;
+  for (unsigned seed = 1; seed <= 20; seed++) {
+    start(seed);
+    hostWifiDisconnected(201); // No AP found: fails right away
+    runUntil(WIFI_LINK_BACKOFF, 100);
+    uint32_t waited = runUntil(WIFI_LINK_CONNECTING, 10000);
+    lo = waited < lo ? waited : lo;
+    hi = waited > hi ? waited : hi;
+  }
+  CHECK(lo >= WIFI_BACKOFF_MIN_MS * 75 / 100);
+  CHECK(hi <= WIFI_BACKOFF_MIN_MS * 125 / 100 + 1);
+  CHECK(hi - lo >= WIFI_BACKOFF_MIN_MS / 4); // Spread over most of +-25%
+}
+
+// A failed attempt reports its reason and skips the connect timeout
+TEST(attempt_fails_on_the_event) {
+  start();
+  run(500);
+  hostWifiDisconnected(15); // Handshake timeout: wrong password
+  CHECK(runUntil(WIFI_LINK_BACKOFF, 100) <= 1);
+  CHECK_EQ(Wifi.getMetrics().disconnects, 0); // Never was up
+  CHECK_EQ(disconnects, 0);
+}
+
+TEST(outages_are_accounted) {
+  start();
+  connectAfter(500);
+  run(10000);
+
+  // AP reboots: 40 s away, one timed-out attempt and a backoff
+  uint32_t lostAt = millis();
+  hostWifiDisconnected(8);
+  run(1);
+  CHECK_EQ(disconnects, 1);
+  CHECK_EQ(Wifi.getMetrics().lastReason, 8);
+  CHECK_EQ(Wifi.state(), WIFI_LINK_CONNECTING); // First retry right away
+  run(40000 - (millis() - lostAt));
+  hostSetWifiStatus(WL_CONNECTED);
+  CHECK(runUntil(WIFI_LINK_UP, WIFI_BACKOFF_MAX_MS) < WIFI_BACKOFF_MAX_MS);
+  uint32_t first = millis() - lostAt;
+  CHECK(first >= 40000);
+
+  const WifiMetrics &m = Wifi.getMetrics();
+  CHECK_EQ(m.disconnects, 1);
+  CHECK_EQ(m.connects, 2);
+  CHECK_NEAR(m.lastOutageMs, first, 1);
+  CHECK_NEAR(m.longestOutageMs, first, 1);
+  CHECK_NEAR(m.downMs, first, 1);
+  CHECK(m.lastConnectMs < first); // The last attempt only
+  CHECK_EQ(connects, 2);
+
+  // A short drop: back on the immediate retry, the longest stays
+  run(60000);
+  lostAt = millis();
+  hostWifiDisconnected(200);
+  run(2000);
+  hostSetWifiStatus(WL_CONNECTED);
+  CHECK(runUntil(WIFI_LINK_UP, 100) < 100);
+  uint32_t second = millis() - lostAt;
+  CHECK_NEAR(m.lastOutageMs, second, 1);
+  CHECK_NEAR(m.longestOutageMs, first, 1);
+  CHECK_NEAR(m.downMs, first + second, 2);
+  CHECK_NEAR(m.lastConnectMs, second, 2);
+  CHECK_EQ(m.disconnects, 2);
+  CHECK_EQ(disconnects, 2);
+
+  // Up again: the backoff starts over from the minimum
+  hostWifiDisconnected(8);
+  CHECK(runUntil(WIFI_LINK_BACKOFF, 60000) < 60000);
+  CHECK(runUntil(WIFI_LINK_CONNECTING, 10000) <=
+        WIFI_BACKOFF_MIN_MS * 125 / 100 + 1);
+}
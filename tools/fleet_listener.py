@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+"""Track Daikin S21 controllers from their multicast state datagrams.
+
+  fleet_listener.py listen              table of units, refreshed every 2s
+  fleet_listener.py listen --stats      throughput/loss only (for load tests)
+  fleet_listener.py simulate --units 500 --rate 2
+                                        fake units, to measure the listener
+
+Datagram layout: see src/net/fleet.h.
+"""
+
+import argparse
+import socket
+import struct
+import sys
+import time
+
+GROUP = "239.255.21.21"
+PORT = 21021
+HEADER = struct.Struct("<2sBBH3sBBBhhhhHHI")
+MODES = {0: "auto?", 1: "auto", 2: "dry", 3: "cool", 4: "heat", 6: "fan"}
+STALE_S = 90  # Three missed heartbeats
+
+
+def decode(data):
+    if len(data) < HEADER.size + 1:
+        return None
+    (magic, version, kind, seq, uid, flags, mode, fan, target, room, outside,
+     coil, rpm, hz, energy) = HEADER.unpack_from(data)
+    if magic != b"DK" or version != 1:
+        return None
+    name_len = data[HEADER.size]
+    name = data[HEADER.size + 1:HEADER.size + 1 + name_len].decode(
+        "utf-8", "replace")
+    return {
+        "id": uid.hex(), "kind": kind, "seq": seq, "name": name,
+        "power": bool(flags & 1), "swing_v": bool(flags & 2),
+        "swing_h": bool(flags & 4), "bus_up": bool(flags & 32),
+        "mode": mode, "fan": fan, "target": target / 10, "room": room / 10,
+        "outside": outside / 10, "coil": coil / 10, "fan_rpm": rpm,
+        "compressor_hz": hz, "energy_kwh": energy / 10,
+    }
+
+
+def listen(args):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4 << 20)
+    sock.bind(("", args.port))
+    mreq = struct.pack("4s4s", socket.inet_aton(args.group),
+                       socket.inet_aton(args.interface))
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, mreq)
+    sock.settimeout(0.5)
+
+    units = {}
+    received = lost = bad = 0
+    window_start = time.monotonic()
+    window_count = 0
+    while True:
+        try:
+            data, addr = sock.recvfrom(256)
+            state = decode(data)
+            if state is None:
+                bad += 1
+            else:
+                received += 1
+                window_count += 1
+                prev = units.get(state["id"])
+                if prev is not None:
+                    gap = (state["seq"] - prev["seq"] - 1) & 0xFFFF
+                    if gap < 1000:  # Larger: the unit rebooted
+                        lost += gap
+                state["ip"] = addr[0]
+                state["seen"] = time.monotonic()
+                units[state["id"]] = state
+        except socket.timeout:
+            pass
+
+        now = time.monotonic()
+        if now - window_start < 2:
+            continue
+        rate = window_count / (now - window_start)
+        window_start, window_count = now, 0
+        live = sum(1 for u in units.values() if now - u["seen"] < STALE_S)
+        loss = 100.0 * lost / max(received + lost, 1)
+        if args.stats:
+            print(f"units {live}/{len(units)}  {rate:7.1f} dgram/s  "
+                  f"received {received}  lost {lost} ({loss:.2f}%)  bad {bad}")
+            continue
+        print("\033[2J\033[H", end="")
+        print(f"{live} live / {len(units)} seen, {rate:.1f} dgram/s, "
+              f"loss {loss:.2f}%")
+        print(f"{'id':6} {'name':16} {'ip':15} {'pwr':3} {'mode':5} "
+              f"{'set':>5} {'room':>5} {'out':>5} {'Hz':>3} {'bus':3} age")
+        for u in sorted(units.values(), key=lambda u: u["name"]):
+            print(f"{u['id']:6} {u['name'][:16]:16} {u['ip']:15} "
+                  f"{'on' if u['power'] else 'off':3} "
+                  f"{MODES.get(u['mode'], '?'):5} {u['target']:5.1f} "
+                  f"{u['room']:5.1f} {u['outside']:5.1f} "
+                  f"{u['compressor_hz']:3} {'up' if u['bus_up'] else 'DOWN':3} "
+                  f"{now - u['seen']:.0f}s")
+
+
+def simulate(args):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL, 1)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_LOOP, 1)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_IF,
+                    socket.inet_aton(args.interface))
+    seqs = [0] * args.units
+    interval = 1.0 / args.rate
+    sent = 0
+    start = time.monotonic()
+    next_tick = start
+    print(f"{args.units} units x {args.rate}/s -> {args.group}:{args.port}")
+    while args.duration == 0 or time.monotonic() - start < args.duration:
+        for i in range(args.units):
+            name = f"unit-{i:04d}".encode()
+            data = HEADER.pack(b"DK", 1, 0, seqs[i], i.to_bytes(3, "big"),
+                               0x21, 3, 5, 240, 250 + i % 30, 120, 90, 900,
+                               35, 12345) + bytes([len(name)]) + name
+            sock.sendto(data, (args.group, args.port))
+            seqs[i] = (seqs[i] + 1) & 0xFFFF
+            sent += 1
+        next_tick += interval
+        delay = next_tick - time.monotonic()
+        if delay > 0:
+            time.sleep(delay)
+    elapsed = time.monotonic() - start
+    print(f"sent {sent} datagrams in {elapsed:.1f}s ({sent / elapsed:.0f}/s)")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--group", default=GROUP)
+    parser.add_argument("--port", type=int, default=PORT)
+    parser.add_argument("--interface", default="0.0.0.0",
+                        help="local address for the multicast group")
+    sub = parser.add_subparsers(dest="command", required=True)
+    p = sub.add_parser("listen")
+    p.add_argument("--stats", action="store_true")
+    p = sub.add_parser("simulate")
+    p.add_argument("--units", type=int, default=100)
+    p.add_argument("--rate", type=float, default=1.0,
+                   help="datagrams per unit per second")
+    p.add_argument("--duration", type=float, default=0, help="0 = forever")
+    args = parser.parse_args()
+    try:
+        (listen if args.command == "listen" else simulate)(args)
+    except KeyboardInterrupt:
+        sys.exit(0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,268 @@
+#!/usr/bin/env python3
+"""Load-test the controller's HTTP API and report latency percentiles.
+
+  http_load.py 192.168.1.50                        /status, 4 clients, 30s
+  http_load.py 192.168.1.50 --scenario mixed -c 16 -d 60
+  http_load.py 192.168.1.50 --mix status=80,page=20 --json > run.json
+
+Scenarios: status, page, mixed (status, page, set, set-swing) and writes.
+Writes are only sent with --allow-writes, and they send back the state
+read from /status first, so the unit doesn't change. Bus utilization and
+server counters come from /metrics before and after the run.
+
+The rate limiter answers 429 once a client goes over RATE_READ_PER_MIN
+/ RATE_WRITE_PER_MIN. 429s are reported separately. To measure the
+server itself, build with the limits set to 0.
+"""
+
+import argparse
+import http.client
+import json
+import random
+import sys
+import threading
+import time
+
+SCENARIOS = {
+    "status": {"status": 1},
+    "page": {"page": 1},
+    "mixed": {"status": 70, "page": 10, "set": 10, "set-swing": 10},
+    "writes": {"set": 1, "set-swing": 1},
+}
+WRITES = ("set", "set-swing")
+
+
+def parse_host(host):
+    name, _, port = host.partition(":")
+    return name, int(port) if port else 80
+
+
+def get_json(host, path, timeout):
+    conn = http.client.HTTPConnection(*parse_host(host), timeout=timeout)
+    try:
+        conn.request("GET", path, headers={"Accept": "application/json"})
+        resp = conn.getresponse()
+        body = resp.read()
+        return json.loads(body) if resp.status == 200 else None
+    except (OSError, http.client.HTTPException, ValueError):
+        return None
+    finally:
+        conn.close()
+
+
+def build_paths(state):
+    """Request path per endpoint. Writes repeat the current state."""
+    paths = {"status": "/status", "page": "/"}
+    if state:
+        paths["set"] = "/set?power=%d&mode=%d&temp=%s&fan=%d" % (
+            state["power"], state["mode"], state["target_temp"], state["fan"])
+        paths["set-swing"] = "/set-swing?v=%d&h=%d" % (state["swing_v"],
+                                                       state["swing_h"])
+    return paths
+
+
+def percentile(sorted_values, p):
+    """Nearest rank; p in 0..100."""
+    if not sorted_values:
+        return 0.0
+    rank = max(1, int(round(p / 100.0 * len(sorted_values) + 0.5)))
+    return sorted_values[min(rank, len(sorted_values)) - 1]
+
+
+class Worker(threading.Thread):
+    def __init__(self, args, paths, names, weights, deadline, budget, seed):
+        super().__init__(daemon=True)
+        self.args = args
+        self.paths = paths
+        self.names = names
+        self.weights = weights
+        self.deadline = deadline
+        self.budget = budget
+        self.rng = random.Random(seed)
+        self.samples = []  # (endpoint, status, seconds); status 0 = error
+        self.conn = None
+
+    def connect(self):
+        if self.conn:
+            self.conn.close()
+        self.conn = http.client.HTTPConnection(
+            *parse_host(self.args.host), timeout=self.args.timeout)
+
+    def one(self, name):
+        if self.conn is None or not self.args.keepalive:
+            self.connect()
+        start = time.perf_counter()
+        try:
+            self.conn.request("GET", self.paths[name])
+            resp = self.conn.getresponse()
+            resp.read()
+            status = resp.status
+            if resp.will_close:
+                self.conn.close()
+                self.conn = None
+        except (OSError, http.client.HTTPException):
+            status = 0
+            self.conn.close()
+            self.conn = None
+        self.samples.append((name, status, time.perf_counter() - start))
+
+    def run(self):
+        while time.monotonic() < self.deadline and self.budget.take():
+            self.one(self.rng.choices(self.names, self.weights)[0])
+            if self.args.think_ms:
+                time.sleep(self.args.think_ms / 1000.0)
+        if self.conn:
+            self.conn.close()
+
+
+class Budget:
+    """Shared request count limit (0 = none)."""
+
+    def __init__(self, total):
+        self.left = total
+        self.lock = threading.Lock()
+
+    def take(self):
+        if self.left is None:
+            return True
+        with self.lock:
+            if self.left <= 0:
+                return False
+            self.left -= 1
+            return True
+
+
+def delta(before, after, *keys):
+    try:
+        a, b = after, before
+        for k in keys:
+            a, b = a[k], b[k]
+        return a - b
+    except (KeyError, TypeError):
+        return None
+
+
+def summarize(samples, elapsed):
+    by_name = {}
+    for name, status, seconds in samples:
+        by_name.setdefault(name, []).append((status, seconds))
+    by_name["all"] = [(s, t) for _, s, t in samples]
+
+    rows = {}
+    for name, items in by_name.items():
+        ok = sorted(t * 1000 for s, t in items if 200 <= s < 400)
+        rows[name] = {
+            "count": len(items),
+            "ok": len(ok),
+            "limited": sum(1 for s, _ in items if s == 429),
+            "errors": sum(1 for s, _ in items if s == 0 or s >= 500),
+            "rps": len(items) / elapsed if elapsed else 0,
+            "p50_ms": percentile(ok, 50),
+            "p99_ms": percentile(ok, 99),
+            "p999_ms": percentile(ok, 99.9),
+            "max_ms": ok[-1] if ok else 0.0,
+        }
+    return rows
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host", help="address[:port] of the controller")
+    parser.add_argument("--scenario", choices=sorted(SCENARIOS),
+                        default="status")
+    parser.add_argument("--mix", help="endpoint weights, e.g. "
+                        "status=70,page=10,set=10,set-swing=10 "
+                        "(overrides --scenario)")
+    parser.add_argument("-c", "--concurrency", type=int, default=4)
+    parser.add_argument("-d", "--duration", type=float, default=30)
+    parser.add_argument("-n", "--requests", type=int, default=0,
+                        help="stop after this many requests (0 = no limit)")
+    parser.add_argument("--think-ms", type=float, default=0,
+                        help="pause per client between requests")
+    parser.add_argument("--timeout", type=float, default=10)
+    parser.add_argument("--no-keepalive", dest="keepalive",
+                        action="store_false",
+                        help="new connection for every request")
+    parser.add_argument("--allow-writes", action="store_true",
+                        help="send /set and /set-swing (same state back)")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--json", action="store_true",
+                        help="machine-readable result on stdout")
+    args = parser.parse_args()
+
+    mix = SCENARIOS[args.scenario]
+    if args.mix:
+        mix = {}
+        for part in args.mix.split(","):
+            name, _, weight = part.partition("=")
+            mix[name.strip()] = float(weight or 1)
+
+    state = get_json(args.host, "/status", args.timeout)
+    paths = build_paths(state)
+    for name in list(mix):
+        if name in WRITES and not args.allow_writes:
+            print("skipping %s (needs --allow-writes)" % name, file=sys.stderr)
+            del mix[name]
+        elif name not in paths:
+            sys.exit("unknown endpoint %r, or /status unreadable" % name)
+    if not mix:
+        sys.exit("nothing to send")
+
+    before = get_json(args.host, "/metrics", args.timeout)
+    budget = Budget(args.requests or None)
+    start = time.monotonic()
+    workers = [Worker(args, paths, list(mix), list(mix.values()),
+                      start + args.duration, budget, args.seed + i)
+               for i in range(args.concurrency)]
+    for w in workers:
+        w.start()
+    for w in workers:
+        w.join()
+    elapsed = time.monotonic() - start
+    after = get_json(args.host, "/metrics", args.timeout)
+
+    samples = [s for w in workers for s in w.samples]
+    result = {
+        "host": args.host,
+        "mix": mix,
+        "concurrency": args.concurrency,
+        "elapsed_s": elapsed,
+        "endpoints": summarize(samples, elapsed),
+    }
+    busy = delta(before, after, "bus", "busy_ms")
+    if busy is not None:
+        result["bus_utilization"] = 100.0 * busy / (elapsed * 1000)
+        result["bus_polls"] = delta(before, after, "admission", "bus_polls")
+        result["degraded_reads"] = delta(before, after, "admission",
+                                         "degraded_reads")
+        result["server"] = {k: delta(before, after, "http", k)
+                            for k in ("requests", "limited", "evicted",
+                                      "rejected")}
+
+    if args.json:
+        json.dump(result, sys.stdout, indent=2)
+        print()
+        return
+
+    print("%d clients, %.1fs, mix %s" % (
+        args.concurrency, elapsed,
+        " ".join("%s=%g" % kv for kv in mix.items())))
+    print("%-10s %7s %7s %7s %6s %8s %8s %8s %8s %8s" % (
+        "endpoint", "count", "ok", "429", "err", "req/s", "p50 ms",
+        "p99 ms", "p999 ms", "max ms"))
+    for name, r in result["endpoints"].items():
+        print("%-10s %7d %7d %7d %6d %8.1f %8.1f %8.1f %8.1f %8.1f" % (
+            name, r["count"], r["ok"], r["limited"], r["errors"], r["rps"],
+            r["p50_ms"], r["p99_ms"], r["p999_ms"], r["max_ms"]))
+    if "bus_utilization" in result:
+        print("bus: %.1f%% utilized, %s polls, %s reads served from cache" % (
+            result["bus_utilization"], result["bus_polls"],
+            result["degraded_reads"]))
+        print("server: " + " ".join("%s=%s" % kv
+                                    for kv in result["server"].items()))
+    else:
+        print("bus: /metrics unavailable")
+
+
+if __name__ == "__main__":
+    main()
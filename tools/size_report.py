@@ -0,0 +1,318 @@
+#!/usr/bin/env python3
+"""Report flash and static RAM per firmware module and check the budgets.
+
+  size_report.py build/esp32-daikin.ino.map       report from a linker map
+  size_report.py --build                          compile with arduino-cli
+  size_report.py --build -D OTA_URL_ENABLED=0 -D WEB_UI_ENABLED=0
+  size_report.py --build --json > size.json
+
+Modules are the sketch's own files (src/web/ota.cpp -> web/ota), Arduino
+libraries (lib/HTTPUpdate), the Arduino core and the SDK and toolchain
+archives (sdk/mbedtls). Flash counts code, constants and the initial
+values of .data. RAM counts .data, .bss and IRAM code, which the C3 loads
+into the same SRAM as the heap. What the linker adds between sections
+(alignment) is only in the totals.
+
+Budgets come from tools/size_budgets.txt. The exit status is 1 when the
+build goes over one, so the report can gate a CI job.
+"""
+
+import argparse
+import fnmatch
+import glob
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+TOOLS = os.path.dirname(os.path.abspath(__file__))
+SKETCH = os.path.dirname(TOOLS)
+DEFAULT_FQBN = "esp32:esp32:esp32c3"
+
+OUT_FULL = re.compile(r"^(\S+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)")
+OUT_NAME = re.compile(r"^(\S+)$")
+IN_FULL = re.compile(
+    r"^ (\S+)\s+0x[0-9a-fA-F]+\s+0x([0-9a-fA-F]+)\s+(\S.*)$")
+IN_NAME = re.compile(r"^ (\S+)$")
+IN_CONT = re.compile(r"^\s+0x[0-9a-fA-F]+\s+0x([0-9a-fA-F]+)\s+(\S.*)$")
+
+
+def classify(section):
+    """(counts in flash, counts in RAM) for an output section name."""
+    s = section.lower()
+    if any(k in s for k in ("debug", "comment", "dummy", "noload",
+                            "attributes", "discard", "stab")):
+        return False, False
+    if "bss" in s or "noinit" in s:
+        return False, True
+    if "iram" in s or "rtc" in s:
+        return True, True
+    if any(k in s for k in ("text", "rodata", "appdesc", "eh_frame",
+                            "except_table", "init_array", "fini_array",
+                            "ctors", "dtors")):
+        return True, False
+    if "data" in s:
+        return True, True
+    return False, False
+
+
+def module_of(path):
+    """Module name for an input file of the map."""
+    path = path.strip().replace("\\", "/")
+    member = None
+    m = re.match(r"^(.*)\(([^()]*)\)$", path)
+    if m:
+        path, member = m.group(1), m.group(2)
+    name = os.path.basename(path)
+
+    if member is not None:
+        if name == "core.a":
+            return "core"
+        m = re.match(r"^lib(.+)\.a$", name)
+        return "sdk/" + (m.group(1) if m else name)
+    m = re.search(r"/libraries/([^/]+)/", path)
+    if m:
+        return "lib/" + m.group(1)
+    if re.search(r"\.ino(\.cpp)?\.o(bj)?$", name):
+        return "sketch"
+    m = re.search(r"(?:^|/)src/(.+?)\.(?:c|cpp)(?:\.o|\.obj)?$", path)
+    if m:
+        return m.group(1)
+    if "/core/" in path or "/cores/" in path:
+        return "core"
+    return "other"
+
+
+def parse_map(lines):
+    """Totals and per-module sizes: ({"flash","ram"}, {module: {...}})."""
+    totals = {"flash": 0, "ram": 0}
+    modules = {}
+    started = False
+    flash = ram = False
+    pending_out = None
+    pending_in = None
+
+    def add(module, size):
+        entry = modules.setdefault(module, {"flash": 0, "ram": 0})
+        if flash:
+            entry["flash"] += size
+        if ram:
+            entry["ram"] += size
+
+    for line in lines:
+        line = line.rstrip("\n")
+        if not started:
+            started = line.startswith("Linker script and memory map")
+            continue
+        if not line.strip():
+            continue
+
+        if not line[0].isspace():
+            pending_in = None
+            m = OUT_FULL.match(line)
+            if m:
+                pending_out = None
+                flash, ram = classify(m.group(1))
+                size = int(m.group(3), 16)
+                totals["flash"] += size if flash else 0
+                totals["ram"] += size if ram else 0
+            else:
+                pending_out = line if OUT_NAME.match(line) else None
+                flash = ram = False
+            continue
+
+        if pending_out is not None:
+            m = re.match(r"^\s+0x[0-9a-fA-F]+\s+0x([0-9a-fA-F]+)", line)
+            name, pending_out = pending_out, None
+            if m:
+                flash, ram = classify(name)
+                size = int(m.group(1), 16)
+                totals["flash"] += size if flash else 0
+                totals["ram"] += size if ram else 0
+                continue
+
+        if not (flash or ram):
+            continue
+        m = IN_FULL.match(line)
+        if m:
+            pending_in = None
+            if not m.group(1).startswith("*"):
+                add(module_of(m.group(3)), int(m.group(2), 16))
+            continue
+        m = IN_NAME.match(line)
+        if m:
+            pending_in = None if m.group(1).startswith("*") else m.group(1)
+            continue
+        m = IN_CONT.match(line)
+        if m and pending_in is not None:
+            add(module_of(m.group(2)), int(m.group(1), 16))
+        pending_in = None
+
+    if not started:
+        raise ValueError("not a GNU ld map (no memory map section)")
+    return totals, modules
+
+
+def parse_size(text):
+    text = text.strip()
+    if text == "-":
+        return None
+    if text[-1:] in ("K", "k"):
+        return int(float(text[:-1]) * 1024)
+    return int(text)
+
+
+def load_budgets(path):
+    budgets = []
+    with open(path) as f:
+        for number, line in enumerate(f, 1):
+            line = line.split("#", 1)[0].strip()
+            if not line:
+                continue
+            fields = line.split()
+            if len(fields) != 3:
+                raise ValueError("%s:%d: expected 'pattern flash ram'" %
+                                 (path, number))
+            budgets.append((fields[0], parse_size(fields[1]),
+                            parse_size(fields[2])))
+    return budgets
+
+
+def check_budgets(budgets, totals, modules):
+    """One result per budget: pattern, matched modules and use vs limit."""
+    results = []
+    for pattern, flash_limit, ram_limit in budgets:
+        if pattern == "total":
+            used, matched = totals, ["total"]
+        else:
+            matched = sorted(m for m in modules
+                             if fnmatch.fnmatchcase(m, pattern))
+            used = {"flash": sum(modules[m]["flash"] for m in matched),
+                    "ram": sum(modules[m]["ram"] for m in matched)}
+        over = [kind for kind, limit in (("flash", flash_limit),
+                                         ("ram", ram_limit))
+                if limit is not None and used[kind] > limit]
+        results.append({"pattern": pattern, "modules": matched,
+                        "flash": used["flash"], "flash_limit": flash_limit,
+                        "ram": used["ram"], "ram_limit": ram_limit,
+                        "over": over})
+    return results
+
+
+def build(args):
+    """Compile the sketch with arduino-cli; returns the map file."""
+    flags = " ".join("-D" + d for d in args.define)
+    command = ["arduino-cli", "compile", "--fqbn", args.fqbn,
+               "--build-path", args.build_path,
+               "--build-property", "compiler.cpp.extra_flags=" + flags,
+               "--build-property", "compiler.c.extra_flags=" + flags,
+               SKETCH]
+    print("$ " + " ".join(command), file=sys.stderr)
+    try:
+        status = subprocess.call(command, stdout=sys.stderr)
+    except OSError as e:
+        sys.exit("size_report: can't run arduino-cli: %s" % e)
+    if status != 0:
+        sys.exit("size_report: build failed")
+    maps = glob.glob(os.path.join(args.build_path, "*.map"))
+    if not maps:
+        sys.exit("size_report: no .map in %s (the platform must link with "
+                 "-Wl,-Map)" % args.build_path)
+    return max(maps, key=os.path.getmtime)
+
+
+def ours(module):
+    return not (module in ("core", "other", "sketch") or
+                module.startswith(("lib/", "sdk/")))
+
+
+def print_report(totals, modules, results, show_all):
+    print("%-28s %9s %8s" % ("module", "flash", "ram"))
+    rows = sorted(modules.items(), key=lambda kv: -kv[1]["flash"])
+    hidden = {"flash": 0, "ram": 0, "count": 0}
+    shown = 0
+    for name, size in rows:
+        if show_all or ours(name) or name == "sketch" or shown < 15:
+            print("%-28s %9d %8d" % (name, size["flash"], size["ram"]))
+            if not ours(name) and name != "sketch":
+                shown += 1
+        else:
+            hidden["flash"] += size["flash"]
+            hidden["ram"] += size["ram"]
+            hidden["count"] += 1
+    if hidden["count"]:
+        print("%-28s %9d %8d" % ("(%d more, --all)" % hidden["count"],
+                                 hidden["flash"], hidden["ram"]))
+    print("%-28s %9d %8d" % (
+        "(alignment)",
+        totals["flash"] - sum(m["flash"] for m in modules.values()),
+        totals["ram"] - sum(m["ram"] for m in modules.values())))
+    print("%-28s %9d %8d" % ("total", totals["flash"], totals["ram"]))
+
+    if not results:
+        return
+    print()
+    print("%-28s %17s %17s" % ("budget", "flash", "ram"))
+    for r in results:
+        cells = []
+        for kind in ("flash", "ram"):
+            limit = r[kind + "_limit"]
+            cell = "%d" % r[kind] if limit is None else \
+                "%d/%d" % (r[kind], limit)
+            cells.append(cell + (" !" if kind in r["over"] else ""))
+        print("%-28s %17s %17s" % (r["pattern"], cells[0], cells[1]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("map", nargs="?", help="linker map file")
+    parser.add_argument("--build", action="store_true",
+                        help="compile the sketch with arduino-cli first")
+    parser.add_argument("--fqbn", default=DEFAULT_FQBN)
+    parser.add_argument("--build-path",
+                        default=os.path.join(tempfile.gettempdir(),
+                                             "esp32-daikin-size"))
+    parser.add_argument("-D", dest="define", action="append", default=[],
+                        metavar="NAME=VALUE",
+                        help="extra define for --build (module switches)")
+    parser.add_argument("--budgets",
+                        default=os.path.join(TOOLS, "size_budgets.txt"),
+                        help="budget file, '' to skip the check")
+    parser.add_argument("--all", action="store_true",
+                        help="list every library and SDK module")
+    parser.add_argument("--json", action="store_true",
+                        help="machine-readable output")
+    args = parser.parse_args()
+
+    if args.build:
+        args.map = build(args)
+    elif not args.map:
+        parser.error("give a map file or --build")
+
+    try:
+        with open(args.map, errors="replace") as f:
+            totals, modules = parse_map(f)
+    except (OSError, ValueError) as e:
+        sys.exit("size_report: %s: %s" % (args.map, e))
+    budgets = load_budgets(args.budgets) if args.budgets else []
+    results = check_budgets(budgets, totals, modules)
+
+    if args.json:
+        json.dump({"map": args.map, "defines": args.define,
+                   "totals": totals, "modules": modules,
+                   "budgets": results}, sys.stdout, indent=2, sort_keys=True)
+        print()
+    else:
+        print_report(totals, modules, results, args.all)
+
+    over = [r for r in results if r["over"]]
+    for r in over:
+        print("size_report: %s over its %s budget" % (
+            r["pattern"], " and ".join(r["over"])), file=sys.stderr)
+    sys.exit(1 if over else 0)
+
+
+if __name__ == "__main__":
+    main()